@@ -0,0 +1,283 @@
+#include "byte_ring.h"
+#include <string.h>
+
+// Helper function for spinlock, waiting as the ring's wait strategy says
+static void spinlock_acquire(atomic_uint* lock, uint32_t strategy) {
+    if (wait_lock_try(lock)) {
+        return;
+    }
+    
+    uint32_t sleeps;
+    wait_lock_acquire_slow(lock, (wait_strategy_t)strategy, &sleeps);
+}
+
+static void spinlock_release(atomic_uint* lock) {
+    wait_lock_release(lock);
+}
+
+// Bytes a record with `length` payload bytes occupies
+static inline uint32_t record_size(uint32_t length) {
+    return BYTE_RING_HEADER + ((length + BYTE_RING_ALIGN - 1) & ~(uint32_t)(BYTE_RING_ALIGN - 1));
+}
+
+// Length word of the record at a position
+static inline uint32_t* record_header(byte_ring_t* rb, uint32_t position) {
+    return (uint32_t*)&rb->data[position & (rb->capacity - 1)];
+}
+
+/**
+ * Get memory size required for a byte ring
+ *
+ * @param capacity Data bytes (power of 2, at least 64)
+ * @return Size in bytes needed for the ring structure
+ */
+size_t byte_ring_size(uint32_t capacity) {
+    return sizeof(byte_ring_t) + capacity;
+}
+
+/**
+ * Initialize a byte ring
+ *
+ * @param rb Pointer to memory of byte_ring_size(capacity) bytes
+ * @param capacity Data bytes (power of 2, at least 64)
+ * @return true on success, false if the capacity is invalid
+ */
+bool byte_ring_init(byte_ring_t* rb, uint32_t capacity) {
+    if (rb == NULL || capacity < 64 || (capacity & (capacity - 1)) != 0) {
+        return false;
+    }
+    
+    rb->capacity = capacity;
+    rb->reserved = 0;
+    rb->reserved_padding = 0;
+    rb->reading = 0;
+    atomic_store(&rb->tail, 0);
+    atomic_store(&rb->head, 0);
+    atomic_store(&rb->producer_lock, 0);
+    atomic_store(&rb->consumer_lock, 0);
+    rb->wait_strategy = wait_strategy_default();
+    return true;
+}
+
+/**
+ * Choose how threads wait for the ring's locks
+ *
+ * @param rb Pointer to byte ring
+ * @param strategy Wait strategy
+ */
+void byte_ring_set_wait_strategy(byte_ring_t* rb, wait_strategy_t strategy) {
+    if (rb != NULL) {
+        rb->wait_strategy = strategy;
+    }
+}
+
+/**
+ * Largest payload a record can have
+ *
+ * @param rb Pointer to byte ring
+ * @return Maximum payload length in bytes
+ */
+uint32_t byte_ring_max_record(const byte_ring_t* rb) {
+    return rb == NULL ? 0 : rb->capacity / 2 - BYTE_RING_HEADER;
+}
+
+/**
+ * Reserve space for a record and take the producer lock
+ *
+ * @param rb Pointer to byte ring
+ * @param length Payload length in bytes
+ * @return Payload to write, or NULL if the ring is full or length is too large
+ */
+void* byte_ring_reserve(byte_ring_t* rb, uint32_t length) {
+    if (rb == NULL || length > byte_ring_max_record(rb)) {
+        return NULL;
+    }
+    
+    uint32_t size = record_size(length);
+    spinlock_acquire(&rb->producer_lock, rb->wait_strategy);
+    
+    // The consumer must be done with the bytes before we overwrite them
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    uint32_t free_bytes = rb->capacity - (tail - head);
+    
+    // A record that would run past the end starts at 0 behind a padding record
+    uint32_t to_end = rb->capacity - (tail & (rb->capacity - 1));
+    uint32_t padding = size > to_end ? to_end : 0;
+    if (padding + size > free_bytes) {
+        spinlock_release(&rb->producer_lock);
+        return NULL;
+    }
+    
+    if (padding != 0) {
+        *record_header(rb, tail) = BYTE_RING_PADDING | padding;
+    }
+    *record_header(rb, tail + padding) = length;
+    rb->reserved = padding + size;
+    rb->reserved_padding = padding;
+    
+    return (uint8_t*)record_header(rb, tail + padding) + BYTE_RING_HEADER;
+}
+
+/**
+ * Publish the reserved record and release the producer lock
+ *
+ * @param rb Pointer to byte ring
+ * @param length Bytes actually written (at most the reserved length)
+ * @return true on success, false if length exceeds the reservation
+ */
+bool byte_ring_commit(byte_ring_t* rb, uint32_t length) {
+    if (rb == NULL || rb->reserved == 0) {
+        return false;
+    }
+    
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    uint32_t* header = record_header(rb, tail + rb->reserved_padding);
+    if (length > *header) {
+        return false;  // Still reserved; the caller may commit again or cancel
+    }
+    
+    // A shorter record gives the rest of the reservation back
+    *header = length;
+    uint32_t advance = rb->reserved_padding + record_size(length);
+    rb->reserved = 0;
+    
+    // Release: the consumer sees the payload before the new tail
+    atomic_store_explicit(&rb->tail, tail + advance, memory_order_release);
+    spinlock_release(&rb->producer_lock);
+    return true;
+}
+
+/**
+ * Drop the reserved record and release the producer lock
+ *
+ * @param rb Pointer to byte ring
+ */
+void byte_ring_cancel(byte_ring_t* rb) {
+    if (rb == NULL || rb->reserved == 0) {
+        return;
+    }
+    
+    // Nothing was published, the next reservation overwrites it
+    rb->reserved = 0;
+    spinlock_release(&rb->producer_lock);
+}
+
+/**
+ * Get the oldest record in place and take the consumer lock
+ *
+ * @param rb Pointer to byte ring
+ * @param length Receives the payload length
+ * @return Payload of the record, or NULL if the ring is empty
+ */
+const void* byte_ring_read(byte_ring_t* rb, uint32_t* length) {
+    if (rb == NULL || length == NULL) {
+        return NULL;
+    }
+    
+    spinlock_acquire(&rb->consumer_lock, rb->wait_strategy);
+    
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+    if (head == tail) {
+        spinlock_release(&rb->consumer_lock);
+        return NULL;
+    }
+    
+    // Skip the padding at the end of the buffer (published with the record after it)
+    uint32_t* header = record_header(rb, head);
+    uint32_t padding = 0;
+    if ((*header & BYTE_RING_PADDING) != 0) {
+        padding = *header & ~BYTE_RING_PADDING;
+        header = record_header(rb, head + padding);
+    }
+    
+    *length = *header;
+    rb->reading = padding + record_size(*length);
+    return (uint8_t*)header + BYTE_RING_HEADER;
+}
+
+/**
+ * Free the record returned by byte_ring_read and release the consumer lock
+ *
+ * @param rb Pointer to byte ring
+ */
+void byte_ring_release(byte_ring_t* rb) {
+    if (rb == NULL || rb->reading == 0) {
+        return;
+    }
+    
+    // Release: producers may overwrite the bytes only after we are done reading
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+    atomic_store_explicit(&rb->head, head + rb->reading, memory_order_release);
+    rb->reading = 0;
+    spinlock_release(&rb->consumer_lock);
+}
+
+/**
+ * Copy a record into the ring
+ *
+ * @param rb Pointer to byte ring
+ * @param data Payload
+ * @param length Payload length in bytes
+ * @return true if stored, false if the ring is full or length is too large
+ */
+bool byte_ring_put(byte_ring_t* rb, const void* data, uint32_t length) {
+    void* payload = byte_ring_reserve(rb, length);
+    if (payload == NULL) {
+        return false;
+    }
+    
+    memcpy(payload, data, length);
+    return byte_ring_commit(rb, length);
+}
+
+/**
+ * Copy the oldest record out of the ring
+ *
+ * @param rb Pointer to byte ring
+ * @param buffer Destination
+ * @param size Size of the destination in bytes
+ * @param length Receives the payload length (also when it does not fit)
+ * @return true if a record was copied, false if empty or the record is larger than size
+ */
+bool byte_ring_get(byte_ring_t* rb, void* buffer, uint32_t size, uint32_t* length) {
+    const void* payload = byte_ring_read(rb, length);
+    if (payload == NULL) {
+        return false;
+    }
+    
+    if (*length > size) {
+        // Leave it queued so a caller with a larger buffer can take it
+        rb->reading = 0;
+        spinlock_release(&rb->consumer_lock);
+        return false;
+    }
+    
+    memcpy(buffer, payload, *length);
+    byte_ring_release(rb);
+    return true;
+}
+
+/**
+ * Get the number of bytes in use, headers and padding included
+ *
+ * @param rb Pointer to byte ring
+ * @return Bytes in use
+ */
+uint32_t byte_ring_used(const byte_ring_t* rb) {
+    if (rb == NULL) {
+        return 0;
+    }
+    return atomic_load(&((byte_ring_t*)rb)->tail) - atomic_load(&((byte_ring_t*)rb)->head);
+}
+
+/**
+ * Check if the byte ring is empty
+ *
+ * @param rb Pointer to byte ring
+ * @return true if empty, false otherwise
+ */
+bool byte_ring_is_empty(const byte_ring_t* rb) {
+    return byte_ring_used(rb) == 0;
+}
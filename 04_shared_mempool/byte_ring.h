@@ -0,0 +1,151 @@
+#ifndef BYTE_RING_H
+#define BYTE_RING_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "wait_strategy.h"
+
+#define BYTE_RING_HEADER 8                  // Bytes in front of every record
+#define BYTE_RING_ALIGN 8                   // Records start on this boundary
+#define BYTE_RING_PADDING 0x80000000u       // Length flag of the record that fills the end of the buffer
+
+/**
+ * Byte ring for variable-length records (Multi-Producer Multi-Consumer)
+ * Records are stored inline as a length header followed by the payload,
+ * so small messages need no pool block and consumers read them in place.
+ * A record never wraps: when it does not fit before the end of the
+ * buffer, a padding record fills the rest and the record starts at 0.
+ * Positions are offsets, so the ring works in shared memory mapped at
+ * different addresses.
+ */
+typedef struct {
+    uint32_t capacity;                      // Data bytes (power of 2)
+    uint32_t wait_strategy;                 // wait_strategy_t for both locks
+    _Alignas(64) atomic_uint tail;          // Write position (bytes, wraps at 2^32)
+    atomic_uint producer_lock;              // Held from reserve to commit
+    uint32_t reserved;                      // Bytes of the pending record including padding
+    uint32_t reserved_padding;              // Padding bytes in front of the pending record
+    _Alignas(64) atomic_uint head;          // Read position (bytes, wraps at 2^32)
+    atomic_uint consumer_lock;              // Held from read to release
+    uint32_t reading;                       // Bytes of the record being read
+    _Alignas(64) uint8_t data[];            // Records
+} byte_ring_t;
+
+/**
+ * Get memory size required for a byte ring
+ *
+ * @param capacity Data bytes (power of 2, at least 64)
+ * @return Size in bytes needed for the ring structure
+ */
+size_t byte_ring_size(uint32_t capacity);
+
+/**
+ * Initialize a byte ring
+ *
+ * @param rb Pointer to memory of byte_ring_size(capacity) bytes
+ * @param capacity Data bytes (power of 2, at least 64)
+ * @return true on success, false if the capacity is invalid
+ */
+bool byte_ring_init(byte_ring_t* rb, uint32_t capacity);
+
+/**
+ * Choose how threads wait for the ring's locks (byte_ring_init takes the
+ * MEMPOOL_WAIT_STRATEGY default); only while no thread uses the ring
+ *
+ * @param rb Pointer to byte ring
+ * @param strategy Wait strategy
+ */
+void byte_ring_set_wait_strategy(byte_ring_t* rb, wait_strategy_t strategy);
+
+/**
+ * Largest payload a record can have (half the capacity minus the header,
+ * so a record always fits once the ring has drained)
+ *
+ * @param rb Pointer to byte ring
+ * @return Maximum payload length in bytes
+ */
+uint32_t byte_ring_max_record(const byte_ring_t* rb);
+
+/**
+ * Reserve space for a record and take the producer lock
+ * On success the caller writes the payload and must call byte_ring_commit
+ * or byte_ring_cancel; other producers wait until then
+ *
+ * @param rb Pointer to byte ring
+ * @param length Payload length in bytes
+ * @return Payload to write, or NULL if the ring is full or length is too large
+ */
+void* byte_ring_reserve(byte_ring_t* rb, uint32_t length);
+
+/**
+ * Publish the reserved record and release the producer lock
+ *
+ * @param rb Pointer to byte ring
+ * @param length Bytes actually written (at most the reserved length)
+ * @return true on success, false if length exceeds the reservation
+ */
+bool byte_ring_commit(byte_ring_t* rb, uint32_t length);
+
+/**
+ * Drop the reserved record and release the producer lock
+ *
+ * @param rb Pointer to byte ring
+ */
+void byte_ring_cancel(byte_ring_t* rb);
+
+/**
+ * Get the oldest record in place and take the consumer lock
+ * On success the caller must call byte_ring_release when done with it
+ *
+ * @param rb Pointer to byte ring
+ * @param length Receives the payload length
+ * @return Payload of the record, or NULL if the ring is empty
+ */
+const void* byte_ring_read(byte_ring_t* rb, uint32_t* length);
+
+/**
+ * Free the record returned by byte_ring_read and release the consumer lock
+ *
+ * @param rb Pointer to byte ring
+ */
+void byte_ring_release(byte_ring_t* rb);
+
+/**
+ * Copy a record into the ring (reserve, copy, commit)
+ *
+ * @param rb Pointer to byte ring
+ * @param data Payload
+ * @param length Payload length in bytes
+ * @return true if stored, false if the ring is full or length is too large
+ */
+bool byte_ring_put(byte_ring_t* rb, const void* data, uint32_t length);
+
+/**
+ * Copy the oldest record out of the ring (read, copy, release)
+ *
+ * @param rb Pointer to byte ring
+ * @param buffer Destination
+ * @param size Size of the destination in bytes
+ * @param length Receives the payload length (also when it does not fit)
+ * @return true if a record was copied, false if empty or the record is larger than size (it stays queued)
+ */
+bool byte_ring_get(byte_ring_t* rb, void* buffer, uint32_t size, uint32_t* length);
+
+/**
+ * Get the number of bytes in use, headers and padding included
+ *
+ * @param rb Pointer to byte ring
+ * @return Bytes in use
+ */
+uint32_t byte_ring_used(const byte_ring_t* rb);
+
+/**
+ * Check if the byte ring is empty
+ *
+ * @param rb Pointer to byte ring
+ * @return true if empty, false otherwise
+ */
+bool byte_ring_is_empty(const byte_ring_t* rb);
+
+#endif
@@ -0,0 +1,416 @@
+#define _GNU_SOURCE           // For sched_getcpu
+#include "cpu_shards.h"
+#include <sched.h>            // For sched_getcpu, sched_setaffinity
+#include <sys/sysinfo.h>      // For get_nprocs_conf
+
+// rseq critical sections are written for x86-64; other architectures use the locked mode
+#if defined(__x86_64__) && defined(__has_include)
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>         // For struct rseq, __rseq_offset, RSEQ_SIG (glibc 2.35+)
+#ifdef RSEQ_SIG
+#define HAVE_RSEQ 1
+#endif
+#endif
+#endif
+
+// Shard of a CPU
+static inline cpu_shard_t* shard_at(const cpu_shards_t* cs, uint32_t cpu) {
+    return (cpu_shard_t*)((uint8_t*)cs->shards + (size_t)cpu * cs->shard_stride);
+}
+
+#ifdef HAVE_RSEQ
+#define RSEQ_STR_(x) #x
+#define RSEQ_STR(x) RSEQ_STR_(x)
+
+// Descriptor of the critical section from label 1 to label 2, restarted at label 4
+#define RSEQ_CS_DESCRIPTOR                                  \
+    ".pushsection __rseq_cs, \"aw\"\n\t"                    \
+    ".balign 32\n\t"                                        \
+    "3:\n\t"                                                \
+    ".long 0, 0\n\t"                                        \
+    ".quad 1f, 2f - 1f, 4f\n\t"                             \
+    ".popsection\n\t"
+
+// Abort handler: the kernel only jumps to it if the signature precedes it
+// (as the operand of a ud1, so the bytes are never executed)
+#define RSEQ_ABORT_HANDLER(label)                           \
+    ".pushsection __rseq_failure, \"ax\"\n\t"               \
+    ".byte 0x0f, 0xb9, 0x3d\n\t"                            \
+    ".long " RSEQ_STR(RSEQ_SIG) "\n\t"                      \
+    "4:\n\t"                                                \
+    "jmp %l[" #label "]\n\t"                                \
+    ".popsection\n\t"
+
+// This thread's rseq area, registered by the C library
+static inline struct rseq* rseq_area(void) {
+    return (struct rseq*)((uint8_t*)__builtin_thread_pointer() + __rseq_offset);
+}
+
+/*
+ * Pop and push are each one restartable sequence: check that we are still
+ * on `cpu`, then load and store the shard as usual. The single store of
+ * count commits; if the thread is preempted, migrated or gets a signal
+ * before it, the kernel resumes at the abort handler and nothing happened.
+ * Return 0 on success, 1 if the shard is empty or full, -1 to retry.
+ */
+static inline int rseq_pop(struct rseq* rs, cpu_shard_t* shard, uint32_t cpu, uint32_t* token) {
+    __asm__ __volatile__ goto(
+        RSEQ_CS_DESCRIPTOR
+        "leaq 3b(%%rip), %%rax\n\t"
+        "movq %%rax, %[rseq_cs]\n\t"
+        "1:\n\t"
+        "cmpl %[cpu], %[cpu_id]\n\t"
+        "jnz %l[abort]\n\t"
+        "movl %[count], %%ecx\n\t"
+        "testl %%ecx, %%ecx\n\t"
+        "jz %l[unavailable]\n\t"
+        "subl $1, %%ecx\n\t"
+        "movl (%[tokens], %%rcx, 4), %%edx\n\t"
+        "movl %%edx, (%[token])\n\t"
+        "movl %%ecx, %[count]\n\t"
+        "2:\n\t"
+        RSEQ_ABORT_HANDLER(abort)
+        :
+        : [rseq_cs] "m" (rs->rseq_cs), [cpu_id] "m" (rs->cpu_id), [cpu] "r" (cpu),
+          [count] "m" (shard->count), [tokens] "r" (shard->tokens), [token] "r" (token)
+        : "memory", "cc", "rax", "rcx", "rdx"
+        : abort, unavailable);
+    return 0;
+abort:
+    return -1;
+unavailable:
+    return 1;
+}
+
+static inline int rseq_push(struct rseq* rs, cpu_shard_t* shard, uint32_t cpu, uint32_t capacity,
+                            uint32_t token) {
+    __asm__ __volatile__ goto(
+        RSEQ_CS_DESCRIPTOR
+        "leaq 3b(%%rip), %%rax\n\t"
+        "movq %%rax, %[rseq_cs]\n\t"
+        "1:\n\t"
+        "cmpl %[cpu], %[cpu_id]\n\t"
+        "jnz %l[abort]\n\t"
+        "movl %[count], %%ecx\n\t"
+        "cmpl %[capacity], %%ecx\n\t"
+        "jae %l[unavailable]\n\t"
+        "movl %[token], (%[tokens], %%rcx, 4)\n\t"
+        "addl $1, %%ecx\n\t"
+        "movl %%ecx, %[count]\n\t"
+        "2:\n\t"
+        RSEQ_ABORT_HANDLER(abort)
+        :
+        : [rseq_cs] "m" (rs->rseq_cs), [cpu_id] "m" (rs->cpu_id), [cpu] "r" (cpu),
+          [count] "m" (shard->count), [tokens] "r" (shard->tokens), [capacity] "r" (capacity),
+          [token] "r" (token)
+        : "memory", "cc", "rax", "rcx"
+        : abort, unavailable);
+    return 0;
+abort:
+    return -1;
+unavailable:
+    return 1;
+}
+#endif
+
+/**
+ * Get the number of CPUs the system may have, one shard each
+ *
+ * @return Number of configured CPUs
+ */
+uint32_t cpu_shards_default_count(void) {
+    int cpus = get_nprocs_conf();
+    return cpus > 0 ? (uint32_t)cpus : 1;
+}
+
+/**
+ * Check whether this process can use restartable sequences
+ *
+ * @return true if the C library registered rseq and this architecture is supported
+ */
+bool cpu_shards_rseq_available(void) {
+#ifdef HAVE_RSEQ
+    // Registration is per thread, but the C library does it for all threads or
+    // for none, so the first answer holds for the whole process
+    static int available = -1;
+    if (available < 0) {
+        available = __rseq_size >= offsetof(struct rseq, cpu_id) + sizeof(uint32_t) &&
+                    (int32_t)rseq_area()->cpu_id >= 0;
+    }
+    return available;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Get memory size required for per-CPU shards
+ *
+ * @param num_shards Number of shards (one per CPU)
+ * @param capacity Tokens per shard (at most CPU_SHARDS_MAX_CAPACITY)
+ * @return Size in bytes, a multiple of 64
+ */
+size_t cpu_shards_size(uint32_t num_shards, uint32_t capacity) {
+    size_t stride = (sizeof(cpu_shard_t) + (size_t)capacity * sizeof(uint32_t) + 63) & ~(size_t)63;
+    return sizeof(cpu_shards_t) + (size_t)num_shards * stride;
+}
+
+/**
+ * Initialize empty shards, using rseq when this process can
+ *
+ * @param cs Pointer to memory of cpu_shards_size(num_shards, capacity) bytes, 64-byte aligned
+ * @param num_shards Number of shards (one per CPU)
+ * @param capacity Tokens per shard (at most CPU_SHARDS_MAX_CAPACITY)
+ * @return true on success, false if a parameter is invalid
+ */
+bool cpu_shards_init(cpu_shards_t* cs, uint32_t num_shards, uint32_t capacity) {
+    if (cs == NULL || num_shards == 0 || capacity == 0 || capacity > CPU_SHARDS_MAX_CAPACITY) {
+        return false;
+    }
+    
+    cs->num_shards = num_shards;
+    cs->capacity = capacity;
+    cs->shard_stride = (uint32_t)((cpu_shards_size(num_shards, capacity) - sizeof(cpu_shards_t)) / num_shards);
+    cs->mode = cpu_shards_rseq_available() ? CPU_SHARDS_RSEQ : CPU_SHARDS_LOCKED;
+    cs->wait_strategy = wait_strategy_default();
+    cpu_shards_reset(cs);
+    
+    // Magic last: attaching processes accept the shards from here on
+    atomic_thread_fence(memory_order_release);
+    cs->magic = CPU_SHARDS_MAGIC;
+    return true;
+}
+
+/**
+ * Check shards set up by another process
+ *
+ * @param cs Pointer to shards
+ * @param num_shards Expected number of shards
+ * @param capacity Expected tokens per shard
+ * @return true if the shards are initialized with these parameters
+ */
+bool cpu_shards_check(const cpu_shards_t* cs, uint32_t num_shards, uint32_t capacity) {
+    return cs != NULL && cs->magic == CPU_SHARDS_MAGIC &&
+           cs->num_shards == num_shards && cs->capacity == capacity;
+}
+
+/**
+ * Choose how threads wait for a shard lock in CPU_SHARDS_LOCKED mode
+ *
+ * @param cs Pointer to shards
+ * @param strategy Wait strategy
+ */
+void cpu_shards_set_wait_strategy(cpu_shards_t* cs, wait_strategy_t strategy) {
+    if (cs != NULL) {
+        cs->wait_strategy = strategy;
+    }
+}
+
+// Lock the current CPU's shard (CPU_SHARDS_LOCKED); only threads that ran
+// on this CPU recently compete for it, so the lock is nearly always free
+static cpu_shard_t* lock_current_shard(cpu_shards_t* cs) {
+    int cpu = sched_getcpu();
+    if (cpu < 0 || (uint32_t)cpu >= cs->num_shards) {
+        return NULL;
+    }
+    
+    cpu_shard_t* shard = shard_at(cs, (uint32_t)cpu);
+    if (!wait_lock_try(&shard->lock)) {
+        uint32_t sleeps;
+        wait_lock_acquire_slow(&shard->lock, (wait_strategy_t)cs->wait_strategy, &sleeps);
+    }
+    return shard;
+}
+
+/**
+ * Take the newest token from the current CPU's shard
+ *
+ * @param cs Pointer to shards
+ * @param token Receives the token
+ * @return CPU_SHARD_OK, CPU_SHARD_EMPTY or CPU_SHARD_NONE
+ */
+cpu_shard_result_t cpu_shards_pop(cpu_shards_t* cs, uint32_t* token) {
+    if (cs->mode == CPU_SHARDS_RSEQ) {
+#ifdef HAVE_RSEQ
+        if (!cpu_shards_rseq_available()) {
+            return CPU_SHARD_NONE;
+        }
+        struct rseq* rs = rseq_area();
+        for (;;) {
+            uint32_t cpu = *(volatile uint32_t*)&rs->cpu_id_start;
+            if (cpu >= cs->num_shards) {
+                return CPU_SHARD_NONE;
+            }
+            int result = rseq_pop(rs, shard_at(cs, cpu), cpu, token);
+            if (result >= 0) {
+                return result == 0 ? CPU_SHARD_OK : CPU_SHARD_EMPTY;
+            }
+        }
+#else
+        return CPU_SHARD_NONE;
+#endif
+    }
+    
+    cpu_shard_t* shard = lock_current_shard(cs);
+    if (shard == NULL) {
+        return CPU_SHARD_NONE;
+    }
+    cpu_shard_result_t result = CPU_SHARD_EMPTY;
+    uint32_t count = atomic_load_explicit(&shard->count, memory_order_relaxed);
+    if (count > 0) {
+        *token = shard->tokens[count - 1];
+        atomic_store_explicit(&shard->count, count - 1, memory_order_relaxed);
+        result = CPU_SHARD_OK;
+    }
+    wait_lock_release(&shard->lock);
+    return result;
+}
+
+/**
+ * Store a token in the current CPU's shard
+ *
+ * @param cs Pointer to shards
+ * @param token Token to store
+ * @return CPU_SHARD_OK, CPU_SHARD_FULL or CPU_SHARD_NONE
+ */
+cpu_shard_result_t cpu_shards_push(cpu_shards_t* cs, uint32_t token) {
+    if (cs->mode == CPU_SHARDS_RSEQ) {
+#ifdef HAVE_RSEQ
+        if (!cpu_shards_rseq_available()) {
+            return CPU_SHARD_NONE;
+        }
+        struct rseq* rs = rseq_area();
+        for (;;) {
+            uint32_t cpu = *(volatile uint32_t*)&rs->cpu_id_start;
+            if (cpu >= cs->num_shards) {
+                return CPU_SHARD_NONE;
+            }
+            int result = rseq_push(rs, shard_at(cs, cpu), cpu, cs->capacity, token);
+            if (result >= 0) {
+                return result == 0 ? CPU_SHARD_OK : CPU_SHARD_FULL;
+            }
+        }
+#else
+        return CPU_SHARD_NONE;
+#endif
+    }
+    
+    cpu_shard_t* shard = lock_current_shard(cs);
+    if (shard == NULL) {
+        return CPU_SHARD_NONE;
+    }
+    cpu_shard_result_t result = CPU_SHARD_FULL;
+    uint32_t count = atomic_load_explicit(&shard->count, memory_order_relaxed);
+    if (count < cs->capacity) {
+        shard->tokens[count] = token;
+        atomic_store_explicit(&shard->count, count + 1, memory_order_relaxed);
+        result = CPU_SHARD_OK;
+    }
+    wait_lock_release(&shard->lock);
+    return result;
+}
+
+/**
+ * Take up to max of the newest tokens from another CPU's shard
+ *
+ * @param cs Pointer to shards
+ * @param cpu CPU whose shard to empty
+ * @param tokens Receives the tokens
+ * @param max Capacity of tokens
+ * @return Number of tokens taken
+ */
+uint32_t cpu_shards_steal(cpu_shards_t* cs, uint32_t cpu, uint32_t* tokens, uint32_t max) {
+    if (cs == NULL || tokens == NULL || cpu >= cs->num_shards) {
+        return 0;
+    }
+    cpu_shard_t* shard = shard_at(cs, cpu);
+    uint32_t taken = 0;
+    
+    if (cs->mode == CPU_SHARDS_RSEQ) {
+#ifdef HAVE_RSEQ
+        // Only code running on the CPU may touch its shard: go there, pop
+        // as its own threads do, then restore our affinity
+        if (!cpu_shards_rseq_available() || cpu >= CPU_SETSIZE) {
+            return 0;
+        }
+        cpu_set_t saved, target;
+        if (sched_getaffinity(0, sizeof(saved), &saved) != 0) {
+            return 0;
+        }
+        CPU_ZERO(&target);
+        CPU_SET(cpu, &target);
+        if (sched_setaffinity(0, sizeof(target), &target) != 0) {
+            return 0;  // Not allowed to run there (cpuset, offline CPU)
+        }
+        
+        struct rseq* rs = rseq_area();
+        while (taken < max) {
+            int result = rseq_pop(rs, shard, cpu, &tokens[taken]);
+            if (result > 0) {
+                break;  // Empty
+            }
+            if (result == 0) {
+                taken++;
+            } else if (*(volatile uint32_t*)&rs->cpu_id_start != cpu) {
+                break;  // Moved away after all (CPU going offline)
+            }
+        }
+        
+        sched_setaffinity(0, sizeof(saved), &saved);
+#endif
+        return taken;
+    }
+    
+    if (!wait_lock_try(&shard->lock)) {
+        uint32_t sleeps;
+        wait_lock_acquire_slow(&shard->lock, (wait_strategy_t)cs->wait_strategy, &sleeps);
+    }
+    uint32_t count = atomic_load_explicit(&shard->count, memory_order_relaxed);
+    while (taken < max && count > 0) {
+        tokens[taken++] = shard->tokens[--count];
+    }
+    atomic_store_explicit(&shard->count, count, memory_order_relaxed);
+    wait_lock_release(&shard->lock);
+    return taken;
+}
+
+/**
+ * Get the number of tokens in a CPU's shard
+ *
+ * @param cs Pointer to shards
+ * @param cpu CPU of the shard
+ * @return Tokens held by the shard, 0 if the CPU has none
+ */
+uint32_t cpu_shards_count_at(const cpu_shards_t* cs, uint32_t cpu) {
+    if (cs == NULL || cpu >= cs->num_shards) {
+        return 0;
+    }
+    return atomic_load_explicit(&shard_at(cs, cpu)->count, memory_order_relaxed);
+}
+
+/**
+ * Get the number of tokens in all shards
+ *
+ * @param cs Pointer to shards
+ * @return Tokens held by the shards
+ */
+uint32_t cpu_shards_count(const cpu_shards_t* cs) {
+    uint32_t total = 0;
+    for (uint32_t cpu = 0; cpu < cs->num_shards; cpu++) {
+        total += atomic_load_explicit(&shard_at(cs, cpu)->count, memory_order_relaxed);
+    }
+    return total;
+}
+
+/**
+ * Empty every shard
+ *
+ * @param cs Pointer to shards
+ */
+void cpu_shards_reset(cpu_shards_t* cs) {
+    for (uint32_t cpu = 0; cpu < cs->num_shards; cpu++) {
+        cpu_shard_t* shard = shard_at(cs, cpu);
+        atomic_store(&shard->count, 0);
+        atomic_store(&shard->lock, 0);
+    }
+}
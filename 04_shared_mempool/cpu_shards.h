@@ -0,0 +1,168 @@
+#ifndef CPU_SHARDS_H
+#define CPU_SHARDS_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "wait_strategy.h"
+
+#define CPU_SHARDS_MAGIC 0x44524853     // "SHRD"
+#define CPU_SHARDS_MAX_CAPACITY 256     // Most tokens one shard can hold
+
+/**
+ * How the shards are protected, fixed when they are created so every
+ * process attached to them uses the same method
+ */
+typedef enum {
+    CPU_SHARDS_LOCKED = 0,  // sched_getcpu, then a per-shard lock word (taken by the CPU's own threads only)
+    CPU_SHARDS_RSEQ = 1     // Restartable sequence on the CPU's shard: no atomic instruction at all
+} cpu_shards_mode_t;
+
+/**
+ * Result of a shard operation
+ */
+typedef enum {
+    CPU_SHARD_OK = 0,       // Token taken or stored
+    CPU_SHARD_EMPTY = 1,    // Our CPU's shard has no tokens
+    CPU_SHARD_FULL = 2,     // Our CPU's shard has no room
+    CPU_SHARD_NONE = 3      // No shard for this CPU, or this process cannot use the shards' mode
+} cpu_shard_result_t;
+
+/**
+ * Stack of tokens of one CPU, on its own cache lines
+ */
+typedef struct {
+    _Alignas(64) atomic_uint count;     // Tokens on the stack
+    atomic_uint lock;                   // Only used in CPU_SHARDS_LOCKED mode
+    uint32_t tokens[];                  // capacity tokens, the newest at count - 1
+} cpu_shard_t;
+
+/**
+ * Per-CPU stacks of 32-bit tokens (nonzero, e.g. block index + 1)
+ * A thread only ever touches the shard of the CPU it runs on, so in the
+ * common case the shard's lines stay in that CPU's cache. With rseq the
+ * kernel restarts an operation that was preempted or migrated, which makes
+ * plain loads and stores safe even between processes sharing the memory.
+ * The shards hold no pointers, so they can live in shared memory mapped at
+ * different addresses. Moving tokens between shards and a global reserve
+ * is up to the user (see memory_pool_init_percpu).
+ */
+typedef struct {
+    uint32_t magic;                     // CPU_SHARDS_MAGIC
+    uint32_t num_shards;                // CPUs 0 .. num_shards - 1 have a shard
+    uint32_t capacity;                  // Tokens per shard
+    uint32_t shard_stride;              // Bytes per shard (multiple of 64)
+    uint32_t mode;                      // cpu_shards_mode_t
+    uint32_t wait_strategy;             // How CPU_SHARDS_LOCKED waits (wait_strategy_t)
+    _Alignas(64) uint8_t shards[];      // num_shards shards of shard_stride bytes
+} cpu_shards_t;
+
+/**
+ * Get the number of CPUs the system may have, one shard each
+ *
+ * @return Number of configured CPUs
+ */
+uint32_t cpu_shards_default_count(void);
+
+/**
+ * Check whether this process can use restartable sequences
+ *
+ * @return true if the C library registered rseq and this architecture is supported
+ */
+bool cpu_shards_rseq_available(void);
+
+/**
+ * Get memory size required for per-CPU shards
+ *
+ * @param num_shards Number of shards (one per CPU)
+ * @param capacity Tokens per shard (at most CPU_SHARDS_MAX_CAPACITY)
+ * @return Size in bytes, a multiple of 64
+ */
+size_t cpu_shards_size(uint32_t num_shards, uint32_t capacity);
+
+/**
+ * Initialize empty shards, using rseq when this process can
+ *
+ * @param cs Pointer to memory of cpu_shards_size(num_shards, capacity) bytes, 64-byte aligned
+ * @param num_shards Number of shards (one per CPU)
+ * @param capacity Tokens per shard (at most CPU_SHARDS_MAX_CAPACITY)
+ * @return true on success, false if a parameter is invalid
+ */
+bool cpu_shards_init(cpu_shards_t* cs, uint32_t num_shards, uint32_t capacity);
+
+/**
+ * Check shards set up by another process
+ *
+ * @param cs Pointer to shards
+ * @param num_shards Expected number of shards
+ * @param capacity Expected tokens per shard
+ * @return true if the shards are initialized with these parameters
+ */
+bool cpu_shards_check(const cpu_shards_t* cs, uint32_t num_shards, uint32_t capacity);
+
+/**
+ * Choose how threads wait for a shard lock in CPU_SHARDS_LOCKED mode;
+ * only while nobody uses the shards
+ *
+ * @param cs Pointer to shards
+ * @param strategy Wait strategy
+ */
+void cpu_shards_set_wait_strategy(cpu_shards_t* cs, wait_strategy_t strategy);
+
+/**
+ * Take the newest token from the current CPU's shard (thread-safe)
+ *
+ * @param cs Pointer to shards
+ * @param token Receives the token
+ * @return CPU_SHARD_OK, CPU_SHARD_EMPTY or CPU_SHARD_NONE
+ */
+cpu_shard_result_t cpu_shards_pop(cpu_shards_t* cs, uint32_t* token);
+
+/**
+ * Store a token in the current CPU's shard (thread-safe)
+ *
+ * @param cs Pointer to shards
+ * @param token Token to store
+ * @return CPU_SHARD_OK, CPU_SHARD_FULL or CPU_SHARD_NONE
+ */
+cpu_shard_result_t cpu_shards_push(cpu_shards_t* cs, uint32_t token);
+
+/**
+ * Take up to max of the newest tokens from another CPU's shard (thread-safe)
+ * Slow: in CPU_SHARDS_RSEQ mode the thread moves to that CPU for the
+ * duration (and fails if it may not run there), in CPU_SHARDS_LOCKED mode
+ * it takes the shard's lock. Meant for when every other source is empty.
+ *
+ * @param cs Pointer to shards
+ * @param cpu CPU whose shard to empty
+ * @param tokens Receives the tokens
+ * @param max Capacity of tokens
+ * @return Number of tokens taken
+ */
+uint32_t cpu_shards_steal(cpu_shards_t* cs, uint32_t cpu, uint32_t* tokens, uint32_t max);
+
+/**
+ * Get the number of tokens in a CPU's shard (approximate while it is in use)
+ *
+ * @param cs Pointer to shards
+ * @param cpu CPU of the shard
+ * @return Tokens held by the shard, 0 if the CPU has none
+ */
+uint32_t cpu_shards_count_at(const cpu_shards_t* cs, uint32_t cpu);
+
+/**
+ * Get the number of tokens in all shards (approximate while they are in use)
+ *
+ * @param cs Pointer to shards
+ * @return Tokens held by the shards
+ */
+uint32_t cpu_shards_count(const cpu_shards_t* cs);
+
+/**
+ * Empty every shard; only while nobody uses the shards
+ *
+ * @param cs Pointer to shards
+ */
+void cpu_shards_reset(cpu_shards_t* cs);
+
+#endif
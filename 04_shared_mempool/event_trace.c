@@ -0,0 +1,261 @@
+#define _GNU_SOURCE           // For program_invocation_short_name and gettid
+#include "event_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>            // For O_* constants
+#include <unistd.h>           // For ftruncate, getpid
+#include <sys/mman.h>         // For shm_open, mmap
+#include <sys/prctl.h>        // For PR_GET_NAME
+#include <pthread.h>
+
+// Recording switch while no trace is open
+static atomic_uint trace_off = 0;
+_Atomic(atomic_uint*) event_trace_switch = &trace_off;
+
+// Segment of this process and its name
+static _Atomic(trace_header_t*) trace = NULL;
+static char trace_name[64];
+
+// Ring of the calling thread, claimed on its first event and released at
+// thread exit (the generation invalidates rings of an earlier trace after reopening)
+static atomic_uint trace_generation = 0;
+static _Thread_local trace_thread_t* thread_ring = NULL;
+static _Thread_local uint32_t thread_generation = 0;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Current CLOCK_MONOTONIC time in nanoseconds
+ */
+uint64_t event_trace_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Measure the counter rate against CLOCK_MONOTONIC over a few milliseconds
+static void calibrate(trace_header_t* header) {
+    header->base_ns = event_trace_clock_ns();
+    header->tsc_base = event_trace_tsc();
+    
+    struct timespec ts = {0, 5000000};
+    nanosleep(&ts, NULL);
+    
+    uint64_t ns = event_trace_clock_ns();
+    uint64_t tsc = event_trace_tsc();
+    header->ticks_per_ns = ns > header->base_ns ? (double)(tsc - header->tsc_base) / (ns - header->base_ns) : 1.0;
+    if (header->ticks_per_ns <= 0.0) {
+        header->ticks_per_ns = 1.0;
+    }
+}
+
+// Thread exit: hand the ring back if it belongs to the open trace
+static void release_ring(void* value) {
+    trace_thread_t* ring = value;
+    if (atomic_load_explicit(&trace, memory_order_acquire) != NULL &&
+        thread_generation == atomic_load(&trace_generation)) {
+        atomic_store_explicit(&ring->state, TRACE_RING_RELEASED, memory_order_release);
+    }
+    thread_ring = NULL;
+}
+
+static void create_ring_key(void) {
+    pthread_key_create(&ring_key, release_ring);
+}
+
+// Claim a ring for the calling thread, NULL if all are taken
+// Fresh rings go first, so the events of exited threads stay readable
+// as long as possible; a reused ring starts empty
+static trace_thread_t* claim_ring(trace_header_t* header) {
+    trace_thread_t* ring = NULL;
+    uint32_t index = atomic_load(&header->threads_used);
+    while (index < EVENT_TRACE_MAX_THREADS) {
+        if (atomic_compare_exchange_weak(&header->threads_used, &index, index + 1)) {
+            ring = &header->threads[index];
+            break;
+        }
+    }
+    for (uint32_t i = 0; ring == NULL && i < EVENT_TRACE_MAX_THREADS; i++) {
+        uint32_t expected = TRACE_RING_RELEASED;
+        if (atomic_compare_exchange_strong(&header->threads[i].state, &expected, TRACE_RING_OWNED)) {
+            ring = &header->threads[i];
+            atomic_store_explicit(&ring->head, 0, memory_order_release);
+        }
+    }
+    if (ring == NULL) {
+        atomic_fetch_add(&header->threads_dropped, 1);
+        return NULL;
+    }
+    
+    atomic_store(&ring->state, TRACE_RING_OWNED);
+    pthread_once(&ring_key_once, create_ring_key);
+    pthread_setspecific(ring_key, ring);
+    ring->tid = (uint32_t)gettid();
+    if (prctl(PR_GET_NAME, ring->name) != 0) {
+        ring->name[0] = '\0';
+    }
+    return ring;
+}
+
+/**
+ * Create this process's trace segment and start recording
+ *
+ * @return true on success, false on failure
+ */
+bool event_trace_open(void) {
+    if (atomic_load_explicit(&trace, memory_order_acquire) != NULL) {
+        event_trace_enable(true);
+        return true;
+    }
+    
+    snprintf(trace_name, sizeof(trace_name), "%s%d", EVENT_TRACE_PREFIX, (int)getpid());
+    
+    // A segment of an earlier process with the same pid is replaced
+    shm_unlink(trace_name);
+    int fd = shm_open(trace_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd == -1) {
+        return false;
+    }
+    
+    // Pages of unused rings are never touched, so they cost no memory
+    if (ftruncate(fd, sizeof(trace_header_t)) == -1) {
+        close(fd);
+        shm_unlink(trace_name);
+        return false;
+    }
+    
+    trace_header_t* header = mmap(NULL, sizeof(trace_header_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED) {
+        shm_unlink(trace_name);
+        return false;
+    }
+    
+    header->version = EVENT_TRACE_VERSION;
+    header->pid = (uint32_t)getpid();
+    header->max_threads = EVENT_TRACE_MAX_THREADS;
+    header->events_per_thread = EVENT_TRACE_EVENTS;
+    snprintf(header->process, sizeof(header->process), "%s", program_invocation_short_name);
+    calibrate(header);
+    header->magic = EVENT_TRACE_MAGIC;
+    
+    // Publish the segment, then switch recording on
+    atomic_fetch_add(&trace_generation, 1);
+    atomic_store_explicit(&trace, header, memory_order_release);
+    atomic_store_explicit(&event_trace_switch, &header->enabled, memory_order_release);
+    event_trace_enable(true);
+    return true;
+}
+
+/**
+ * Open the trace when the MEMPOOL_TRACE environment variable is set
+ *
+ * @return true if tracing was requested and started
+ */
+bool event_trace_open_from_env(void) {
+    const char* value = getenv("MEMPOOL_TRACE");
+    if (value == NULL || value[0] == '\0' || strcmp(value, "0") == 0) {
+        return false;
+    }
+    
+    if (!event_trace_open()) {
+        fprintf(stderr, "Failed to create trace segment %s: %s\n", trace_name, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Turn recording on or off
+ *
+ * @param enabled Whether to record
+ */
+void event_trace_enable(bool enabled) {
+    trace_header_t* header = atomic_load_explicit(&trace, memory_order_acquire);
+    if (header != NULL) {
+        atomic_store(&header->enabled, enabled ? 1 : 0);
+    }
+}
+
+/**
+ * Stop recording and unmap the segment
+ * Other threads must not be recording any more
+ *
+ * @param unlink Whether to remove the segment as well
+ */
+void event_trace_close(bool unlink) {
+    trace_header_t* header = atomic_load_explicit(&trace, memory_order_acquire);
+    if (header == NULL) {
+        return;
+    }
+    
+    atomic_store_explicit(&event_trace_switch, &trace_off, memory_order_release);
+    atomic_store_explicit(&trace, NULL, memory_order_release);
+    munmap(header, sizeof(trace_header_t));
+    if (unlink) {
+        shm_unlink(trace_name);
+    }
+}
+
+/**
+ * Record an event into the calling thread's ring
+ *
+ * @param type trace_event_type_t
+ * @param arg Event argument
+ * @param aux Second, smaller argument
+ */
+void event_trace_record(uint16_t type, uint32_t arg, uint16_t aux) {
+    trace_header_t* header = atomic_load_explicit(&trace, memory_order_acquire);
+    if (header == NULL) {
+        return;
+    }
+    
+    uint32_t generation = atomic_load_explicit(&trace_generation, memory_order_relaxed);
+    if (thread_generation != generation) {
+        thread_ring = claim_ring(header);
+        thread_generation = generation;
+    }
+    trace_thread_t* ring = thread_ring;
+    if (ring == NULL) {
+        return;
+    }
+    
+    // Only this thread writes the ring: fill the slot, then publish it
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    trace_event_t* event = &ring->events[head & (EVENT_TRACE_EVENTS - 1)];
+    event->tsc = event_trace_tsc();
+    event->arg = arg;
+    event->type = type;
+    event->aux = aux;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/**
+ * Convert a counter value of a segment to CLOCK_MONOTONIC nanoseconds
+ *
+ * @param header Trace segment
+ * @param tsc Counter value from an event
+ * @return Nanoseconds, comparable between processes of the same boot
+ */
+uint64_t event_trace_to_ns(const trace_header_t* header, uint64_t tsc) {
+    double delta = (double)(int64_t)(tsc - header->tsc_base) / header->ticks_per_ns;
+    return header->base_ns + (int64_t)delta;
+}
+
+/**
+ * Check that a mapped segment or file is a trace this build can read
+ *
+ * @param header Start of the segment
+ * @param size Size of the segment in bytes
+ * @return true if the layout matches
+ */
+bool event_trace_valid(const trace_header_t* header, size_t size) {
+    return header != NULL && size >= sizeof(trace_header_t) &&
+           header->magic == EVENT_TRACE_MAGIC && header->version == EVENT_TRACE_VERSION &&
+           header->max_threads == EVENT_TRACE_MAX_THREADS &&
+           header->events_per_thread == EVENT_TRACE_EVENTS &&
+           header->ticks_per_ns > 0.0;
+}
@@ -0,0 +1,185 @@
+#ifndef EVENT_TRACE_H
+#define EVENT_TRACE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define EVENT_TRACE_MAGIC 0x43525445       // "ETRC"
+#define EVENT_TRACE_VERSION 2
+#define EVENT_TRACE_MAX_THREADS 32          // Live threads of one process with their own ring
+#define EVENT_TRACE_EVENTS 16384            // Events kept per thread (power of 2, oldest overwritten)
+#define EVENT_TRACE_PREFIX "/mempool_trace." // Segment name is the prefix followed by the pid
+#define EVENT_TRACE_NO_INDEX UINT32_MAX     // Argument of a failed allocation
+
+/**
+ * Traced events
+ */
+typedef enum {
+    TRACE_POOL_ALLOC = 1,       // arg: block index, aux: 0
+    TRACE_POOL_FREE = 2,        // arg: block index, aux: 1 if accepted
+    TRACE_RING_PUT = 3,         // arg: items in the ring afterwards, aux: 1 if stored
+    TRACE_RING_GET = 4,         // arg: items in the ring afterwards, aux: 1 if an item was taken
+    TRACE_TRACKER_ADD = 5,      // arg: message sequence (low 32 bits), aux: tracker slot
+    TRACE_TRACKER_MARK = 6,     // arg: tracker slot, aux: participant
+    TRACE_TRACKER_FREE = 7,     // arg: tracker slot, aux: 0
+    TRACE_LOCK_WAIT_BEGIN = 8,  // arg: 0, aux: trace_lock_t
+    TRACE_LOCK_WAIT_END = 9,    // arg: failed attempts, aux: trace_lock_t
+    TRACE_EVENT_TYPES = 10
+} trace_event_type_t;
+
+/**
+ * Spinlocks reported by the lock wait events
+ */
+typedef enum {
+    TRACE_LOCK_RING_PRODUCER = 0,
+    TRACE_LOCK_RING_CONSUMER = 1,
+    TRACE_LOCK_TRACKER = 2
+} trace_lock_t;
+
+/**
+ * One event, 16 bytes
+ */
+typedef struct {
+    uint64_t tsc;               // Time stamp counter (see trace_header_t for the conversion)
+    uint32_t arg;
+    uint16_t type;              // trace_event_type_t
+    uint16_t aux;
+} trace_event_t;
+
+/**
+ * Ring states: a ring is handed out fresh once, and again after its
+ * thread exited
+ */
+typedef enum {
+    TRACE_RING_FRESH = 0,
+    TRACE_RING_OWNED = 1,
+    TRACE_RING_RELEASED = 2     // Its thread exited; kept for decoding until reused
+} trace_ring_state_t;
+
+/**
+ * Event ring of one thread. Only the owning thread writes; `head` counts
+ * every event ever written, so the last EVENT_TRACE_EVENTS are valid
+ */
+typedef struct {
+    _Alignas(64) atomic_ullong head;
+    uint32_t tid;
+    atomic_uint state;          // trace_ring_state_t
+    char name[16];              // Thread name when the ring was claimed
+    trace_event_t events[EVENT_TRACE_EVENTS];
+} trace_thread_t;
+
+/**
+ * Start of a trace segment. The segment contains no pointers, so it can
+ * be read live by another process or copied to a file and decoded later
+ */
+typedef struct {
+    _Alignas(64) uint32_t magic;    // EVENT_TRACE_MAGIC
+    uint32_t version;               // EVENT_TRACE_VERSION
+    uint32_t pid;
+    uint32_t max_threads;           // EVENT_TRACE_MAX_THREADS when written
+    uint32_t events_per_thread;     // EVENT_TRACE_EVENTS when written
+    atomic_uint enabled;            // Recording switch, may be flipped by another process
+    atomic_uint threads_used;       // Rings handed out so far (reused rings count once)
+    atomic_uint threads_dropped;    // Threads that found no free ring
+    uint64_t tsc_base;              // Counter value at base_ns
+    uint64_t base_ns;               // CLOCK_MONOTONIC time in nanoseconds
+    double ticks_per_ns;            // Counter rate
+    char process[32];               // Program name
+    trace_thread_t threads[EVENT_TRACE_MAX_THREADS];
+} trace_header_t;
+
+/**
+ * Recording switch read by EVENT_TRACE (points at a constant 0 until a
+ * trace is opened, then at the segment's `enabled` word; published with
+ * release ordering after the segment is set up)
+ */
+extern _Atomic(atomic_uint*) event_trace_switch;
+
+/**
+ * Create this process's trace segment (EVENT_TRACE_PREFIX + pid) and start recording
+ * The segment is left behind at exit so it can be decoded afterwards
+ *
+ * @return true on success, false on failure
+ */
+bool event_trace_open(void);
+
+/**
+ * Open the trace when the MEMPOOL_TRACE environment variable is set
+ *
+ * @return true if tracing was requested and started
+ */
+bool event_trace_open_from_env(void);
+
+/**
+ * Turn recording on or off
+ *
+ * @param enabled Whether to record
+ */
+void event_trace_enable(bool enabled);
+
+/**
+ * Stop recording and unmap the segment
+ *
+ * @param unlink Whether to remove the segment as well
+ */
+void event_trace_close(bool unlink);
+
+/**
+ * Record an event into the calling thread's ring (use EVENT_TRACE, which
+ * skips the call while recording is off)
+ *
+ * @param type trace_event_type_t
+ * @param arg Event argument
+ * @param aux Second, smaller argument
+ */
+void event_trace_record(uint16_t type, uint32_t arg, uint16_t aux);
+
+/**
+ * Current CLOCK_MONOTONIC time in nanoseconds
+ */
+uint64_t event_trace_clock_ns(void);
+
+/**
+ * Read the time stamp counter (CLOCK_MONOTONIC nanoseconds where there is none)
+ */
+static inline uint64_t event_trace_tsc(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return event_trace_clock_ns();
+#endif
+}
+
+/**
+ * Convert a counter value of a segment to CLOCK_MONOTONIC nanoseconds
+ *
+ * @param header Trace segment
+ * @param tsc Counter value from an event
+ * @return Nanoseconds, comparable between processes of the same boot
+ */
+uint64_t event_trace_to_ns(const trace_header_t* header, uint64_t tsc);
+
+/**
+ * Check that a mapped segment or file of `size` bytes is a trace this build can read
+ *
+ * @param header Start of the segment
+ * @param size Size of the segment in bytes
+ * @return true if the layout matches
+ */
+bool event_trace_valid(const trace_header_t* header, size_t size);
+
+/**
+ * Record an event when recording is on; costs one load and a
+ * predicted branch when it is off
+ */
+#define EVENT_TRACE(type, arg, aux) do {                                                \
+        atomic_uint* event_trace_on_ = atomic_load_explicit(&event_trace_switch,        \
+                                                            memory_order_acquire);      \
+        if (__builtin_expect(atomic_load_explicit(event_trace_on_,                      \
+                                                  memory_order_relaxed) != 0, 0)) {     \
+            event_trace_record((type), (uint32_t)(arg), (uint16_t)(aux));               \
+        }                                                                               \
+    } while (0)
+
+#endif
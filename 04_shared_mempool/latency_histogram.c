@@ -0,0 +1,327 @@
+#include "latency_histogram.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+// Per-thread histograms, one per timed operation
+typedef struct latency_thread_set {
+    latency_histogram_t histograms[LATENCY_OP_COUNT];
+    struct latency_thread_set* next;
+} latency_thread_set_t;
+
+// Sets of the running threads; an exiting thread folds its set into
+// retired_set and frees it, so threads that come and go cost no memory
+static pthread_mutex_t thread_sets_lock = PTHREAD_MUTEX_INITIALIZER;
+static latency_thread_set_t* thread_sets = NULL;
+static latency_thread_set_t retired_set;
+static pthread_key_t thread_set_key;
+static pthread_once_t thread_set_key_once = PTHREAD_ONCE_INIT;
+static _Thread_local latency_thread_set_t* thread_set = NULL;
+
+// Thread exit: keep the samples in retired_set and release the set
+static void retire_thread_set(void* value) {
+    latency_thread_set_t* set = value;
+    
+    pthread_mutex_lock(&thread_sets_lock);
+    for (latency_thread_set_t** link = &thread_sets; *link != NULL; link = &(*link)->next) {
+        if (*link == set) {
+            *link = set->next;
+            break;
+        }
+    }
+    for (int op = 0; op < LATENCY_OP_COUNT; op++) {
+        latency_histogram_merge(&retired_set.histograms[op], &set->histograms[op]);
+    }
+    pthread_mutex_unlock(&thread_sets_lock);
+    
+    if (thread_set == set) {
+        thread_set = NULL;
+    }
+    free(set);
+}
+
+static void create_thread_set_key(void) {
+    pthread_key_create(&thread_set_key, retire_thread_set);
+}
+
+// Bucket of a value: exact below 16, then 16 buckets per power of two
+static inline uint32_t bucket_index(uint64_t value) {
+    const uint64_t linear = 1ULL << LATENCY_SUB_BUCKET_BITS;
+    if (value < linear) {
+        return (uint32_t)value;
+    }
+    if (value >= (1ULL << LATENCY_MAX_EXPONENT)) {
+        value = (1ULL << LATENCY_MAX_EXPONENT) - 1;
+    }
+    
+    uint32_t exponent = 63 - __builtin_clzll(value);
+    uint32_t shift = exponent - LATENCY_SUB_BUCKET_BITS;
+    uint32_t sub_bucket = (uint32_t)(value >> shift) & (linear - 1);
+    return ((shift + 1) << LATENCY_SUB_BUCKET_BITS) + sub_bucket;
+}
+
+// Smallest value of a bucket
+static inline uint64_t bucket_lower_bound(uint32_t index) {
+    const uint32_t linear = 1u << LATENCY_SUB_BUCKET_BITS;
+    if (index < linear) {
+        return index;
+    }
+    
+    uint32_t shift = (index >> LATENCY_SUB_BUCKET_BITS) - 1;
+    uint64_t sub_bucket = index & (linear - 1);
+    return (linear + sub_bucket) << shift;
+}
+
+// Only the owner writes, so a load and a store replace the locked add
+static inline void owner_add(atomic_ullong* counter, uint64_t value) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+                          memory_order_relaxed);
+}
+
+/**
+ * Clear a histogram
+ *
+ * @param histogram Pointer to histogram
+ */
+void latency_histogram_reset(latency_histogram_t* histogram) {
+    if (histogram != NULL) {
+        memset(histogram, 0, sizeof(latency_histogram_t));
+    }
+}
+
+/**
+ * Record a value (single writer)
+ *
+ * @param histogram Pointer to histogram
+ * @param value_ns Latency in nanoseconds
+ */
+void latency_histogram_record(latency_histogram_t* histogram, uint64_t value_ns) {
+    if (histogram == NULL) {
+        return;
+    }
+    
+    owner_add(&histogram->counts[bucket_index(value_ns)], 1);
+    owner_add(&histogram->total, 1);
+    owner_add(&histogram->sum_ns, value_ns);
+    if (value_ns > atomic_load_explicit(&histogram->max_ns, memory_order_relaxed)) {
+        atomic_store_explicit(&histogram->max_ns, value_ns, memory_order_relaxed);
+    }
+}
+
+/**
+ * Add the counts of one histogram to another
+ *
+ * @param destination Histogram receiving the counts
+ * @param source Histogram to add
+ */
+void latency_histogram_merge(latency_histogram_t* destination, const latency_histogram_t* source) {
+    if (destination == NULL || source == NULL) {
+        return;
+    }
+    
+    for (uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+        uint64_t count = atomic_load_explicit(&source->counts[i], memory_order_relaxed);
+        if (count != 0) {
+            atomic_fetch_add_explicit(&destination->counts[i], count, memory_order_relaxed);
+        }
+    }
+    atomic_fetch_add_explicit(&destination->total,
+                              atomic_load_explicit(&source->total, memory_order_relaxed),
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&destination->sum_ns,
+                              atomic_load_explicit(&source->sum_ns, memory_order_relaxed),
+                              memory_order_relaxed);
+    
+    // Raise the maximum
+    uint64_t max = atomic_load_explicit(&source->max_ns, memory_order_relaxed);
+    uint64_t current = atomic_load_explicit(&destination->max_ns, memory_order_relaxed);
+    while (max > current &&
+           !atomic_compare_exchange_weak_explicit(&destination->max_ns, &current, max,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+/**
+ * Get the value at or below which a fraction of the recorded values lie
+ *
+ * @param histogram Pointer to histogram
+ * @param fraction Fraction between 0 and 1
+ * @return Upper bound of the bucket holding the percentile, 0 if empty
+ */
+uint64_t latency_histogram_percentile(const latency_histogram_t* histogram, double fraction) {
+    if (histogram == NULL) {
+        return 0;
+    }
+    
+    // Sum the buckets rather than trusting total, which a concurrent
+    // recorder may have updated separately
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+        total += atomic_load_explicit(&histogram->counts[i], memory_order_relaxed);
+    }
+    if (total == 0) {
+        return 0;
+    }
+    
+    uint64_t rank = (uint64_t)(fraction * total + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    
+    uint64_t max = atomic_load_explicit(&histogram->max_ns, memory_order_relaxed);
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += atomic_load_explicit(&histogram->counts[i], memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t upper = i + 1 < LATENCY_BUCKETS ? bucket_lower_bound(i + 1) - 1 : max;
+            return upper < max ? upper : max;
+        }
+    }
+    
+    return max;
+}
+
+/**
+ * Print count, mean and p50/p90/p99/p99.9/max on one line
+ *
+ * @param histogram Pointer to histogram
+ * @param label Name printed in front of the numbers
+ * @param out Stream to print to
+ */
+void latency_histogram_print(const latency_histogram_t* histogram, const char* label, FILE* out) {
+    if (histogram == NULL || out == NULL) {
+        return;
+    }
+    
+    uint64_t total = atomic_load_explicit(&histogram->total, memory_order_relaxed);
+    uint64_t sum = atomic_load_explicit(&histogram->sum_ns, memory_order_relaxed);
+    fprintf(out, "%-10s count %llu  mean %llu ns  p50 %llu  p90 %llu  p99 %llu  p99.9 %llu  max %llu ns\n",
+            label != NULL ? label : "", (unsigned long long)total,
+            (unsigned long long)(total != 0 ? sum / total : 0),
+            (unsigned long long)latency_histogram_percentile(histogram, 0.50),
+            (unsigned long long)latency_histogram_percentile(histogram, 0.90),
+            (unsigned long long)latency_histogram_percentile(histogram, 0.99),
+            (unsigned long long)latency_histogram_percentile(histogram, 0.999),
+            (unsigned long long)atomic_load_explicit(&histogram->max_ns, memory_order_relaxed));
+}
+
+// File header of a saved histogram
+typedef struct {
+    uint32_t magic;
+    uint32_t buckets;
+} histogram_file_header_t;
+
+/**
+ * Save a histogram to a file so another process can merge it
+ *
+ * @param histogram Pointer to histogram
+ * @param path File to write
+ * @return true on success, false on error
+ */
+bool latency_histogram_save(const latency_histogram_t* histogram, const char* path) {
+    if (histogram == NULL || path == NULL) {
+        return false;
+    }
+    
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    
+    // Copy first so the file holds one snapshot even while recording goes on
+    latency_histogram_t snapshot;
+    latency_histogram_reset(&snapshot);
+    latency_histogram_merge(&snapshot, histogram);
+    
+    histogram_file_header_t header = { LATENCY_HISTOGRAM_MAGIC, LATENCY_BUCKETS };
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(&snapshot, sizeof(snapshot), 1, file) == 1;
+    return fclose(file) == 0 && success;
+}
+
+/**
+ * Merge a histogram saved by latency_histogram_save
+ *
+ * @param histogram Histogram receiving the counts
+ * @param path File to read
+ * @return true on success, false if the file is missing or not a histogram
+ */
+bool latency_histogram_load(latency_histogram_t* histogram, const char* path) {
+    if (histogram == NULL || path == NULL) {
+        return false;
+    }
+    
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    
+    histogram_file_header_t header;
+    latency_histogram_t* saved = malloc(sizeof(latency_histogram_t));
+    bool success = saved != NULL &&
+                   fread(&header, sizeof(header), 1, file) == 1 &&
+                   header.magic == LATENCY_HISTOGRAM_MAGIC && header.buckets == LATENCY_BUCKETS &&
+                   fread(saved, sizeof(latency_histogram_t), 1, file) == 1;
+    fclose(file);
+    
+    if (success) {
+        latency_histogram_merge(histogram, saved);
+    }
+    free(saved);
+    return success;
+}
+
+/**
+ * Get the calling thread's histogram for an operation
+ *
+ * @param op Timed operation
+ * @return Histogram only this thread records into
+ */
+latency_histogram_t* latency_thread_histogram(latency_op_t op) {
+    if (thread_set == NULL) {
+        pthread_once(&thread_set_key_once, create_thread_set_key);
+        latency_thread_set_t* set = calloc(1, sizeof(latency_thread_set_t));
+        if (set == NULL || pthread_setspecific(thread_set_key, set) != 0) {
+            free(set);
+            return NULL;  // Recording is skipped
+        }
+        
+        // Register it so latency_collect can find it
+        pthread_mutex_lock(&thread_sets_lock);
+        set->next = thread_sets;
+        thread_sets = set;
+        pthread_mutex_unlock(&thread_sets_lock);
+        thread_set = set;
+    }
+    
+    return &thread_set->histograms[op];
+}
+
+/**
+ * Merge the histograms of all threads of this process for an operation
+ *
+ * @param op Timed operation
+ * @param destination Histogram receiving the counts (not reset first)
+ */
+void latency_collect(latency_op_t op, latency_histogram_t* destination) {
+    if (destination == NULL || (int)op < 0 || op >= LATENCY_OP_COUNT) {
+        return;
+    }
+    
+    pthread_mutex_lock(&thread_sets_lock);
+    latency_histogram_merge(destination, &retired_set.histograms[op]);
+    for (latency_thread_set_t* set = thread_sets; set != NULL; set = set->next) {
+        latency_histogram_merge(destination, &set->histograms[op]);
+    }
+    pthread_mutex_unlock(&thread_sets_lock);
+}
+
+/**
+ * Current CLOCK_MONOTONIC time in nanoseconds
+ */
+uint64_t latency_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
@@ -0,0 +1,137 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdatomic.h>
+
+#define LATENCY_SUB_BUCKET_BITS 4         // 16 linear sub-buckets per power of two (~6% error)
+#define LATENCY_MAX_EXPONENT 40           // Values up to 2^40 ns (~18 minutes), larger ones are clamped
+#define LATENCY_BUCKETS ((LATENCY_MAX_EXPONENT - LATENCY_SUB_BUCKET_BITS + 1) << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_HISTOGRAM_MAGIC 0x4C415448  // "LATH", header of saved histograms
+
+/**
+ * Log-linear latency histogram (HDR style)
+ * Values below 16 ns get one bucket each, above that every power of two
+ * is split into 16 linear buckets. The layout is fixed and contains no
+ * pointers, so a histogram can live in shared memory or be saved to a
+ * file and merged by another process.
+ */
+typedef struct {
+    atomic_ullong total;                      // Number of recorded values
+    atomic_ullong sum_ns;                     // Sum of recorded values (for the mean)
+    atomic_ullong max_ns;                     // Largest recorded value
+    atomic_ullong counts[LATENCY_BUCKETS];
+} latency_histogram_t;
+
+/**
+ * Operations timed when built with MEMPOOL_LATENCY
+ */
+typedef enum {
+    LATENCY_POOL_ALLOC = 0,
+    LATENCY_POOL_FREE = 1,
+    LATENCY_RING_PUT = 2,
+    LATENCY_RING_GET = 3,
+    LATENCY_OP_COUNT = 4
+} latency_op_t;
+
+/**
+ * Clear a histogram
+ *
+ * @param histogram Pointer to histogram
+ */
+void latency_histogram_reset(latency_histogram_t* histogram);
+
+/**
+ * Record a value (single writer: only the owning thread may record,
+ * readers and merges may run concurrently)
+ *
+ * @param histogram Pointer to histogram
+ * @param value_ns Latency in nanoseconds
+ */
+void latency_histogram_record(latency_histogram_t* histogram, uint64_t value_ns);
+
+/**
+ * Add the counts of one histogram to another (safe with several
+ * threads or processes merging into the same destination)
+ *
+ * @param destination Histogram receiving the counts
+ * @param source Histogram to add
+ */
+void latency_histogram_merge(latency_histogram_t* destination, const latency_histogram_t* source);
+
+/**
+ * Get the value at or below which a fraction of the recorded values lie
+ *
+ * @param histogram Pointer to histogram
+ * @param fraction Fraction between 0 and 1 (0.99 for p99)
+ * @return Upper bound of the bucket holding the percentile, 0 if empty
+ */
+uint64_t latency_histogram_percentile(const latency_histogram_t* histogram, double fraction);
+
+/**
+ * Print count, mean and p50/p90/p99/p99.9/max on one line
+ *
+ * @param histogram Pointer to histogram
+ * @param label Name printed in front of the numbers
+ * @param out Stream to print to
+ */
+void latency_histogram_print(const latency_histogram_t* histogram, const char* label, FILE* out);
+
+/**
+ * Save a histogram to a file so another process can merge it
+ *
+ * @param histogram Pointer to histogram
+ * @param path File to write
+ * @return true on success, false on error
+ */
+bool latency_histogram_save(const latency_histogram_t* histogram, const char* path);
+
+/**
+ * Merge a histogram saved by latency_histogram_save
+ *
+ * @param histogram Histogram receiving the counts
+ * @param path File to read
+ * @return true on success, false if the file is missing or not a histogram
+ */
+bool latency_histogram_load(latency_histogram_t* histogram, const char* path);
+
+/**
+ * Get the calling thread's histogram for an operation
+ * Each thread gets its own set on first use; when the thread exits its
+ * samples move to a process-wide total and the set is freed
+ *
+ * @param op Timed operation
+ * @return Histogram only this thread records into
+ */
+latency_histogram_t* latency_thread_histogram(latency_op_t op);
+
+/**
+ * Merge the histograms of all threads of this process for an operation
+ *
+ * @param op Timed operation
+ * @param destination Histogram receiving the counts (not reset first)
+ */
+void latency_collect(latency_op_t op, latency_histogram_t* destination);
+
+/**
+ * Current CLOCK_MONOTONIC time in nanoseconds
+ */
+uint64_t latency_now_ns(void);
+
+/**
+ * Time a call into the calling thread's histogram for `op` when built
+ * with MEMPOOL_LATENCY; otherwise just make the call
+ */
+#ifdef MEMPOOL_LATENCY
+#define LATENCY_TIMED(op, result, call) do {                                    \
+        uint64_t latency_start_ = latency_now_ns();                             \
+        (result) = (call);                                                      \
+        latency_histogram_record(latency_thread_histogram(op),                  \
+                                 latency_now_ns() - latency_start_);            \
+    } while (0)
+#else
+#define LATENCY_TIMED(op, result, call) do { (result) = (call); } while (0)
+#endif
+
+#endif
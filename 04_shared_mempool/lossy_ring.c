@@ -0,0 +1,178 @@
+#include "lossy_ring.h"
+#include <string.h>
+#include <sched.h>     // For sched_yield
+
+// Slot holding a position
+static inline lossy_slot_t* slot_at(lossy_ring_t* lr, uint64_t position) {
+    return (lossy_slot_t*)(lr->slots + (size_t)(position & (lr->capacity - 1)) * lr->slot_size);
+}
+
+/**
+ * Get memory size required for a lossy ring
+ *
+ * @param capacity Slots (power of 2)
+ * @param item_size Bytes per item (multiple of 8, at most LOSSY_RING_MAX_ITEM)
+ * @return Size in bytes needed for the lossy ring structure
+ */
+size_t lossy_ring_size(uint32_t capacity, uint32_t item_size) {
+    return sizeof(lossy_ring_t) + (size_t)capacity * (sizeof(lossy_slot_t) + item_size);
+}
+
+/**
+ * Initialize a lossy ring
+ *
+ * @param lr Pointer to memory of lossy_ring_size(capacity, item_size) bytes
+ * @param capacity Slots (power of 2)
+ * @param item_size Bytes per item (multiple of 8, at most LOSSY_RING_MAX_ITEM)
+ * @return true on success, false if a parameter is invalid
+ */
+bool lossy_ring_init(lossy_ring_t* lr, uint32_t capacity, uint32_t item_size) {
+    if (lr == NULL || capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+        item_size == 0 || item_size % 8 != 0 || item_size > LOSSY_RING_MAX_ITEM) {
+        return false;
+    }
+    
+    lr->capacity = capacity;
+    lr->item_size = item_size;
+    lr->slot_size = (uint32_t)sizeof(lossy_slot_t) + item_size;
+    atomic_store(&lr->tail, 0);
+    
+    // Sequence 0 is below every position's, so empty slots read as not yet written
+    for (uint32_t i = 0; i < capacity; i++) {
+        lossy_slot_t* slot = slot_at(lr, i);
+        atomic_store(&slot->sequence, 0);
+        for (uint32_t w = 0; w < item_size / 8; w++) {
+            atomic_store_explicit(&slot->words[w], 0, memory_order_relaxed);
+        }
+    }
+    return true;
+}
+
+/**
+ * Add an item, overwriting the oldest one when the ring is full
+ *
+ * @param lr Pointer to lossy ring
+ * @param item item_size bytes
+ * @return Position (sequence number) of the item
+ */
+uint64_t lossy_ring_put(lossy_ring_t* lr, const void* item) {
+    uint64_t position = atomic_fetch_add(&lr->tail, 1);
+    lossy_slot_t* slot = slot_at(lr, position);
+    uint64_t writing = 2 * position + 1;
+    
+    // Take the slot by making its sequence odd; only a producer of an
+    // earlier lap that is still writing can hold us up, readers never do
+    uint64_t current = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+    for (;;) {
+        if (current >= writing) {
+            return position;  // A later lap owns the slot already, our item is overwritten
+        }
+        if ((current & 1) != 0) {
+            sched_yield();
+            current = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+            continue;
+        }
+        if (atomic_compare_exchange_weak_explicit(&slot->sequence, &current, writing,
+                                                  memory_order_acq_rel, memory_order_relaxed)) {
+            break;
+        }
+    }
+    
+    // Readers that see any of the new words also see the odd sequence
+    atomic_thread_fence(memory_order_release);
+    
+    uint64_t words[LOSSY_RING_MAX_ITEM / 8];
+    memcpy(words, item, lr->item_size);
+    for (uint32_t w = 0; w < lr->item_size / 8; w++) {
+        atomic_store_explicit(&slot->words[w], words[w], memory_order_relaxed);
+    }
+    
+    atomic_store_explicit(&slot->sequence, writing + 1, memory_order_release);
+    return position;
+}
+
+/**
+ * Set up a reader
+ *
+ * @param lr Pointer to lossy ring
+ * @param reader Reader to set up
+ * @param from_oldest Start at the oldest item still in the ring (true) or with the next new one (false)
+ */
+void lossy_ring_reader_init(lossy_ring_t* lr, lossy_ring_reader_t* reader, bool from_oldest) {
+    uint64_t tail = atomic_load(&lr->tail);
+    reader->next = tail;
+    if (from_oldest) {
+        reader->next = tail > lr->capacity ? tail - lr->capacity : 0;
+    }
+    reader->missed = 0;
+}
+
+/**
+ * Read the next item for a reader
+ *
+ * @param lr Pointer to lossy ring
+ * @param reader Reader position
+ * @param item Receives item_size bytes
+ * @param missed Receives the items overwritten since the previous read (may be NULL)
+ * @return true if an item was read, false if there is no new complete item yet
+ */
+bool lossy_ring_read(lossy_ring_t* lr, lossy_ring_reader_t* reader, void* item, uint64_t* missed) {
+    uint64_t skipped = 0;
+    bool found = false;
+    
+    for (;;) {
+        uint64_t tail = atomic_load_explicit(&lr->tail, memory_order_acquire);
+        if (reader->next >= tail) {
+            break;  // Nothing new
+        }
+        
+        // Lapped: everything older than one ring behind the tail is gone
+        if (tail - reader->next > lr->capacity) {
+            skipped += tail - lr->capacity - reader->next;
+            reader->next = tail - lr->capacity;
+        }
+        
+        lossy_slot_t* slot = slot_at(lr, reader->next);
+        uint64_t expected = 2 * reader->next + 2;
+        uint64_t before = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (before < expected) {
+            break;  // Claimed but still being written
+        }
+        
+        if (before == expected) {
+            uint64_t words[LOSSY_RING_MAX_ITEM / 8];
+            for (uint32_t w = 0; w < lr->item_size / 8; w++) {
+                words[w] = atomic_load_explicit(&slot->words[w], memory_order_relaxed);
+            }
+            atomic_thread_fence(memory_order_acquire);
+            
+            // Unchanged sequence: no producer touched the slot while we copied
+            if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) == before) {
+                memcpy(item, words, lr->item_size);
+                reader->next++;
+                found = true;
+                break;
+            }
+        }
+        
+        // Overwritten before or while we read it; the tail check above skips ahead
+    }
+    
+    reader->missed += skipped;
+    if (missed != NULL) {
+        *missed = skipped;
+    }
+    return found;
+}
+
+/**
+ * Get the number of items a reader has not read yet
+ *
+ * @param lr Pointer to lossy ring
+ * @param reader Reader position
+ * @return Items behind the tail
+ */
+uint64_t lossy_ring_lag(const lossy_ring_t* lr, const lossy_ring_reader_t* reader) {
+    uint64_t tail = atomic_load(&((lossy_ring_t*)lr)->tail);
+    return tail > reader->next ? tail - reader->next : 0;
+}
@@ -0,0 +1,104 @@
+#ifndef LOSSY_RING_H
+#define LOSSY_RING_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define LOSSY_RING_MAX_ITEM 256         // Largest item in bytes
+
+/**
+ * Slot of a lossy ring: a sequence word followed by the item
+ * The sequence is 2 * position + 2 once the item at that position is
+ * complete, and odd while a producer writes it (a per-slot seqlock)
+ */
+typedef struct {
+    atomic_ullong sequence;
+    atomic_ullong words[];              // Item, stored word by word so readers may race with writers
+} lossy_slot_t;
+
+/**
+ * Overwrite-oldest ring for telemetry (Multi-Producer, any number of readers)
+ * Producers claim a position with one fetch_add and overwrite whatever the
+ * slot held, so they never wait for readers and never fail. Each reader
+ * keeps its own position (lossy_ring_reader_t); when producers lap it, the
+ * sequence numbers show the overrun and the reader skips ahead, counting
+ * the items it missed. Every reader sees every item still in the ring.
+ * Positions are offsets, so the ring works in shared memory mapped at
+ * different addresses.
+ */
+typedef struct {
+    uint32_t capacity;                  // Slots (power of 2)
+    uint32_t item_size;                 // Bytes per item (multiple of 8)
+    uint32_t slot_size;                 // Bytes per slot, sequence included
+    _Alignas(64) atomic_ullong tail;    // Next position to claim (never wraps)
+    _Alignas(64) uint8_t slots[];       // capacity slots of slot_size bytes
+} lossy_ring_t;
+
+/**
+ * Read position of one consumer (private to it, not shared)
+ */
+typedef struct {
+    uint64_t next;                      // Position of the next item to read
+    uint64_t missed;                    // Items overwritten before this reader got to them
+} lossy_ring_reader_t;
+
+/**
+ * Get memory size required for a lossy ring
+ *
+ * @param capacity Slots (power of 2)
+ * @param item_size Bytes per item (multiple of 8, at most LOSSY_RING_MAX_ITEM)
+ * @return Size in bytes needed for the lossy ring structure
+ */
+size_t lossy_ring_size(uint32_t capacity, uint32_t item_size);
+
+/**
+ * Initialize a lossy ring
+ *
+ * @param lr Pointer to memory of lossy_ring_size(capacity, item_size) bytes
+ * @param capacity Slots (power of 2)
+ * @param item_size Bytes per item (multiple of 8, at most LOSSY_RING_MAX_ITEM)
+ * @return true on success, false if a parameter is invalid
+ */
+bool lossy_ring_init(lossy_ring_t* lr, uint32_t capacity, uint32_t item_size);
+
+/**
+ * Add an item, overwriting the oldest one when the ring is full (thread-safe)
+ * Only waits for a producer still writing the same slot a full lap earlier
+ *
+ * @param lr Pointer to lossy ring
+ * @param item item_size bytes
+ * @return Position (sequence number) of the item
+ */
+uint64_t lossy_ring_put(lossy_ring_t* lr, const void* item);
+
+/**
+ * Set up a reader
+ *
+ * @param lr Pointer to lossy ring
+ * @param reader Reader to set up
+ * @param from_oldest Start at the oldest item still in the ring (true) or with the next new one (false)
+ */
+void lossy_ring_reader_init(lossy_ring_t* lr, lossy_ring_reader_t* reader, bool from_oldest);
+
+/**
+ * Read the next item for a reader
+ *
+ * @param lr Pointer to lossy ring
+ * @param reader Reader position
+ * @param item Receives item_size bytes
+ * @param missed Receives the items overwritten since the previous read (may be NULL)
+ * @return true if an item was read, false if there is no new complete item yet
+ */
+bool lossy_ring_read(lossy_ring_t* lr, lossy_ring_reader_t* reader, void* item, uint64_t* missed);
+
+/**
+ * Get the number of items a reader has not read yet (including ones already overwritten)
+ *
+ * @param lr Pointer to lossy ring
+ * @param reader Reader position
+ * @return Items behind the tail
+ */
+uint64_t lossy_ring_lag(const lossy_ring_t* lr, const lossy_ring_reader_t* reader);
+
+#endif
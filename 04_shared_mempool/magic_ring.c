@@ -0,0 +1,391 @@
+#define _GNU_SOURCE           // For memfd_create
+#include "magic_ring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Helper function for spinlock, waiting as the ring's wait strategy says
+static void spinlock_acquire(atomic_uint* lock, uint32_t strategy) {
+    if (wait_lock_try(lock)) {
+        return;
+    }
+    
+    uint32_t sleeps;
+    wait_lock_acquire_slow(lock, (wait_strategy_t)strategy, &sleeps);
+}
+
+static void spinlock_release(atomic_uint* lock) {
+    wait_lock_release(lock);
+}
+
+// Bytes of the control page in front of the data
+static size_t header_size(void) {
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+static bool valid_capacity(uint32_t capacity) {
+    size_t page = header_size();
+    return capacity >= page && (capacity & (capacity - 1)) == 0 && capacity % page == 0;
+}
+
+// Map the control page and the data pages of fd, then the data pages again right behind them
+static bool map_ring(magic_ring_t* mr, int fd, uint32_t capacity) {
+    size_t page = header_size();
+    size_t size = page + 2 * (size_t)capacity;
+    
+    // Reserve the address space first so nothing else can land between the two views
+    uint8_t* base = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    
+    if (mmap(base, page + capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+        mmap(base + page + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+             fd, (off_t)page) == MAP_FAILED) {
+        munmap(base, size);
+        return false;
+    }
+    
+    mr->header = (magic_ring_header_t*)base;
+    mr->data = base + page;
+    mr->mapping_size = size;
+    mr->shm_id = fd;
+    return true;
+}
+
+static void init_header(magic_ring_header_t* header, uint32_t capacity) {
+    header->capacity = capacity;
+    header->reserved = 0;
+    header->reading = 0;
+    atomic_store(&header->tail, 0);
+    atomic_store(&header->head, 0);
+    atomic_store(&header->producer_lock, 0);
+    atomic_store(&header->consumer_lock, 0);
+    header->wait_strategy = wait_strategy_default();
+    header->magic = MAGIC_RING_MAGIC;
+}
+
+/**
+ * Get the address space a magic ring occupies (control page plus the data twice)
+ *
+ * @param capacity Data bytes (power of 2, multiple of the page size)
+ * @return Size in bytes, 0 if the capacity is invalid
+ */
+size_t magic_ring_size(uint32_t capacity) {
+    if (!valid_capacity(capacity)) {
+        return 0;
+    }
+    return header_size() + 2 * (size_t)capacity;
+}
+
+/**
+ * Initialize a magic ring in private memory (an anonymous memfd,
+ * still shared with children forked afterwards)
+ *
+ * @param mr Pointer to magic ring structure
+ * @param capacity Data bytes (power of 2, multiple of the page size)
+ * @return true on success, false on failure
+ */
+bool magic_ring_init(magic_ring_t* mr, uint32_t capacity) {
+    if (mr == NULL || !valid_capacity(capacity)) {
+        return false;
+    }
+    
+    int fd = memfd_create("magic_ring", MFD_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    
+    if (ftruncate(fd, (off_t)(header_size() + capacity)) == -1 || !map_ring(mr, fd, capacity)) {
+        close(fd);
+        return false;
+    }
+    
+    mr->shm_name = NULL;
+    init_header(mr->header, capacity);
+    return true;
+}
+
+/**
+ * Initialize a magic ring in shared memory
+ *
+ * @param mr Pointer to magic ring structure
+ * @param shm_name Name for the shared memory segment
+ * @param capacity Data bytes (ignored when attaching, read from the segment)
+ * @param create Whether to create the segment (true) or attach to existing (false)
+ * @param mode Permission mode when creating shared memory
+ * @return true on success, false on failure
+ */
+bool magic_ring_init_shared(magic_ring_t* mr, const char* shm_name, uint32_t capacity,
+                            bool create, mode_t mode) {
+    if (mr == NULL || shm_name == NULL || (create && !valid_capacity(capacity))) {
+        return false;
+    }
+    
+    // A memfd has no name other processes can open, so shared rings use shm_open
+    int flags = O_RDWR;
+    if (create) {
+        flags |= O_CREAT | O_EXCL;
+    }
+    
+    int shm_fd = shm_open(shm_name, flags, mode);
+    if (shm_fd == -1) {
+        return false;
+    }
+    
+    if (create) {
+        if (ftruncate(shm_fd, (off_t)(header_size() + capacity)) == -1) {
+            close(shm_fd);
+            shm_unlink(shm_name);
+            return false;
+        }
+    } else {
+        // The segment size tells the capacity; the header confirms it after mapping
+        struct stat st;
+        if (fstat(shm_fd, &st) == -1 || (size_t)st.st_size <= header_size() ||
+            (size_t)st.st_size - header_size() > UINT32_MAX) {
+            close(shm_fd);
+            return false;
+        }
+        capacity = (uint32_t)((size_t)st.st_size - header_size());
+        if (!valid_capacity(capacity)) {
+            close(shm_fd);
+            return false;
+        }
+    }
+    
+    if (!map_ring(mr, shm_fd, capacity)) {
+        close(shm_fd);
+        if (create) {
+            shm_unlink(shm_name);
+        }
+        return false;
+    }
+    
+    if (create) {
+        init_header(mr->header, capacity);
+    } else if (mr->header->magic != MAGIC_RING_MAGIC || mr->header->capacity != capacity) {
+        munmap(mr->header, mr->mapping_size);
+        close(shm_fd);
+        return false;
+    }
+    
+    mr->shm_name = strdup(shm_name);
+    if (mr->shm_name == NULL) {
+        magic_ring_destroy(mr, false);
+        if (create) {
+            shm_unlink(shm_name);
+        }
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Unmap a magic ring and close its descriptor
+ *
+ * @param mr Pointer to magic ring
+ * @param unlink Whether to unlink the shared memory segment
+ * @return true if successful, false on error
+ */
+bool magic_ring_destroy(magic_ring_t* mr, bool unlink) {
+    if (mr == NULL || mr->header == NULL) {
+        return false;
+    }
+    
+    bool success = true;
+    if (munmap(mr->header, mr->mapping_size) == -1) {
+        success = false;
+    }
+    if (close(mr->shm_id) == -1) {
+        success = false;
+    }
+    if (unlink && mr->shm_name != NULL && shm_unlink(mr->shm_name) == -1) {
+        success = false;
+    }
+    
+    free(mr->shm_name);
+    mr->shm_name = NULL;
+    mr->header = NULL;
+    mr->data = NULL;
+    mr->shm_id = -1;
+    return success;
+}
+
+/**
+ * Choose how threads wait for the ring's locks
+ *
+ * @param mr Pointer to magic ring
+ * @param strategy Wait strategy
+ */
+void magic_ring_set_wait_strategy(magic_ring_t* mr, wait_strategy_t strategy) {
+    if (mr != NULL && mr->header != NULL) {
+        mr->header->wait_strategy = strategy;
+    }
+}
+
+/**
+ * Reserve contiguous space and take the producer lock
+ *
+ * @param mr Pointer to magic ring
+ * @param length Bytes to reserve
+ * @return Pointer to write to, or NULL if fewer than length bytes are free
+ */
+void* magic_ring_reserve(magic_ring_t* mr, uint32_t length) {
+    if (mr == NULL || mr->header == NULL || length == 0 || length > mr->header->capacity) {
+        return NULL;
+    }
+    
+    magic_ring_header_t* header = mr->header;
+    spinlock_acquire(&header->producer_lock, header->wait_strategy);
+    
+    // The consumer must be done with the bytes before we overwrite them
+    uint32_t tail = atomic_load_explicit(&header->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&header->head, memory_order_acquire);
+    if (length > header->capacity - (tail - head)) {
+        spinlock_release(&header->producer_lock);
+        return NULL;
+    }
+    
+    // No wrap check: bytes past the end land in the second view, i.e. at the start
+    header->reserved = length;
+    return mr->data + (tail & (header->capacity - 1));
+}
+
+/**
+ * Publish the reserved bytes and release the producer lock
+ *
+ * @param mr Pointer to magic ring
+ * @param length Bytes actually written (at most the reserved length)
+ * @return true on success, false if length exceeds the reservation
+ */
+bool magic_ring_commit(magic_ring_t* mr, uint32_t length) {
+    if (mr == NULL || mr->header == NULL || mr->header->reserved == 0) {
+        return false;
+    }
+    
+    magic_ring_header_t* header = mr->header;
+    if (length > header->reserved) {
+        return false;  // Still reserved; the caller may commit again or cancel
+    }
+    
+    // Release: the consumer sees the bytes before the new tail
+    uint32_t tail = atomic_load_explicit(&header->tail, memory_order_relaxed);
+    header->reserved = 0;
+    atomic_store_explicit(&header->tail, tail + length, memory_order_release);
+    spinlock_release(&header->producer_lock);
+    return true;
+}
+
+/**
+ * Drop the reservation and release the producer lock
+ *
+ * @param mr Pointer to magic ring
+ */
+void magic_ring_cancel(magic_ring_t* mr) {
+    if (mr == NULL || mr->header == NULL || mr->header->reserved == 0) {
+        return;
+    }
+    
+    mr->header->reserved = 0;
+    spinlock_release(&mr->header->producer_lock);
+}
+
+/**
+ * Get all readable bytes in place and take the consumer lock
+ *
+ * @param mr Pointer to magic ring
+ * @param available Receives the number of contiguous readable bytes
+ * @return Pointer to the oldest byte, or NULL if the ring is empty
+ */
+const void* magic_ring_read(magic_ring_t* mr, uint32_t* available) {
+    if (mr == NULL || mr->header == NULL || available == NULL) {
+        return NULL;
+    }
+    
+    magic_ring_header_t* header = mr->header;
+    spinlock_acquire(&header->consumer_lock, header->wait_strategy);
+    
+    uint32_t head = atomic_load_explicit(&header->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&header->tail, memory_order_acquire);
+    if (head == tail) {
+        spinlock_release(&header->consumer_lock);
+        return NULL;
+    }
+    
+    *available = tail - head;
+    header->reading = *available;
+    return mr->data + (head & (header->capacity - 1));
+}
+
+/**
+ * Free the first length bytes returned by magic_ring_read and release the consumer lock
+ *
+ * @param mr Pointer to magic ring
+ * @param length Bytes consumed (at most the available count, 0 keeps everything)
+ * @return true on success, false if length exceeds what was available (nothing is consumed)
+ */
+bool magic_ring_consume(magic_ring_t* mr, uint32_t length) {
+    if (mr == NULL || mr->header == NULL || mr->header->reading == 0) {
+        return false;
+    }
+    
+    magic_ring_header_t* header = mr->header;
+    bool success = length <= header->reading;
+    if (success) {
+        // Release: producers may overwrite the bytes only after we are done reading
+        uint32_t head = atomic_load_explicit(&header->head, memory_order_relaxed);
+        atomic_store_explicit(&header->head, head + length, memory_order_release);
+    }
+    
+    header->reading = 0;
+    spinlock_release(&header->consumer_lock);
+    return success;
+}
+
+/**
+ * Copy bytes into the ring (all or nothing)
+ *
+ * @param mr Pointer to magic ring
+ * @param data Bytes to write
+ * @param length Number of bytes
+ * @return true if stored, false if fewer than length bytes are free
+ */
+bool magic_ring_write(magic_ring_t* mr, const void* data, uint32_t length) {
+    void* destination = magic_ring_reserve(mr, length);
+    if (destination == NULL) {
+        return false;
+    }
+    
+    memcpy(destination, data, length);
+    return magic_ring_commit(mr, length);
+}
+
+/**
+ * Get the number of readable bytes
+ *
+ * @param mr Pointer to magic ring
+ * @return Bytes in the ring
+ */
+uint32_t magic_ring_used(const magic_ring_t* mr) {
+    if (mr == NULL || mr->header == NULL) {
+        return 0;
+    }
+    return atomic_load(&mr->header->tail) - atomic_load(&mr->header->head);
+}
+
+/**
+ * Get the number of writable bytes
+ *
+ * @param mr Pointer to magic ring
+ * @return Free bytes
+ */
+uint32_t magic_ring_free(const magic_ring_t* mr) {
+    if (mr == NULL || mr->header == NULL) {
+        return 0;
+    }
+    return mr->header->capacity - magic_ring_used(mr);
+}
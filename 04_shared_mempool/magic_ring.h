@@ -0,0 +1,167 @@
+#ifndef MAGIC_RING_H
+#define MAGIC_RING_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>  // For mode_t
+#include <stdatomic.h>
+#include "wait_strategy.h"
+
+#define MAGIC_RING_MAGIC 0x474E524D   // "MRNG"
+
+/**
+ * Control block of a magic ring, stored in the first page of the segment
+ * so processes attaching by name find the capacity and positions
+ */
+typedef struct {
+    uint32_t magic;                         // MAGIC_RING_MAGIC
+    uint32_t capacity;                      // Data bytes (power of 2, multiple of the page size)
+    uint32_t wait_strategy;                 // wait_strategy_t for both locks (shared by every process)
+    _Alignas(64) atomic_uint tail;          // Write position (bytes, wraps at 2^32)
+    atomic_uint producer_lock;              // Held from reserve to commit
+    uint32_t reserved;                      // Bytes of the pending write
+    _Alignas(64) atomic_uint head;          // Read position (bytes, wraps at 2^32)
+    atomic_uint consumer_lock;              // Held from read to consume
+    uint32_t reading;                       // Bytes returned by the pending read
+} magic_ring_header_t;
+
+/**
+ * Double-mapped byte ring ("magic ring")
+ * The data pages are mapped twice back to back, so the byte after the
+ * end of the buffer is the first byte again. Any run of up to capacity
+ * bytes starting anywhere in the buffer is contiguous in memory: writers
+ * and readers get one pointer and never split a copy or a parse at the
+ * wrap. The mapping is process-local; in shared mode every process maps
+ * the segment itself and only positions are shared.
+ */
+typedef struct {
+    magic_ring_header_t* header;            // Control block (first page)
+    uint8_t* data;                          // capacity bytes, followed by the same bytes again
+    size_t mapping_size;                    // Bytes of address space reserved
+    int shm_id;                             // memfd or shm_open descriptor
+    char* shm_name;                         // Shared memory name, NULL in private mode
+} magic_ring_t;
+
+/**
+ * Get the address space a magic ring occupies (control page plus the data twice)
+ *
+ * @param capacity Data bytes (power of 2, multiple of the page size)
+ * @return Size in bytes, 0 if the capacity is invalid
+ */
+size_t magic_ring_size(uint32_t capacity);
+
+/**
+ * Initialize a magic ring in private memory (an anonymous memfd,
+ * still shared with children forked afterwards)
+ *
+ * @param mr Pointer to magic ring structure
+ * @param capacity Data bytes (power of 2, multiple of the page size)
+ * @return true on success, false on failure
+ */
+bool magic_ring_init(magic_ring_t* mr, uint32_t capacity);
+
+/**
+ * Initialize a magic ring in shared memory
+ *
+ * @param mr Pointer to magic ring structure
+ * @param shm_name Name for the shared memory segment
+ * @param capacity Data bytes (ignored when attaching, read from the segment)
+ * @param create Whether to create the segment (true) or attach to existing (false)
+ * @param mode Permission mode when creating shared memory
+ * @return true on success, false on failure
+ */
+bool magic_ring_init_shared(magic_ring_t* mr, const char* shm_name, uint32_t capacity,
+                            bool create, mode_t mode);
+
+/**
+ * Unmap a magic ring and close its descriptor
+ *
+ * @param mr Pointer to magic ring
+ * @param unlink Whether to unlink the shared memory segment
+ * @return true if successful, false on error
+ */
+bool magic_ring_destroy(magic_ring_t* mr, bool unlink);
+
+/**
+ * Choose how threads wait for the ring's locks (a created ring takes the
+ * MEMPOOL_WAIT_STRATEGY default); only while no thread uses the ring
+ *
+ * @param mr Pointer to magic ring
+ * @param strategy Wait strategy
+ */
+void magic_ring_set_wait_strategy(magic_ring_t* mr, wait_strategy_t strategy);
+
+/**
+ * Reserve contiguous space and take the producer lock
+ * On success the caller writes up to length bytes and must call
+ * magic_ring_commit or magic_ring_cancel; other producers wait until then
+ *
+ * @param mr Pointer to magic ring
+ * @param length Bytes to reserve
+ * @return Pointer to write to, or NULL if fewer than length bytes are free
+ */
+void* magic_ring_reserve(magic_ring_t* mr, uint32_t length);
+
+/**
+ * Publish the reserved bytes and release the producer lock
+ *
+ * @param mr Pointer to magic ring
+ * @param length Bytes actually written (at most the reserved length)
+ * @return true on success, false if length exceeds the reservation
+ */
+bool magic_ring_commit(magic_ring_t* mr, uint32_t length);
+
+/**
+ * Drop the reservation and release the producer lock
+ *
+ * @param mr Pointer to magic ring
+ */
+void magic_ring_cancel(magic_ring_t* mr);
+
+/**
+ * Get all readable bytes in place and take the consumer lock
+ * On success the caller must call magic_ring_consume, also when it uses
+ * none of the bytes
+ *
+ * @param mr Pointer to magic ring
+ * @param available Receives the number of contiguous readable bytes
+ * @return Pointer to the oldest byte, or NULL if the ring is empty
+ */
+const void* magic_ring_read(magic_ring_t* mr, uint32_t* available);
+
+/**
+ * Free the first length bytes returned by magic_ring_read and release the consumer lock
+ *
+ * @param mr Pointer to magic ring
+ * @param length Bytes consumed (at most the available count, 0 keeps everything)
+ * @return true on success, false if length exceeds what was available (nothing is consumed)
+ */
+bool magic_ring_consume(magic_ring_t* mr, uint32_t length);
+
+/**
+ * Copy bytes into the ring (all or nothing)
+ *
+ * @param mr Pointer to magic ring
+ * @param data Bytes to write
+ * @param length Number of bytes
+ * @return true if stored, false if fewer than length bytes are free
+ */
+bool magic_ring_write(magic_ring_t* mr, const void* data, uint32_t length);
+
+/**
+ * Get the number of readable bytes
+ *
+ * @param mr Pointer to magic ring
+ * @return Bytes in the ring
+ */
+uint32_t magic_ring_used(const magic_ring_t* mr);
+
+/**
+ * Get the number of writable bytes
+ *
+ * @param mr Pointer to magic ring
+ * @return Free bytes
+ */
+uint32_t magic_ring_free(const magic_ring_t* mr);
+
+#endif
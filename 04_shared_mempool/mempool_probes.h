@@ -0,0 +1,41 @@
+#ifndef MEMPOOL_PROBES_H
+#define MEMPOOL_PROBES_H
+
+/**
+ * USDT (statically defined tracing) probes for perf and bpftrace
+ *
+ * Built with MEMPOOL_USDT (set by CMake when sys/sdt.h is installed), every
+ * probe is a single nop plus an ELF note; a tracer that attaches replaces
+ * the nop with a breakpoint. Without MEMPOOL_USDT the probes compile to
+ * nothing, but their arguments are still type checked.
+ *
+ * List the probes of a binary:  perf list 'sdt_mempool:*' (after perf buildid-cache --add)
+ *                               bpftrace -l 'usdt:./chat_server:*'
+ * Example:                      bpftrace -e 'usdt:./chat_server:mempool:lock_wait { @[arg1] = hist(arg3); }'
+ *
+ * Probes and arguments:
+ *   mempool:alloc           pool, block (NULL if empty), block size
+ *   mempool:free            pool, block, block size, accepted (0/1)
+ *   mempool:ring_put        ring, item, stored (0/1)
+ *   mempool:ring_get        ring, item (NULL if empty)
+ *   mempool:ring_put_batch  ring, items stored
+ *   mempool:ring_drain      ring, items removed
+ *   mempool:lock_wait       lock, trace_lock_t, failed attempts, wait in ns (contended locks only)
+ *   chat:tracker_add        tracker, slot (-1 if full), sequence (0 if full), recipient mask
+ *   chat:tracker_free       tracker, slot, sequence, send time (CLOCK_MONOTONIC ns, compare with nsecs)
+ */
+#ifdef MEMPOOL_USDT
+#include <sys/sdt.h>
+#define MEMPOOL_PROBE(provider, name, ...) STAP_PROBEV(provider, name, __VA_ARGS__)
+#else
+static inline void mempool_probe_unused(int unused, ...) {
+    (void)unused;
+}
+#define MEMPOOL_PROBE(provider, name, ...) do {                 \
+        if (0) {                                                \
+            mempool_probe_unused(0, __VA_ARGS__);               \
+        }                                                       \
+    } while (0)
+#endif
+
+#endif
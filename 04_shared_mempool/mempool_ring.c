@@ -1,10 +1,146 @@
+#define _GNU_SOURCE           // For sched_getcpu
 #include "mempool_ring.h"
+#include "latency_histogram.h"
+#include "event_trace.h"
+#include "mempool_probes.h"
 #include <string.h>
 #include <stdlib.h>
 #include <fcntl.h>           // For O_* constants
 #include <sys/mman.h>         // For shm_open, mmap
 #include <unistd.h>           // For ftruncate
 #include <sys/stat.h>         // For mode constants
+#ifdef MEMPOOL_STATS
+#include <sched.h>            // For sched_getcpu
+#endif
+
+/*
+ * The free ring holds block tokens (block index + 1) rather than raw
+ * pointers, so a pool created by one process stays valid in every other
+ * process that maps the segment at a different address.
+ */
+static inline uint32_t block_index(const mem_pool_t* pool, const void* block) {
+    return ((const uint8_t*)block - (const uint8_t*)pool->pool_start) / pool->block_size;
+}
+
+static inline void* block_to_token(const mem_pool_t* pool, const void* block) {
+    return (void*)(uintptr_t)(block_index(pool, block) + 1);
+}
+
+static inline void* token_to_block(const mem_pool_t* pool, const void* token) {
+    uint32_t index = (uint32_t)(uintptr_t)token - 1;
+    return (uint8_t*)pool->pool_start + ((size_t)index * pool->block_size);
+}
+
+/*
+ * Segment layout: free ring, per-CPU shards (if the pool has them, from
+ * the next cache line), blocks, then (with MEMPOOL_STATS) the statistics
+ * block in the last cache-line-aligned bytes of the memory. The block is
+ * aligned by address, as the caller's memory need not be 64-byte aligned.
+ */
+static inline size_t stats_block_offset(const void* memory, uint32_t memory_size) {
+    if (memory_size < sizeof(mempool_stats_t) + 63) {
+        return 0;  // No room
+    }
+    uintptr_t start = (uintptr_t)memory + memory_size - sizeof(mempool_stats_t);
+    return (start & ~(uintptr_t)63) - (uintptr_t)memory;
+}
+
+// End of the blocks area
+static inline size_t stats_offset(const void* memory, uint32_t memory_size) {
+#ifdef MEMPOOL_STATS
+    return stats_block_offset(memory, memory_size);
+#else
+    (void)memory;
+    return memory_size;
+#endif
+}
+
+static inline size_t shards_offset(size_t rb_size) {
+    return (rb_size + 63) & ~(size_t)63;
+}
+
+static inline size_t blocks_offset(size_t rb_size, uint32_t shard_capacity) {
+    if (shard_capacity == 0) {
+        return rb_size;
+    }
+    return shards_offset(rb_size) + cpu_shards_size(cpu_shards_default_count(), shard_capacity);
+}
+
+// Set up the pool structure for a region laid out as above
+static void pool_layout(mem_pool_t* pool, void* memory, uint32_t memory_size, uint32_t block_size,
+                        uint32_t shard_capacity) {
+    // The ring has room for every block that could fit without any overhead
+    size_t rb_size = ring_buffer_size(memory_size / block_size);
+    size_t offset = blocks_offset(rb_size, shard_capacity);
+    
+    pool->pool_start = (uint8_t*)memory + offset;
+    pool->total_size = memory_size;
+    pool->block_size = block_size;
+    pool->num_blocks = (stats_offset(memory, memory_size) - offset) / block_size;
+    pool->free_blocks = (ring_buffer_t*)memory;
+    pool->cpu_shards = shard_capacity != 0 ? (cpu_shards_t*)((uint8_t*)memory + shards_offset(rb_size)) : NULL;
+    pool->stats = NULL;
+#ifdef MEMPOOL_STATS
+    pool->stats = (mempool_stats_t*)((uint8_t*)memory + stats_offset(memory, memory_size));
+#endif
+}
+
+// Check that a segment's creator agreed with this build on MEMPOOL_STATS:
+// a statistics block describing this pool is there exactly when we expect one
+// (otherwise one side would take the other's statistics block for blocks)
+static bool stats_layout_matches(void* memory, uint32_t memory_size, uint32_t block_size, uint32_t shard_capacity) {
+    size_t offset = blocks_offset(ring_buffer_size(memory_size / block_size), shard_capacity);
+    bool present = false;
+    if (memory_size >= offset + sizeof(mempool_stats_t)) {
+        const mempool_stats_t* stats =
+            (const mempool_stats_t*)((uint8_t*)memory + stats_block_offset(memory, memory_size));
+        present = stats->magic == MEMPOOL_STATS_MAGIC && stats->block_size == block_size &&
+                  stats->blocks_offset == offset;
+    }
+#ifdef MEMPOOL_STATS
+    return present;
+#else
+    return !present;
+#endif
+}
+
+// Free blocks in the reserve and the shards
+static inline uint32_t free_blocks_count(const mem_pool_t* pool) {
+    uint32_t count = ring_buffer_count(pool->free_blocks);
+    if (pool->cpu_shards != NULL) {
+        count += cpu_shards_count(pool->cpu_shards);
+    }
+    return count;
+}
+
+#ifdef MEMPOOL_STATS
+// Counter shard of the CPU we are running on
+static inline mempool_stats_shard_t* stats_shard(const mem_pool_t* pool) {
+    int cpu = sched_getcpu();
+    return &pool->stats->shards[(cpu < 0 ? 0 : cpu) & (MEMPOOL_STATS_SHARDS - 1)];
+}
+
+// Move the lock contention counted by the free ring into our shard
+static inline void stats_collect_locks(mempool_stats_shard_t* shard) {
+    uint64_t spins, backoffs;
+    ring_buffer_take_lock_stats(&spins, &backoffs);
+    if (spins != 0) {
+        atomic_fetch_add_explicit(&shard->lock_spins, spins, memory_order_relaxed);
+        atomic_fetch_add_explicit(&shard->lock_backoffs, backoffs, memory_order_relaxed);
+    }
+}
+
+// Raise the high-water mark (the shared line is only written when it rises);
+// blocks cached by the CPUs count as used, summing the shards would read every CPU's lines
+static inline void stats_update_peak(const mem_pool_t* pool) {
+    uint32_t used = pool->num_blocks - ring_buffer_count(pool->free_blocks);
+    uint32_t peak = atomic_load_explicit(&pool->stats->peak_used, memory_order_relaxed);
+    while (used > peak &&
+           !atomic_compare_exchange_weak_explicit(&pool->stats->peak_used, &peak, used,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+#endif
 
 /**
  * Initialize a memory pool
@@ -16,60 +152,69 @@
  * @return true on success, false on failure
  */
 bool memory_pool_init(mem_pool_t* pool, void* memory, uint32_t memory_size, uint32_t block_size) {
+    return memory_pool_init_percpu(pool, memory, memory_size, block_size, 0);
+}
+
+/**
+ * Initialize a memory pool with per-CPU free lists
+ * 
+ * @param pool Pointer to memory pool structure
+ * @param memory Pointer to memory region to use (64-byte aligned)
+ * @param memory_size Size of memory region in bytes
+ * @param block_size Size of each block in bytes
+ * @param shard_capacity Blocks each CPU may cache (0 for none)
+ * @return true on success, false on failure
+ */
+bool memory_pool_init_percpu(mem_pool_t* pool, void* memory, uint32_t memory_size, uint32_t block_size,
+                             uint32_t shard_capacity) {
     if (pool == NULL || memory == NULL) {
         return false;
     }
     
     // Ensure block size is reasonable
-    if (block_size < sizeof(void*) || memory_size < block_size) {
+    if (block_size < sizeof(void*) || memory_size < block_size || shard_capacity > CPU_SHARDS_MAX_CAPACITY) {
         return false;
     }
     
-    // Calculate how many blocks we can fit
-    uint32_t potential_blocks = (memory_size / block_size);
-    
-    // Reserve space for the ring buffer structure with flexible array
-    size_t rb_size = ring_buffer_size(potential_blocks);
+    // Reserve space for the ring buffer structure with flexible array (one slot
+    // per potential block) and the shards
+    size_t rb_size = ring_buffer_size(memory_size / block_size);
     
     // Check if we have enough memory after overhead
-    if (memory_size <= rb_size + block_size) {
+    if (stats_offset(memory, memory_size) < blocks_offset(rb_size, shard_capacity) + block_size) {
         return false;  // Not enough memory for even one block
     }
     
-    // Recalculate how many blocks we can actually fit
-    uint32_t actual_blocks = (memory_size - rb_size) / block_size;
-    
-    // Set up memory layout
-    uint8_t* mem_ptr = (uint8_t*)memory;
-    
-    // 1. Ring buffer structure at the beginning (including the flexible array)
-    ring_buffer_t* rb = (ring_buffer_t*)mem_ptr;
-    rb->buffer[0] = (uint8_t *)mem_ptr + sizeof(ring_buffer_t) - sizeof(void *) ;
-
-    
-    mem_ptr += rb_size;
-    
-    // 2. Actual memory blocks start here
-    void* blocks_start = mem_ptr;
-    
-    // Initialize the pool structure
-    pool->pool_start = blocks_start;
-    pool->total_size = memory_size;
-    pool->block_size = block_size;
-    pool->num_blocks = actual_blocks;
-    pool->free_blocks = rb;
+    // Initialize the pool structure: ring buffer at the beginning, then the
+    // shards, then the actual memory blocks
+    pool_layout(pool, memory, memory_size, block_size, shard_capacity);
     pool->shm_id = -1;        // Not using shared memory
     pool->shm_name = NULL;    // No shared memory name
+
+#ifdef MEMPOOL_STATS
+    // Set up the statistics block
+    memset(pool->stats, 0, sizeof(mempool_stats_t));
+    pool->stats->block_size = block_size;
+    pool->stats->num_blocks = pool->num_blocks;
+    pool->stats->blocks_offset = (uint32_t)((uint8_t*)pool->pool_start - (uint8_t*)memory);
+    pool->stats->magic = MEMPOOL_STATS_MAGIC;
+#endif
     
     // Initialize the ring buffer
-    if (!ring_buffer_init(rb, actual_blocks)) {
+    ring_buffer_t* rb = pool->free_blocks;
+    if (!ring_buffer_init(rb, memory_size / block_size)) {
+        return false;
+    }
+    
+    // Start with empty shards, every block is in the reserve
+    if (pool->cpu_shards != NULL && !cpu_shards_init(pool->cpu_shards, cpu_shards_default_count(), shard_capacity)) {
         return false;
     }
     
     // Add all blocks to the ring buffer
-    for (uint32_t i = 0; i < actual_blocks; i++) {
-        void* block = (uint8_t*)blocks_start + (i * block_size);
-        ring_buffer_put(rb, block);
+    for (uint32_t i = 0; i < pool->num_blocks; i++) {
+        void* block = (uint8_t*)pool->pool_start + (i * block_size);
+        ring_buffer_put_untimed(rb, block_to_token(pool, block));
     }
     
     return true;
@@ -88,12 +233,29 @@ bool memory_pool_init(mem_pool_t* pool, void* memory, uint32_t memory_size, uint
  */
 bool memory_pool_init_shared(mem_pool_t* pool, const char* shm_name, uint32_t memory_size, 
                            uint32_t block_size, bool create, mode_t mode) {
+    return memory_pool_init_shared_percpu(pool, shm_name, memory_size, block_size, 0, create, mode);
+}
+
+/**
+ * Initialize a memory pool with per-CPU free lists in shared memory
+ * 
+ * @param pool Pointer to memory pool structure
+ * @param shm_name Name for the shared memory segment
+ * @param memory_size Size of memory region in bytes
+ * @param block_size Size of each block in bytes
+ * @param shard_capacity Blocks each CPU may cache (0 for none)
+ * @param create Whether to create the segment (true) or attach to existing (false)
+ * @param mode Permission mode when creating shared memory
+ * @return true on success, false on failure
+ */
+bool memory_pool_init_shared_percpu(mem_pool_t* pool, const char* shm_name, uint32_t memory_size,
+                                    uint32_t block_size, uint32_t shard_capacity, bool create, mode_t mode) {
     if (pool == NULL || shm_name == NULL) {
         return false;
     }
     
     // Ensure block size is reasonable
-    if (block_size < sizeof(void*) || memory_size < block_size) {
+    if (block_size < sizeof(void*) || memory_size < block_size || shard_capacity > CPU_SHARDS_MAX_CAPACITY) {
         return false;
     }
     
@@ -142,36 +304,33 @@ bool memory_pool_init_shared(mem_pool_t* pool, const char* shm_name, uint32_t me
     
     // If creating, initialize the memory pool
     if (create) {
-        if (!memory_pool_init(pool, memory, memory_size, block_size)) {
+        // memory_pool_init marks the pool as private; keep the segment so
+        // memory_pool_destroy unmaps and unlinks it
+        char* shm_name_copy = pool->shm_name;
+        if (!memory_pool_init_percpu(pool, memory, memory_size, block_size, shard_capacity)) {
             munmap(memory, memory_size);
             close(shm_fd);
             shm_unlink(shm_name);
-            free(pool->shm_name);
+            free(shm_name_copy);
             pool->shm_name = NULL;
             return false;
         }
+        pool->shm_id = shm_fd;
+        pool->shm_name = shm_name_copy;
     } else {
-        // If attaching, just set up the pointers
-        
-        // Calculate how many blocks we can fit with the flexible array
-        uint32_t potential_blocks = (memory_size / block_size);
-        size_t rb_size = ring_buffer_size(potential_blocks);
-        uint32_t actual_blocks = (memory_size - rb_size) / block_size;
+        // If attaching, just set up the pointers (same layout as the creator's)
+        pool_layout(pool, memory, memory_size, block_size, shard_capacity);
         
-        uint8_t* mem_ptr = (uint8_t*)memory;
-        
-        // Get pointers from shared memory
-        ring_buffer_t* rb = (ring_buffer_t*)mem_ptr;
-        mem_ptr += rb_size;
-        
-        void* blocks_start = mem_ptr;
-        
-        // Set up pool structure
-        pool->pool_start = blocks_start;
-        pool->total_size = memory_size;
-        pool->block_size = block_size;
-        pool->num_blocks = actual_blocks;
-        pool->free_blocks = rb;
+        // The creator must have made the same shards and statistics block
+        if (!stats_layout_matches(memory, memory_size, block_size, shard_capacity) ||
+            (pool->cpu_shards != NULL &&
+             !cpu_shards_check(pool->cpu_shards, cpu_shards_default_count(), shard_capacity))) {
+            munmap(memory, memory_size);
+            close(shm_fd);
+            free(pool->shm_name);
+            pool->shm_name = NULL;
+            return false;
+        }
     }
     
     // Close the file descriptor (the mapping remains valid)
@@ -181,18 +340,176 @@ bool memory_pool_init_shared(mem_pool_t* pool, const char* shm_name, uint32_t me
 }
 
 /**
- * Allocate a memory block from the pool
+ * Get the memory per-CPU free lists take from the pool memory
  * 
- * @param pool Pointer to memory pool
- * @return Pointer to allocated block, or NULL if none available
+ * @param shard_capacity Blocks each CPU may cache
+ * @return Bytes to add to memory_size to keep the same number of blocks
  */
-void* memory_pool_alloc(mem_pool_t* pool) {
+size_t memory_pool_percpu_size(uint32_t shard_capacity) {
+    // Shards plus the padding that moves them to a cache line boundary
+    return shard_capacity == 0 ? 0 : cpu_shards_size(cpu_shards_default_count(), shard_capacity) + 63;
+}
+
+// Blocks moved between a CPU's shard and the reserve at once: half a shard,
+// so a CPU allocating and freeing around either limit does not move blocks every time
+static inline uint32_t shard_batch(const mem_pool_t* pool) {
+    uint32_t batch = pool->cpu_shards->capacity / 2;
+    return batch > 0 ? batch : 1;
+}
+
+// The reserve and our shard are empty: take the blocks other CPUs cache
+// (a batch from the first shard that has any) rather than fail while the
+// pool still has free blocks; the ones we do not return go to the reserve
+static void* shard_steal(mem_pool_t* pool) {
+    uint32_t stolen[CPU_SHARDS_MAX_CAPACITY / 2 + 1];
+    for (uint32_t cpu = 0; cpu < pool->cpu_shards->num_shards; cpu++) {
+        if (cpu_shards_count_at(pool->cpu_shards, cpu) == 0) {
+            continue;
+        }
+        
+        uint32_t taken = cpu_shards_steal(pool->cpu_shards, cpu, stolen, shard_batch(pool) + 1);
+        if (taken == 0) {
+            continue;
+        }
+        
+        void* batch[CPU_SHARDS_MAX_CAPACITY / 2];
+        for (uint32_t i = 1; i < taken; i++) {
+            batch[i - 1] = (void*)(uintptr_t)stolen[i];
+        }
+        if (taken > 1) {
+            ring_buffer_put_batch(pool->free_blocks, batch, taken - 1);
+        }
+        return (void*)(uintptr_t)stolen[0];
+    }
+    
+    return NULL;
+}
+
+// Take a block token from our CPU's shard, refilling the shard from the reserve when it is empty
+static void* shard_alloc(mem_pool_t* pool, bool* from_reserve) {
+    uint32_t token;
+    cpu_shard_result_t result = cpu_shards_pop(pool->cpu_shards, &token);
+    *from_reserve = result != CPU_SHARD_OK;
+    if (result == CPU_SHARD_OK) {
+        return (void*)(uintptr_t)token;
+    }
+    if (result == CPU_SHARD_NONE) {
+        // No shard for us, use the reserve directly
+        void* block = ring_buffer_get_untimed(pool->free_blocks);
+        return block != NULL ? block : shard_steal(pool);
+    }
+    
+    // One reserve lock acquisition for the block we return and a batch for the shard;
+    // whatever does not fit (we may have moved to another CPU) goes back
+    void* batch[CPU_SHARDS_MAX_CAPACITY / 2 + 1];
+    uint32_t taken = ring_buffer_drain(pool->free_blocks, batch, shard_batch(pool) + 1);
+    uint32_t cached = 1;
+    while (cached < taken &&
+           cpu_shards_push(pool->cpu_shards, (uint32_t)(uintptr_t)batch[cached]) == CPU_SHARD_OK) {
+        cached++;
+    }
+    if (cached < taken) {
+        ring_buffer_put_batch(pool->free_blocks, batch + cached, taken - cached);
+    }
+    
+    return taken > 0 ? batch[0] : shard_steal(pool);
+}
+
+// Put a block token on our CPU's shard, moving half of the shard to the reserve when it is full
+static bool shard_free(mem_pool_t* pool, void* token) {
+    cpu_shard_result_t result = cpu_shards_push(pool->cpu_shards, (uint32_t)(uintptr_t)token);
+    if (result == CPU_SHARD_OK) {
+        return true;
+    }
+    if (result == CPU_SHARD_NONE) {
+        return ring_buffer_put_untimed(pool->free_blocks, token);
+    }
+    
+    // The block and the older half of the shard go back in one reserve lock acquisition
+    void* batch[CPU_SHARDS_MAX_CAPACITY / 2 + 1];
+    uint32_t count = 0;
+    batch[count++] = token;
+    uint32_t cached;
+    while (count <= shard_batch(pool) && cpu_shards_pop(pool->cpu_shards, &cached) == CPU_SHARD_OK) {
+        batch[count++] = (void*)(uintptr_t)cached;
+    }
+    
+    return ring_buffer_put_batch(pool->free_blocks, batch, count) == count;
+}
+
+// Take a block from our CPU's shard or the free ring
+static void* pool_alloc(mem_pool_t* pool) {
     if (pool == NULL || pool->free_blocks == NULL) {
         return NULL;
     }
     
-    // Get a block from the ring buffer
-    return ring_buffer_get(pool->free_blocks);
+    // Get a block from our CPU's shard or the ring buffer
+    bool from_reserve = true;
+    void* token = pool->cpu_shards != NULL ? shard_alloc(pool, &from_reserve)
+                                           : ring_buffer_get_untimed(pool->free_blocks);
+
+#ifdef MEMPOOL_STATS
+    mempool_stats_shard_t* shard = stats_shard(pool);
+    stats_collect_locks(shard);
+    if (token == NULL) {
+        atomic_fetch_add_explicit(&shard->alloc_failures, 1, memory_order_relaxed);
+        return NULL;
+    }
+    atomic_fetch_add_explicit(&shard->allocs, 1, memory_order_relaxed);
+    if (from_reserve) {
+        stats_update_peak(pool);  // Only the reserve's count can have changed
+    }
+#else
+    (void)from_reserve;
+#endif
+    
+    if (token == NULL) {
+        return NULL;
+    }
+    
+    return token_to_block(pool, token);
+}
+
+// Validate a block and put it back on our CPU's shard or the free ring
+static bool pool_free(mem_pool_t* pool, void* block) {
+    if (pool == NULL || pool->free_blocks == NULL || block == NULL) {
+        return false;
+    }
+    
+    // Validate block is within our pool and aligned
+    bool valid = block >= pool->pool_start && 
+                 block < (void*)((uint8_t*)pool->pool_start + (pool->num_blocks * pool->block_size)) &&
+                 ((uint8_t*)block - (uint8_t*)pool->pool_start) % pool->block_size == 0;
+    
+    // Add block back to our CPU's shard or the ring buffer
+    bool success = false;
+    if (valid) {
+        void* token = block_to_token(pool, block);
+        success = pool->cpu_shards != NULL ? shard_free(pool, token)
+                                           : ring_buffer_put_untimed(pool->free_blocks, token);
+    }
+
+#ifdef MEMPOOL_STATS
+    mempool_stats_shard_t* shard = stats_shard(pool);
+    stats_collect_locks(shard);
+    atomic_fetch_add_explicit(success ? &shard->frees : &shard->free_failures, 1, memory_order_relaxed);
+#endif
+    
+    return success;
+}
+
+/**
+ * Allocate a memory block from the pool
+ * 
+ * @param pool Pointer to memory pool
+ * @return Pointer to allocated block, or NULL if none available
+ */
+void* memory_pool_alloc(mem_pool_t* pool) {
+    void* block;
+    LATENCY_TIMED(LATENCY_POOL_ALLOC, block, pool_alloc(pool));
+    EVENT_TRACE(TRACE_POOL_ALLOC, block != NULL ? block_index(pool, block) : EVENT_TRACE_NO_INDEX, 0);
+    MEMPOOL_PROBE(mempool, alloc, pool, block, pool != NULL ? pool->block_size : 0);
+    return block;
 }
 
 /**
@@ -203,24 +520,11 @@ void* memory_pool_alloc(mem_pool_t* pool) {
  * @return true if successful, false on error
  */
 bool memory_pool_free(mem_pool_t* pool, void* block) {
-    if (pool == NULL || pool->free_blocks == NULL || block == NULL) {
-        return false;
-    }
-    
-    // Validate block is within our pool
-    if (block < pool->pool_start || 
-        block >= (void*)((uint8_t*)pool->pool_start + (pool->num_blocks * pool->block_size))) {
-        return false;
-    }
-    
-    // Validate block alignment
-    uint32_t offset = (uint8_t*)block - (uint8_t*)pool->pool_start;
-    if (offset % pool->block_size != 0) {
-        return false;
-    }
-    
-    // Add block back to the ring buffer
-    return ring_buffer_put(pool->free_blocks, block);
+    bool success;
+    LATENCY_TIMED(LATENCY_POOL_FREE, success, pool_free(pool, block));
+    EVENT_TRACE(TRACE_POOL_FREE, success ? block_index(pool, block) : EVENT_TRACE_NO_INDEX, success);
+    MEMPOOL_PROBE(mempool, free, pool, block, pool != NULL ? pool->block_size : 0, success);
+    return success;
 }
 
 /**
@@ -234,7 +538,7 @@ uint32_t memory_pool_free_count(mem_pool_t* pool) {
         return 0;
     }
     
-    return ring_buffer_count(pool->free_blocks);
+    return free_blocks_count(pool);
 }
 
 /**
@@ -251,6 +555,19 @@ uint32_t memory_pool_used_count(mem_pool_t* pool) {
     return pool->num_blocks - memory_pool_free_count(pool);
 }
 
+/**
+ * Choose how threads wait for the pool's free-list locks
+ * 
+ * @param pool Pointer to memory pool
+ * @param strategy Wait strategy
+ */
+void memory_pool_set_wait_strategy(mem_pool_t* pool, wait_strategy_t strategy) {
+    if (pool != NULL) {
+        ring_buffer_set_wait_strategy(pool->free_blocks, strategy);
+        cpu_shards_set_wait_strategy(pool->cpu_shards, strategy);
+    }
+}
+
 /**
  * Reset memory pool to initial state
  * 
@@ -262,13 +579,16 @@ bool memory_pool_reset(mem_pool_t* pool) {
         return false;
     }
     
-    // Reset the ring buffer
+    // Reset the ring buffer and empty the shards
     ring_buffer_reset(pool->free_blocks);
+    if (pool->cpu_shards != NULL) {
+        cpu_shards_reset(pool->cpu_shards);
+    }
     
     // Add all blocks back to the ring buffer
     for (uint32_t i = 0; i < pool->num_blocks; i++) {
         void* block = (uint8_t*)pool->pool_start + (i * pool->block_size);
-        if (!ring_buffer_put(pool->free_blocks, block)) {
+        if (!ring_buffer_put_untimed(pool->free_blocks, block_to_token(pool, block))) {
             return false;  // Ring buffer is full (shouldn't happen)
         }
     }
@@ -276,6 +596,44 @@ bool memory_pool_reset(mem_pool_t* pool) {
     return true;
 }
 
+/**
+ * Sum the counters of a statistics block
+ * 
+ * @param stats Pointer to statistics block
+ * @param snapshot Receives the summed counters (used is left at 0)
+ */
+void memory_pool_sum_stats(const mempool_stats_t* stats, mempool_stats_snapshot_t* snapshot) {
+    memset(snapshot, 0, sizeof(mempool_stats_snapshot_t));
+    
+    for (int i = 0; i < MEMPOOL_STATS_SHARDS; i++) {
+        const mempool_stats_shard_t* shard = &stats->shards[i];
+        snapshot->allocs += atomic_load_explicit(&shard->allocs, memory_order_relaxed);
+        snapshot->frees += atomic_load_explicit(&shard->frees, memory_order_relaxed);
+        snapshot->alloc_failures += atomic_load_explicit(&shard->alloc_failures, memory_order_relaxed);
+        snapshot->free_failures += atomic_load_explicit(&shard->free_failures, memory_order_relaxed);
+        snapshot->lock_spins += atomic_load_explicit(&shard->lock_spins, memory_order_relaxed);
+        snapshot->lock_backoffs += atomic_load_explicit(&shard->lock_backoffs, memory_order_relaxed);
+    }
+    snapshot->peak_used = atomic_load_explicit(&stats->peak_used, memory_order_relaxed);
+}
+
+/**
+ * Read the pool statistics without stopping allocations
+ * 
+ * @param pool Pointer to memory pool
+ * @param snapshot Receives the summed counters
+ * @return true on success, false if the pool has no statistics block
+ */
+bool memory_pool_get_stats(const mem_pool_t* pool, mempool_stats_snapshot_t* snapshot) {
+    if (pool == NULL || snapshot == NULL || pool->stats == NULL) {
+        return false;
+    }
+    
+    memory_pool_sum_stats(pool->stats, snapshot);
+    snapshot->used = pool->num_blocks - free_blocks_count(pool);
+    return true;
+}
+
 /**
  * Destroy memory pool and release resources
  * 
@@ -310,6 +668,8 @@ bool memory_pool_destroy(mem_pool_t* pool, bool unlink) {
     // Reset the pool structure
     pool->pool_start = NULL;
     pool->free_blocks = NULL;
+    pool->cpu_shards = NULL;
+    pool->stats = NULL;
     pool->shm_id = -1;
     
     return success;
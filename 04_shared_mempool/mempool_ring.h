@@ -4,7 +4,63 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <sys/types.h>  // For mode_t
+#include <stdatomic.h>
 #include "ring_buffer.h"
+#include "cpu_shards.h"
+
+#define MEMPOOL_STATS_MAGIC 0x54534C50   // "PLST"
+#define MEMPOOL_STATS_SHARDS 16           // Counter shards, selected by CPU (power of 2)
+
+/**
+ * Statistics counters of one shard, one cache line each so CPUs
+ * updating their own shard never share a line
+ */
+typedef struct {
+    _Alignas(64) atomic_ullong allocs;        // Successful allocations
+    atomic_ullong frees;                      // Successful frees
+    atomic_ullong alloc_failures;             // Allocations from an empty pool
+    atomic_ullong free_failures;              // Frees of invalid blocks
+    atomic_ullong lock_spins;                 // Failed spinlock acquisition attempts
+    atomic_ullong lock_backoffs;              // nanosleep calls while waiting for a lock
+} mempool_stats_shard_t;
+
+/**
+ * Statistics block, stored at the end of the pool memory when the library
+ * is built with MEMPOOL_STATS. The header also describes the pool layout,
+ * so external readers can interpret a segment without further information.
+ */
+typedef struct {
+    _Alignas(64) uint32_t magic;              // MEMPOOL_STATS_MAGIC
+    uint32_t block_size;                      // Size of each block in bytes
+    uint32_t num_blocks;                      // Total number of blocks in the pool
+    uint32_t blocks_offset;                   // Offset of the first block from the segment start
+    atomic_uint peak_used;                    // High-water mark of allocated blocks (per-CPU pools: of
+                                              // blocks out of the reserve, cached ones included)
+    mempool_stats_shard_t shards[MEMPOOL_STATS_SHARDS];
+} mempool_stats_t;
+
+/**
+ * Bytes reserved at the end of the pool memory for the statistics block
+ */
+#ifdef MEMPOOL_STATS
+#define MEMPOOL_STATS_RESERVED sizeof(mempool_stats_t)
+#else
+#define MEMPOOL_STATS_RESERVED 0
+#endif
+
+/**
+ * Summed statistics of a pool
+ */
+typedef struct {
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t alloc_failures;
+    uint64_t free_failures;
+    uint64_t lock_spins;
+    uint64_t lock_backoffs;
+    uint32_t used;                            // Blocks currently allocated
+    uint32_t peak_used;                       // High-water mark of allocated blocks
+} mempool_stats_snapshot_t;
 
 /**
  * Memory Pool Structure
@@ -14,9 +70,11 @@ typedef struct {
     uint64_t total_size;      // Total size of the memory pool
     uint32_t block_size;      // Size of each block in bytes
     uint32_t num_blocks;      // Total number of blocks in the pool
-    ring_buffer_t* free_blocks; // Ring buffer to track free blocks
+    ring_buffer_t* free_blocks; // Ring buffer to track free blocks (the reserve in per-CPU pools)
+    cpu_shards_t* cpu_shards; // Per-CPU free lists in front of free_blocks, NULL if the pool has none
     int shm_id;               // Shared memory ID when using shared memory
     char* shm_name;           // Shared memory name
+    mempool_stats_t* stats;   // Statistics block, NULL when built without MEMPOOL_STATS
 } mem_pool_t;
 
 /**
@@ -32,6 +90,7 @@ bool memory_pool_init(mem_pool_t* pool, void* memory, uint32_t memory_size, uint
 
 /**
  * Initialize a memory pool in shared memory
+ * Attaching fails when the creator was built with a different MEMPOOL_STATS setting
  * 
  * @param pool Pointer to memory pool structure
  * @param shm_name Name for the shared memory segment
@@ -44,6 +103,47 @@ bool memory_pool_init(mem_pool_t* pool, void* memory, uint32_t memory_size, uint
 bool memory_pool_init_shared(mem_pool_t* pool, const char* shm_name, uint32_t memory_size, 
                            uint32_t block_size, bool create, mode_t mode);
 
+/**
+ * Initialize a memory pool in private memory with per-CPU free lists
+ * Each CPU allocates from and frees to its own shard of up to shard_capacity
+ * blocks; half a shard moves to or from the shared free ring (the reserve)
+ * when a shard runs dry or overflows. When the reserve is empty too, an
+ * allocation takes blocks cached by other CPUs (slowly) before it fails.
+ * 
+ * @param pool Pointer to memory pool structure
+ * @param memory Pointer to memory region to use (64-byte aligned)
+ * @param memory_size Size of memory region in bytes, memory_pool_percpu_size more than without shards
+ * @param block_size Size of each block in bytes
+ * @param shard_capacity Blocks each CPU may cache (at most CPU_SHARDS_MAX_CAPACITY, 0 for none)
+ * @return true on success, false on failure
+ */
+bool memory_pool_init_percpu(mem_pool_t* pool, void* memory, uint32_t memory_size, uint32_t block_size,
+                             uint32_t shard_capacity);
+
+/**
+ * Initialize a memory pool with per-CPU free lists in shared memory
+ * Every process must pass the same shard_capacity and be built with the same MEMPOOL_STATS setting
+ * 
+ * @param pool Pointer to memory pool structure
+ * @param shm_name Name for the shared memory segment
+ * @param memory_size Size of memory region in bytes
+ * @param block_size Size of each block in bytes
+ * @param shard_capacity Blocks each CPU may cache (at most CPU_SHARDS_MAX_CAPACITY, 0 for none)
+ * @param create Whether to create the segment (true) or attach to existing (false)
+ * @param mode Permission mode when creating shared memory
+ * @return true on success, false on failure
+ */
+bool memory_pool_init_shared_percpu(mem_pool_t* pool, const char* shm_name, uint32_t memory_size,
+                                    uint32_t block_size, uint32_t shard_capacity, bool create, mode_t mode);
+
+/**
+ * Get the memory per-CPU free lists take from the pool memory
+ * 
+ * @param shard_capacity Blocks each CPU may cache
+ * @return Bytes to add to memory_size to keep the same number of blocks
+ */
+size_t memory_pool_percpu_size(uint32_t shard_capacity);
+
 /**
  * Allocate a memory block from the pool
  * 
@@ -65,7 +165,7 @@ bool memory_pool_free(mem_pool_t* pool, void* block);
  * Get number of free blocks in the pool
  * 
  * @param pool Pointer to memory pool
- * @return Number of free blocks
+ * @return Number of free blocks (per-CPU pools: including the ones cached by the CPUs)
  */
 uint32_t memory_pool_free_count(mem_pool_t* pool);
 
@@ -77,6 +177,15 @@ uint32_t memory_pool_free_count(mem_pool_t* pool);
  */
 uint32_t memory_pool_used_count(mem_pool_t* pool);
 
+/**
+ * Choose how threads wait for the pool's free-list locks (pools take the
+ * MEMPOOL_WAIT_STRATEGY default at init); only while nobody uses the pool
+ * 
+ * @param pool Pointer to memory pool
+ * @param strategy Wait strategy
+ */
+void memory_pool_set_wait_strategy(mem_pool_t* pool, wait_strategy_t strategy);
+
 /**
  * Reset memory pool to initial state
  * 
@@ -85,6 +194,25 @@ uint32_t memory_pool_used_count(mem_pool_t* pool);
  */
 bool memory_pool_reset(mem_pool_t* pool);
 
+/**
+ * Read the pool statistics without stopping allocations
+ * Counters from different shards are read one after another, so the
+ * snapshot is only approximately consistent under load
+ * 
+ * @param pool Pointer to memory pool
+ * @param snapshot Receives the summed counters
+ * @return true on success, false if the pool has no statistics block
+ */
+bool memory_pool_get_stats(const mem_pool_t* pool, mempool_stats_snapshot_t* snapshot);
+
+/**
+ * Sum the counters of a statistics block (for readers that mapped a segment themselves)
+ * 
+ * @param stats Pointer to statistics block
+ * @param snapshot Receives the summed counters (used is left at 0)
+ */
+void memory_pool_sum_stats(const mempool_stats_t* stats, mempool_stats_snapshot_t* snapshot);
+
 /**
  * Destroy memory pool and release resources
  * 
@@ -1,4 +1,5 @@
 // mempool_test.c
+#define _GNU_SOURCE  // For sched_setaffinity and sched_getcpu
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,8 +7,20 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <stdatomic.h>
 #include "ring_buffer.h"
 #include "mempool_ring.h"
+#include "latency_histogram.h"
+#include "event_trace.h"
+#include "byte_ring.h"
+#include "magic_ring.h"
+#include "priority_ring.h"
+#include "wait_strategy.h"
+#include "lossy_ring.h"
+#include "cpu_shards.h"
 
 #define NUM_THREADS 4
 #define OPERATIONS_PER_THREAD 1000
@@ -15,6 +28,9 @@
 #define SHM_SIZE (1024 * 1024)  // 1MB
 #define BLOCK_SIZE 32
 
+// Items consumed across all consumer threads in the MPMC test
+static atomic_int total_consumed = 0;
+
 // Struct for thread worker function arguments
 typedef struct {
     ring_buffer_t* rb;
@@ -28,9 +44,19 @@ void* consumer_thread(void* arg);
 
 // Test function prototypes
 void test_ring_buffer(void);
+void test_ring_buffer_batch(void);
 void test_memory_pool(void);
 void test_mpmc_ring_buffer(void);
 void test_shared_memory_pool(void);
+void test_pool_stats(void);
+void test_latency_histogram(void);
+void test_event_trace(void);
+void test_byte_ring(void);
+void test_magic_ring(void);
+void test_priority_ring(void);
+void test_wait_strategies(void);
+void test_lossy_ring(void);
+void test_percpu_pool(void);
 
 int main(void) {
     printf("===== RING BUFFER AND MEMORY POOL TESTS =====\n\n");
@@ -39,6 +65,10 @@ int main(void) {
     test_ring_buffer();
     printf("Basic ring buffer tests passed!\n\n");
     
+    printf("Testing ring buffer peek, iteration and drain...\n");
+    test_ring_buffer_batch();
+    printf("Ring buffer peek, iteration and drain tests passed!\n\n");
+    
     printf("Testing memory pool...\n");
     test_memory_pool();
     printf("Memory pool tests passed!\n\n");
@@ -51,6 +81,42 @@ int main(void) {
     test_shared_memory_pool();
     printf("Shared memory pool tests passed!\n\n");
     
+    printf("Testing pool statistics...\n");
+    test_pool_stats();
+    printf("Pool statistics tests passed!\n\n");
+    
+    printf("Testing latency histograms...\n");
+    test_latency_histogram();
+    printf("Latency histogram tests passed!\n\n");
+    
+    printf("Testing event trace...\n");
+    test_event_trace();
+    printf("Event trace tests passed!\n\n");
+    
+    printf("Testing byte ring...\n");
+    test_byte_ring();
+    printf("Byte ring tests passed!\n\n");
+    
+    printf("Testing magic ring...\n");
+    test_magic_ring();
+    printf("Magic ring tests passed!\n\n");
+    
+    printf("Testing priority ring...\n");
+    test_priority_ring();
+    printf("Priority ring tests passed!\n\n");
+    
+    printf("Testing wait strategies...\n");
+    test_wait_strategies();
+    printf("Wait strategy tests passed!\n\n");
+    
+    printf("Testing lossy ring...\n");
+    test_lossy_ring();
+    printf("Lossy ring tests passed!\n\n");
+    
+    printf("Testing per-CPU pool...\n");
+    test_percpu_pool();
+    printf("Per-CPU pool tests passed!\n\n");
+    
     printf("All tests passed successfully!\n");
     return 0;
 }
@@ -152,7 +218,7 @@ void test_memory_pool(void) {
     // Check initial state
     uint32_t potential_blocks = (memory_size / block_size);
     size_t rb_size = ring_buffer_size(potential_blocks);
-    uint32_t expected_blocks = (memory_size - rb_size) / block_size;
+    uint32_t expected_blocks = (memory_size - rb_size - MEMPOOL_STATS_RESERVED) / block_size;
     
     assert(memory_pool_free_count(&pool) == expected_blocks);
     assert(memory_pool_used_count(&pool) == 0);
@@ -307,17 +373,15 @@ void* consumer_thread(void* arg) {
     printf("Consumer %d starting\n", args->thread_id);
     
     int items_consumed = 0;
-    int consecutive_empty = 0;
-    const int max_consecutive_empty = 1000;
     
-    // Consume items until all producers have finished
-    while (items_consumed < OPERATIONS_PER_THREAD || consecutive_empty < max_consecutive_empty) {
+    // Consume items until every produced item has been taken by some consumer
+    while (atomic_load(&total_consumed) < OPERATIONS_PER_THREAD * NUM_THREADS) {
         void* item = ring_buffer_get(args->rb);
         
         if (item != NULL) {
             // Successfully got an item
-            consecutive_empty = 0;
             items_consumed++;
+            atomic_fetch_add(&total_consumed, 1);
             
             // Use the item (just a read to verify it's valid)
             int value = *(int*)item;
@@ -329,7 +393,6 @@ void* consumer_thread(void* arg) {
             }
         } else {
             // Buffer is empty, wait a bit
-            consecutive_empty++;
             usleep(1);
         }
     }
@@ -448,4 +511,1109 @@ void test_shared_memory_pool(void) {
         
         printf("Parent: Child exited successfully\n");
     }
-}
\ No newline at end of file
+}
+
+#ifdef MEMPOOL_STATS
+// Thread function hammering a pool for the statistics test
+static void* stats_worker(void* arg) {
+    mem_pool_t* pool = (mem_pool_t*)arg;
+    
+    for (int i = 0; i < OPERATIONS_PER_THREAD; i++) {
+        void* block = memory_pool_alloc(pool);
+        if (block != NULL) {
+            memory_pool_free(pool, block);
+        }
+    }
+    
+    return NULL;
+}
+#endif
+
+// Test pool statistics counters
+void test_pool_stats(void) {
+    mem_pool_t pool;
+    mempool_stats_snapshot_t stats;
+
+#ifndef MEMPOOL_STATS
+    void* memory = malloc(4096);
+    assert(memory_pool_init(&pool, memory, 4096, 64));
+    assert(!memory_pool_get_stats(&pool, &stats));
+    printf("Statistics disabled, nothing to test\n");
+    free(memory);
+#else
+    shm_unlink(SHM_NAME);
+    assert(memory_pool_init_shared(&pool, SHM_NAME, SHM_SIZE, BLOCK_SIZE, true, 0666));
+    assert(memory_pool_get_stats(&pool, &stats));
+    assert(stats.allocs == 0 && stats.frees == 0 && stats.used == 0 && stats.peak_used == 0);
+    
+    // The layout is described for external readers
+    assert(pool.stats->magic == MEMPOOL_STATS_MAGIC);
+    assert(pool.stats->block_size == BLOCK_SIZE);
+    assert(pool.stats->num_blocks == pool.num_blocks);
+    assert((uint8_t*)pool.free_blocks + pool.stats->blocks_offset == (uint8_t*)pool.pool_start);
+    
+    // Builds that disagree on MEMPOOL_STATS must not attach to each other's segments
+    mem_pool_t mismatched;
+    pool.stats->magic = 0;
+    assert(!memory_pool_init_shared(&mismatched, SHM_NAME, SHM_SIZE, BLOCK_SIZE, false, 0));
+    pool.stats->magic = MEMPOOL_STATS_MAGIC;
+    
+    // The block is cache-line aligned even in memory that is not
+    uint8_t* unaligned = malloc(4096 + 64);
+    assert(unaligned != NULL);
+    mem_pool_t private_pool;
+    assert(memory_pool_init(&private_pool, unaligned + 8, 4096, 64));
+    assert(((uintptr_t)private_pool.stats & 63) == 0);
+    assert((uint8_t*)private_pool.stats + sizeof(mempool_stats_t) <= unaligned + 8 + 4096);
+    assert((uint8_t*)private_pool.pool_start + private_pool.num_blocks * 64 <= (uint8_t*)private_pool.stats);
+    free(unaligned);
+    
+    // Exhaust the pool, then free everything
+    void** blocks = malloc(pool.num_blocks * sizeof(void*));
+    assert(blocks != NULL);
+    for (uint32_t i = 0; i < pool.num_blocks; i++) {
+        blocks[i] = memory_pool_alloc(&pool);
+        assert(blocks[i] != NULL);
+    }
+    assert(memory_pool_alloc(&pool) == NULL);
+    assert(!memory_pool_free(&pool, (uint8_t*)blocks[0] + 1));  // Misaligned
+    
+    assert(memory_pool_get_stats(&pool, &stats));
+    assert(stats.allocs == pool.num_blocks);
+    assert(stats.alloc_failures == 1);
+    assert(stats.free_failures == 1);
+    assert(stats.used == pool.num_blocks);
+    assert(stats.peak_used == pool.num_blocks);
+    
+    for (uint32_t i = 0; i < pool.num_blocks; i++) {
+        assert(memory_pool_free(&pool, blocks[i]));
+    }
+    free(blocks);
+    
+    assert(memory_pool_get_stats(&pool, &stats));
+    assert(stats.frees == pool.num_blocks);
+    assert(stats.used == 0);
+    assert(stats.peak_used == pool.num_blocks);
+    
+    // A second process sees the same counters through its own mapping
+    mem_pool_t attached;
+    assert(memory_pool_init_shared(&attached, SHM_NAME, SHM_SIZE, BLOCK_SIZE, false, 0));
+    assert(memory_pool_alloc(&attached) != NULL);
+    assert(memory_pool_get_stats(&pool, &stats));
+    assert(stats.allocs == pool.num_blocks + 1 && stats.used == 1);
+    memory_pool_destroy(&attached, false);
+    
+    // Counters from concurrent threads add up exactly
+    assert(memory_pool_reset(&pool));
+    mempool_stats_snapshot_t before;
+    assert(memory_pool_get_stats(&pool, &before));
+    
+    pthread_t threads[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++) {
+        assert(pthread_create(&threads[i], NULL, stats_worker, &pool) == 0);
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    
+    assert(memory_pool_get_stats(&pool, &stats));
+    assert(stats.allocs - before.allocs == NUM_THREADS * OPERATIONS_PER_THREAD);
+    assert(stats.frees - before.frees == NUM_THREADS * OPERATIONS_PER_THREAD);
+    printf("Lock spins: %llu, backoffs: %llu\n", 
+           (unsigned long long)stats.lock_spins, (unsigned long long)stats.lock_backoffs);
+    
+    memory_pool_destroy(&pool, true);
+#endif
+}
+
+#ifdef MEMPOOL_LATENCY
+// Thread function recording 100 pool allocations and frees, then exiting
+static void* latency_worker(void* arg) {
+    mem_pool_t* pool = (mem_pool_t*)arg;
+    
+    for (int i = 0; i < 100; i++) {
+        void* block = memory_pool_alloc(pool);
+        assert(block != NULL);
+        assert(memory_pool_free(pool, block));
+    }
+    
+    return NULL;
+}
+#endif
+
+// Test latency histogram buckets, merging and saving
+void test_latency_histogram(void) {
+    latency_histogram_t histogram;
+    latency_histogram_reset(&histogram);
+    assert(latency_histogram_percentile(&histogram, 0.5) == 0);
+    
+    // Small values are exact
+    for (uint64_t value = 1; value <= 10; value++) {
+        latency_histogram_record(&histogram, value);
+    }
+    assert(atomic_load(&histogram.total) == 10);
+    assert(latency_histogram_percentile(&histogram, 0.5) == 5);
+    assert(latency_histogram_percentile(&histogram, 1.0) == 10);
+    
+    // Larger values land in a bucket within 1/16 of them
+    latency_histogram_t wide;
+    latency_histogram_reset(&wide);
+    for (uint64_t value = 1000; value <= 100000; value += 1000) {
+        latency_histogram_record(&wide, value);
+    }
+    uint64_t p50 = latency_histogram_percentile(&wide, 0.5);
+    assert(p50 >= 50000 && p50 <= 50000 + 50000 / 16);
+    uint64_t p99 = latency_histogram_percentile(&wide, 0.99);
+    assert(p99 >= 99000 && p99 <= 99000 + 99000 / 16);
+    assert(latency_histogram_percentile(&wide, 1.0) == 100000);
+    
+    // A stall is kept in the tail, not averaged away
+    latency_histogram_record(&wide, 5000000);
+    assert(latency_histogram_percentile(&wide, 1.0) == 5000000);
+    
+    // Merging adds counts and keeps the maximum
+    latency_histogram_merge(&histogram, &wide);
+    assert(atomic_load(&histogram.total) == 111);
+    assert(atomic_load(&histogram.max_ns) == 5000000);
+    
+    // A saved histogram merges into another process's histogram
+    const char* path = "/tmp/mempool_test_latency.bin";
+    assert(latency_histogram_save(&histogram, path));
+    latency_histogram_t loaded;
+    latency_histogram_reset(&loaded);
+    assert(latency_histogram_load(&loaded, path));
+    assert(latency_histogram_load(&loaded, path));
+    assert(atomic_load(&loaded.total) == 222);
+    assert(latency_histogram_percentile(&loaded, 0.5) == latency_histogram_percentile(&histogram, 0.5));
+    unlink(path);
+    assert(!latency_histogram_load(&loaded, path));
+
+#ifdef MEMPOOL_LATENCY
+    // Pool and ring operations record into this thread's histograms
+    uint8_t memory[4096];
+    mem_pool_t pool;
+    assert(memory_pool_init(&pool, memory, sizeof(memory), BLOCK_SIZE));
+    
+    latency_histogram_t allocs, frees, gets;
+    latency_histogram_reset(&allocs);
+    latency_histogram_reset(&frees);
+    latency_histogram_reset(&gets);
+    latency_collect(LATENCY_POOL_ALLOC, &allocs);
+    latency_collect(LATENCY_POOL_FREE, &frees);
+    latency_collect(LATENCY_RING_GET, &gets);
+    uint64_t allocs_before = atomic_load(&allocs.total);
+    uint64_t frees_before = atomic_load(&frees.total);
+    uint64_t gets_before = atomic_load(&gets.total);
+    
+    for (int i = 0; i < 100; i++) {
+        void* block = memory_pool_alloc(&pool);
+        assert(block != NULL);
+        assert(memory_pool_free(&pool, block));
+    }
+    
+    latency_histogram_reset(&allocs);
+    latency_histogram_reset(&frees);
+    latency_histogram_reset(&gets);
+    latency_collect(LATENCY_POOL_ALLOC, &allocs);
+    latency_collect(LATENCY_POOL_FREE, &frees);
+    latency_collect(LATENCY_RING_GET, &gets);
+    assert(atomic_load(&allocs.total) - allocs_before == 100);
+    assert(atomic_load(&frees.total) - frees_before == 100);
+    assert(atomic_load(&gets.total) - gets_before == 0);  // The pool's ring use is not timed twice
+    latency_histogram_print(&allocs, "alloc", stdout);
+    latency_histogram_print(&frees, "free", stdout);
+    
+    // A thread's samples outlive it
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, latency_worker, &pool) == 0);
+    assert(pthread_join(thread, NULL) == 0);
+    latency_histogram_reset(&allocs);
+    latency_collect(LATENCY_POOL_ALLOC, &allocs);
+    assert(atomic_load(&allocs.total) - allocs_before == 200);
+#endif
+}
+
+// Thread function tracing one allocation and free, then exiting
+static void* trace_worker(void* arg) {
+    mem_pool_t* pool = (mem_pool_t*)arg;
+    
+    void* block = memory_pool_alloc(pool);
+    assert(block != NULL);
+    assert(memory_pool_free(pool, block));
+    
+    return NULL;
+}
+
+// Test the binary event trace of pool and ring operations
+void test_event_trace(void) {
+    uint8_t memory[4096];
+    mem_pool_t pool;
+    assert(memory_pool_init(&pool, memory, sizeof(memory), BLOCK_SIZE));
+    
+    // Nothing is recorded before a trace is opened
+    assert(atomic_load(atomic_load(&event_trace_switch)) == 0);
+    void* block = memory_pool_alloc(&pool);
+    assert(block != NULL);
+    assert(memory_pool_free(&pool, block));
+    
+    assert(event_trace_open());
+    assert(atomic_load(atomic_load(&event_trace_switch)) == 1);
+    
+    // Read the segment the way the decoder does
+    char name[64];
+    snprintf(name, sizeof(name), "%s%d", EVENT_TRACE_PREFIX, (int)getpid());
+    int fd = shm_open(name, O_RDONLY, 0);
+    assert(fd != -1);
+    const trace_header_t* header = mmap(NULL, sizeof(trace_header_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    assert(header != MAP_FAILED);
+    assert(event_trace_valid(header, sizeof(trace_header_t)));
+    assert(header->pid == (uint32_t)getpid());
+    assert(atomic_load(&header->threads_used) == 0);
+    
+    // alloc takes from the free ring, free puts back into it
+    uint64_t start_ns = event_trace_clock_ns();
+    block = memory_pool_alloc(&pool);
+    assert(block != NULL);
+    assert(memory_pool_free(&pool, block));
+    uint32_t index = (uint32_t)(((uint8_t*)block - (uint8_t*)pool.pool_start) / pool.block_size);
+    
+    assert(atomic_load(&header->threads_used) == 1);
+    const trace_thread_t* ring = &header->threads[0];
+    uint64_t head = atomic_load(&ring->head);
+    assert(head == 4);
+    assert(ring->tid == (uint32_t)getpid());  // Main thread
+    assert(ring->events[0].type == TRACE_RING_GET && ring->events[0].aux == 1);
+    assert(ring->events[1].type == TRACE_POOL_ALLOC && ring->events[1].arg == index);
+    assert(ring->events[2].type == TRACE_RING_PUT && ring->events[2].arg == pool.num_blocks);
+    assert(ring->events[3].type == TRACE_POOL_FREE && ring->events[3].arg == index);
+    assert(ring->events[3].aux == 1);
+    
+    // Timestamps convert to CLOCK_MONOTONIC (allow for calibration error)
+    uint64_t event_ns = event_trace_to_ns(header, ring->events[1].tsc);
+    uint64_t end_ns = event_trace_clock_ns();
+    assert(event_ns + 1000000 >= start_ns && event_ns <= end_ns + 1000000);
+    assert(ring->events[3].tsc >= ring->events[0].tsc);
+    
+    // A rejected free is recorded too (it never reaches the ring)
+    assert(!memory_pool_free(&pool, memory));
+    assert(atomic_load(&ring->head) == 5);
+    assert(ring->events[4].type == TRACE_POOL_FREE && ring->events[4].aux == 0);
+    assert(ring->events[4].arg == EVENT_TRACE_NO_INDEX);
+    
+    // Rings of exited threads are handed to new threads, so any number of
+    // short-lived threads is traced
+    for (int i = 0; i < 2 * EVENT_TRACE_MAX_THREADS; i++) {
+        pthread_t thread;
+        assert(pthread_create(&thread, NULL, trace_worker, &pool) == 0);
+        assert(pthread_join(thread, NULL) == 0);
+    }
+    assert(atomic_load(&header->threads_dropped) == 0);
+    assert(atomic_load(&header->threads_used) == EVENT_TRACE_MAX_THREADS);
+    assert(atomic_load(&ring->state) == TRACE_RING_OWNED);  // Main thread still holds its ring
+    assert(atomic_load(&header->threads[1].state) == TRACE_RING_RELEASED);
+    assert(atomic_load(&header->threads[1].head) == 4);
+    
+    // Switched off, operations leave the ring alone
+    event_trace_enable(false);
+    block = memory_pool_alloc(&pool);
+    assert(memory_pool_free(&pool, block));
+    assert(atomic_load(&ring->head) == 5);
+    
+    munmap((void*)header, sizeof(trace_header_t));
+    event_trace_close(true);
+    assert(atomic_load(atomic_load(&event_trace_switch)) == 0);
+    assert(shm_open(name, O_RDONLY, 0) == -1);
+}
+
+// Records the SPSC byte ring test sends (lengths cycle through 0..BYTE_RING_TEST_MAX)
+#define BYTE_RING_TEST_RECORDS 20000
+#define BYTE_RING_TEST_MAX 100
+
+// Producer of the SPSC byte ring test: record i holds i in every byte
+static void* byte_ring_producer(void* arg) {
+    byte_ring_t* rb = (byte_ring_t*)arg;
+    uint8_t record[BYTE_RING_TEST_MAX];
+    
+    for (uint32_t i = 0; i < BYTE_RING_TEST_RECORDS; i++) {
+        uint32_t length = i % (BYTE_RING_TEST_MAX + 1);
+        memset(record, (int)(i & 0xff), length);
+        while (!byte_ring_put(rb, record, length)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+// Test inline variable-length records
+void test_byte_ring(void) {
+    const uint32_t capacity = 256;
+    byte_ring_t* rb = aligned_alloc(64, byte_ring_size(capacity));
+    assert(rb != NULL);
+    assert(!byte_ring_init(rb, 100));  // Not a power of 2
+    assert(!byte_ring_init(rb, 32));   // Too small
+    assert(byte_ring_init(rb, capacity));
+    assert(byte_ring_is_empty(rb));
+    assert(byte_ring_max_record(rb) == capacity / 2 - BYTE_RING_HEADER);
+    
+    // Records keep their boundaries and order
+    char buffer[256];
+    uint32_t length = 0;
+    assert(!byte_ring_get(rb, buffer, sizeof(buffer), &length));
+    assert(byte_ring_put(rb, "hello", 5));
+    assert(byte_ring_put(rb, "", 0));
+    assert(byte_ring_put(rb, "world!!!", 8));
+    assert(byte_ring_used(rb) == (8 + 8) + 8 + (8 + 8));
+    assert(byte_ring_get(rb, buffer, sizeof(buffer), &length));
+    assert(length == 5 && memcmp(buffer, "hello", 5) == 0);
+    assert(byte_ring_get(rb, buffer, sizeof(buffer), &length));
+    assert(length == 0);
+    
+    // A buffer that is too small leaves the record queued
+    assert(!byte_ring_get(rb, buffer, 4, &length));
+    assert(length == 8);
+    assert(byte_ring_get(rb, buffer, sizeof(buffer), &length));
+    assert(length == 8 && memcmp(buffer, "world!!!", 8) == 0);
+    assert(byte_ring_is_empty(rb));
+    
+    // Oversized records are refused
+    assert(byte_ring_reserve(rb, byte_ring_max_record(rb) + 1) == NULL);
+    
+    // Reserve for the worst case, commit what was written
+    char* payload = byte_ring_reserve(rb, 64);
+    assert(payload != NULL);
+    int written = snprintf(payload, 64, "seq=%d", 42);
+    assert(!byte_ring_commit(rb, 65));
+    assert(byte_ring_commit(rb, (uint32_t)written));
+    assert(byte_ring_used(rb) == 8 + 8);
+    
+    // A cancelled reservation leaves nothing behind
+    assert(byte_ring_reserve(rb, 16) != NULL);
+    byte_ring_cancel(rb);
+    assert(byte_ring_used(rb) == 8 + 8);
+    
+    // Read in place
+    const char* record = byte_ring_read(rb, &length);
+    assert(record != NULL && length == (uint32_t)written);
+    assert(memcmp(record, "seq=42", 6) == 0);
+    byte_ring_release(rb);
+    assert(byte_ring_is_empty(rb));
+    
+    // Start over at offset 0 and fill: 7 * 32 bytes used, a 40 byte record does not fit
+    assert(byte_ring_init(rb, capacity));
+    for (int i = 0; i < 7; i++) {
+        memset(buffer, 'a' + i, 24);
+        assert(byte_ring_put(rb, buffer, 24));
+    }
+    assert(byte_ring_used(rb) == 7 * 32);
+    assert(!byte_ring_put(rb, buffer, 32));
+    
+    // Free three records, then an 88 byte record wraps behind 32 bytes of padding
+    for (int i = 0; i < 3; i++) {
+        assert(byte_ring_get(rb, buffer, sizeof(buffer), &length));
+        assert(length == 24 && buffer[0] == 'a' + i);
+    }
+    memset(buffer, 'z', 80);
+    assert(byte_ring_put(rb, buffer, 80));
+    assert(byte_ring_used(rb) == 4 * 32 + 32 + 88);  // Records, padding, wrapped record
+    for (int i = 3; i < 7; i++) {
+        assert(byte_ring_get(rb, buffer, sizeof(buffer), &length));
+        assert(length == 24 && buffer[23] == 'a' + i);
+    }
+    assert(byte_ring_get(rb, buffer, sizeof(buffer), &length));
+    assert(length == 80 && buffer[0] == 'z' && buffer[79] == 'z');
+    assert(byte_ring_is_empty(rb));
+    
+    // One producer and one consumer thread, every length and every wrap offset
+    pthread_t producer;
+    pthread_create(&producer, NULL, byte_ring_producer, rb);
+    for (uint32_t i = 0; i < BYTE_RING_TEST_RECORDS; i++) {
+        while (!byte_ring_get(rb, buffer, sizeof(buffer), &length)) {
+            sched_yield();
+        }
+        assert(length == i % (BYTE_RING_TEST_MAX + 1));
+        for (uint32_t j = 0; j < length; j++) {
+            assert((uint8_t)buffer[j] == (i & 0xff));
+        }
+    }
+    pthread_join(producer, NULL);
+    assert(byte_ring_is_empty(rb));
+    
+    free(rb);
+}
+
+// Test the double-mapped ring in private and shared mode
+void test_magic_ring(void) {
+    const uint32_t page = (uint32_t)sysconf(_SC_PAGESIZE);
+    const uint32_t capacity = 4 * page;
+    assert(magic_ring_size(capacity) == page + 2 * (size_t)capacity);
+    assert(magic_ring_size(3 * page) == 0);   // Not a power of 2
+    assert(magic_ring_size(page / 2) == 0);   // Less than a page
+    
+    magic_ring_t mr;
+    assert(!magic_ring_init(&mr, page + 1));
+    assert(magic_ring_init(&mr, capacity));
+    assert(magic_ring_used(&mr) == 0 && magic_ring_free(&mr) == capacity);
+    
+    // Both views show the same bytes
+    mr.data[0] = 'x';
+    assert(mr.data[capacity] == 'x');
+    mr.data[2 * capacity - 1] = 'y';
+    assert(mr.data[capacity - 1] == 'y');
+    
+    // Move the positions close to the end of the buffer
+    uint8_t* chunk = malloc(capacity);
+    assert(chunk != NULL);
+    memset(chunk, 0, capacity);
+    assert(magic_ring_write(&mr, chunk, capacity - 100));
+    uint32_t available = 0;
+    assert(magic_ring_read(&mr, &available) != NULL && available == capacity - 100);
+    assert(magic_ring_consume(&mr, available));
+    
+    // A 300 byte write crosses the end but is one contiguous run for both sides
+    for (uint32_t i = 0; i < 300; i++) {
+        chunk[i] = (uint8_t)i;
+    }
+    uint8_t* destination = magic_ring_reserve(&mr, 300);
+    assert(destination == mr.data + capacity - 100);
+    memcpy(destination, chunk, 300);
+    assert(magic_ring_commit(&mr, 300));
+    assert(mr.data[0] == 100 && mr.data[199] == (uint8_t)299);  // Wrapped part
+    
+    const uint8_t* source = magic_ring_read(&mr, &available);
+    assert(source != NULL && available == 300);
+    assert(memcmp(source, chunk, 300) == 0);
+    
+    // Consume part, the rest stays readable
+    assert(!magic_ring_consume(&mr, 301));
+    source = magic_ring_read(&mr, &available);
+    assert(available == 300);
+    assert(magic_ring_consume(&mr, 120));
+    source = magic_ring_read(&mr, &available);
+    assert(available == 180 && source[0] == 120);
+    assert(magic_ring_consume(&mr, available));
+    assert(magic_ring_read(&mr, &available) == NULL);
+    
+    // Full ring, shorter commit and cancel
+    assert(magic_ring_write(&mr, chunk, capacity));
+    assert(magic_ring_reserve(&mr, 1) == NULL);
+    source = magic_ring_read(&mr, &available);
+    assert(available == capacity);
+    assert(magic_ring_consume(&mr, capacity));
+    assert(magic_ring_reserve(&mr, capacity + 1) == NULL);
+    assert(magic_ring_reserve(&mr, 64) != NULL);
+    assert(!magic_ring_commit(&mr, 65));
+    assert(magic_ring_commit(&mr, 10));
+    assert(magic_ring_reserve(&mr, 64) != NULL);
+    magic_ring_cancel(&mr);
+    assert(magic_ring_used(&mr) == 10);
+    assert(magic_ring_destroy(&mr, false));
+    
+    // Shared mode: a second mapping at another address sees the same stream
+    const char* name = "/mempool_test_magic";
+    shm_unlink(name);
+    magic_ring_t writer, reader;
+    assert(magic_ring_init_shared(&writer, name, capacity, true, 0666));
+    assert(!magic_ring_init_shared(&reader, name, capacity, true, 0666));  // Exists
+    assert(magic_ring_init_shared(&reader, name, 0, false, 0));
+    assert(reader.header->capacity == capacity && reader.data != writer.data);
+    
+    assert(magic_ring_write(&writer, chunk, capacity - 50));
+    source = magic_ring_read(&reader, &available);
+    assert(available == capacity - 50);
+    assert(magic_ring_consume(&reader, available));
+    assert(magic_ring_write(&writer, chunk, 300));
+    source = magic_ring_read(&reader, &available);
+    assert(available == 300 && memcmp(source, chunk, 300) == 0);
+    assert(magic_ring_consume(&reader, available));
+    
+    assert(magic_ring_destroy(&reader, false));
+    assert(magic_ring_destroy(&writer, true));
+    assert(shm_open(name, O_RDONLY, 0) == -1);
+    free(chunk);
+}
+
+// Test the non-consuming and batch operations of the ring buffer
+void test_ring_buffer_batch(void) {
+    const uint32_t capacity = 8;
+    ring_buffer_t* rb = malloc(ring_buffer_size(capacity));
+    assert(rb != NULL);
+    assert(ring_buffer_init(rb, capacity));
+    
+    int values[16];
+    void* items[16];
+    for (int i = 0; i < 16; i++) {
+        values[i] = i;
+    }
+    
+    // Nothing to see in an empty buffer
+    ring_buffer_iter_t it;
+    void* item = NULL;
+    assert(ring_buffer_peek(rb) == NULL);
+    assert(ring_buffer_drain(rb, items, 16) == 0);
+    assert(ring_buffer_iter_begin(rb, &it) == 0);
+    assert(!ring_buffer_iter_next(&it, &item));
+    ring_buffer_iter_end(&it);
+    
+    // Move head and tail so the items wrap around the end of the array
+    for (int i = 0; i < 6; i++) {
+        assert(ring_buffer_put(rb, &values[i]));
+    }
+    assert(ring_buffer_drain(rb, items, 16) == 6);
+    assert(items[0] == &values[0] && items[5] == &values[5]);
+    for (int i = 0; i < 7; i++) {
+        assert(ring_buffer_put(rb, &values[i + 6]));
+    }
+    
+    // Peek and iterate leave everything in place
+    assert(ring_buffer_peek(rb) == &values[6]);
+    assert(ring_buffer_peek(rb) == &values[6]);
+    assert(ring_buffer_iter_begin(rb, &it) == 7);
+    int expected = 6;
+    while (ring_buffer_iter_next(&it, &item)) {
+        assert(item == &values[expected]);
+        expected++;
+    }
+    ring_buffer_iter_end(&it);
+    assert(expected == 13);
+    assert(ring_buffer_count(rb) == 7);
+    
+    // Producers may append during an iteration; it visits what was there at begin
+    assert(ring_buffer_iter_begin(rb, &it) == 7);
+    assert(ring_buffer_put(rb, &values[13]));
+    expected = 0;
+    while (ring_buffer_iter_next(&it, &item)) {
+        expected++;
+    }
+    ring_buffer_iter_end(&it);
+    assert(expected == 7);
+    
+    // Drain in parts across the wrap, oldest first
+    assert(ring_buffer_drain(rb, items, 3) == 3);
+    assert(items[0] == &values[6] && items[2] == &values[8]);
+    assert(ring_buffer_drain(rb, items, 16) == 5);
+    for (int i = 0; i < 5; i++) {
+        assert(items[i] == &values[9 + i]);
+    }
+    assert(ring_buffer_is_empty(rb));
+    
+    // Put in one go across the wrap; only what fits is stored
+    for (int i = 0; i < 10; i++) {
+        items[i] = &values[i];
+    }
+    assert(ring_buffer_put_batch(rb, items, 5) == 5);
+    assert(ring_buffer_put_batch(rb, items, 10) == 3);
+    assert(ring_buffer_put_batch(rb, items, 1) == 0);
+    assert(ring_buffer_drain(rb, items, 16) == 8);
+    for (int i = 0; i < 8; i++) {
+        assert(items[i] == &values[i < 5 ? i : i - 5]);
+    }
+    
+    // The consumer lock is free again
+    assert(ring_buffer_put(rb, &values[0]));
+    assert(ring_buffer_get(rb) == &values[0]);
+    
+    free(rb);
+}
+
+// Test the multi-level priority queue
+void test_priority_ring(void) {
+    const uint32_t levels = 3;
+    const uint32_t capacity = 8;
+    size_t size = priority_ring_size(levels, capacity);
+    
+    // Place it in shared memory so a forked producer can use it
+    priority_ring_t* pr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    assert(pr != MAP_FAILED);
+    assert(!priority_ring_init(pr, 0, capacity, 0));
+    assert(!priority_ring_init(pr, PRIORITY_RING_MAX_LEVELS + 1, capacity, 0));
+    assert(priority_ring_init(pr, levels, capacity, 0));
+    assert(priority_ring_is_empty(pr));
+    assert(priority_ring_get(pr, NULL) == NULL);
+    assert(!priority_ring_put(pr, levels, (void*)1));
+    
+    // Strict priority: level 0 overtakes everything queued before it, FIFO within a level
+    assert(priority_ring_put(pr, 2, (void*)21));
+    assert(priority_ring_put(pr, 1, (void*)11));
+    assert(priority_ring_put(pr, 2, (void*)22));
+    assert(priority_ring_put(pr, 0, (void*)1));
+    assert(priority_ring_count(pr) == 4);
+    uint32_t level = 99;
+    assert(priority_ring_get(pr, &level) == (void*)1 && level == 0);
+    assert(priority_ring_get(pr, &level) == (void*)11 && level == 1);
+    assert(priority_ring_get(pr, &level) == (void*)21 && level == 2);
+    assert(priority_ring_get(pr, &level) == (void*)22 && level == 2);
+    assert(priority_ring_get(pr, &level) == NULL);
+    assert(atomic_load(&pr->nonempty) == 0);
+    
+    // A full level does not block the others
+    for (uint32_t i = 0; i < capacity; i++) {
+        assert(priority_ring_put(pr, 1, (void*)(uintptr_t)(100 + i)));
+    }
+    assert(!priority_ring_put(pr, 1, (void*)1));
+    assert(priority_ring_put(pr, 0, (void*)1));
+    assert(priority_ring_get(pr, &level) == (void*)1 && level == 0);
+    assert(ring_buffer_count(priority_ring_level(pr, 1)) == capacity);
+    ring_buffer_reset(priority_ring_level(pr, 1));
+    
+    // Starvation limit 2: two top items, then one from the lower levels in turn
+    assert(priority_ring_init(pr, levels, capacity, 2));
+    for (uint32_t i = 0; i < 6; i++) {
+        assert(priority_ring_put(pr, 0, (void*)(uintptr_t)(i + 1)));
+    }
+    assert(priority_ring_put(pr, 1, (void*)11));
+    assert(priority_ring_put(pr, 2, (void*)21));
+    uint32_t expected_levels[] = {0, 0, 1, 0, 0, 2, 0, 0};
+    for (int i = 0; i < 8; i++) {
+        assert(priority_ring_get(pr, &level) != NULL);
+        assert(level == expected_levels[i]);
+    }
+    assert(priority_ring_is_empty(pr));
+    
+    // Without lower levels waiting the top level runs freely
+    assert(priority_ring_init(pr, levels, capacity, 1));
+    for (uint32_t i = 0; i < 4; i++) {
+        assert(priority_ring_put(pr, 0, (void*)(uintptr_t)(i + 1)));
+    }
+    for (uint32_t i = 0; i < 4; i++) {
+        assert(priority_ring_get(pr, &level) == (void*)(uintptr_t)(i + 1) && level == 0);
+    }
+    
+    // Another process fills every level; nothing is lost and each level stays FIFO
+    assert(priority_ring_init(pr, levels, capacity, 0));
+    const uint32_t per_level = 1000;
+    pid_t pid = fork();
+    assert(pid != -1);
+    if (pid == 0) {
+        for (uint32_t i = 1; i <= per_level; i++) {
+            for (uint32_t l = 0; l < levels; l++) {
+                while (!priority_ring_put(pr, l, (void*)(uintptr_t)i)) {
+                    sched_yield();
+                }
+            }
+        }
+        _exit(0);
+    }
+    
+    uintptr_t last[3] = {0, 0, 0};
+    uint32_t received = 0;
+    while (received < levels * per_level) {
+        void* item = priority_ring_get(pr, &level);
+        if (item == NULL) {
+            sched_yield();
+            continue;
+        }
+        assert(level < levels && (uintptr_t)item == last[level] + 1);
+        last[level] = (uintptr_t)item;
+        received++;
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    assert(priority_ring_is_empty(pr));
+    
+    munmap(pr, size);
+}
+
+// Lock word and the counter it protects in the wait strategy test
+#define WAIT_TEST_THREADS 4
+#define WAIT_TEST_ROUNDS 20000
+
+typedef struct {
+    atomic_uint lock;
+    wait_strategy_t strategy;
+    uint64_t counter;          // Plain increments: lost updates show a broken lock
+} wait_test_t;
+
+static void* wait_test_thread(void* arg) {
+    wait_test_t* test = (wait_test_t*)arg;
+    
+    for (int i = 0; i < WAIT_TEST_ROUNDS; i++) {
+        if (!wait_lock_try(&test->lock)) {
+            uint32_t sleeps;
+            assert(wait_lock_acquire_slow(&test->lock, test->strategy, &sleeps) >= 1);
+        }
+        test->counter++;
+        wait_lock_release(&test->lock);
+    }
+    return NULL;
+}
+
+// Test every wait strategy for mutual exclusion, and their selection
+void test_wait_strategies(void) {
+    wait_strategy_t strategy;
+    assert(wait_strategy_parse("futex", &strategy) && strategy == WAIT_FUTEX);
+    assert(!wait_strategy_parse("sleepy", &strategy));
+    assert(strcmp(wait_strategy_name(WAIT_YIELD), "yield") == 0);
+    
+    // The environment picks the default for new rings, pools and trackers
+    assert(setenv(WAIT_STRATEGY_ENV, "spin", 1) == 0);
+    assert(wait_strategy_default() == WAIT_SPIN);
+    ring_buffer_t* rb = malloc(ring_buffer_size(16));
+    assert(rb != NULL && ring_buffer_init(rb, 16));
+    assert(rb->wait_strategy == WAIT_SPIN);
+    assert(setenv(WAIT_STRATEGY_ENV, "nonsense", 1) == 0);
+    assert(wait_strategy_default() == WAIT_BACKOFF);
+    assert(unsetenv(WAIT_STRATEGY_ENV) == 0);
+    assert(wait_strategy_default() == WAIT_BACKOFF);
+    
+    uint8_t memory[4096];
+    mem_pool_t pool;
+    assert(memory_pool_init(&pool, memory, sizeof(memory), BLOCK_SIZE));
+    memory_pool_set_wait_strategy(&pool, WAIT_FUTEX);
+    assert(pool.free_blocks->wait_strategy == WAIT_FUTEX);
+    void* block = memory_pool_alloc(&pool);
+    assert(block != NULL && memory_pool_free(&pool, block));
+    free(rb);
+    
+    // Every strategy must keep the counter exact under contention
+    for (int s = WAIT_BACKOFF; s <= WAIT_FUTEX; s++) {
+        wait_test_t test = {.strategy = (wait_strategy_t)s, .counter = 0};
+        atomic_init(&test.lock, 0);
+        
+        pthread_t threads[WAIT_TEST_THREADS];
+        for (int t = 0; t < WAIT_TEST_THREADS; t++) {
+            pthread_create(&threads[t], NULL, wait_test_thread, &test);
+        }
+        for (int t = 0; t < WAIT_TEST_THREADS; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        
+        assert(test.counter == (uint64_t)WAIT_TEST_THREADS * WAIT_TEST_ROUNDS);
+        assert(atomic_load(&test.lock) == 0);
+        printf("  %s: ok\n", wait_strategy_name((wait_strategy_t)s));
+    }
+}
+
+// Sample written by the lossy ring producers; check detects torn reads
+#define LOSSY_TEST_PRODUCERS 2
+#define LOSSY_TEST_ITEMS 50000
+
+typedef struct {
+    uint64_t producer;
+    uint64_t counter;
+    uint64_t check;            // ~(producer ^ counter)
+} lossy_sample_t;
+
+typedef struct {
+    lossy_ring_t* lr;
+    uint64_t producer;
+} lossy_producer_args_t;
+
+static void* lossy_producer(void* arg) {
+    lossy_producer_args_t* args = (lossy_producer_args_t*)arg;
+    for (uint64_t i = 1; i <= LOSSY_TEST_ITEMS; i++) {
+        lossy_sample_t sample = {args->producer, i, ~(args->producer ^ i)};
+        lossy_ring_put(args->lr, &sample);
+    }
+    return NULL;
+}
+
+// Test the overwrite-oldest ring
+void test_lossy_ring(void) {
+    const uint32_t capacity = 8;
+    lossy_ring_t* lr = aligned_alloc(64, lossy_ring_size(64, sizeof(lossy_sample_t)));
+    assert(lr != NULL);
+    assert(!lossy_ring_init(lr, 6, 8));                // Not a power of 2
+    assert(!lossy_ring_init(lr, capacity, 12));        // Not a multiple of 8
+    assert(!lossy_ring_init(lr, capacity, LOSSY_RING_MAX_ITEM + 8));
+    assert(lossy_ring_init(lr, capacity, sizeof(uint64_t)));
+    
+    lossy_ring_reader_t early, late;
+    lossy_ring_reader_init(lr, &early, true);
+    uint64_t value = 0, missed = 99;
+    assert(!lossy_ring_read(lr, &early, &value, &missed) && missed == 0);
+    
+    // Items come out in order with their positions
+    for (uint64_t i = 0; i < 5; i++) {
+        assert(lossy_ring_put(lr, &i) == i);
+    }
+    assert(lossy_ring_lag(lr, &early) == 5);
+    for (uint64_t i = 0; i < 3; i++) {
+        assert(lossy_ring_read(lr, &early, &value, &missed));
+        assert(value == i && missed == 0);
+    }
+    
+    // Producers never fail: 15 more items lap the early reader
+    for (uint64_t i = 5; i < 20; i++) {
+        assert(lossy_ring_put(lr, &i) == i);
+    }
+    assert(lossy_ring_lag(lr, &early) == 17);
+    assert(lossy_ring_read(lr, &early, &value, &missed));
+    assert(missed == 9 && value == 12);                // 3..11 were overwritten
+    assert(early.missed == 9);
+    for (uint64_t i = 13; i < 20; i++) {
+        assert(lossy_ring_read(lr, &early, &value, &missed));
+        assert(value == i && missed == 0);
+    }
+    assert(!lossy_ring_read(lr, &early, &value, &missed));
+    
+    // Readers are independent: a new one starts at the oldest item left or at the tail
+    lossy_ring_reader_init(lr, &late, true);
+    assert(late.next == 12);
+    assert(lossy_ring_read(lr, &late, &value, &missed) && value == 12);
+    lossy_ring_reader_init(lr, &late, false);
+    assert(!lossy_ring_read(lr, &late, &value, &missed));
+    value = 20;
+    lossy_ring_put(lr, &value);
+    assert(lossy_ring_read(lr, &late, &value, &missed) && value == 20);
+    assert(lossy_ring_read(lr, &early, &value, &missed) && value == 20);
+    
+    // Concurrent producers and a slow reader: no torn items, nothing counted twice
+    assert(lossy_ring_init(lr, 64, sizeof(lossy_sample_t)));
+    lossy_ring_reader_t reader;
+    lossy_ring_reader_init(lr, &reader, true);
+    
+    pthread_t producers[LOSSY_TEST_PRODUCERS];
+    lossy_producer_args_t args[LOSSY_TEST_PRODUCERS];
+    for (int p = 0; p < LOSSY_TEST_PRODUCERS; p++) {
+        args[p].lr = lr;
+        args[p].producer = (uint64_t)p;
+        pthread_create(&producers[p], NULL, lossy_producer, &args[p]);
+    }
+    
+    uint64_t last[LOSSY_TEST_PRODUCERS] = {0};
+    uint64_t received = 0;
+    bool done = false;
+    while (!done) {
+        // Check before reading: once the producers are finished, drain and stop
+        done = atomic_load(&lr->tail) == (uint64_t)LOSSY_TEST_PRODUCERS * LOSSY_TEST_ITEMS;
+        lossy_sample_t sample;
+        while (lossy_ring_read(lr, &reader, &sample, &missed)) {
+            assert(sample.producer < LOSSY_TEST_PRODUCERS);
+            assert(sample.check == ~(sample.producer ^ sample.counter));
+            assert(sample.counter > last[sample.producer]);
+            last[sample.producer] = sample.counter;
+            received++;
+        }
+        if (!done) {
+            sched_yield();
+        }
+    }
+    for (int p = 0; p < LOSSY_TEST_PRODUCERS; p++) {
+        pthread_join(producers[p], NULL);
+    }
+    
+    // Read a last time: a producer may still have been finishing its final item
+    lossy_sample_t sample;
+    while (lossy_ring_read(lr, &reader, &sample, &missed)) {
+        received++;
+    }
+    assert(received + reader.missed == (uint64_t)LOSSY_TEST_PRODUCERS * LOSSY_TEST_ITEMS);
+    printf("  read %llu, missed %llu\n", (unsigned long long)received, (unsigned long long)reader.missed);
+    
+    free(lr);
+}
+
+#define PERCPU_TEST_THREADS 4
+#define PERCPU_TEST_ROUNDS 20000
+#define PERCPU_TEST_HELD 16
+
+// Pin the calling thread to the CPU it runs on, so it keeps using one shard
+static void pin_to_current_cpu(cpu_set_t* previous) {
+    sched_getaffinity(0, sizeof(*previous), previous);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(sched_getcpu(), &set);
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+// Allocate and free at random, checking nobody else got our blocks meanwhile
+static void* percpu_worker(void* arg) {
+    mem_pool_t* pool = (mem_pool_t*)arg;
+    uint64_t owner = (uint64_t)(uintptr_t)pthread_self();
+    unsigned int seed = (unsigned int)owner;
+    uint64_t* held[PERCPU_TEST_HELD];
+    int count = 0;
+    
+    for (uint64_t i = 0; i < PERCPU_TEST_ROUNDS; i++) {
+        if (count < PERCPU_TEST_HELD && (count == 0 || rand_r(&seed) % 2 == 0)) {
+            uint64_t* block = memory_pool_alloc(pool);
+            if (block != NULL) {
+                block[0] = owner;
+                block[1] = i;
+                held[count++] = block;
+            }
+        } else {
+            int index = rand_r(&seed) % count;
+            uint64_t* block = held[index];
+            assert(block[0] == owner);
+            held[index] = held[--count];
+            assert(memory_pool_free(pool, block));
+        }
+        if (i % 1000 == 0) {
+            sched_yield();  // Give the other threads (and CPUs) a turn
+        }
+    }
+    while (count > 0) {
+        assert(held[count - 1][0] == owner);
+        assert(memory_pool_free(pool, held[--count]));
+    }
+    return NULL;
+}
+
+// Test the per-CPU shards and the pool that uses them
+void test_percpu_pool(void) {
+    // The shards on their own, in both modes
+    const uint32_t shards = cpu_shards_default_count();
+    cpu_shards_t* cs = aligned_alloc(64, cpu_shards_size(shards, 4));
+    assert(cs != NULL);
+    assert(!cpu_shards_init(cs, shards, 0));
+    assert(!cpu_shards_init(cs, shards, CPU_SHARDS_MAX_CAPACITY + 1));
+    
+    cpu_set_t previous;
+    pin_to_current_cpu(&previous);
+    for (int mode = CPU_SHARDS_LOCKED; mode <= CPU_SHARDS_RSEQ; mode++) {
+        assert(cpu_shards_init(cs, shards, 4));
+        assert(cpu_shards_check(cs, shards, 4) && !cpu_shards_check(cs, shards, 8));
+        if (mode == CPU_SHARDS_RSEQ && cs->mode != CPU_SHARDS_RSEQ) {
+            printf("  rseq not available, tested the locked mode only\n");
+            break;
+        }
+        cs->mode = (uint32_t)mode;
+        
+        uint32_t token = 0;
+        assert(cpu_shards_pop(cs, &token) == CPU_SHARD_EMPTY);
+        for (uint32_t t = 1; t <= 4; t++) {
+            assert(cpu_shards_push(cs, t) == CPU_SHARD_OK);
+        }
+        assert(cpu_shards_push(cs, 5) == CPU_SHARD_FULL);
+        assert(cpu_shards_count(cs) == 4);
+        assert(cpu_shards_pop(cs, &token) == CPU_SHARD_OK && token == 4);  // Newest first
+        assert(cpu_shards_push(cs, 6) == CPU_SHARD_OK);
+        assert(cpu_shards_pop(cs, &token) == CPU_SHARD_OK && token == 6);
+        
+        // Another thread may empty a CPU's shard (here our own CPU's)
+        uint32_t stolen[4];
+        uint32_t cpu = (uint32_t)sched_getcpu();
+        assert(cpu_shards_count_at(cs, cpu) == 3);
+        assert(cpu_shards_steal(cs, cpu, stolen, 2) == 2 && stolen[0] == 3 && stolen[1] == 2);
+        assert(cpu_shards_steal(cs, cpu, stolen, 4) == 1 && stolen[0] == 1);
+        assert(cpu_shards_steal(cs, cpu, stolen, 4) == 0);
+        assert(cpu_shards_steal(cs, shards, stolen, 4) == 0);  // No such CPU
+        assert(sched_getcpu() == (int)cpu);
+        assert(cpu_shards_push(cs, 7) == CPU_SHARD_OK);
+        cpu_shards_reset(cs);
+        assert(cpu_shards_count(cs) == 0);
+        assert(cpu_shards_pop(cs, &token) == CPU_SHARD_EMPTY);
+    }
+    free(cs);
+    
+    // A pool with per-CPU free lists; one CPU can still use every block
+    const uint32_t capacity = 8;
+    const uint32_t block_size = 64;
+    uint32_t memory_size = (64 * 1024 + (uint32_t)memory_pool_percpu_size(capacity) + 63) & ~63u;
+    void* memory = aligned_alloc(64, memory_size);
+    assert(memory != NULL);
+    mem_pool_t pool;
+    assert(!memory_pool_init_percpu(&pool, memory, memory_size, block_size, CPU_SHARDS_MAX_CAPACITY + 1));
+    assert(memory_pool_init_percpu(&pool, memory, memory_size, block_size, capacity));
+    assert(pool.cpu_shards != NULL);
+    const uint32_t total = pool.num_blocks;
+    assert(memory_pool_free_count(&pool) == total);
+    
+    // The first allocation takes half a shard more out of the reserve
+    void* block = memory_pool_alloc(&pool);
+    assert(block != NULL);
+    assert(cpu_shards_count(pool.cpu_shards) == capacity / 2);
+    assert(ring_buffer_count(pool.free_blocks) == total - 1 - capacity / 2);
+    assert(memory_pool_free_count(&pool) == total - 1);
+    assert(memory_pool_free(&pool, block));
+    assert(cpu_shards_count(pool.cpu_shards) == capacity / 2 + 1);
+    
+    // Allocate everything, every block once
+    void** blocks = malloc(total * sizeof(void*));
+    uint8_t* seen = calloc(total, 1);
+    assert(blocks != NULL && seen != NULL);
+    for (uint32_t i = 0; i < total; i++) {
+        blocks[i] = memory_pool_alloc(&pool);
+        assert(blocks[i] != NULL);
+        uint32_t index = ((uint8_t*)blocks[i] - (uint8_t*)pool.pool_start) / block_size;
+        assert(index < total && !seen[index]);
+        seen[index] = 1;
+    }
+    assert(memory_pool_alloc(&pool) == NULL);
+    assert(memory_pool_used_count(&pool) == total);
+    
+    // Freeing overflows the shard into the reserve again and again
+    for (uint32_t i = 0; i < total; i++) {
+        assert(memory_pool_free(&pool, blocks[i]));
+        assert(cpu_shards_count(pool.cpu_shards) <= capacity);
+    }
+    assert(memory_pool_free_count(&pool) == total);
+    assert(!memory_pool_free(&pool, (uint8_t*)blocks[0] + 1));
+    
+    // Blocks cached by another CPU are taken before an allocation fails
+    if (shards > 1) {
+        uint32_t home = (uint32_t)sched_getcpu();
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(home == 0 ? 1 : 0, &set);
+        for (uint32_t i = 0; i < total; i++) {
+            blocks[i] = memory_pool_alloc(&pool);
+            assert(blocks[i] != NULL);
+        }
+        for (uint32_t i = 0; i < capacity; i++) {
+            assert(memory_pool_free(&pool, blocks[i]));  // Cached on our CPU
+        }
+        if (sched_setaffinity(0, sizeof(set), &set) == 0) {
+            for (uint32_t i = 0; i < capacity; i++) {
+                blocks[i] = memory_pool_alloc(&pool);
+                assert(blocks[i] != NULL);
+            }
+            assert(memory_pool_alloc(&pool) == NULL);
+        } else {
+            printf("  cannot move to another CPU, stealing not tested\n");
+            for (uint32_t i = 0; i < capacity; i++) {
+                blocks[i] = memory_pool_alloc(&pool);
+            }
+        }
+        for (uint32_t i = 0; i < total; i++) {
+            assert(memory_pool_free(&pool, blocks[i]));
+        }
+        pin_to_current_cpu(&set);
+    } else {
+        printf("  one CPU, stealing from other CPUs' shards not tested\n");
+    }
+    
+    // Reset moves the cached blocks back to the reserve
+    block = memory_pool_alloc(&pool);
+    assert(memory_pool_reset(&pool));
+    assert(cpu_shards_count(pool.cpu_shards) == 0);
+    assert(ring_buffer_count(pool.free_blocks) == total);
+    sched_setaffinity(0, sizeof(previous), &previous);
+    
+    // Threads on any CPU never get a block somebody else holds
+    pthread_t threads[PERCPU_TEST_THREADS];
+    for (int i = 0; i < PERCPU_TEST_THREADS; i++) {
+        pthread_create(&threads[i], NULL, percpu_worker, &pool);
+    }
+    for (int i = 0; i < PERCPU_TEST_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    assert(memory_pool_free_count(&pool) == total);
+    memory_pool_destroy(&pool, false);
+    free(memory);
+    free(blocks);
+    free(seen);
+    
+    // In shared memory every process must ask for the same shards
+    const char* shm_name = "/mempool_percpu_test";
+    shm_unlink(shm_name);
+    mem_pool_t creator, attached;
+    assert(memory_pool_init_shared_percpu(&creator, shm_name, memory_size, block_size, capacity, true, 0600));
+    assert(!memory_pool_init_shared_percpu(&attached, shm_name, memory_size, block_size, capacity * 2, false, 0600));
+    assert(memory_pool_init_shared_percpu(&attached, shm_name, memory_size, block_size, capacity, false, 0600));
+    assert(attached.num_blocks == creator.num_blocks);
+    
+    // A block allocated through one mapping is freed through the other
+    block = memory_pool_alloc(&creator);
+    assert(block != NULL);
+    void* same_block = (uint8_t*)attached.pool_start + ((uint8_t*)block - (uint8_t*)creator.pool_start);
+    assert(memory_pool_used_count(&attached) == 1);
+    assert(memory_pool_free(&attached, same_block));
+    assert(memory_pool_free_count(&creator) == creator.num_blocks);
+    
+    assert(memory_pool_destroy(&attached, false));
+    assert(memory_pool_destroy(&creator, true));
+}
@@ -0,0 +1,161 @@
+#include "priority_ring.h"
+
+// Ring buffers are padded to whole cache lines so neighbours never share one
+static uint32_t ring_stride(uint32_t capacity) {
+    return (uint32_t)((ring_buffer_size(capacity) + 63) & ~(size_t)63);
+}
+
+// Levels below `level` in a bitmap (none for the last level)
+static inline uint32_t levels_below(uint32_t mask, uint32_t level) {
+    return mask & ~((2u << level) - 1);
+}
+
+/**
+ * Get memory size required for a priority ring
+ *
+ * @param levels Number of priority levels (1 to PRIORITY_RING_MAX_LEVELS)
+ * @param capacity Items per level
+ * @return Size in bytes needed for the priority ring structure
+ */
+size_t priority_ring_size(uint32_t levels, uint32_t capacity) {
+    return sizeof(priority_ring_t) + (size_t)levels * ring_stride(capacity);
+}
+
+/**
+ * Initialize a priority ring
+ *
+ * @param pr Pointer to memory of priority_ring_size(levels, capacity) bytes
+ * @param levels Number of priority levels (1 to PRIORITY_RING_MAX_LEVELS)
+ * @param capacity Items per level
+ * @param starvation_limit Top-level items in a row before a lower level gets one (0 = strict priority)
+ * @return true on success, false on failure
+ */
+bool priority_ring_init(priority_ring_t* pr, uint32_t levels, uint32_t capacity,
+                        uint32_t starvation_limit) {
+    if (pr == NULL || levels == 0 || levels > PRIORITY_RING_MAX_LEVELS || capacity == 0) {
+        return false;
+    }
+    
+    pr->levels = levels;
+    pr->capacity = capacity;
+    pr->ring_stride = ring_stride(capacity);
+    pr->starvation_limit = starvation_limit;
+    atomic_store(&pr->nonempty, 0);
+    atomic_store(&pr->streak, 0);
+    atomic_store(&pr->boost_level, 0);
+    
+    for (uint32_t level = 0; level < levels; level++) {
+        if (!ring_buffer_init(priority_ring_level(pr, level), capacity)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Add an item at a priority level
+ *
+ * @param pr Pointer to priority ring
+ * @param level Priority level (0 is the highest)
+ * @param item Pointer to add
+ * @return true if successful, false if the level is full or invalid
+ */
+bool priority_ring_put(priority_ring_t* pr, uint32_t level, void* item) {
+    ring_buffer_t* rb = priority_ring_level(pr, level);
+    if (rb == NULL || !ring_buffer_put(rb, item)) {
+        return false;
+    }
+    
+    // Set the bit after the item is in, so a consumer that sees it finds the item
+    atomic_fetch_or(&pr->nonempty, 1u << level);
+    return true;
+}
+
+/**
+ * Remove the next item, highest priority first
+ *
+ * @param pr Pointer to priority ring
+ * @param level Receives the level the item came from (may be NULL)
+ * @return Pointer from the queue, or NULL if all levels are empty
+ */
+void* priority_ring_get(priority_ring_t* pr, uint32_t* level) {
+    if (pr == NULL) {
+        return NULL;
+    }
+    
+    for (;;) {
+        uint32_t mask = atomic_load(&pr->nonempty);
+        if (mask == 0) {
+            return NULL;
+        }
+        
+        uint32_t chosen = (uint32_t)__builtin_ctz(mask);
+        uint32_t lower = levels_below(mask, chosen);
+        
+        // Starvation protection: every starvation_limit + 1 items, serve a lower level
+        if (pr->starvation_limit != 0 && lower != 0) {
+            if (atomic_fetch_add(&pr->streak, 1) >= pr->starvation_limit) {
+                atomic_store(&pr->streak, 0);
+                
+                // Rotate through the waiting levels so middle ones get their turn too
+                uint32_t after = levels_below(lower, atomic_load(&pr->boost_level));
+                chosen = (uint32_t)__builtin_ctz(after != 0 ? after : lower);
+                atomic_store(&pr->boost_level, chosen);
+            }
+        }
+        
+        ring_buffer_t* rb = priority_ring_level(pr, chosen);
+        void* item = ring_buffer_get(rb);
+        if (item != NULL) {
+            if (level != NULL) {
+                *level = chosen;
+            }
+            return item;
+        }
+        
+        // The level ran dry: clear its bit, then look again in case a
+        // producer put an item in between (its bit set would be lost otherwise)
+        atomic_fetch_and(&pr->nonempty, ~(1u << chosen));
+        if (!ring_buffer_is_empty(rb)) {
+            atomic_fetch_or(&pr->nonempty, 1u << chosen);
+        }
+    }
+}
+
+/**
+ * Get the ring buffer of one level
+ *
+ * @param pr Pointer to priority ring
+ * @param level Priority level
+ * @return Ring buffer, or NULL if the level is invalid
+ */
+ring_buffer_t* priority_ring_level(priority_ring_t* pr, uint32_t level) {
+    if (pr == NULL || level >= pr->levels) {
+        return NULL;
+    }
+    return (ring_buffer_t*)(pr->rings + (size_t)level * pr->ring_stride);
+}
+
+/**
+ * Get number of items across all levels
+ *
+ * @param pr Pointer to priority ring
+ * @return Number of items
+ */
+uint32_t priority_ring_count(priority_ring_t* pr) {
+    uint32_t count = 0;
+    for (uint32_t level = 0; pr != NULL && level < pr->levels; level++) {
+        count += ring_buffer_count(priority_ring_level(pr, level));
+    }
+    return count;
+}
+
+/**
+ * Check if all levels are empty
+ *
+ * @param pr Pointer to priority ring
+ * @return true if empty, false otherwise
+ */
+bool priority_ring_is_empty(const priority_ring_t* pr) {
+    return priority_ring_count((priority_ring_t*)pr) == 0;
+}
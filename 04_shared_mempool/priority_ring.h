@@ -0,0 +1,97 @@
+#ifndef PRIORITY_RING_H
+#define PRIORITY_RING_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "ring_buffer.h"
+
+#define PRIORITY_RING_MAX_LEVELS 32     // Bits of the non-empty bitmap
+
+/**
+ * Priority queue made of one ring buffer per level (level 0 is the highest)
+ * Producers put into the ring of their level and set its bit in a shared
+ * bitmap; consumers take from the lowest set bit, so finding the highest
+ * waiting level is a single ctz. With a starvation limit, after that many
+ * consecutive items from the top level one item is taken from a lower
+ * non-empty level (rotating through them). The rings follow the header at
+ * fixed offsets, so the queue works in shared memory mapped at different
+ * addresses.
+ */
+typedef struct {
+    uint32_t levels;                        // Number of rings
+    uint32_t capacity;                      // Items per ring
+    uint32_t ring_stride;                   // Bytes from one ring to the next
+    uint32_t starvation_limit;              // Top-level items in a row before a lower level is served (0 = strict)
+    _Alignas(64) atomic_uint nonempty;      // Bit n set while level n may hold items
+    atomic_uint streak;                     // Items taken from the top level in a row while lower ones waited
+    atomic_uint boost_level;                // Lower level served last by the starvation rule
+    _Alignas(64) uint8_t rings[];           // levels ring buffers of ring_stride bytes each
+} priority_ring_t;
+
+/**
+ * Get memory size required for a priority ring
+ *
+ * @param levels Number of priority levels (1 to PRIORITY_RING_MAX_LEVELS)
+ * @param capacity Items per level
+ * @return Size in bytes needed for the priority ring structure
+ */
+size_t priority_ring_size(uint32_t levels, uint32_t capacity);
+
+/**
+ * Initialize a priority ring
+ *
+ * @param pr Pointer to memory of priority_ring_size(levels, capacity) bytes
+ * @param levels Number of priority levels (1 to PRIORITY_RING_MAX_LEVELS)
+ * @param capacity Items per level
+ * @param starvation_limit Top-level items in a row before a lower level gets one (0 = strict priority)
+ * @return true on success, false on failure
+ */
+bool priority_ring_init(priority_ring_t* pr, uint32_t levels, uint32_t capacity,
+                        uint32_t starvation_limit);
+
+/**
+ * Add an item at a priority level (thread-safe)
+ *
+ * @param pr Pointer to priority ring
+ * @param level Priority level (0 is the highest)
+ * @param item Pointer to add
+ * @return true if successful, false if the level is full or invalid
+ */
+bool priority_ring_put(priority_ring_t* pr, uint32_t level, void* item);
+
+/**
+ * Remove the next item, highest priority first (thread-safe)
+ *
+ * @param pr Pointer to priority ring
+ * @param level Receives the level the item came from (may be NULL)
+ * @return Pointer from the queue, or NULL if all levels are empty
+ */
+void* priority_ring_get(priority_ring_t* pr, uint32_t* level);
+
+/**
+ * Get the ring buffer of one level (e.g. to drain or inspect it)
+ *
+ * @param pr Pointer to priority ring
+ * @param level Priority level
+ * @return Ring buffer, or NULL if the level is invalid
+ */
+ring_buffer_t* priority_ring_level(priority_ring_t* pr, uint32_t level);
+
+/**
+ * Get number of items across all levels
+ *
+ * @param pr Pointer to priority ring
+ * @return Number of items
+ */
+uint32_t priority_ring_count(priority_ring_t* pr);
+
+/**
+ * Check if all levels are empty
+ *
+ * @param pr Pointer to priority ring
+ * @return true if empty, false otherwise
+ */
+bool priority_ring_is_empty(const priority_ring_t* pr);
+
+#endif
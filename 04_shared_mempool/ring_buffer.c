@@ -1,6 +1,9 @@
 #include "ring_buffer.h"
-#include <time.h>      // For nanosleep in spinlock
+#include "latency_histogram.h"
+#include "event_trace.h"
+#include "mempool_probes.h"
 #include <stdlib.h>    // For size_t
+#include <string.h>    // For memcpy in drain
 
 /**
  * Get memory size required for a ring buffer with given capacity
@@ -12,24 +15,36 @@ size_t ring_buffer_size(uint32_t capacity) {
     return sizeof(ring_buffer_t) + (capacity * sizeof(void*));
 }
 
-// Helper function for spinlock with backoff
-static void spinlock_acquire(atomic_uint* lock) {
-    uint32_t backoff = 1;
-    const uint32_t max_backoff = 1000;
-    
-    while (atomic_exchange(lock, 1) != 0) {
-        // Use exponential backoff to reduce contention
-        struct timespec ts = {0, backoff * 100};  // Nanoseconds
-        nanosleep(&ts, NULL);
-        
-        // Increase backoff time (capped at max_backoff)
-        if (backoff < max_backoff)
-            backoff *= 2;
+#ifdef MEMPOOL_STATS
+// Lock contention of this thread, collected by the pool after each operation
+static _Thread_local uint64_t lock_spins = 0;
+static _Thread_local uint64_t lock_backoffs = 0;
+#endif
+
+// Helper function for spinlock, waiting as the ring's wait strategy says
+// `kind` (trace_lock_t) names the lock in the trace when we have to wait
+static void spinlock_acquire(atomic_uint* lock, uint32_t strategy, uint16_t kind) {
+    if (wait_lock_try(lock)) {
+        return;
     }
+    
+    EVENT_TRACE(TRACE_LOCK_WAIT_BEGIN, 0, kind);
+    uint64_t wait_start = event_trace_clock_ns();  // Only read the clock once we have to wait
+    uint32_t sleeps;
+    uint32_t attempts = wait_lock_acquire_slow(lock, (wait_strategy_t)strategy, &sleeps);
+#ifdef MEMPOOL_STATS
+    lock_spins += attempts;
+    lock_backoffs += sleeps;
+#else
+    (void)sleeps;
+#endif
+    
+    EVENT_TRACE(TRACE_LOCK_WAIT_END, attempts, kind);
+    MEMPOOL_PROBE(mempool, lock_wait, lock, kind, attempts, event_trace_clock_ns() - wait_start);
 }
 
 static void spinlock_release(atomic_uint* lock) {
-    atomic_store(lock, 0);
+    wait_lock_release(lock);
 }
 
 /**
@@ -52,25 +67,32 @@ bool ring_buffer_init(ring_buffer_t* rb, uint32_t capacity) {
     atomic_store(&rb->count, 0);
     atomic_store(&rb->producer_lock, 0);
     atomic_store(&rb->consumer_lock, 0);
+    rb->wait_strategy = wait_strategy_default();
     
     return true;
 }
 
 /**
- * Add an item to the ring buffer
+ * Choose how threads wait for the ring's locks
  * 
  * @param rb Pointer to ring buffer
- * @param item Pointer to add to the buffer
- * @return true if successful, false if buffer is full
+ * @param strategy Wait strategy
  */
-bool ring_buffer_put(ring_buffer_t* rb, void* item) {
+void ring_buffer_set_wait_strategy(ring_buffer_t* rb, wait_strategy_t strategy) {
+    if (rb != NULL) {
+        rb->wait_strategy = strategy;
+    }
+}
+
+// Add an item under the producer lock
+static bool ring_put(ring_buffer_t* rb, void* item) {
     // Check for null pointers or full buffer without locking
     if (rb == NULL || atomic_load(&rb->count) >= rb->capacity) {
         return false;  // Buffer is full
     }
     
     // Acquire the producer lock
-    spinlock_acquire(&rb->producer_lock);
+    spinlock_acquire(&rb->producer_lock, rb->wait_strategy, TRACE_LOCK_RING_PRODUCER);
     
     // Check again now that we have the lock
     bool success = false;
@@ -96,20 +118,49 @@ bool ring_buffer_put(ring_buffer_t* rb, void* item) {
     return success;
 }
 
-/**
- * Remove and return an item from the ring buffer
- * 
- * @param rb Pointer to ring buffer
- * @return Pointer from the buffer, or NULL if buffer is empty
- */
-void* ring_buffer_get(ring_buffer_t* rb) {
+// Add up to count items under the producer lock
+static uint32_t ring_put_batch(ring_buffer_t* rb, void* const* items, uint32_t count) {
+    // Check for null pointers or full buffer without locking
+    if (rb == NULL || items == NULL || count == 0 || atomic_load(&rb->count) >= rb->capacity) {
+        return 0;
+    }
+    
+    spinlock_acquire(&rb->producer_lock, rb->wait_strategy, TRACE_LOCK_RING_PRODUCER);
+    
+    // Consumers only free slots while we hold the lock, so this much surely fits
+    uint32_t stored = rb->capacity - atomic_load(&rb->count);
+    if (stored > count) {
+        stored = count;
+    }
+    
+    if (stored > 0) {
+        // At most two runs: up to the end of the array, then from slot 0
+        uint32_t tail = atomic_load(&rb->tail);
+        uint32_t first = rb->capacity - tail;
+        if (first > stored) {
+            first = stored;
+        }
+        memcpy(&rb->buffer[tail], items, first * sizeof(void*));
+        memcpy(&rb->buffer[0], items + first, (stored - first) * sizeof(void*));
+        
+        atomic_store(&rb->tail, (tail + stored) % rb->capacity);
+        atomic_fetch_add(&rb->count, stored);
+    }
+    
+    spinlock_release(&rb->producer_lock);
+    
+    return stored;
+}
+
+// Remove an item under the consumer lock
+static void* ring_get(ring_buffer_t* rb) {
     // Check for null pointers or empty buffer without locking
     if (rb == NULL || atomic_load(&rb->count) == 0) {
         return NULL;  // Buffer is empty
     }
     
     // Acquire the consumer lock
-    spinlock_acquire(&rb->consumer_lock);
+    spinlock_acquire(&rb->consumer_lock, rb->wait_strategy, TRACE_LOCK_RING_CONSUMER);
     
     // Check again now that we have the lock
     void* item = NULL;
@@ -118,8 +169,8 @@ void* ring_buffer_get(ring_buffer_t* rb) {
         uint32_t head = atomic_load(&rb->head);
         
         // Get the item
-        item = (void *)&rb->buffer[head];
-
+        item = rb->buffer[head];
+        
         // Update head position
         atomic_store(&rb->head, (head + 1) % rb->capacity);
         
@@ -133,6 +184,199 @@ void* ring_buffer_get(ring_buffer_t* rb) {
     return item;
 }
 
+// Remove up to max items under the consumer lock
+static uint32_t ring_drain(ring_buffer_t* rb, void** items, uint32_t max) {
+    // Check for null pointers or empty buffer without locking
+    if (rb == NULL || items == NULL || max == 0 || atomic_load(&rb->count) == 0) {
+        return 0;
+    }
+    
+    spinlock_acquire(&rb->consumer_lock, rb->wait_strategy, TRACE_LOCK_RING_CONSUMER);
+    
+    // Everything committed so far is ours; producers only append behind it
+    uint32_t taken = atomic_load(&rb->count);
+    if (taken > max) {
+        taken = max;
+    }
+    
+    if (taken > 0) {
+        // At most two runs: up to the end of the array, then from slot 0
+        uint32_t head = atomic_load(&rb->head);
+        uint32_t first = rb->capacity - head;
+        if (first > taken) {
+            first = taken;
+        }
+        memcpy(items, &rb->buffer[head], first * sizeof(void*));
+        memcpy(items + first, &rb->buffer[0], (taken - first) * sizeof(void*));
+        
+        atomic_store(&rb->head, (head + taken) % rb->capacity);
+        atomic_fetch_sub(&rb->count, taken);
+    }
+    
+    spinlock_release(&rb->consumer_lock);
+    
+    return taken;
+}
+
+/**
+ * Add an item to the ring buffer
+ * 
+ * @param rb Pointer to ring buffer
+ * @param item Pointer to add to the buffer
+ * @return true if successful, false if buffer is full
+ */
+bool ring_buffer_put(ring_buffer_t* rb, void* item) {
+    bool success;
+    LATENCY_TIMED(LATENCY_RING_PUT, success, ring_put(rb, item));
+    EVENT_TRACE(TRACE_RING_PUT, ring_buffer_count(rb), success);
+    MEMPOOL_PROBE(mempool, ring_put, rb, item, success);
+    return success;
+}
+
+/**
+ * Add an item without timing it
+ * 
+ * @param rb Pointer to ring buffer
+ * @param item Pointer to add to the buffer
+ * @return true if successful, false if buffer is full
+ */
+bool ring_buffer_put_untimed(ring_buffer_t* rb, void* item) {
+    bool success = ring_put(rb, item);
+    EVENT_TRACE(TRACE_RING_PUT, ring_buffer_count(rb), success);
+    MEMPOOL_PROBE(mempool, ring_put, rb, item, success);
+    return success;
+}
+
+/**
+ * Add up to count items in one lock acquisition
+ * 
+ * @param rb Pointer to ring buffer
+ * @param items Items to add, oldest first
+ * @param count Number of items
+ * @return Number of items added (fewer than count if the buffer filled up)
+ */
+uint32_t ring_buffer_put_batch(ring_buffer_t* rb, void* const* items, uint32_t count) {
+    uint32_t stored = ring_put_batch(rb, items, count);
+    EVENT_TRACE(TRACE_RING_PUT, ring_buffer_count(rb), stored != 0);
+    MEMPOOL_PROBE(mempool, ring_put_batch, rb, stored);
+    return stored;
+}
+
+/**
+ * Remove and return an item from the ring buffer
+ * 
+ * @param rb Pointer to ring buffer
+ * @return Pointer from the buffer, or NULL if buffer is empty
+ */
+void* ring_buffer_get(ring_buffer_t* rb) {
+    void* item;
+    LATENCY_TIMED(LATENCY_RING_GET, item, ring_get(rb));
+    EVENT_TRACE(TRACE_RING_GET, ring_buffer_count(rb), item != NULL);
+    MEMPOOL_PROBE(mempool, ring_get, rb, item);
+    return item;
+}
+
+/**
+ * Remove an item without timing it
+ * 
+ * @param rb Pointer to ring buffer
+ * @return Pointer from the buffer, or NULL if buffer is empty
+ */
+void* ring_buffer_get_untimed(ring_buffer_t* rb) {
+    void* item = ring_get(rb);
+    EVENT_TRACE(TRACE_RING_GET, ring_buffer_count(rb), item != NULL);
+    MEMPOOL_PROBE(mempool, ring_get, rb, item);
+    return item;
+}
+
+/**
+ * Remove up to max items in one lock acquisition
+ * 
+ * @param rb Pointer to ring buffer
+ * @param items Receives the items, oldest first
+ * @param max Capacity of items
+ * @return Number of items removed (0 if buffer is empty)
+ */
+uint32_t ring_buffer_drain(ring_buffer_t* rb, void** items, uint32_t max) {
+    uint32_t taken = ring_drain(rb, items, max);
+    EVENT_TRACE(TRACE_RING_GET, ring_buffer_count(rb), taken != 0);
+    MEMPOOL_PROBE(mempool, ring_drain, rb, taken);
+    return taken;
+}
+
+/**
+ * Return the oldest item without removing it
+ * 
+ * @param rb Pointer to ring buffer
+ * @return Pointer from the buffer, or NULL if buffer is empty
+ */
+void* ring_buffer_peek(ring_buffer_t* rb) {
+    if (rb == NULL || atomic_load(&rb->count) == 0) {
+        return NULL;
+    }
+    
+    // The consumer lock keeps the head item from being taken while we read it
+    spinlock_acquire(&rb->consumer_lock, rb->wait_strategy, TRACE_LOCK_RING_CONSUMER);
+    void* item = NULL;
+    if (atomic_load(&rb->count) > 0) {
+        item = rb->buffer[atomic_load(&rb->head)];
+    }
+    spinlock_release(&rb->consumer_lock);
+    
+    return item;
+}
+
+/**
+ * Start iterating over the items present now and take the consumer lock
+ * 
+ * @param rb Pointer to ring buffer
+ * @param it Iterator to set up
+ * @return Number of items the iterator will visit
+ */
+uint32_t ring_buffer_iter_begin(ring_buffer_t* rb, ring_buffer_iter_t* it) {
+    it->rb = rb;
+    it->position = 0;
+    it->remaining = 0;
+    if (rb == NULL) {
+        return 0;
+    }
+    
+    spinlock_acquire(&rb->consumer_lock, rb->wait_strategy, TRACE_LOCK_RING_CONSUMER);
+    it->position = atomic_load(&rb->head);
+    it->remaining = atomic_load(&rb->count);
+    return it->remaining;
+}
+
+/**
+ * Get the next item of the iteration
+ * 
+ * @param it Iterator from ring_buffer_iter_begin
+ * @param item Receives the item
+ * @return true if an item was returned, false at the end
+ */
+bool ring_buffer_iter_next(ring_buffer_iter_t* it, void** item) {
+    if (it->remaining == 0) {
+        return false;
+    }
+    
+    *item = it->rb->buffer[it->position];
+    it->position = (it->position + 1) % it->rb->capacity;
+    it->remaining--;
+    return true;
+}
+
+/**
+ * Finish an iteration and release the consumer lock
+ * 
+ * @param it Iterator from ring_buffer_iter_begin
+ */
+void ring_buffer_iter_end(ring_buffer_iter_t* it) {
+    if (it->rb != NULL) {
+        spinlock_release(&it->rb->consumer_lock);
+        it->rb = NULL;
+    }
+}
+
 /**
  * Check if ring buffer is empty
  * 
@@ -163,6 +407,24 @@ uint32_t ring_buffer_count(const ring_buffer_t* rb) {
     return (rb == NULL) ? 0 : atomic_load(&rb->count);
 }
 
+/**
+ * Take the spinlock contention counted for the calling thread
+ * 
+ * @param spins Receives failed lock acquisition attempts
+ * @param backoffs Receives nanosleep calls while waiting
+ */
+void ring_buffer_take_lock_stats(uint64_t* spins, uint64_t* backoffs) {
+#ifdef MEMPOOL_STATS
+    *spins = lock_spins;
+    *backoffs = lock_backoffs;
+    lock_spins = 0;
+    lock_backoffs = 0;
+#else
+    *spins = 0;
+    *backoffs = 0;
+#endif
+}
+
 /**
  * Reset ring buffer to empty state
  * 
@@ -171,8 +433,8 @@ uint32_t ring_buffer_count(const ring_buffer_t* rb) {
 void ring_buffer_reset(ring_buffer_t* rb) {
     if (rb != NULL) {
         // Acquire both locks for reset
-        spinlock_acquire(&rb->producer_lock);
-        spinlock_acquire(&rb->consumer_lock);
+        spinlock_acquire(&rb->producer_lock, rb->wait_strategy, TRACE_LOCK_RING_PRODUCER);
+        spinlock_acquire(&rb->consumer_lock, rb->wait_strategy, TRACE_LOCK_RING_CONSUMER);
         
         atomic_store(&rb->head, 0);
         atomic_store(&rb->tail, 0);
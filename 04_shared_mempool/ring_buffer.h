@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdatomic.h>  // For atomic operations
+#include "wait_strategy.h"
 
 /**
  * Ring Buffer Structure for Multi-Producer Multi-Consumer (MPMC)
@@ -16,9 +17,21 @@ typedef struct {
     atomic_uint count;        // Number of elements currently in buffer
     atomic_uint producer_lock; // Lock for producers
     atomic_uint consumer_lock; // Lock for consumers
+    uint32_t wait_strategy;   // wait_strategy_t for both locks
     void* buffer[];           // Flexible array member for pointers
 } ring_buffer_t;
 
+/**
+ * Iterator over the items of a ring buffer, oldest first
+ * Holds the consumer lock from ring_buffer_iter_begin to ring_buffer_iter_end,
+ * so the items it visits stay in place (producers may still append)
+ */
+typedef struct {
+    ring_buffer_t* rb;        // Ring buffer being inspected
+    uint32_t position;        // Slot of the next item
+    uint32_t remaining;       // Items left of those present at begin
+} ring_buffer_iter_t;
+
 /**
  * Get memory size required for a ring buffer with given capacity
  *
@@ -36,6 +49,15 @@ size_t ring_buffer_size(uint32_t capacity);
  */
 bool ring_buffer_init(ring_buffer_t* rb, uint32_t capacity);
 
+/**
+ * Choose how threads wait for the ring's locks (ring_buffer_init takes the
+ * MEMPOOL_WAIT_STRATEGY default); only while no thread uses the ring
+ * 
+ * @param rb Pointer to ring buffer
+ * @param strategy Wait strategy
+ */
+void ring_buffer_set_wait_strategy(ring_buffer_t* rb, wait_strategy_t strategy);
+
 /**
  * Add an item to the ring buffer (thread-safe)
  * 
@@ -45,6 +67,16 @@ bool ring_buffer_init(ring_buffer_t* rb, uint32_t capacity);
  */
 bool ring_buffer_put(ring_buffer_t* rb, void* item);
 
+/**
+ * Add up to count items in one lock acquisition (thread-safe)
+ * 
+ * @param rb Pointer to ring buffer
+ * @param items Items to add, oldest first
+ * @param count Number of items
+ * @return Number of items added (fewer than count if the buffer filled up)
+ */
+uint32_t ring_buffer_put_batch(ring_buffer_t* rb, void* const* items, uint32_t count);
+
 /**
  * Remove and return an item from the ring buffer (thread-safe)
  * 
@@ -53,6 +85,59 @@ bool ring_buffer_put(ring_buffer_t* rb, void* item);
  */
 void* ring_buffer_get(ring_buffer_t* rb);
 
+/**
+ * ring_buffer_put and ring_buffer_get without the MEMPOOL_LATENCY histograms,
+ * for structures built on a ring that time their own operations (the pool),
+ * so their operations are not counted twice
+ */
+bool ring_buffer_put_untimed(ring_buffer_t* rb, void* item);
+void* ring_buffer_get_untimed(ring_buffer_t* rb);
+
+/**
+ * Remove up to max items in one lock acquisition (thread-safe)
+ * 
+ * @param rb Pointer to ring buffer
+ * @param items Receives the items, oldest first
+ * @param max Capacity of items
+ * @return Number of items removed (0 if buffer is empty)
+ */
+uint32_t ring_buffer_drain(ring_buffer_t* rb, void** items, uint32_t max);
+
+/**
+ * Return the oldest item without removing it (thread-safe)
+ * 
+ * @param rb Pointer to ring buffer
+ * @return Pointer from the buffer, or NULL if buffer is empty
+ */
+void* ring_buffer_peek(ring_buffer_t* rb);
+
+/**
+ * Start iterating over the items present now and take the consumer lock
+ * Every call must be paired with ring_buffer_iter_end; keep the loop short,
+ * consumers wait for it
+ * 
+ * @param rb Pointer to ring buffer
+ * @param it Iterator to set up
+ * @return Number of items the iterator will visit
+ */
+uint32_t ring_buffer_iter_begin(ring_buffer_t* rb, ring_buffer_iter_t* it);
+
+/**
+ * Get the next item of the iteration
+ * 
+ * @param it Iterator from ring_buffer_iter_begin
+ * @param item Receives the item
+ * @return true if an item was returned, false at the end
+ */
+bool ring_buffer_iter_next(ring_buffer_iter_t* it, void** item);
+
+/**
+ * Finish an iteration and release the consumer lock
+ * 
+ * @param it Iterator from ring_buffer_iter_begin
+ */
+void ring_buffer_iter_end(ring_buffer_iter_t* it);
+
 /**
  * Check if ring buffer is empty
  * 
@@ -77,6 +162,15 @@ bool ring_buffer_is_full(const ring_buffer_t* rb);
  */
 uint32_t ring_buffer_count(const ring_buffer_t* rb);
 
+/**
+ * Take the spinlock contention counted for the calling thread since the
+ * last call (always 0 unless built with MEMPOOL_STATS)
+ * 
+ * @param spins Receives failed lock acquisition attempts
+ * @param backoffs Receives nanosleep calls while waiting
+ */
+void ring_buffer_take_lock_stats(uint64_t* spins, uint64_t* backoffs);
+
 /**
  * Reset ring buffer to empty state
  * 
@@ -0,0 +1,146 @@
+#include "wait_strategy.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>      // For nanosleep
+#include <sched.h>     // For sched_yield
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+// Lock word values; 2 tells the holder that futex waiters need a wake-up
+#define LOCK_FREE 0
+#define LOCK_HELD 1
+#define LOCK_CONTENDED 2
+
+static const char* const strategy_names[] = {"backoff", "spin", "yield", "futex"};
+
+// Tell the CPU we are spinning (saves power, frees the sibling hyperthread)
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// futex on a shared (not process-private) word
+static long futex(atomic_uint* word, int op, uint32_t value) {
+    return syscall(SYS_futex, word, op, value, NULL, NULL, 0);
+}
+
+/**
+ * Get the strategy named by MEMPOOL_WAIT_STRATEGY
+ *
+ * @return Default wait strategy for this process
+ */
+wait_strategy_t wait_strategy_default(void) {
+    wait_strategy_t strategy = WAIT_BACKOFF;
+    const char* name = getenv(WAIT_STRATEGY_ENV);
+    if (name != NULL && !wait_strategy_parse(name, &strategy)) {
+        strategy = WAIT_BACKOFF;
+    }
+    return strategy;
+}
+
+/**
+ * Parse a strategy name
+ *
+ * @param name backoff, spin, yield or futex
+ * @param strategy Receives the strategy
+ * @return true on success, false if the name is unknown
+ */
+bool wait_strategy_parse(const char* name, wait_strategy_t* strategy) {
+    for (int i = 0; i < (int)(sizeof(strategy_names) / sizeof(strategy_names[0])); i++) {
+        if (strcmp(name, strategy_names[i]) == 0) {
+            *strategy = (wait_strategy_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Get the name of a strategy
+ *
+ * @param strategy Wait strategy
+ * @return Name as accepted by wait_strategy_parse
+ */
+const char* wait_strategy_name(wait_strategy_t strategy) {
+    if ((unsigned)strategy >= sizeof(strategy_names) / sizeof(strategy_names[0])) {
+        return "unknown";
+    }
+    return strategy_names[strategy];
+}
+
+/**
+ * Take a lock word after wait_lock_try failed, waiting as the strategy says
+ *
+ * @param lock Lock word (0 = free)
+ * @param strategy Wait strategy
+ * @param sleeps Receives how often the thread gave up the CPU (nanosleep, yield or futex wait)
+ * @return Failed acquisition attempts
+ */
+uint32_t wait_lock_acquire_slow(atomic_uint* lock, wait_strategy_t strategy, uint32_t* sleeps) {
+    uint32_t attempts = 1;  // The wait_lock_try that sent us here
+    *sleeps = 0;
+    
+    if (strategy == WAIT_BACKOFF) {
+        uint32_t backoff = 1;
+        const uint32_t max_backoff = 1000;
+        
+        for (;;) {
+            // Use exponential backoff to reduce contention
+            struct timespec ts = {0, backoff * 100};  // Nanoseconds
+            nanosleep(&ts, NULL);
+            (*sleeps)++;
+            
+            if (wait_lock_try(lock)) {
+                return attempts;
+            }
+            attempts++;
+            
+            // Increase backoff time (capped at max_backoff)
+            if (backoff < max_backoff)
+                backoff *= 2;
+        }
+    }
+    
+    // Spin on plain loads so waiters do not bounce the cache line between them
+    uint32_t spins = 0;
+    for (;;) {
+        cpu_relax();
+        if (atomic_load_explicit(lock, memory_order_relaxed) == LOCK_FREE && wait_lock_try(lock)) {
+            return attempts;
+        }
+        attempts++;
+        
+        if (strategy == WAIT_SPIN || ++spins < WAIT_SPIN_LIMIT) {
+            continue;
+        }
+        if (strategy == WAIT_YIELD) {
+            sched_yield();
+            (*sleeps)++;
+            continue;
+        }
+        break;  // WAIT_FUTEX: stop spinning and sleep
+    }
+    
+    // Mark the lock contended so the holder wakes us, and sleep while it stays held
+    while (atomic_exchange(lock, LOCK_CONTENDED) != LOCK_FREE) {
+        futex(lock, FUTEX_WAIT, LOCK_CONTENDED);
+        (*sleeps)++;
+        attempts++;
+    }
+    return attempts;
+}
+
+/**
+ * Release a lock word, waking a futex waiter if there is one
+ *
+ * @param lock Lock word
+ */
+void wait_lock_release(atomic_uint* lock) {
+    if (atomic_exchange(lock, LOCK_FREE) == LOCK_CONTENDED) {
+        futex(lock, FUTEX_WAKE, 1);
+    }
+}
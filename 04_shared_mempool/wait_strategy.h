@@ -0,0 +1,75 @@
+#ifndef WAIT_STRATEGY_H
+#define WAIT_STRATEGY_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define WAIT_STRATEGY_ENV "MEMPOOL_WAIT_STRATEGY"  // Default for new rings, pools and trackers
+#define WAIT_SPIN_LIMIT 128                        // PAUSE rounds before yield/futex strategies give up the CPU
+
+/**
+ * How a thread waits for a lock word held by someone else
+ * The strategy is stored next to the lock in (shared) memory, so every
+ * process uses the same one; change it only while nobody holds the lock.
+ */
+typedef enum {
+    WAIT_BACKOFF = 0,   // Exponential nanosleep (0.1 to 100 us), the original behaviour
+    WAIT_SPIN = 1,      // PAUSE until free: lowest latency, burns the CPU (pinned threads)
+    WAIT_YIELD = 2,     // PAUSE for a while, then sched_yield between attempts
+    WAIT_FUTEX = 3      // PAUSE for a while, then sleep on a process-shared futex
+} wait_strategy_t;
+
+/**
+ * Get the strategy named by MEMPOOL_WAIT_STRATEGY (backoff, spin, yield
+ * or futex), WAIT_BACKOFF when unset or unknown
+ *
+ * @return Default wait strategy for this process
+ */
+wait_strategy_t wait_strategy_default(void);
+
+/**
+ * Parse a strategy name
+ *
+ * @param name backoff, spin, yield or futex
+ * @param strategy Receives the strategy
+ * @return true on success, false if the name is unknown
+ */
+bool wait_strategy_parse(const char* name, wait_strategy_t* strategy);
+
+/**
+ * Get the name of a strategy
+ *
+ * @param strategy Wait strategy
+ * @return Name as accepted by wait_strategy_parse
+ */
+const char* wait_strategy_name(wait_strategy_t strategy);
+
+/**
+ * Try to take a lock word once
+ *
+ * @param lock Lock word (0 = free)
+ * @return true if the lock was taken
+ */
+static inline bool wait_lock_try(atomic_uint* lock) {
+    uint32_t expected = 0;
+    return atomic_compare_exchange_strong(lock, &expected, 1);
+}
+
+/**
+ * Take a lock word after wait_lock_try failed, waiting as the strategy says
+ *
+ * @param lock Lock word (0 = free)
+ * @param strategy Wait strategy
+ * @param sleeps Receives how often the thread gave up the CPU (nanosleep, yield or futex wait)
+ * @return Failed acquisition attempts
+ */
+uint32_t wait_lock_acquire_slow(atomic_uint* lock, wait_strategy_t strategy, uint32_t* sleeps);
+
+/**
+ * Release a lock word, waking a futex waiter if there is one
+ *
+ * @param lock Lock word
+ */
+void wait_lock_release(atomic_uint* lock);
+
+#endif
@@ -0,0 +1,304 @@
+#include "channel_directory.h"
+#include <string.h>
+
+// Helper function for spinlock, waiting as the directory's wait strategy says
+static void spinlock_acquire(atomic_uint* lock, uint32_t strategy) {
+    if (wait_lock_try(lock)) {
+        return;
+    }
+    
+    uint32_t sleeps;
+    wait_lock_acquire_slow(lock, (wait_strategy_t)strategy, &sleeps);
+}
+
+static void spinlock_release(atomic_uint* lock) {
+    wait_lock_release(lock);
+}
+
+// FNV-1a hash of a channel name
+static uint32_t channel_hash(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (const char* p = name; *p != '\0'; p++) {
+        hash ^= (uint8_t)*p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Channels and messages are referenced by offset so every process can
+// resolve them whatever address it mapped the pools at
+static inline uint32_t block_to_offset(const mem_pool_t* pool, const void* block) {
+    return (uint32_t)((const uint8_t*)block - (const uint8_t*)pool->pool_start);
+}
+
+static inline void* offset_to_block(const mem_pool_t* pool, uint32_t offset) {
+    return (uint8_t*)pool->pool_start + offset;
+}
+
+// Drop the oldest logged message (channel lock held)
+static void channel_drop_oldest(channel_t* channel, mem_pool_t* message_pool) {
+    uint32_t slot = channel->head % CHANNEL_LOG_CAPACITY;
+    memory_pool_free(message_pool, offset_to_block(message_pool, channel->log[slot]));
+    channel->unread[slot] = 0;
+    channel->head++;
+}
+
+// Free messages at the head of the log that every member has read (channel lock held)
+static void channel_trim(channel_t* channel, mem_pool_t* message_pool) {
+    uint32_t tail = atomic_load(&channel->tail);
+    while (channel->head != tail && channel->unread[channel->head % CHANNEL_LOG_CAPACITY] == 0) {
+        channel_drop_oldest(channel, message_pool);
+    }
+}
+
+// Initialize an empty directory
+bool channel_directory_init(channel_directory_t* directory) {
+    if (directory == NULL) {
+        return false;
+    }
+    
+    memset(directory, 0, sizeof(channel_directory_t));
+    atomic_store(&directory->index_lock, 0);
+    atomic_store(&directory->channel_count, 0);
+    directory->wait_strategy = wait_strategy_default();
+    
+    return true;
+}
+
+// Find a channel by name, NULL if it does not exist
+channel_t* channel_lookup(channel_directory_t* directory, mem_pool_t* channel_pool, const char* name) {
+    if (directory == NULL || channel_pool == NULL || name == NULL) {
+        return NULL;
+    }
+    
+    uint32_t home = channel_hash(name) & (CHANNEL_INDEX_SIZE - 1);
+    
+    for (uint32_t i = 0; i < CHANNEL_INDEX_SIZE; i++) {
+        uint32_t entry = atomic_load(&directory->name_index[(home + i) & (CHANNEL_INDEX_SIZE - 1)]);
+        if (entry == 0) {
+            break;  // End of the probe chain
+        }
+        
+        channel_t* channel = offset_to_block(channel_pool, entry - 1);
+        if (strncmp(channel->name, name, MAX_CHANNEL_NAME) == 0) {
+            return channel;
+        }
+    }
+    
+    return NULL;
+}
+
+// Find a channel by name, creating it if needed
+channel_t* channel_open(channel_directory_t* directory, mem_pool_t* channel_pool, const char* name) {
+    if (name == NULL || strlen(name) == 0 || strlen(name) >= MAX_CHANNEL_NAME) {
+        return NULL;
+    }
+    
+    // Fast path: channel already exists
+    channel_t* channel = channel_lookup(directory, channel_pool, name);
+    if (channel != NULL) {
+        return channel;
+    }
+    
+    // Creation is rare, so it is serialized on the directory lock
+    spinlock_acquire(&directory->index_lock, directory->wait_strategy);
+    
+    // Someone may have created it while we waited
+    channel = channel_lookup(directory, channel_pool, name);
+    if (channel != NULL) {
+        spinlock_release(&directory->index_lock);
+        return channel;
+    }
+    
+    channel = memory_pool_alloc(channel_pool);
+    if (channel == NULL) {
+        spinlock_release(&directory->index_lock);
+        return NULL;  // No more channels
+    }
+    
+    memset(channel, 0, sizeof(channel_t));
+    strncpy(channel->name, name, MAX_CHANNEL_NAME - 1);
+    atomic_store(&channel->lock, 0);
+    channel->wait_strategy = directory->wait_strategy;
+    atomic_store(&channel->members, 0);
+    atomic_store(&channel->tail, 0);
+    
+    // Publish the fully initialized channel in the first free index entry
+    uint32_t home = channel_hash(name) & (CHANNEL_INDEX_SIZE - 1);
+    for (uint32_t i = 0; i < CHANNEL_INDEX_SIZE; i++) {
+        uint32_t pos = (home + i) & (CHANNEL_INDEX_SIZE - 1);
+        if (atomic_load(&directory->name_index[pos]) == 0) {
+            atomic_store(&directory->name_index[pos], block_to_offset(channel_pool, channel) + 1);
+            atomic_fetch_add(&directory->channel_count, 1);
+            spinlock_release(&directory->index_lock);
+            return channel;
+        }
+    }
+    
+    // Index full
+    memory_pool_free(channel_pool, channel);
+    spinlock_release(&directory->index_lock);
+    return NULL;
+}
+
+// Add a participant to a channel; it only sees messages posted afterwards
+bool channel_join(channel_t* channel, int participant_id) {
+    if (channel == NULL || participant_id < 0 || participant_id >= CHANNEL_MAX_MEMBERS) {
+        return false;
+    }
+    
+    spinlock_acquire(&channel->lock, channel->wait_strategy);
+    channel->read_seq[participant_id] = atomic_load(&channel->tail);
+    atomic_fetch_or(&channel->members, 1u << participant_id);
+    spinlock_release(&channel->lock);
+    
+    return true;
+}
+
+// Remove a participant from a channel, releasing its unread messages
+void channel_leave(channel_t* channel, int participant_id, mem_pool_t* message_pool) {
+    if (channel == NULL || message_pool == NULL ||
+        participant_id < 0 || participant_id >= CHANNEL_MAX_MEMBERS) {
+        return;
+    }
+    
+    uint32_t bit = 1u << participant_id;
+    
+    spinlock_acquire(&channel->lock, channel->wait_strategy);
+    
+    atomic_fetch_and(&channel->members, ~bit);
+    
+    uint32_t tail = atomic_load(&channel->tail);
+    for (uint32_t seq = channel->head; seq != tail; seq++) {
+        channel->unread[seq % CHANNEL_LOG_CAPACITY] &= ~bit;
+    }
+    channel_trim(channel, message_pool);
+    
+    spinlock_release(&channel->lock);
+}
+
+// Allocate a message block for a channel
+void* channel_alloc_message(channel_t* channel, mem_pool_t* message_pool) {
+    if (channel == NULL || message_pool == NULL) {
+        return NULL;
+    }
+    
+    void* block = memory_pool_alloc(message_pool);
+    if (block != NULL) {
+        return block;
+    }
+    
+    // Pool exhausted: take over the channel's oldest message, read or not
+    spinlock_acquire(&channel->lock, channel->wait_strategy);
+    if (channel->head != atomic_load(&channel->tail)) {
+        uint32_t slot = channel->head % CHANNEL_LOG_CAPACITY;
+        block = offset_to_block(message_pool, channel->log[slot]);
+        channel->unread[slot] = 0;
+        channel->head++;
+    }
+    spinlock_release(&channel->lock);
+    
+    return block;
+}
+
+// Post a message block to all members (the channel takes ownership of the block)
+bool channel_post(channel_t* channel, mem_pool_t* message_pool, void* block) {
+    if (channel == NULL || message_pool == NULL || block == NULL) {
+        return false;
+    }
+    
+    spinlock_acquire(&channel->lock, channel->wait_strategy);
+    
+    uint32_t members = atomic_load(&channel->members);
+    if (members == 0) {
+        // Nobody to deliver to
+        spinlock_release(&channel->lock);
+        memory_pool_free(message_pool, block);
+        return true;
+    }
+    
+    // A full log drops its oldest message rather than blocking the channel
+    uint32_t tail = atomic_load(&channel->tail);
+    if (tail - channel->head == CHANNEL_LOG_CAPACITY) {
+        channel_drop_oldest(channel, message_pool);
+    }
+    
+    uint32_t slot = tail % CHANNEL_LOG_CAPACITY;
+    channel->log[slot] = block_to_offset(message_pool, block);
+    channel->unread[slot] = members;
+    atomic_store(&channel->tail, tail + 1);
+    
+    spinlock_release(&channel->lock);
+    return true;
+}
+
+// Deliver the participant's unread messages, oldest first
+int channel_receive(channel_t* channel, mem_pool_t* message_pool, int participant_id,
+                    channel_message_callback_t callback, void* context) {
+    if (channel == NULL || message_pool == NULL || callback == NULL ||
+        participant_id < 0 || participant_id >= CHANNEL_MAX_MEMBERS) {
+        return 0;
+    }
+    
+    uint32_t bit = 1u << participant_id;
+    if (!channel_has_unread(channel, participant_id)) {
+        return 0;
+    }
+    
+    spinlock_acquire(&channel->lock, channel->wait_strategy);
+    
+    // Messages dropped while we were behind are skipped
+    uint32_t seq = channel->read_seq[participant_id];
+    if ((int32_t)(seq - channel->head) < 0) {
+        seq = channel->head;
+    }
+    
+    int delivered = 0;
+    uint32_t tail = atomic_load(&channel->tail);
+    for (; seq != tail; seq++) {
+        uint32_t slot = seq % CHANNEL_LOG_CAPACITY;
+        if ((channel->unread[slot] & bit) == 0) {
+            continue;
+        }
+        
+        callback(channel, offset_to_block(message_pool, channel->log[slot]), context);
+        channel->unread[slot] &= ~bit;
+        delivered++;
+    }
+    
+    channel->read_seq[participant_id] = tail;
+    channel_trim(channel, message_pool);
+    
+    spinlock_release(&channel->lock);
+    return delivered;
+}
+
+// Remove a participant from every channel it is a member of
+void channel_directory_release_participant(channel_directory_t* directory, mem_pool_t* channel_pool,
+                                           int participant_id, mem_pool_t* message_pool) {
+    if (directory == NULL || channel_pool == NULL || message_pool == NULL ||
+        participant_id < 0 || participant_id >= CHANNEL_MAX_MEMBERS) {
+        return;
+    }
+    
+    for (uint32_t i = 0; i < CHANNEL_INDEX_SIZE; i++) {
+        uint32_t entry = atomic_load(&directory->name_index[i]);
+        if (entry == 0) {
+            continue;
+        }
+        
+        channel_t* channel = offset_to_block(channel_pool, entry - 1);
+        if (atomic_load(&channel->members) & (1u << participant_id)) {
+            channel_leave(channel, participant_id, message_pool);
+        }
+    }
+}
+
+// Check whether a participant has unread messages (lock free)
+bool channel_has_unread(const channel_t* channel, int participant_id) {
+    if (channel == NULL || participant_id < 0 || participant_id >= CHANNEL_MAX_MEMBERS) {
+        return false;
+    }
+    
+    return channel->read_seq[participant_id] != atomic_load(&channel->tail);
+}
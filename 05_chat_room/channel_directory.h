@@ -0,0 +1,86 @@
+#ifndef CHANNEL_DIRECTORY_H
+#define CHANNEL_DIRECTORY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "mempool_ring.h"
+#include "wait_strategy.h"
+
+// Channel limits
+#define MAX_CHANNELS 4096
+#define MAX_CHANNEL_NAME 32
+#define CHANNEL_LOG_CAPACITY 16           // Messages retained per channel
+#define CHANNEL_INDEX_SIZE 8192           // Name hash table (power of 2)
+#define CHANNEL_MAX_MEMBERS 32            // Members are participant ids (bitmask)
+
+// Channel block size in the channel pool (cache-line rounded)
+#define CHANNEL_BLOCK_SIZE ((sizeof(channel_t) + 63) & ~(size_t)63)
+
+// Size of the channel pool segment: the blocks plus the pool's free ring
+#define CHANNEL_POOL_SIZE (MAX_CHANNELS * (CHANNEL_BLOCK_SIZE + sizeof(void*)) + 4096)
+
+// A channel: its own message log and membership set
+// Channels are carved out of a shared pool and live until the server exits
+typedef struct {
+    char name[MAX_CHANNEL_NAME];                  // Channel name
+    atomic_uint lock;                             // Protects this channel only
+    uint32_t wait_strategy;                       // wait_strategy_t for lock (the directory's)
+    atomic_uint members;                          // Bitmask of member participant ids
+    uint32_t head;                                // Sequence of the oldest logged message
+    atomic_uint tail;                             // Sequence of the next message
+    uint32_t read_seq[CHANNEL_MAX_MEMBERS];       // Next sequence each member reads
+    uint32_t log[CHANNEL_LOG_CAPACITY];           // Message block offsets
+    uint32_t unread[CHANNEL_LOG_CAPACITY];        // Members yet to read each message
+} channel_t;
+
+// Channel directory: maps names to channels in the channel pool
+typedef struct {
+    atomic_uint index_lock;                       // Serializes channel creation only
+    uint32_t wait_strategy;                       // wait_strategy_t for all channel locks
+    atomic_uint channel_count;                    // Number of channels
+    atomic_uint name_index[CHANNEL_INDEX_SIZE];   // Channel block offset + 1, 0 if empty
+} channel_directory_t;
+
+// Callback for a received message; `block` is the message block in the message pool
+typedef void (*channel_message_callback_t)(const channel_t* channel, void* block, void* context);
+
+// Initialize an empty directory
+bool channel_directory_init(channel_directory_t* directory);
+
+// Find a channel by name, NULL if it does not exist
+channel_t* channel_lookup(channel_directory_t* directory, mem_pool_t* channel_pool, const char* name);
+
+// Find a channel by name, creating it if needed
+channel_t* channel_open(channel_directory_t* directory, mem_pool_t* channel_pool, const char* name);
+
+// Add a participant to a channel; it only sees messages posted afterwards
+bool channel_join(channel_t* channel, int participant_id);
+
+// Remove a participant from a channel, releasing its unread messages
+void channel_leave(channel_t* channel, int participant_id, mem_pool_t* message_pool);
+
+// Allocate a message block for a channel
+// A channel holds at most CHANNEL_LOG_CAPACITY blocks; when the pool is
+// empty it recycles its own oldest message instead of failing, so a busy
+// channel evicts from itself rather than starving the others
+void* channel_alloc_message(channel_t* channel, mem_pool_t* message_pool);
+
+// Post a message block to all members (the channel takes ownership of the block)
+// When the log is full the oldest message is dropped
+bool channel_post(channel_t* channel, mem_pool_t* message_pool, void* block);
+
+// Deliver the participant's unread messages, oldest first
+// Returns the number of messages delivered
+int channel_receive(channel_t* channel, mem_pool_t* message_pool, int participant_id,
+                    channel_message_callback_t callback, void* context);
+
+// Remove a participant from every channel it is a member of
+// Walks the whole directory, so it is meant for crash cleanup only
+void channel_directory_release_participant(channel_directory_t* directory, mem_pool_t* channel_pool,
+                                           int participant_id, mem_pool_t* message_pool);
+
+// Check whether a participant has unread messages (lock free)
+bool channel_has_unread(const channel_t* channel, int participant_id);
+
+#endif // CHANNEL_DIRECTORY_H
@@ -3,16 +3,27 @@
 #include <string.h>
 #include <signal.h>
 #include <unistd.h>
-#include <pthread.h>
+#include <sys/epoll.h>
 #include "shm_manager.h"
+#include "event_loop.h"
 
-// Flag to indicate if the client should continue running
-static volatile int running = 1;
+// How often the connection is checked
+#define HOUSEKEEPING_INTERVAL_MS 1000
 
-// Signal handler to handle Ctrl+C
-void handle_signal(int sig) {
+// Event loop driving the client
+static event_loop_t loop;
+
+// Partial line typed by the user
+static char input[MAX_MESSAGE_LENGTH];
+static size_t input_length = 0;
+
+// Signal handler to handle Ctrl+C (delivered through the event loop)
+void handle_signal(int fd, uint32_t signo, void* context) {
+    (void)fd;
+    (void)signo;
+    (void)context;
     printf("\nLeaving chat...\n");
-    running = 0;
+    event_loop_stop(&loop);
 }
 
 // Callback function for handling messages
@@ -20,17 +31,164 @@ void print_message(const char* sender, const char* message) {
     printf("[%s] %s\n", sender, message);
 }
 
-// Thread function to read messages
-void* read_messages_thread(void* arg) {
-    while (running) {
-        // Process new messages
-        process_new_messages(print_message);
+// Callback function for handling channel messages
+void print_channel_message(const char* channel, const char* sender, const char* message) {
+    printf("#%s [%s] %s\n", channel, sender, message);
+}
+
+// Callback function for handling private messages
+void print_direct_message(const char* sender, const char* message) {
+    printf("[%s -> you] %s\n", sender, message);
+}
+
+// Process every kind of pending message
+static void process_all_messages(void) {
+    process_new_messages(print_message);
+    process_channel_messages(print_channel_message);
+    process_direct_messages(print_direct_message);
+}
+
+// New messages arrived
+static void handle_messages(int fd, uint32_t events, void* context) {
+    (void)fd;
+    (void)events;
+    (void)context;
+    ack_message_notifier();
+    process_all_messages();
+}
+
+// Stop once the server disconnected us for falling behind
+static void handle_housekeeping(int fd, uint32_t expirations, void* context) {
+    (void)fd;
+    (void)expirations;
+    (void)context;
+    if (!is_connected()) {
+        printf("\nDisconnected by the server.\n");
+        event_loop_stop(&loop);
+    }
+}
+
+// Handle one line of user input
+// Returns false when the user asked to leave
+static bool handle_command(char* input) {
+    // Check for empty input or exit command
+    if (strlen(input) == 0) {
+        return true;
+    }
+    
+    if (strcmp(input, "/exit") == 0 || strcmp(input, "/quit") == 0) {
+        return false;
+    }
+    
+    if (strcmp(input, "/list") == 0) {
+        char usernames[MAX_PARTICIPANTS][MAX_USERNAME_LENGTH];
+        int count = get_participants(usernames, MAX_PARTICIPANTS);
         
-        // Sleep to avoid busy waiting
-        usleep(100000);  // 100ms
+        printf("\nActive participants (%d):\n", count);
+        for (int i = 0; i < count; i++) {
+            printf("- %s\n", usernames[i]);
+        }
+        printf("\n");
+        return true;
+    }
+    
+    if (strcmp(input, "/latency") == 0) {
+        uint64_t average_ns, max_ns;
+        get_delivery_latency(&average_ns, &max_ns);
+        printf("Delivery latency: avg %llu us, max %llu us\n", 
+               (unsigned long long)(average_ns / 1000), (unsigned long long)(max_ns / 1000));
+        return true;
+    }
+    
+    if (strncmp(input, "/history", 8) == 0) {
+        int count = atoi(input + 8);
+        replay_chat_history(count > 0 ? count : HISTORY_REPLAY_COUNT, print_message);
+        return true;
+    }
+    
+    if (strncmp(input, "/join ", 6) == 0) {
+        if (!join_channel(input + 6)) {
+            fprintf(stderr, "Failed to join channel\n");
+        }
+        return true;
+    }
+    
+    if (strncmp(input, "/leave ", 7) == 0) {
+        if (!leave_channel(input + 7)) {
+            fprintf(stderr, "Not in that channel\n");
+        }
+        return true;
+    }
+    
+    // "/msg user text" sends a private message
+    if (strncmp(input, "/msg ", 5) == 0) {
+        char* text = strchr(input + 5, ' ');
+        if (text == NULL) {
+            return true;
+        }
+        *text++ = '\0';
+        if (!send_direct_message(input + 5, text)) {
+            fprintf(stderr, "Failed to send private message\n");
+        }
+        return true;
+    }
+    
+    // "#channel text" sends to a channel
+    if (input[0] == '#') {
+        char* text = strchr(input, ' ');
+        if (text == NULL) {
+            return true;
+        }
+        *text++ = '\0';
+        if (!send_channel_message(input + 1, text)) {
+            fprintf(stderr, "Failed to send channel message\n");
+        }
+        return true;
     }
     
-    return NULL;
+    // Send the message
+    if (!send_message(input)) {
+        fprintf(stderr, "Failed to send message\n");
+    }
+    
+    return true;
+}
+
+// Read user input and handle every complete line
+static void handle_input(int fd, uint32_t events, void* context) {
+    (void)events;
+    (void)context;
+    ssize_t n = read(fd, input + input_length, sizeof(input) - 1 - input_length);
+    if (n <= 0) {
+        event_loop_stop(&loop);  // EOF
+        return;
+    }
+    input_length += n;
+    
+    char* line = input;
+    char* newline;
+    while ((newline = memchr(line, '\n', input + input_length - line)) != NULL) {
+        *newline = '\0';
+        if (!handle_command(line)) {
+            event_loop_stop(&loop);
+            return;
+        }
+        line = newline + 1;
+        
+        printf("> ");
+        fflush(stdout);
+    }
+    
+    // Keep the partial line; an overlong one is handled as is
+    input_length -= line - input;
+    memmove(input, line, input_length);
+    if (input_length == sizeof(input) - 1) {
+        input[input_length] = '\0';
+        input_length = 0;
+        if (!handle_command(input)) {
+            event_loop_stop(&loop);
+        }
+    }
 }
 
 int main(int argc, char* argv[]) {
@@ -39,9 +197,12 @@ int main(int argc, char* argv[]) {
         fprintf(stderr, "Usage: %s <username>\n", argv[0]);
     }
     
-    // Set up signal handler
-    signal(SIGINT, handle_signal);
-    signal(SIGTERM, handle_signal);
+    // Set up the event loop; signals are blocked and read from a signalfd
+    int signals[] = { SIGINT, SIGTERM };
+    if (!event_loop_init(&loop) || event_loop_add_signals(&loop, signals, 2, handle_signal, NULL) == -1) {
+        perror("Failed to set up event loop");
+        return 1;
+    }
     
     // Get username from command line
     const char* username = (argc < 2)? "ddd": argv[1];
@@ -51,79 +212,45 @@ int main(int argc, char* argv[]) {
     // Join the chat
     if (!join_chat_client(username)) {
         fprintf(stderr, "Failed to join chat\n");
+        event_loop_destroy(&loop);
         return 1;
     }
     
     printf("Joined chat. Type your messages and press Enter. Press Ctrl+C to exit.\n");
     
+    // Show recent history from the journal
+    if (replay_chat_history(HISTORY_REPLAY_COUNT, print_message) > 0) {
+        printf("--- end of history ---\n");
+    }
+    
     // Send join message
     char join_message[MAX_MESSAGE_LENGTH];
     snprintf(join_message, MAX_MESSAGE_LENGTH, "has joined the chat");
     send_message(join_message);
     
-    // Create thread to read messages
-    pthread_t thread;
-    if (pthread_create(&thread, NULL, read_messages_thread, NULL) != 0) {
-        fprintf(stderr, "Failed to create message reader thread\n");
+    // Wake up for user input, new messages and housekeeping only
+    if (!event_loop_add_fd(&loop, STDIN_FILENO, EPOLLIN, handle_input, NULL) ||
+        !event_loop_add_fd(&loop, open_message_notifier(), EPOLLIN, handle_messages, NULL) ||
+        event_loop_add_timer(&loop, HOUSEKEEPING_INTERVAL_MS, handle_housekeeping, NULL) == -1) {
+        fprintf(stderr, "Failed to set up event sources\n");
         leave_chat();
+        event_loop_destroy(&loop);
         return 1;
     }
     
-    // Main loop to read user input
-    char input[MAX_MESSAGE_LENGTH];
-    
-    while (running) {
-        printf("> ");
-        fflush(stdout);
-        
-        if (fgets(input, MAX_MESSAGE_LENGTH, stdin) == NULL) {
-            break;  // EOF
-        }
-        
-        // Remove trailing newline
-        size_t len = strlen(input);
-        if (len > 0 && input[len - 1] == '\n') {
-            input[len - 1] = '\0';
-        }
-        
-        // Check for empty input or exit command
-        if (strlen(input) == 0) {
-            continue;
-        }
-        
-        if (strcmp(input, "/exit") == 0 || strcmp(input, "/quit") == 0) {
-            running = 0;
-            break;
-        }
-        
-        if (strcmp(input, "/list") == 0) {
-            char usernames[MAX_PARTICIPANTS][MAX_USERNAME_LENGTH];
-            int count = get_participants(usernames, MAX_PARTICIPANTS);
-            
-            printf("\nActive participants (%d):\n", count);
-            for (int i = 0; i < count; i++) {
-                printf("- %s\n", usernames[i]);
-            }
-            printf("\n");
-            continue;
-        }
-        
-        // Send the message
-        if (!send_message(input)) {
-            fprintf(stderr, "Failed to send message\n");
-        }
-    }
+    // Main loop: user input and messages are handled as they arrive
+    process_all_messages();
+    printf("> ");
+    fflush(stdout);
+    event_loop_run(&loop);
     
     // Send leave message
     snprintf(join_message, MAX_MESSAGE_LENGTH, "has left the chat");
     send_message(join_message);
     
-    // Wait for message reader thread to finish
-    pthread_cancel(thread);
-    pthread_join(thread, NULL);
-    
     // Leave the chat
     leave_chat();
+    event_loop_destroy(&loop);
     
     printf("Left chat\n");
     return 0;
@@ -0,0 +1,568 @@
+#define _GNU_SOURCE  // accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "shm_manager.h"
+
+// Gateway settings
+#define GATEWAY_SOCKET_PATH "/tmp/chat_gateway.sock"
+#define GATEWAY_MAX_CLIENTS 8192
+#define GATEWAY_MAX_EVENTS 256
+#define GATEWAY_HOUSEKEEPING_MS 1000        // Connection check when nothing happens
+#define GATEWAY_BATCH_SIZE 64               // Outbound lines sent with one writev
+#define GATEWAY_LINE_SIZE (MAX_USERNAME_LENGTH + MAX_MESSAGE_LENGTH + 4)
+#define GATEWAY_MAX_BACKLOG (64 * 1024)     // Unsent bytes before a client is dropped
+#define GATEWAY_READS_PER_TURN 4            // Socket reads per client per loop iteration
+
+// A socket client
+// Inbound bytes are read straight into a reserved message block, so a
+// complete line is sent without another copy
+typedef struct gateway_client {
+    int fd;
+    char username[MAX_USERNAME_LENGTH];     // Empty until the client sent its name
+    int name_handle;                        // reserve_username handle, -1 before login
+    void* block;                            // Message block being filled, NULL if none
+    uint32_t fill;                          // Bytes of text in block
+    char* backlog;                          // Outbound bytes the socket did not take yet
+    uint32_t backlog_length;
+    uint32_t backlog_capacity;
+    struct gateway_client* prev;            // List of all clients
+    struct gateway_client* next;
+} gateway_client_t;
+
+// Flag to indicate if the gateway should continue running
+static volatile int running = 1;
+
+static int epoll_fd = -1;
+static gateway_client_t* clients = NULL;
+static int client_count = 0;
+
+// Outbound batch: lines from the room waiting to be written to every client
+static char batch_lines[GATEWAY_BATCH_SIZE][GATEWAY_LINE_SIZE];
+static struct iovec batch[GATEWAY_BATCH_SIZE];
+static int batch_count = 0;
+
+// Listening socket and notifier markers for epoll (clients carry their own pointer)
+static int unix_listen_fd = -1;
+static int tcp_listen_fd = -1;
+static int message_fd = -1;
+
+// Signal handler to handle Ctrl+C
+void handle_signal(int sig) {
+    (void)sig;
+    running = 0;
+}
+
+// Write a short notice to a client, ignoring errors (best effort)
+static void send_notice(gateway_client_t* client, const char* notice) {
+    ssize_t written = write(client->fd, notice, strlen(notice));
+    (void)written;
+}
+
+// Close a client and announce its departure
+static void close_client(gateway_client_t* client) {
+    if (client->username[0] != '\0') {
+        void* block = reserve_message_block();
+        if (block != NULL) {
+            const char* text = "has left the chat";
+            memcpy(message_block_text(block), text, strlen(text));
+            commit_message_block(block, client->username, strlen(text));
+        }
+        release_username(client->name_handle);
+    }
+    
+    release_message_block(client->block);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    
+    if (client->prev != NULL) {
+        client->prev->next = client->next;
+    } else {
+        clients = client->next;
+    }
+    if (client->next != NULL) {
+        client->next->prev = client->prev;
+    }
+    
+    client_count--;
+    free(client->backlog);
+    free(client);
+}
+
+// Accept all pending connections on a listening socket
+static void accept_clients(int listen_fd) {
+    while (1) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("accept");
+            }
+            return;
+        }
+        
+        if (client_count >= GATEWAY_MAX_CLIENTS) {
+            close(fd);  // Full
+            continue;
+        }
+        
+        gateway_client_t* client = calloc(1, sizeof(gateway_client_t));
+        if (client == NULL) {
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        client->name_handle = -1;
+        
+        struct epoll_event event = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = client };
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+            close(fd);
+            free(client);
+            continue;
+        }
+        
+        client->next = clients;
+        if (clients != NULL) {
+            clients->prev = client;
+        }
+        clients = client;
+        client_count++;
+    }
+}
+
+// Handle one complete line from a client, held in `block`
+// Takes ownership of the block; returns false if the client should be closed
+static bool handle_line(gateway_client_t* client, void* block, uint32_t length) {
+    char* text = message_block_text(block);
+    if (length > 0 && text[length - 1] == '\r') {
+        length--;
+    }
+    
+    if (client->username[0] == '\0') {
+        // First line is the username, which must not be taken in the room
+        char username[MAX_USERNAME_LENGTH];
+        if (length == 0 || length >= MAX_USERNAME_LENGTH) {
+            release_message_block(block);
+            send_notice(client, "* invalid username\n");
+            return false;
+        }
+        memcpy(username, text, length);
+        username[length] = '\0';
+        
+        client->name_handle = reserve_username(username);
+        if (client->name_handle < 0) {
+            release_message_block(block);
+            send_notice(client, "* username reserved or in use\n");
+            return false;
+        }
+        memcpy(client->username, username, length + 1);
+        
+        // Reuse the block for the join notice
+        const char* joined = "has joined the chat";
+        memcpy(text, joined, strlen(joined));
+        commit_message_block(block, client->username, strlen(joined));
+        return true;
+    }
+    
+    if (length == 0) {
+        release_message_block(block);
+        return true;
+    }
+    
+    if (length == 5 && memcmp(text, "/quit", 5) == 0) {
+        release_message_block(block);
+        return false;
+    }
+    
+    // Send the block as is: the text was read into it in place
+    commit_message_block(block, client->username, length);
+    return true;
+}
+
+// Read from a client and send complete lines
+// At most GATEWAY_READS_PER_TURN reads, so one flooding client cannot
+// starve the others; epoll reports the rest on the next iteration
+// Returns false if the client should be closed
+static bool read_client(gateway_client_t* client) {
+    for (int reads = 0; reads < GATEWAY_READS_PER_TURN; reads++) {
+        if (client->block == NULL) {
+            client->block = reserve_message_block();
+            client->fill = 0;
+            if (client->block == NULL) {
+                // Pool exhausted: drain the socket rather than spin on it
+                char discard[MAX_MESSAGE_LENGTH];
+                ssize_t n = read(client->fd, discard, sizeof(discard));
+                if (n == 0) {
+                    return false;
+                }
+                if (n > 0) {
+                    send_notice(client, "* message dropped: chat is busy\n");
+                    continue;
+                }
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            }
+        }
+        
+        char* text = message_block_text(client->block);
+        ssize_t n = read(client->fd, text + client->fill, MAX_MESSAGE_LENGTH - 1 - client->fill);
+        if (n == 0) {
+            return false;  // Closed by the peer
+        }
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        
+        uint32_t scanned = client->fill;
+        client->fill += n;
+        
+        // Send every complete line
+        char* newline;
+        while ((newline = memchr(text + scanned, '\n', client->fill - scanned)) != NULL) {
+            void* line = client->block;
+            uint32_t length = newline - text;
+            uint32_t rest = client->fill - length - 1;
+            
+            // Bytes after the newline start the next message
+            client->block = NULL;
+            client->fill = 0;
+            if (rest > 0) {
+                client->block = reserve_message_block();
+                if (client->block != NULL) {
+                    memcpy(message_block_text(client->block), newline + 1, rest);
+                    client->fill = rest;
+                } else {
+                    send_notice(client, "* message dropped: chat is busy\n");
+                }
+            }
+            
+            if (!handle_line(client, line, length)) {
+                return false;
+            }
+            if (client->block == NULL) {
+                break;
+            }
+            
+            text = message_block_text(client->block);
+            scanned = 0;
+        }
+        
+        // A line longer than a message is sent in pieces
+        if (client->block != NULL && client->fill == MAX_MESSAGE_LENGTH - 1) {
+            void* line = client->block;
+            client->block = NULL;
+            if (!handle_line(client, line, MAX_MESSAGE_LENGTH - 1)) {
+                return false;
+            }
+        }
+    }
+    
+    return true;
+}
+
+// Queue bytes the socket did not accept
+// Returns false if the client fell too far behind
+static bool append_backlog(gateway_client_t* client, const char* data, size_t length) {
+    if (client->backlog_length + length > GATEWAY_MAX_BACKLOG) {
+        return false;
+    }
+    
+    if (client->backlog_length + length > client->backlog_capacity) {
+        uint32_t capacity = client->backlog_capacity ? client->backlog_capacity : 4096;
+        while (capacity < client->backlog_length + length) {
+            capacity *= 2;
+        }
+        char* backlog = realloc(client->backlog, capacity);
+        if (backlog == NULL) {
+            return false;
+        }
+        client->backlog = backlog;
+        client->backlog_capacity = capacity;
+    }
+    
+    memcpy(client->backlog + client->backlog_length, data, length);
+    client->backlog_length += length;
+    return true;
+}
+
+// Start or stop waiting for a client's socket to become writable
+static void watch_writable(gateway_client_t* client, bool writable) {
+    struct epoll_event event = {
+        .events = EPOLLIN | EPOLLRDHUP | (writable ? EPOLLOUT : 0),
+        .data.ptr = client
+    };
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+}
+
+// Write as much of the backlog as the socket takes
+// Returns false if the client should be closed
+static bool flush_backlog(gateway_client_t* client) {
+    while (client->backlog_length > 0) {
+        ssize_t n = write(client->fd, client->backlog, client->backlog_length);
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        memmove(client->backlog, client->backlog + n, client->backlog_length - n);
+        client->backlog_length -= n;
+    }
+    
+    watch_writable(client, false);
+    return true;
+}
+
+// Write the batch to one client with a single writev
+// Returns false if the client should be closed
+static bool send_batch(gateway_client_t* client) {
+    int first = 0;
+    size_t skip = 0;
+    
+    // Keep the order: nothing goes out directly while older bytes wait
+    if (client->backlog_length == 0) {
+        ssize_t n = writev(client->fd, batch, batch_count);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                return false;
+            }
+            n = 0;
+        }
+        
+        // Find where the socket stopped taking data
+        size_t written = n;
+        while (first < batch_count && written >= batch[first].iov_len) {
+            written -= batch[first].iov_len;
+            first++;
+        }
+        skip = written;
+        
+        if (first == batch_count) {
+            return true;  // All sent
+        }
+        watch_writable(client, true);
+    }
+    
+    for (int i = first; i < batch_count; i++) {
+        if (!append_backlog(client, (char*)batch[i].iov_base + skip, batch[i].iov_len - skip)) {
+            send_notice(client, "* disconnected: too slow\n");
+            return false;
+        }
+        skip = 0;
+    }
+    
+    return true;
+}
+
+// Write the batch to every client that sent its name
+static void flush_batch(void) {
+    if (batch_count == 0) {
+        return;
+    }
+    
+    gateway_client_t* client = clients;
+    while (client != NULL) {
+        gateway_client_t* next = client->next;
+        if (client->username[0] != '\0' && !send_batch(client)) {
+            close_client(client);
+        }
+        client = next;
+    }
+    
+    batch_count = 0;
+}
+
+// Callback function for messages from the room: add them to the batch
+void queue_message(const char* sender, const char* message) {
+    if (batch_count == GATEWAY_BATCH_SIZE) {
+        flush_batch();
+    }
+    
+    int length = snprintf(batch_lines[batch_count], GATEWAY_LINE_SIZE, "[%s] %s\n", sender, message);
+    if (length >= GATEWAY_LINE_SIZE) {
+        length = GATEWAY_LINE_SIZE - 1;
+    }
+    
+    batch[batch_count].iov_base = batch_lines[batch_count];
+    batch[batch_count].iov_len = length;
+    batch_count++;
+}
+
+// Create the non-blocking Unix-domain listening socket
+static int listen_unix(const char* path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+    
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(fd, SOMAXCONN) == -1) {
+        close(fd);
+        return -1;
+    }
+    
+    return fd;
+}
+
+// Create the non-blocking loopback TCP listening socket
+static int listen_tcp(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(fd, SOMAXCONN) == -1) {
+        close(fd);
+        return -1;
+    }
+    
+    return fd;
+}
+
+// Add a listening socket to the epoll set
+static bool watch_listener(int* fd) {
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = fd };
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, *fd, &event) == 0;
+}
+
+int main(int argc, char* argv[]) {
+    const char* socket_path = GATEWAY_SOCKET_PATH;
+    int tcp_port = 0;
+    
+    // Parse command line options
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--tcp") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            tcp_port = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [--socket path] [--tcp port]\n", argv[0]);
+            return 1;
+        }
+    }
+    
+    // Set up signal handler
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+    signal(SIGPIPE, SIG_IGN);  // Closed sockets are handled through write errors
+    
+    // Allow one descriptor per client
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    
+    // The gateway takes a single participant slot for all its clients
+    if (!join_chat_client("Gateway")) {
+        fprintf(stderr, "Failed to join chat\n");
+        return 1;
+    }
+    
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) {
+        perror("epoll_create1");
+        leave_chat();
+        return 1;
+    }
+    
+    unix_listen_fd = listen_unix(socket_path);
+    if (unix_listen_fd == -1 || !watch_listener(&unix_listen_fd)) {
+        perror("Failed to listen on Unix socket");
+        leave_chat();
+        return 1;
+    }
+    
+    if (tcp_port > 0) {
+        tcp_listen_fd = listen_tcp(tcp_port);
+        if (tcp_listen_fd == -1 || !watch_listener(&tcp_listen_fd)) {
+            perror("Failed to listen on TCP port");
+            leave_chat();
+            return 1;
+        }
+    }
+    
+    // Wake up when messages arrive instead of polling the room
+    message_fd = open_message_notifier();
+    struct epoll_event message_event = { .events = EPOLLIN, .data.ptr = &message_fd };
+    if (message_fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, message_fd, &message_event) == -1) {
+        perror("Failed to watch for messages");
+        leave_chat();
+        return 1;
+    }
+    
+    printf("Gateway listening on %s", socket_path);
+    if (tcp_port > 0) {
+        printf(" and 127.0.0.1:%d", tcp_port);
+    }
+    printf(". Press Ctrl+C to exit.\n");
+    
+    struct epoll_event events[GATEWAY_MAX_EVENTS];
+    
+    while (running && is_connected()) {
+        int count = epoll_wait(epoll_fd, events, GATEWAY_MAX_EVENTS, GATEWAY_HOUSEKEEPING_MS);
+        
+        for (int i = 0; i < count; i++) {
+            void* ptr = events[i].data.ptr;
+            
+            if (ptr == &unix_listen_fd || ptr == &tcp_listen_fd) {
+                accept_clients(*(int*)ptr);
+                continue;
+            }
+            
+            if (ptr == &message_fd) {
+                ack_message_notifier();
+                continue;  // Processed below
+            }
+            
+            gateway_client_t* client = ptr;
+            bool keep = true;
+            
+            if (events[i].events & EPOLLOUT) {
+                keep = flush_backlog(client);
+            }
+            if (keep && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+                keep = read_client(client);
+            }
+            if (!keep) {
+                close_client(client);
+            }
+        }
+        
+        // Fan messages from the room out to the socket clients
+        process_new_messages(queue_message);
+        flush_batch();
+    }
+    
+    printf("\nShutting down gateway...\n");
+    
+    // Clean up resources
+    while (clients != NULL) {
+        close_client(clients);
+    }
+    if (tcp_listen_fd != -1) {
+        close(tcp_listen_fd);
+    }
+    close(unix_listen_fd);
+    unlink(socket_path);
+    close(epoll_fd);
+    leave_chat();
+    
+    printf("Gateway shut down\n");
+    return 0;
+}
@@ -0,0 +1,467 @@
+#include "chat_journal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Offset of the first record, keeping records cache-line aligned
+#define JOURNAL_DATA_OFFSET ((sizeof(journal_segment_t) + 63) & ~(size_t)63)
+
+// Find the journal directory, creating it (mode 0700) if needed
+// Fails unless it is a real directory that only we can write to, so nobody
+// else can plant files or symlinks where segments are created
+static bool journal_dir(char* dir) {
+    const char* configured = getenv(JOURNAL_DIR_ENV);
+    const char* runtime = getenv("XDG_RUNTIME_DIR");
+    int length;
+    
+    if (configured != NULL && configured[0] != '\0') {
+        length = snprintf(dir, JOURNAL_MAX_PATH, "%s", configured);
+    } else if (runtime != NULL && runtime[0] != '\0') {
+        length = snprintf(dir, JOURNAL_MAX_PATH, "%s/%s", runtime, JOURNAL_DIR_NAME);
+    } else {
+        length = snprintf(dir, JOURNAL_MAX_PATH, "%s/%s-%u", JOURNAL_FALLBACK_DIR, JOURNAL_DIR_NAME,
+                          (unsigned)geteuid());
+    }
+    if (length < 0 || length >= JOURNAL_MAX_PATH - 32) {
+        return false;  // No room left for segment names
+    }
+    
+    if (mkdir(dir, 0700) == -1 && errno != EEXIST) {
+        return false;
+    }
+    
+    struct stat st;
+    if (lstat(dir, &st) == -1 || !S_ISDIR(st.st_mode) || 
+        st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        errno = EPERM;
+        return false;
+    }
+    
+    return true;
+}
+
+// Build the file name of a segment
+static void segment_path(char* path, const char* dir, uint64_t segment_number) {
+    snprintf(path, JOURNAL_MAX_PATH, "%s/%s.%08llu.log", dir, JOURNAL_PREFIX,
+             (unsigned long long)segment_number);
+}
+
+// Parse a segment number out of a directory entry name
+static bool parse_segment_name(const char* name, uint64_t* segment_number) {
+    size_t prefix_len = strlen(JOURNAL_PREFIX);
+    if (strncmp(name, JOURNAL_PREFIX, prefix_len) != 0 || name[prefix_len] != '.') {
+        return false;
+    }
+    
+    char* end = NULL;
+    unsigned long long number = strtoull(name + prefix_len + 1, &end, 10);
+    if (end == name + prefix_len + 1 || strcmp(end, ".log") != 0) {
+        return false;
+    }
+    
+    *segment_number = number;
+    return true;
+}
+
+// Collect the newest `max_count` segment numbers in ascending order
+static uint32_t list_segments(const char* path, uint64_t* numbers, uint32_t max_count) {
+    DIR* dir = opendir(path);
+    if (dir == NULL) {
+        return 0;
+    }
+    
+    uint32_t count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        uint64_t number;
+        if (!parse_segment_name(entry->d_name, &number)) {
+            continue;
+        }
+        
+        // Insertion sort, dropping the oldest once the list is full
+        uint32_t pos = count;
+        if (count == max_count) {
+            if (number < numbers[0]) {
+                continue;
+            }
+            memmove(&numbers[0], &numbers[1], (count - 1) * sizeof(uint64_t));
+            pos = count - 1;
+        } else {
+            count++;
+        }
+        while (pos > 0 && numbers[pos - 1] > number) {
+            numbers[pos] = numbers[pos - 1];
+            pos--;
+        }
+        numbers[pos] = number;
+    }
+    
+    closedir(dir);
+    return count;
+}
+
+// Map a segment file, creating and initializing it if requested
+// A new segment must not exist yet, and symlinks are never followed
+static journal_segment_t* map_segment(const char* dir, uint64_t segment_number, bool create,
+                                      uint64_t first_sequence, bool writable) {
+    char path[JOURNAL_MAX_PATH];
+    segment_path(path, dir, segment_number);
+    
+    int flags = (writable ? O_RDWR : O_RDONLY) | O_NOFOLLOW | O_CLOEXEC;
+    if (create) {
+        flags |= O_CREAT | O_EXCL;
+    }
+    
+    int fd = open(path, flags, 0600);
+    if (fd == -1) {
+        return NULL;
+    }
+    
+    if (create && ftruncate(fd, JOURNAL_SEGMENT_SIZE) == -1) {
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+    
+    int prot = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    journal_segment_t* segment = mmap(NULL, JOURNAL_SEGMENT_SIZE, prot, MAP_SHARED, fd, 0);
+    close(fd);  // Mapping remains valid
+    if (segment == MAP_FAILED) {
+        return NULL;
+    }
+    
+    if (create) {
+        segment->magic = JOURNAL_MAGIC;
+        segment->data_offset = JOURNAL_DATA_OFFSET;
+        segment->segment_number = segment_number;
+        segment->first_sequence = first_sequence;
+        atomic_store(&segment->write_offset, JOURNAL_DATA_OFFSET);
+        atomic_store(&segment->record_count, 0);
+        atomic_store(&segment->index_count, 0);
+        atomic_store(&segment->sealed, 0);
+    } else if (segment->magic != JOURNAL_MAGIC) {
+        munmap(segment, JOURNAL_SEGMENT_SIZE);
+        return NULL;
+    }
+    
+    return segment;
+}
+
+// Start a new segment and delete the one falling out of the retention window
+static bool journal_rotate(journal_writer_t* writer) {
+    if (writer->segment != NULL) {
+        journal_flush(writer);
+        atomic_store(&writer->segment->sealed, 1);
+        munmap(writer->segment, JOURNAL_SEGMENT_SIZE);
+        writer->segment = NULL;
+        writer->segment_number++;
+    }
+    
+    writer->segment = map_segment(writer->dir, writer->segment_number, true, 
+                                  writer->next_sequence, true);
+    if (writer->segment == NULL) {
+        return false;
+    }
+    
+    writer->write_offset = JOURNAL_DATA_OFFSET;
+    writer->record_count = 0;
+    writer->index_count = 0;
+    writer->pending = 0;
+    
+    if (writer->segment_number >= JOURNAL_MAX_SEGMENTS) {
+        char path[JOURNAL_MAX_PATH];
+        segment_path(path, writer->dir, writer->segment_number - JOURNAL_MAX_SEGMENTS);
+        unlink(path);
+    }
+    
+    return true;
+}
+
+// Open the journal for appending, continuing after the newest existing segment
+bool journal_open_writer(journal_writer_t* writer) {
+    if (writer == NULL) {
+        return false;
+    }
+    
+    memset(writer, 0, sizeof(journal_writer_t));
+    if (!journal_dir(writer->dir)) {
+        return false;
+    }
+    
+    uint64_t newest;
+    if (list_segments(writer->dir, &newest, 1) == 0) {
+        return journal_rotate(writer);  // Fresh journal
+    }
+    
+    writer->segment_number = newest;
+    writer->segment = map_segment(writer->dir, newest, false, 0, true);
+    if (writer->segment == NULL) {
+        // Unreadable segment, start after it
+        writer->segment_number = newest + 1;
+        return journal_rotate(writer);
+    }
+    
+    // Resume from the last published state
+    journal_segment_t* segment = writer->segment;
+    writer->write_offset = atomic_load(&segment->write_offset);
+    writer->record_count = atomic_load(&segment->record_count);
+    writer->index_count = atomic_load(&segment->index_count);
+    writer->next_sequence = segment->first_sequence;
+    
+    // Sequences need not be contiguous, so walk from the last index entry to the last record
+    if (writer->index_count > 0) {
+        uint32_t offset = segment->index[writer->index_count - 1].offset;
+        while (offset < writer->write_offset) {
+            const journal_record_t* record = (const journal_record_t*)((uint8_t*)segment + offset);
+            writer->next_sequence = record->sequence + 1;
+            offset += record->record_length;
+        }
+    }
+    
+    if (atomic_load(&segment->sealed)) {
+        return journal_rotate(writer);
+    }
+    
+    return true;
+}
+
+// Append a message to the journal (visible to readers after journal_flush)
+bool journal_append(journal_writer_t* writer, uint64_t sequence, uint64_t timestamp,
+                    const char* sender, const char* message, uint32_t message_length) {
+    if (writer == NULL || writer->segment == NULL || sender == NULL || message == NULL) {
+        return false;
+    }
+    
+    uint32_t length = (sizeof(journal_record_t) + message_length + 1 + 7) & ~7u;
+    if (JOURNAL_DATA_OFFSET + length > JOURNAL_SEGMENT_SIZE) {
+        return false;  // Can never fit
+    }
+    
+    if (writer->write_offset + length > JOURNAL_SEGMENT_SIZE) {
+        writer->next_sequence = sequence;  // First sequence of the new segment
+        if (!journal_rotate(writer)) {
+            return false;
+        }
+    }
+    
+    journal_segment_t* segment = writer->segment;
+    journal_record_t* record = (journal_record_t*)((uint8_t*)segment + writer->write_offset);
+    record->record_length = length;
+    record->message_length = message_length;
+    record->sequence = sequence;
+    record->timestamp = timestamp;
+    strncpy(record->sender, sender, MAX_USERNAME_LENGTH - 1);
+    record->sender[MAX_USERNAME_LENGTH - 1] = '\0';
+    memcpy(record->data, message, message_length);
+    record->data[message_length] = '\0';
+    
+    // Sparse index: one entry every JOURNAL_INDEX_INTERVAL records
+    if (writer->record_count % JOURNAL_INDEX_INTERVAL == 0 &&
+        writer->index_count < JOURNAL_MAX_INDEX_ENTRIES) {
+        journal_index_entry_t* entry = &segment->index[writer->index_count++];
+        entry->sequence = record->sequence;
+        entry->timestamp = timestamp;
+        entry->offset = writer->write_offset;
+    }
+    
+    writer->write_offset += length;
+    writer->record_count++;
+    writer->next_sequence = sequence + 1;
+    writer->pending++;
+    
+    return true;
+}
+
+// Publish all appended records to readers
+void journal_flush(journal_writer_t* writer) {
+    if (writer == NULL || writer->segment == NULL || writer->pending == 0) {
+        return;
+    }
+    
+    journal_segment_t* segment = writer->segment;
+    
+    // Records and index entries first, then the counters readers bound their scans by
+    atomic_store_explicit(&segment->index_count, writer->index_count, memory_order_release);
+    atomic_store_explicit(&segment->record_count, writer->record_count, memory_order_release);
+    atomic_store_explicit(&segment->write_offset, writer->write_offset, memory_order_release);
+    
+    // Schedule write-back without blocking the server loop
+    msync(segment, writer->write_offset, MS_ASYNC);
+    
+    writer->pending = 0;
+}
+
+// Flush and unmap the current segment (segment files are kept)
+void journal_close_writer(journal_writer_t* writer) {
+    if (writer == NULL || writer->segment == NULL) {
+        return;
+    }
+    
+    journal_flush(writer);
+    munmap(writer->segment, JOURNAL_SEGMENT_SIZE);
+    writer->segment = NULL;
+}
+
+// Map all retained segments read-only
+bool journal_open_reader(journal_reader_t* reader) {
+    if (reader == NULL) {
+        return false;
+    }
+    
+    memset(reader, 0, sizeof(journal_reader_t));
+    
+    char dir[JOURNAL_MAX_PATH];
+    if (!journal_dir(dir)) {
+        return false;
+    }
+    
+    uint64_t numbers[JOURNAL_MAX_SEGMENTS];
+    uint32_t count = list_segments(dir, numbers, JOURNAL_MAX_SEGMENTS);
+    
+    for (uint32_t i = 0; i < count; i++) {
+        const journal_segment_t* segment = map_segment(dir, numbers[i], false, 0, false);
+        if (segment != NULL) {
+            reader->segments[reader->count++] = segment;
+        }
+    }
+    
+    return reader->count > 0;
+}
+
+// Walk published records of a segment starting at `offset`
+// Stops after `limit` records or when a record is newer than `to`
+static int replay_segment(const journal_segment_t* segment, uint32_t offset, uint32_t skip,
+                          uint32_t limit, uint64_t from, uint64_t to,
+                          journal_callback_t callback, void* context) {
+    uint32_t end = atomic_load_explicit(&segment->write_offset, memory_order_acquire);
+    int replayed = 0;
+    
+    while (offset < end && (uint32_t)replayed < limit) {
+        const journal_record_t* record = (const journal_record_t*)((const uint8_t*)segment + offset);
+        if (record->record_length == 0) {
+            break;  // Corrupt record, stop here
+        }
+        offset += record->record_length;
+        
+        if (skip > 0) {
+            skip--;
+            continue;
+        }
+        if (record->timestamp > to) {
+            break;
+        }
+        if (record->timestamp >= from) {
+            callback(record, context);
+            replayed++;
+        }
+    }
+    
+    return replayed;
+}
+
+// Replay the last `count` records, oldest first
+int journal_replay_last(const journal_reader_t* reader, uint32_t count,
+                        journal_callback_t callback, void* context) {
+    if (reader == NULL || callback == NULL || count == 0) {
+        return 0;
+    }
+    
+    // Find the first segment that holds part of the requested tail
+    uint32_t remaining = count;
+    int first = reader->count - 1;
+    uint32_t skip = 0;
+    for (; first >= 0; first--) {
+        uint32_t records = atomic_load_explicit(&reader->segments[first]->record_count,
+                                                memory_order_acquire);
+        if (records >= remaining) {
+            skip = records - remaining;
+            break;
+        }
+        remaining -= records;
+    }
+    if (first < 0) {
+        first = 0;  // Fewer records than requested, replay everything
+        skip = 0;
+    }
+    
+    int replayed = 0;
+    for (uint32_t i = first; i < reader->count; i++) {
+        const journal_segment_t* segment = reader->segments[i];
+        uint32_t offset = segment->data_offset;
+        
+        // Jump to the nearest indexed record before the first one wanted
+        uint32_t entries = atomic_load_explicit(&segment->index_count, memory_order_acquire);
+        if (skip > 0 && entries > 0) {
+            uint32_t entry = skip / JOURNAL_INDEX_INTERVAL;
+            if (entry >= entries) {
+                entry = entries - 1;
+            }
+            offset = segment->index[entry].offset;
+            skip -= entry * JOURNAL_INDEX_INTERVAL;
+        }
+        
+        replayed += replay_segment(segment, offset, skip, count - replayed, 0, UINT64_MAX,
+                                   callback, context);
+        skip = 0;
+    }
+    
+    return replayed;
+}
+
+// Replay records with from <= timestamp <= to, oldest first
+int journal_replay_range(const journal_reader_t* reader, uint64_t from, uint64_t to,
+                         journal_callback_t callback, void* context) {
+    if (reader == NULL || callback == NULL || from > to) {
+        return 0;
+    }
+    
+    int replayed = 0;
+    for (uint32_t i = 0; i < reader->count; i++) {
+        const journal_segment_t* segment = reader->segments[i];
+        uint32_t entries = atomic_load_explicit(&segment->index_count, memory_order_acquire);
+        if (entries == 0) {
+            continue;
+        }
+        
+        // Skip segments that start after the range
+        if (segment->index[0].timestamp > to) {
+            break;
+        }
+        
+        // Binary search for the last index entry older than `from`
+        uint32_t lo = 0;
+        uint32_t hi = entries;
+        while (hi - lo > 1) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (segment->index[mid].timestamp < from) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        
+        replayed += replay_segment(segment, segment->index[lo].offset, 0, UINT32_MAX,
+                                   from, to, callback, context);
+    }
+    
+    return replayed;
+}
+
+// Unmap all segments
+void journal_close_reader(journal_reader_t* reader) {
+    if (reader == NULL) {
+        return;
+    }
+    
+    for (uint32_t i = 0; i < reader->count; i++) {
+        munmap((void*)reader->segments[i], JOURNAL_SEGMENT_SIZE);
+        reader->segments[i] = NULL;
+    }
+    reader->count = 0;
+}
@@ -0,0 +1,104 @@
+#ifndef CHAT_JOURNAL_H
+#define CHAT_JOURNAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "shm_manager.h"
+
+// Journal location and segment layout
+// Segments live in a directory only its owner can write to (created 0700):
+// $CHAT_JOURNAL_DIR, else $XDG_RUNTIME_DIR/chat_journal, else /tmp/chat_journal-<uid>
+#define JOURNAL_DIR_ENV "CHAT_JOURNAL_DIR"
+#define JOURNAL_DIR_NAME "chat_journal"
+#define JOURNAL_FALLBACK_DIR "/tmp"
+#define JOURNAL_PREFIX "chat_journal"
+#define JOURNAL_MAGIC 0x4C4E524A               // "JRNL"
+#define JOURNAL_SEGMENT_SIZE (4 * 1024 * 1024) // 4MB per segment file
+#define JOURNAL_MAX_SEGMENTS 8                 // Segments kept before the oldest is deleted
+#define JOURNAL_INDEX_INTERVAL 64              // One sparse index entry every N records
+#define JOURNAL_MAX_INDEX_ENTRIES 1024
+#define JOURNAL_MAX_PATH 256
+
+// Sparse index entry pointing at every JOURNAL_INDEX_INTERVAL-th record
+typedef struct {
+    uint64_t sequence;                   // Sequence number of the indexed record
+    uint64_t timestamp;                  // Timestamp of the indexed record
+    uint32_t offset;                     // Byte offset of the record in the segment
+    uint32_t reserved;
+} journal_index_entry_t;
+
+// Segment header, stored at the start of every segment file
+typedef struct {
+    uint32_t magic;                      // JOURNAL_MAGIC
+    uint32_t data_offset;                // Offset of the first record
+    uint64_t segment_number;             // Position of this segment in the journal
+    uint64_t first_sequence;             // Sequence number of the first record
+    atomic_uint write_offset;            // End of the published records
+    atomic_uint record_count;            // Number of published records
+    atomic_uint index_count;             // Number of published index entries
+    atomic_uint sealed;                  // Set once the writer rotated away
+    journal_index_entry_t index[JOURNAL_MAX_INDEX_ENTRIES];
+} journal_segment_t;
+
+// A single journaled message, padded to 8 bytes
+typedef struct {
+    uint32_t record_length;              // Total record size including padding
+    uint32_t message_length;             // Length of message data
+    uint64_t sequence;                   // Global message sequence number
+    uint64_t timestamp;                  // Wall-clock time the message was journaled (seconds)
+    char sender[MAX_USERNAME_LENGTH];    // Sender username
+    char data[];                         // NUL-terminated message data
+} journal_record_t;
+
+// Writer state (server only, process local)
+typedef struct {
+    char dir[JOURNAL_MAX_PATH];          // Journal directory
+    journal_segment_t* segment;          // Currently mapped segment, NULL when closed
+    uint64_t segment_number;             // Number of the current segment
+    uint64_t next_sequence;              // One past the last journaled sequence number
+    uint32_t write_offset;               // Write position, published on flush
+    uint32_t record_count;               // Records in segment, published on flush
+    uint32_t index_count;                // Index entries in segment, published on flush
+    uint32_t pending;                    // Records appended since the last flush
+} journal_writer_t;
+
+// Reader state: read-only mappings of the retained segments, oldest first
+typedef struct {
+    const journal_segment_t* segments[JOURNAL_MAX_SEGMENTS];
+    uint32_t count;
+} journal_reader_t;
+
+// Callback invoked for every replayed record; the record points into the mapping
+typedef void (*journal_callback_t)(const journal_record_t* record, void* context);
+
+// Open the journal for appending, continuing after the newest existing segment
+bool journal_open_writer(journal_writer_t* writer);
+
+// Append a message to the journal (visible to readers after journal_flush)
+bool journal_append(journal_writer_t* writer, uint64_t sequence, uint64_t timestamp,
+                    const char* sender, const char* message, uint32_t message_length);
+
+// Publish all appended records to readers
+void journal_flush(journal_writer_t* writer);
+
+// Flush and unmap the current segment (segment files are kept)
+void journal_close_writer(journal_writer_t* writer);
+
+// Map all retained segments read-only
+bool journal_open_reader(journal_reader_t* reader);
+
+// Replay the last `count` records, oldest first
+// Returns the number of records replayed
+int journal_replay_last(const journal_reader_t* reader, uint32_t count,
+                        journal_callback_t callback, void* context);
+
+// Replay records with from <= timestamp <= to, oldest first
+// Returns the number of records replayed
+int journal_replay_range(const journal_reader_t* reader, uint64_t from, uint64_t to,
+                         journal_callback_t callback, void* context);
+
+// Unmap all segments
+void journal_close_reader(journal_reader_t* reader);
+
+#endif // CHAT_JOURNAL_H
@@ -3,15 +3,25 @@
 #include <string.h>
 #include <signal.h>
 #include <unistd.h>
+#include <time.h>
+#include <sys/epoll.h>
 #include "shm_manager.h"
+#include "event_loop.h"
 
-// Flag to indicate if the server should continue running
-static volatile int running = 1;
+// Housekeeping period and status print interval
+#define HOUSEKEEPING_INTERVAL_MS 1000
+#define STATUS_INTERVAL_SECONDS 10
 
-// Signal handler to handle Ctrl+C
-void handle_signal(int sig) {
+// Event loop driving the server
+static event_loop_t loop;
+
+// Signal handler to handle Ctrl+C (delivered through the event loop)
+void handle_signal(int fd, uint32_t signo, void* context) {
+    (void)fd;
+    (void)signo;
+    (void)context;
     printf("\nShutting down chat server...\n");
-    running = 0;
+    event_loop_stop(&loop);
 }
 
 // Callback function for handling messages
@@ -19,55 +29,125 @@ void print_message(const char* sender, const char* message) {
     printf("[%s] %s\n", sender, message);
 }
 
-int main() {
-    // Set up signal handler
-    signal(SIGINT, handle_signal);
-    signal(SIGTERM, handle_signal);
+// Print the active participants
+static void print_participants(void) {
+    char usernames[MAX_PARTICIPANTS][MAX_USERNAME_LENGTH];
+    int count = get_participants(usernames, MAX_PARTICIPANTS);
+    
+    printf("\nActive participants (%d):\n", count);
+    for (int i = 0; i < count; i++) {
+        printf("- %s\n", usernames[i]);
+    }
+    printf("\n");
+}
+
+// New messages: process them, then look for joins and disconnections
+static void handle_messages(int fd, uint32_t events, void* context) {
+    (void)fd;
+    (void)events;
+    (void)context;
+    ack_message_notifier();
+    process_new_messages(print_message);
+    check_participants();
+}
+
+// A watched participant exited
+static void handle_participant_exit(int fd, uint32_t events, void* context) {
+    (void)fd;
+    (void)events;
+    (void)context;
+    check_participants();
+}
+
+// Periodic housekeeping: liveness fallback, slow consumers and status
+static void handle_housekeeping(int fd, uint32_t expirations, void* context) {
+    (void)fd;
+    (void)expirations;
+    (void)context;
+    static time_t last_status = 0;
+    
+    process_new_messages(print_message);
+    check_participants();
+    
+    // Print active participants every 10 seconds
+    time_t now = time(NULL);
+    if (now - last_status >= STATUS_INTERVAL_SECONDS) {
+        print_participants();
+        last_status = now;
+    }
+}
+
+// Parse a slow-consumer policy name
+static bool parse_policy(const char* name, tracker_policy_t* policy) {
+    if (strcmp(name, "reject") == 0) {
+        *policy = TRACKER_POLICY_REJECT;
+    } else if (strcmp(name, "evict") == 0) {
+        *policy = TRACKER_POLICY_EVICT_OLDEST;
+    } else if (strcmp(name, "disconnect") == 0) {
+        *policy = TRACKER_POLICY_DISCONNECT;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    tracker_policy_t policy = DEFAULT_SLOW_CONSUMER_POLICY;
+    int max_lag = DEFAULT_MAX_LAG;
+    
+    // Parse command line options
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc && parse_policy(argv[i + 1], &policy)) {
+            i++;
+        } else if (strcmp(argv[i], "--max-lag") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 0) {
+            max_lag = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [--policy reject|evict|disconnect] [--max-lag N]\n", argv[0]);
+            return 1;
+        }
+    }
+    
+    // Set up the event loop; signals are blocked and read from a signalfd
+    int signals[] = { SIGINT, SIGTERM };
+    if (!event_loop_init(&loop) || event_loop_add_signals(&loop, signals, 2, handle_signal, NULL) == -1) {
+        perror("Failed to set up event loop");
+        return 1;
+    }
     
     printf("Starting chat server...\n");
     
     // Initialize the chat server
     if (!init_chat_server()) {
         fprintf(stderr, "Failed to initialize chat server\n");
+        event_loop_destroy(&loop);
         return 1;
     }
     
+    // Configure how slow participants are handled
+    set_slow_consumer_policy(policy, (uint32_t)max_lag);
+    
     printf("Chat server initialized. Press Ctrl+C to exit.\n");
     
     // Send welcome message
     send_message("Chat server is now online");
     
-    // Main server loop
-    while (running) {
-        // Process new messages
-        process_new_messages(print_message);
-        
-        // Check for inactive participants
-        check_participants();
-        
-        // Print active participants every 10 seconds
-        static time_t last_status = 0;
-        time_t now = time(NULL);
-        
-        if (now - last_status >= 10) {
-            char usernames[MAX_PARTICIPANTS][MAX_USERNAME_LENGTH];
-            int count = get_participants(usernames, MAX_PARTICIPANTS);
-            
-            printf("\nActive participants (%d):\n", count);
-            for (int i = 0; i < count; i++) {
-                printf("- %s\n", usernames[i]);
-            }
-            printf("\n");
-            
-            last_status = now;
-        }
-        
-        // Sleep to avoid busy waiting
-        usleep(100);  // 100ms
+    // Wake up for messages, exiting participants and housekeeping only
+    if (!event_loop_add_fd(&loop, open_message_notifier(), EPOLLIN, handle_messages, NULL) ||
+        !event_loop_add_fd(&loop, participant_watch_fd(), EPOLLIN, handle_participant_exit, NULL) ||
+        event_loop_add_timer(&loop, HOUSEKEEPING_INTERVAL_MS, handle_housekeeping, NULL) == -1) {
+        perror("Failed to set up event sources");
+        cleanup_chat_server();
+        event_loop_destroy(&loop);
+        return 1;
     }
     
+    // Main server loop
+    handle_housekeeping(-1, 0, NULL);
+    event_loop_run(&loop);
+    
     // Clean up resources
     cleanup_chat_server();
+    event_loop_destroy(&loop);
     
     printf("Chat server shut down\n");
     return 0;
@@ -0,0 +1,664 @@
+// chat_test.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include "shm_manager.h"
+#include "chat_journal.h"
+#include "message_tracker.h"
+#include "channel_directory.h"
+#include "direct_channel.h"
+#include "event_loop.h"
+#include "mempool_ring.h"
+
+// Test function prototypes
+void test_channel_leave(void);
+void test_username_index(void);
+void test_journal_directory(void);
+void test_tracker_policies(void);
+void test_journal_replay(void);
+void test_channel_accounting(void);
+void test_direct_accounting(void);
+void test_event_loop(void);
+
+// Journal directory of the servers the tests start, so a real journal is left alone
+static char test_journal_dir[] = "/tmp/chat_test.XXXXXX";
+
+// Remove a directory and the files in it
+static void remove_directory(const char* path) {
+    char file[JOURNAL_MAX_PATH + sizeof(((struct dirent*)0)->d_name)];
+    DIR* dir = opendir(path);
+    assert(dir != NULL);
+    
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+            snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+            assert(unlink(file) == 0);
+        }
+    }
+    
+    closedir(dir);
+    assert(rmdir(path) == 0);
+}
+
+int main(void) {
+    printf("Starting chat room tests...\n");
+    
+    assert(mkdtemp(test_journal_dir) != NULL);
+    setenv(JOURNAL_DIR_ENV, test_journal_dir, 1);
+    
+    test_channel_leave();
+    test_username_index();
+    test_journal_directory();
+    test_tracker_policies();
+    test_journal_replay();
+    test_channel_accounting();
+    test_direct_accounting();
+    test_event_loop();
+    
+    remove_directory(test_journal_dir);
+    
+    printf("All chat room tests passed!\n");
+    return 0;
+}
+
+// Run a client in a child process against the server this process runs
+// The client's globals live in the child; it fails the test by aborting
+static void run_client(void (*client)(void)) {
+    fflush(stdout);  // Or the child prints our buffered output again
+    pid_t pid = fork();
+    assert(pid >= 0);
+    
+    if (pid == 0) {
+        client();
+        exit(0);
+    }
+    
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+// Free blocks in a chat pool, through a mapping of our own
+static uint32_t pool_free_count(const char* shm_name, uint32_t memory_size) {
+    mem_pool_t pool;
+    assert(memory_pool_init_shared(&pool, shm_name, memory_size, MESSAGE_BLOCK_SIZE, false, 0666));
+    uint32_t free_count = memory_pool_free_count(&pool);
+    memory_pool_destroy(&pool, false);
+    return free_count;
+}
+
+static void channel_leave_client(void) {
+    assert(join_chat_client("alice"));
+    assert(join_channel("dev"));
+    
+    uint32_t room_free = pool_free_count(SHM_CHAT_POOL, MEMORY_POOL_SIZE);
+    uint32_t channel_free = pool_free_count(SHM_CHANNEL_MESSAGE_POOL, CHANNEL_MESSAGE_POOL_SIZE);
+    
+    // The unread post holds a channel block, not one of the room's
+    assert(send_channel_message("dev", "hello"));
+    assert(pool_free_count(SHM_CHANNEL_MESSAGE_POOL, CHANNEL_MESSAGE_POOL_SIZE) == channel_free - 1);
+    assert(pool_free_count(SHM_CHAT_POOL, MEMORY_POOL_SIZE) == room_free);
+    
+    // Leaving releases it back to the channel pool
+    assert(leave_channel("dev"));
+    assert(pool_free_count(SHM_CHANNEL_MESSAGE_POOL, CHANNEL_MESSAGE_POOL_SIZE) == channel_free);
+    assert(pool_free_count(SHM_CHAT_POOL, MEMORY_POOL_SIZE) == room_free);
+    
+    leave_chat();
+}
+
+// Test leaving a channel with unread messages
+void test_channel_leave(void) {
+    printf("Testing channel leave...\n");
+    
+    assert(init_chat_server());
+    run_client(channel_leave_client);
+    cleanup_chat_server();
+    
+    printf("Channel leave tests passed!\n");
+}
+
+// Map the participants directory to look at the username index
+static participants_directory_t* map_participants(void) {
+    int fd = shm_open(SHM_PARTICIPANTS, O_RDWR, 0666);
+    assert(fd != -1);
+    participants_directory_t* directory = mmap(NULL, sizeof(participants_directory_t),
+                                               PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    assert(directory != MAP_FAILED);
+    return directory;
+}
+
+// Username index entries in use or deleted
+static int username_index_load(const participants_directory_t* directory) {
+    int used = 0;
+    for (int i = 0; i < USERNAME_INDEX_SIZE; i++) {
+        used += atomic_load(&directory->username_index[i]) != USERNAME_INDEX_EMPTY;
+    }
+    return used;
+}
+
+static void guest_names_client(void) {
+    static int handles[MAX_GUEST_NAMES];
+    char name[MAX_USERNAME_LENGTH];
+    participants_directory_t* directory = map_participants();
+    
+    assert(join_chat_client("gateway"));
+    int baseline = username_index_load(directory);
+    
+    // Names are unique across guests and participants
+    assert(reserve_username("gateway") == -1);
+    assert(reserve_username("Server") == -1);
+    int handle = reserve_username("carol");
+    assert(handle >= 0);
+    assert(reserve_username("carol") == -1);
+    release_username(handle);
+    release_username(handle);  // Already released
+    
+    // Fill the guest table, then empty it, several times over
+    for (int round = 0; round < 4; round++) {
+        for (int i = 0; i < MAX_GUEST_NAMES; i++) {
+            snprintf(name, sizeof(name), "guest%d.%d", round, i);
+            handles[i] = reserve_username(name);
+            assert(handles[i] >= 0);
+        }
+        assert(reserve_username("one too many") == -1);
+        
+        for (int i = 0; i < MAX_GUEST_NAMES; i++) {
+            release_username(handles[i]);
+        }
+        
+        // Deleted entries are reclaimed instead of piling up along the chains
+        assert(username_index_load(directory) < baseline + 256);
+    }
+    
+    // Names still held when a participant leaves are released with it
+    for (int i = 0; i < 16; i++) {
+        snprintf(name, sizeof(name), "kept%d", i);
+        assert(reserve_username(name) >= 0);
+    }
+    leave_chat();
+    assert(username_index_load(directory) < baseline + 256);
+    
+    assert(join_chat_client("gateway"));
+    for (int i = 0; i < 16; i++) {
+        snprintf(name, sizeof(name), "kept%d", i);
+        assert(reserve_username(name) >= 0);
+    }
+    leave_chat();
+    
+    munmap(directory, sizeof(participants_directory_t));
+}
+
+// Test guest name reservation and username index upkeep
+void test_username_index(void) {
+    printf("Testing username index...\n");
+    
+    assert(init_chat_server());
+    run_client(guest_names_client);
+    cleanup_chat_server();
+    
+    printf("Username index tests passed!\n");
+}
+
+// Test that the journal keeps to a directory nobody else can write to
+void test_journal_directory(void) {
+    printf("Testing journal directory...\n");
+    
+    char dir[64];
+    char path[JOURNAL_MAX_PATH];
+    snprintf(dir, sizeof(dir), "%s/private", test_journal_dir);
+    setenv(JOURNAL_DIR_ENV, dir, 1);
+    
+    // Segments are created private to the owner
+    journal_writer_t writer;
+    struct stat st;
+    assert(journal_open_writer(&writer));
+    snprintf(path, sizeof(path), "%s/%s.%08llu.log", dir, JOURNAL_PREFIX, 0ull);
+    assert(stat(path, &st) == 0 && (st.st_mode & 0777) == 0600);
+    journal_close_writer(&writer);
+    
+    // A directory others can write to is refused
+    assert(chmod(dir, 0777) == 0);
+    assert(!journal_open_writer(&writer));
+    assert(chmod(dir, 0700) == 0);
+    
+    // A symlink posing as a segment is never followed: the writer starts after it
+    char target[JOURNAL_MAX_PATH];
+    snprintf(target, sizeof(target), "%s/target", dir);
+    snprintf(path, sizeof(path), "%s/%s.%08llu.log", dir, JOURNAL_PREFIX, 1ull);
+    assert(symlink(target, path) == 0);
+    assert(journal_open_writer(&writer));
+    assert(writer.segment_number == 2);
+    assert(access(target, F_OK) == -1);
+    journal_close_writer(&writer);
+    
+    remove_directory(dir);
+    setenv(JOURNAL_DIR_ENV, test_journal_dir, 1);
+    
+    printf("Journal directory tests passed!\n");
+}
+
+// Set up a message pool in private memory; returns the memory to free afterwards
+static void* private_pool(mem_pool_t* pool, uint32_t memory_size, uint32_t block_size) {
+    void* memory = malloc(memory_size);
+    assert(memory != NULL);
+    assert(memory_pool_init(pool, memory, memory_size, block_size));
+    return memory;
+}
+
+// Track a fresh block for the participants in `mask`
+static bool add_tracked(message_tracker_t* tracker, mem_pool_t* pool, uint32_t mask) {
+    void* block = memory_pool_alloc(pool);
+    assert(block != NULL);
+    
+    uint64_t sequence;
+    if (!tracker_add_message(tracker, pool, block, mask, &sequence, 0, TRACKER_PRIORITY_NORMAL)) {
+        memory_pool_free(pool, block);
+        return false;
+    }
+    return true;
+}
+
+// Read everything a participant has pending, as process_new_messages does
+static int read_tracked(message_tracker_t* tracker, mem_pool_t* pool, int participant_id) {
+    int read = 0;
+    int index;
+    while ((index = tracker_get_next_unread(tracker, participant_id, false)) >= 0) {
+        if (tracker_mark_read(tracker, index, participant_id, tracker->messages[index].sequence)) {
+            tracker_try_free_message(tracker, index, pool);
+            read++;
+        }
+    }
+    return read;
+}
+
+// Test the slow-consumer policies of the message tracker
+void test_tracker_policies(void) {
+    printf("Testing tracker policies...\n");
+    
+    mem_pool_t pool;
+    void* memory = private_pool(&pool, MEMORY_POOL_SIZE, MESSAGE_BLOCK_SIZE);
+    uint32_t total = memory_pool_free_count(&pool);
+    message_tracker_t* tracker = malloc(sizeof(message_tracker_t));
+    assert(tracker != NULL);
+    
+    // REJECT: a stalled participant fills the tracker and sends start failing
+    assert(tracker_init(tracker));
+    tracker_set_policy(tracker, TRACKER_POLICY_REJECT, 4);
+    for (int i = 0; i < MAX_TRACKED_MESSAGES; i++) {
+        assert(add_tracked(tracker, &pool, 0x3));
+        assert(read_tracked(tracker, &pool, 0) == 1);
+    }
+    assert(!add_tracked(tracker, &pool, 0x3));
+    assert(memory_pool_free_count(&pool) == total - MAX_TRACKED_MESSAGES);
+    assert(tracker_release_participant(tracker, 1, &pool) == MAX_TRACKED_MESSAGES);
+    assert(memory_pool_free_count(&pool) == total);
+    
+    // EVICT_OLDEST: the laggard keeps its newest max_lag messages and is told
+    // how many it missed; the others are not held up
+    assert(tracker_init(tracker));
+    tracker_set_policy(tracker, TRACKER_POLICY_EVICT_OLDEST, 4);
+    for (int i = 0; i < 10; i++) {
+        assert(add_tracked(tracker, &pool, 0x3));
+        assert(read_tracked(tracker, &pool, 0) == 1);
+    }
+    assert(atomic_load(&tracker->pending[1]) == 4);
+    assert(tracker_take_missed(tracker, 1) == 6);
+    assert(tracker_take_missed(tracker, 1) == 0);
+    assert(memory_pool_free_count(&pool) == total - 4);
+    
+    // The oldest kept message is the first one it reads
+    int index = tracker_get_next_unread(tracker, 1, false);
+    assert(index >= 0 && tracker->messages[index].sequence == 6);
+    assert(read_tracked(tracker, &pool, 1) == 4);
+    assert(memory_pool_free_count(&pool) == total);
+    assert(tracker_take_evicted(tracker) == 0);
+    
+    // DISCONNECT: the laggard is flagged, loses everything and gets nothing new
+    assert(tracker_init(tracker));
+    tracker_set_policy(tracker, TRACKER_POLICY_DISCONNECT, 4);
+    for (int i = 0; i < 10; i++) {
+        assert(add_tracked(tracker, &pool, 0x3));
+        assert(read_tracked(tracker, &pool, 0) == 1);
+    }
+    assert(tracker_take_evicted(tracker) == 0x2);
+    assert(tracker_take_evicted(tracker) == 0);
+    assert(atomic_load(&tracker->pending[1]) == 0);
+    assert(tracker_get_next_unread(tracker, 1, false) == -1);
+    assert(memory_pool_free_count(&pool) == total);
+    
+    // Retained participants are never dropped, whatever the policy
+    assert(tracker_init(tracker));
+    tracker_set_policy(tracker, TRACKER_POLICY_EVICT_OLDEST, 4);
+    tracker_set_retained(tracker, 0x1);
+    for (int i = 0; i < 10; i++) {
+        assert(add_tracked(tracker, &pool, 0x3));
+        assert(read_tracked(tracker, &pool, 1) == 1);
+    }
+    assert(atomic_load(&tracker->pending[0]) == 10);
+    assert(tracker_take_missed(tracker, 0) == 0);
+    assert(read_tracked(tracker, &pool, 0) == 10);
+    assert(memory_pool_free_count(&pool) == total);
+    
+    free(tracker);
+    memory_pool_destroy(&pool, false);
+    free(memory);
+    
+    printf("Tracker policy tests passed!\n");
+}
+
+// Replay callback checking that records arrive in sequence order
+typedef struct {
+    uint64_t first;
+    uint64_t last;
+    int count;
+} replay_check_t;
+
+static void check_record(const journal_record_t* record, void* context) {
+    replay_check_t* check = context;
+    if (check->count == 0) {
+        check->first = record->sequence;
+    } else {
+        assert(record->sequence == check->last + 1);
+    }
+    assert(record->message_length == strlen(record->data));
+    assert(strcmp(record->sender, "replayer") == 0);
+    check->last = record->sequence;
+    check->count++;
+}
+
+// Records of JOURNAL_TEST_MESSAGE_LENGTH bytes that fit in one segment
+#define JOURNAL_TEST_MESSAGE_LENGTH 1000
+#define JOURNAL_TEST_RECORD_LENGTH \
+    ((sizeof(journal_record_t) + JOURNAL_TEST_MESSAGE_LENGTH + 1 + 7) & ~(size_t)7)
+
+// Test replaying the journal across segment rotations and retention
+void test_journal_replay(void) {
+    printf("Testing journal replay...\n");
+    
+    char dir[64];
+    snprintf(dir, sizeof(dir), "%s/replay", test_journal_dir);
+    setenv(JOURNAL_DIR_ENV, dir, 1);
+    
+    char message[JOURNAL_TEST_MESSAGE_LENGTH + 1];
+    memset(message, 'm', JOURNAL_TEST_MESSAGE_LENGTH);
+    message[JOURNAL_TEST_MESSAGE_LENGTH] = '\0';
+    
+    // Enough records for a few segments; timestamps step once every 100
+    uint32_t per_segment = JOURNAL_SEGMENT_SIZE / JOURNAL_TEST_RECORD_LENGTH;
+    uint64_t total = per_segment * 3;
+    journal_writer_t writer;
+    assert(journal_open_writer(&writer));
+    for (uint64_t sequence = 0; sequence < total; sequence++) {
+        assert(journal_append(&writer, sequence, 1000 + sequence / 100, "replayer",
+                              message, JOURNAL_TEST_MESSAGE_LENGTH));
+        if (sequence % 64 == 63) {
+            journal_flush(&writer);
+        }
+    }
+    assert(writer.segment_number >= 2);
+    journal_close_writer(&writer);
+    
+    journal_reader_t reader;
+    replay_check_t check;
+    assert(journal_open_reader(&reader));
+    assert(reader.count == writer.segment_number + 1);
+    
+    // The last records, across the boundary into the newest segment
+    uint32_t tail = atomic_load(&reader.segments[reader.count - 1]->record_count) + 10;
+    memset(&check, 0, sizeof(check));
+    assert(journal_replay_last(&reader, tail, check_record, &check) == (int)tail);
+    assert(check.first == total - tail && check.last == total - 1);
+    
+    // Asking for more than there is replays everything
+    memset(&check, 0, sizeof(check));
+    assert(journal_replay_last(&reader, UINT32_MAX, check_record, &check) == (int)total);
+    assert(check.first == 0);
+    
+    // A time range spanning a segment boundary
+    uint64_t boundary = reader.segments[1]->first_sequence;
+    uint64_t from = 1000 + boundary / 100 - 2;
+    uint64_t to = 1000 + boundary / 100 + 2;
+    memset(&check, 0, sizeof(check));
+    assert(journal_replay_range(&reader, from, to, check_record, &check) == 500);
+    assert(check.first == (from - 1000) * 100 && check.last == (to - 1000) * 100 + 99);
+    journal_close_reader(&reader);
+    
+    // The writer continues the sequence, and old segments fall out of retention
+    assert(journal_open_writer(&writer));
+    assert(writer.next_sequence == total);
+    uint64_t more = per_segment * JOURNAL_MAX_SEGMENTS;
+    for (uint64_t sequence = total; sequence < total + more; sequence++) {
+        assert(journal_append(&writer, sequence, 2000, "replayer", message, JOURNAL_TEST_MESSAGE_LENGTH));
+    }
+    journal_close_writer(&writer);
+    
+    assert(journal_open_reader(&reader));
+    assert(reader.count == JOURNAL_MAX_SEGMENTS);
+    memset(&check, 0, sizeof(check));
+    journal_replay_last(&reader, UINT32_MAX, check_record, &check);
+    assert(check.first == reader.segments[0]->first_sequence && check.first > 0);
+    assert(check.last == total + more - 1);
+    journal_close_reader(&reader);
+    
+    remove_directory(dir);
+    setenv(JOURNAL_DIR_ENV, test_journal_dir, 1);
+    
+    printf("Journal replay tests passed!\n");
+}
+
+static void count_channel_message(const channel_t* channel, void* block, void* context) {
+    (void)channel;
+    (void)block;
+    (*(int*)context)++;
+}
+
+// Test that channel message blocks return to their pool on read, leave and release
+void test_channel_accounting(void) {
+    printf("Testing channel block accounting...\n");
+    
+    mem_pool_t channel_pool, message_pool;
+    void* channel_memory = private_pool(&channel_pool, CHANNEL_POOL_SIZE, CHANNEL_BLOCK_SIZE);
+    void* message_memory = private_pool(&message_pool, CHANNEL_MESSAGE_POOL_SIZE, MESSAGE_BLOCK_SIZE);
+    uint32_t total = memory_pool_free_count(&message_pool);
+    channel_directory_t* directory = malloc(sizeof(channel_directory_t));
+    assert(directory != NULL);
+    assert(channel_directory_init(directory));
+    
+    channel_t* channel = channel_open(directory, &channel_pool, "dev");
+    assert(channel != NULL);
+    assert(channel_lookup(directory, &channel_pool, "dev") == channel);
+    assert(channel_join(channel, 1));
+    assert(channel_join(channel, 2));
+    
+    // A message stays until every member has read it or left
+    for (int i = 0; i < 3; i++) {
+        void* block = channel_alloc_message(channel, &message_pool);
+        assert(block != NULL);
+        assert(channel_post(channel, &message_pool, block));
+    }
+    int delivered = 0;
+    assert(channel_receive(channel, &message_pool, 1, count_channel_message, &delivered) == 3);
+    assert(memory_pool_free_count(&message_pool) == total - 3);
+    channel_leave(channel, 2, &message_pool);
+    assert(memory_pool_free_count(&message_pool) == total);
+    
+    // A full log drops its oldest message instead of holding more blocks
+    for (int i = 0; i < CHANNEL_LOG_CAPACITY + 5; i++) {
+        void* block = channel_alloc_message(channel, &message_pool);
+        assert(block != NULL);
+        assert(channel_post(channel, &message_pool, block));
+    }
+    assert(memory_pool_free_count(&message_pool) == total - CHANNEL_LOG_CAPACITY);
+    
+    // Releasing a dead member frees what it had not read
+    channel_directory_release_participant(directory, &channel_pool, 1, &message_pool);
+    assert(atomic_load(&channel->members) == 0);
+    assert(memory_pool_free_count(&message_pool) == total);
+    
+    // Posts to a channel nobody is in are freed at once
+    void* block = channel_alloc_message(channel, &message_pool);
+    assert(channel_post(channel, &message_pool, block));
+    assert(memory_pool_free_count(&message_pool) == total);
+    
+    free(directory);
+    memory_pool_destroy(&message_pool, false);
+    memory_pool_destroy(&channel_pool, false);
+    free(message_memory);
+    free(channel_memory);
+    
+    printf("Channel block accounting tests passed!\n");
+}
+
+static void count_direct_message(int sender_id, void* block, void* context) {
+    (void)sender_id;
+    (void)block;
+    (*(int*)context)++;
+}
+
+// Send a fresh block from one participant to another
+static bool send_direct(direct_directory_t* directory, mem_pool_t* direct_pool, mem_pool_t* message_pool,
+                        int sender_id, int receiver_id) {
+    void* block = memory_pool_alloc(message_pool);
+    assert(block != NULL);
+    
+    if (!direct_send(directory, direct_pool, sender_id, receiver_id, message_pool, block)) {
+        memory_pool_free(message_pool, block);
+        return false;
+    }
+    return true;
+}
+
+// Test that direct message blocks return to their pool on receive, eviction and release
+void test_direct_accounting(void) {
+    printf("Testing direct message block accounting...\n");
+    
+    mem_pool_t direct_pool, message_pool;
+    void* direct_memory = private_pool(&direct_pool, DIRECT_POOL_SIZE, DIRECT_BLOCK_SIZE);
+    void* message_memory = private_pool(&message_pool, MEMORY_POOL_SIZE, MESSAGE_BLOCK_SIZE);
+    uint32_t total = memory_pool_free_count(&message_pool);
+    direct_directory_t* directory = malloc(sizeof(direct_directory_t));
+    assert(directory != NULL);
+    assert(direct_directory_init(directory));
+    
+    // Received blocks are freed after the callback
+    for (int i = 0; i < 5; i++) {
+        assert(send_direct(directory, &direct_pool, &message_pool, 1, 2));
+    }
+    assert(direct_has_pending(directory, 2));
+    assert(memory_pool_free_count(&message_pool) == total - 5);
+    int delivered = 0;
+    assert(direct_receive(directory, &direct_pool, 2, &message_pool, count_direct_message, &delivered) == 5);
+    assert(delivered == 5);
+    assert(!direct_has_pending(directory, 2));
+    assert(memory_pool_free_count(&message_pool) == total);
+    
+    // REJECT: a stalled receiver holds at most DIRECT_MAX_QUEUED blocks from all senders
+    int sent = 0;
+    for (int sender = 1; sender < 6; sender++) {
+        for (int i = 0; i < DIRECT_CAPACITY; i++) {
+            sent += send_direct(directory, &direct_pool, &message_pool, sender, 3);
+        }
+    }
+    assert(sent == DIRECT_MAX_QUEUED);
+    assert(memory_pool_free_count(&message_pool) == total - DIRECT_MAX_QUEUED);
+    
+    // EVICT_OLDEST: sends go through and the receiver is told what it missed
+    direct_set_policy(directory, DIRECT_POLICY_EVICT_OLDEST);
+    for (int i = 0; i < 10; i++) {
+        assert(send_direct(directory, &direct_pool, &message_pool, 6, 3));
+    }
+    assert(direct_take_missed(directory, 3) == 10);
+    assert(memory_pool_free_count(&message_pool) == total - DIRECT_MAX_QUEUED);
+    
+    // Releasing the receiver frees everything waiting for it
+    direct_release_participant(directory, &direct_pool, 3, &message_pool);
+    assert(!direct_has_pending(directory, 3));
+    assert(memory_pool_free_count(&message_pool) == total);
+    
+    free(directory);
+    memory_pool_destroy(&message_pool, false);
+    memory_pool_destroy(&direct_pool, false);
+    free(message_memory);
+    free(direct_memory);
+    
+    printf("Direct message block accounting tests passed!\n");
+}
+
+// Event loop test state
+typedef struct {
+    event_loop_t* loop;
+    int reads;
+    int ticks;
+    int signals;
+} loop_check_t;
+
+static void on_pipe(int fd, uint32_t events, void* context) {
+    loop_check_t* check = context;
+    char byte;
+    assert(events & EPOLLIN);
+    assert(read(fd, &byte, 1) == 1);
+    check->reads++;
+}
+
+static void on_signal(int fd, uint32_t events, void* context) {
+    (void)fd;
+    loop_check_t* check = context;
+    assert(events == SIGUSR1);
+    check->signals++;
+}
+
+static void on_tick(int fd, uint32_t events, void* context) {
+    (void)fd;
+    loop_check_t* check = context;
+    check->ticks += events;
+    if (check->ticks >= 3) {
+        event_loop_stop(check->loop);
+    }
+}
+
+// Test dispatching descriptors, timers and signals
+void test_event_loop(void) {
+    printf("Testing event loop...\n");
+    
+    event_loop_t loop;
+    loop_check_t check = { &loop, 0, 0, 0 };
+    int fds[2];
+    assert(pipe(fds) == 0);
+    assert(event_loop_init(&loop));
+    
+    int signals[] = { SIGUSR1 };
+    assert(event_loop_add_fd(&loop, fds[0], EPOLLIN, on_pipe, &check));
+    assert(event_loop_add_signals(&loop, signals, 1, on_signal, &check) != -1);
+    assert(event_loop_add_timer(&loop, 10, on_tick, &check) != -1);
+    
+    // Everything queued before the loop runs is dispatched along with the ticks
+    assert(write(fds[1], "ab", 2) == 2);
+    raise(SIGUSR1);  // Blocked, so it waits in the signalfd
+    event_loop_run(&loop);
+    assert(check.reads == 2 && check.signals == 1 && check.ticks >= 3);
+    
+    // A removed descriptor is no longer dispatched
+    assert(event_loop_remove_fd(&loop, fds[0]));
+    assert(write(fds[1], "c", 1) == 1);
+    check.ticks = 0;
+    event_loop_run(&loop);
+    assert(check.reads == 2);
+    
+    event_loop_destroy(&loop);
+    close(fds[0]);
+    close(fds[1]);
+    
+    printf("Event loop tests passed!\n");
+}
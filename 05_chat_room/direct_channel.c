@@ -0,0 +1,227 @@
+#include "direct_channel.h"
+#include <string.h>
+
+// Pairs and messages are referenced by offset so every process can
+// resolve them whatever address it mapped the pools at
+static inline uint32_t block_to_offset(const mem_pool_t* pool, const void* block) {
+    return (uint32_t)((const uint8_t*)block - (const uint8_t*)pool->pool_start);
+}
+
+static inline void* offset_to_block(const mem_pool_t* pool, uint32_t offset) {
+    return (uint8_t*)pool->pool_start + offset;
+}
+
+static inline bool valid_participant(int participant_id) {
+    return participant_id >= 0 && participant_id < DIRECT_MAX_PARTICIPANTS;
+}
+
+// Find the channel of a pair, NULL if it was never used
+static direct_channel_t* pair_lookup(direct_directory_t* directory, mem_pool_t* direct_pool,
+                                     int sender_id, int receiver_id) {
+    uint32_t entry = atomic_load(&directory->pairs[sender_id][receiver_id]);
+    return entry != 0 ? offset_to_block(direct_pool, entry - 1) : NULL;
+}
+
+// Find the channel of a pair, allocating it on first use
+static direct_channel_t* pair_open(direct_directory_t* directory, mem_pool_t* direct_pool,
+                                   int sender_id, int receiver_id) {
+    direct_channel_t* channel = pair_lookup(directory, direct_pool, sender_id, receiver_id);
+    if (channel != NULL) {
+        return channel;
+    }
+    
+    channel = memory_pool_alloc(direct_pool);
+    if (channel == NULL) {
+        return NULL;
+    }
+    
+    memset(channel, 0, sizeof(direct_channel_t));
+    atomic_store(&channel->head, 0);
+    atomic_store(&channel->tail, 0);
+    
+    // Publish it; if another send raced us, use the winner's channel
+    uint32_t expected = 0;
+    uint32_t entry = block_to_offset(direct_pool, channel) + 1;
+    if (!atomic_compare_exchange_strong(&directory->pairs[sender_id][receiver_id], &expected, entry)) {
+        memory_pool_free(direct_pool, channel);
+        channel = offset_to_block(direct_pool, expected - 1);
+    }
+    
+    return channel;
+}
+
+// Take the oldest message off a pair, NULL if it is empty
+// Whoever wins the CAS on head owns the block
+static void* pair_claim(direct_channel_t* channel, mem_pool_t* message_pool) {
+    uint32_t head = atomic_load_explicit(&channel->head, memory_order_acquire);
+    
+    while (head != atomic_load_explicit(&channel->tail, memory_order_acquire)) {
+        uint32_t offset = atomic_load_explicit(&channel->log[head % DIRECT_CAPACITY], memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&channel->head, &head, head + 1,
+                                                  memory_order_acq_rel, memory_order_acquire)) {
+            return offset_to_block(message_pool, offset);
+        }
+    }
+    
+    return NULL;
+}
+
+// Drop the oldest message waiting for a receiver, from the sender's own
+// pair if it has one, otherwise from any other sender's
+static bool evict_oldest(direct_directory_t* directory, mem_pool_t* direct_pool, int sender_id,
+                         int receiver_id, mem_pool_t* message_pool) {
+    for (int i = 0; i < DIRECT_MAX_PARTICIPANTS; i++) {
+        int from = (sender_id + i) % DIRECT_MAX_PARTICIPANTS;
+        direct_channel_t* channel = pair_lookup(directory, direct_pool, from, receiver_id);
+        void* block = channel != NULL ? pair_claim(channel, message_pool) : NULL;
+        
+        if (block != NULL) {
+            memory_pool_free(message_pool, block);
+            atomic_fetch_sub(&directory->queued[receiver_id], 1);
+            atomic_fetch_add(&directory->missed[receiver_id], 1);
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+// Initialize an empty directory
+bool direct_directory_init(direct_directory_t* directory) {
+    if (directory == NULL) {
+        return false;
+    }
+    
+    memset(directory, 0, sizeof(direct_directory_t));
+    directory->policy = DIRECT_POLICY_REJECT;
+    return true;
+}
+
+// Choose what senders do about a receiver that stops reading
+void direct_set_policy(direct_directory_t* directory, direct_policy_t policy) {
+    if (directory != NULL) {
+        directory->policy = policy;
+    }
+}
+
+// Send a message block to a participant
+bool direct_send(direct_directory_t* directory, mem_pool_t* direct_pool, int sender_id,
+                 int receiver_id, mem_pool_t* message_pool, void* block) {
+    if (directory == NULL || direct_pool == NULL || message_pool == NULL || block == NULL ||
+        !valid_participant(sender_id) || !valid_participant(receiver_id)) {
+        return false;
+    }
+    
+    direct_channel_t* channel = pair_open(directory, direct_pool, sender_id, receiver_id);
+    if (channel == NULL) {
+        return false;
+    }
+    
+    // Receiver is not keeping up: make room or give up
+    uint32_t tail = atomic_load_explicit(&channel->tail, memory_order_relaxed);
+    bool pair_full = tail - atomic_load_explicit(&channel->head, memory_order_acquire) == DIRECT_CAPACITY;
+    if (pair_full || atomic_load(&directory->queued[receiver_id]) >= DIRECT_MAX_QUEUED) {
+        if (directory->policy != DIRECT_POLICY_EVICT_OLDEST) {
+            return false;
+        }
+        
+        // Our own pair is tried first, so a full pair always gets room
+        if (!evict_oldest(directory, direct_pool, sender_id, receiver_id, message_pool) && pair_full) {
+            return false;
+        }
+    }
+    
+    atomic_store_explicit(&channel->log[tail % DIRECT_CAPACITY], block_to_offset(message_pool, block),
+                          memory_order_relaxed);
+    atomic_fetch_add(&directory->queued[receiver_id], 1);
+    atomic_store_explicit(&channel->tail, tail + 1, memory_order_release);
+    
+    // Flag the pair after publishing, so a receiver that sees the flag sees the message
+    atomic_fetch_or(&directory->pending[receiver_id], 1u << sender_id);
+    return true;
+}
+
+// Drain one pair channel towards `receiver_id`
+static int pair_drain(direct_directory_t* directory, direct_channel_t* channel, int sender_id,
+                      int receiver_id, mem_pool_t* message_pool,
+                      direct_message_callback_t callback, void* context) {
+    int delivered = 0;
+    void* block;
+    
+    while ((block = pair_claim(channel, message_pool)) != NULL) {
+        atomic_fetch_sub(&directory->queued[receiver_id], 1);
+        if (callback != NULL) {
+            callback(sender_id, block, context);
+        }
+        memory_pool_free(message_pool, block);
+        delivered++;
+    }
+    
+    return delivered;
+}
+
+// Deliver the receiver's pending messages
+int direct_receive(direct_directory_t* directory, mem_pool_t* direct_pool, int receiver_id,
+                   mem_pool_t* message_pool, direct_message_callback_t callback, void* context) {
+    if (directory == NULL || direct_pool == NULL || message_pool == NULL || callback == NULL ||
+        !valid_participant(receiver_id)) {
+        return 0;
+    }
+    
+    // Clear the flags before draining: a message sent meanwhile sets its flag again
+    uint32_t senders = atomic_exchange(&directory->pending[receiver_id], 0);
+    int delivered = 0;
+    
+    while (senders != 0) {
+        int sender_id = __builtin_ctz(senders);
+        senders &= senders - 1;
+        
+        direct_channel_t* channel = pair_lookup(directory, direct_pool, sender_id, receiver_id);
+        if (channel != NULL) {
+            delivered += pair_drain(directory, channel, sender_id, receiver_id, message_pool,
+                                    callback, context);
+        }
+    }
+    
+    return delivered;
+}
+
+// Check whether a participant has pending direct messages (lock free)
+bool direct_has_pending(const direct_directory_t* directory, int receiver_id) {
+    if (directory == NULL || !valid_participant(receiver_id)) {
+        return false;
+    }
+    
+    return atomic_load(&directory->pending[receiver_id]) != 0;
+}
+
+// Take the number of messages evicted for a receiver since the last call
+uint32_t direct_take_missed(direct_directory_t* directory, int receiver_id) {
+    if (directory == NULL || !valid_participant(receiver_id)) {
+        return 0;
+    }
+    
+    return atomic_exchange(&directory->missed[receiver_id], 0);
+}
+
+// Drop all messages waiting for a participant that left, died or was disconnected
+void direct_release_participant(direct_directory_t* directory, mem_pool_t* direct_pool,
+                                int receiver_id, mem_pool_t* message_pool) {
+    if (directory == NULL || direct_pool == NULL || message_pool == NULL ||
+        !valid_participant(receiver_id)) {
+        return;
+    }
+    
+    atomic_store(&directory->pending[receiver_id], 0);
+    
+    // Every pair is drained, flagged or not, so nothing is left for the
+    // next participant in this slot
+    for (int sender_id = 0; sender_id < DIRECT_MAX_PARTICIPANTS; sender_id++) {
+        direct_channel_t* channel = pair_lookup(directory, direct_pool, sender_id, receiver_id);
+        if (channel != NULL) {
+            pair_drain(directory, channel, sender_id, receiver_id, message_pool, NULL, NULL);
+        }
+    }
+    
+    atomic_store(&directory->missed[receiver_id], 0);
+}
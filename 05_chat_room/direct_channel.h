@@ -0,0 +1,80 @@
+#ifndef DIRECT_CHANNEL_H
+#define DIRECT_CHANNEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "mempool_ring.h"
+
+// Direct message limits
+#define DIRECT_MAX_PARTICIPANTS 32        // Participant ids (pending bitmask)
+#define DIRECT_CAPACITY 16                // Messages in flight per pair (power of 2)
+#define DIRECT_MAX_QUEUED 32              // Messages waiting for one receiver from all senders
+#define DIRECT_MAX_PAIRS (DIRECT_MAX_PARTICIPANTS * DIRECT_MAX_PARTICIPANTS)
+
+// Pair block size in the direct pool (cache-line rounded)
+#define DIRECT_BLOCK_SIZE ((sizeof(direct_channel_t) + 63) & ~(size_t)63)
+
+// Size of the direct pool segment: the blocks plus the pool's free ring
+#define DIRECT_POOL_SIZE (DIRECT_MAX_PAIRS * (DIRECT_BLOCK_SIZE + sizeof(void*)) + 4096)
+
+// What a sender does when its receiver has DIRECT_MAX_QUEUED messages waiting
+typedef enum {
+    DIRECT_POLICY_REJECT = 0,             // Fail the send
+    DIRECT_POLICY_EVICT_OLDEST = 1        // Drop the receiver's oldest waiting message and count it as missed
+} direct_policy_t;
+
+// Single-producer single-consumer channel from one participant to another
+// Only the sender moves tail, so it takes no lock. Messages leave by a CAS
+// on head, which lets the receiver, a sender evicting for a stalled
+// receiver and the server releasing a dead one take them concurrently.
+// Head and tail live on separate cache lines
+typedef struct {
+    _Alignas(64) atomic_uint tail;                // Next slot the sender writes
+    _Alignas(64) atomic_uint head;                // Next slot to be taken
+    _Alignas(64) atomic_uint log[DIRECT_CAPACITY]; // Message block offsets
+} direct_channel_t;
+
+// Direct message directory: pair channels are allocated on first use
+typedef struct {
+    atomic_uint pairs[DIRECT_MAX_PARTICIPANTS][DIRECT_MAX_PARTICIPANTS]; // [sender][receiver] offset + 1, 0 if none
+    atomic_uint pending[DIRECT_MAX_PARTICIPANTS]; // Per receiver: senders with new messages
+    atomic_uint queued[DIRECT_MAX_PARTICIPANTS];  // Per receiver: messages waiting from all senders
+    atomic_uint missed[DIRECT_MAX_PARTICIPANTS];  // Per receiver: evicted messages not yet reported
+    uint32_t policy;                              // direct_policy_t
+} direct_directory_t;
+
+// Callback for a received message; `block` is the message block in the message pool
+// and is freed once the callback returns
+typedef void (*direct_message_callback_t)(int sender_id, void* block, void* context);
+
+// Initialize an empty directory
+bool direct_directory_init(direct_directory_t* directory);
+
+// Choose what senders do about a receiver that stops reading (REJECT by default)
+void direct_set_policy(direct_directory_t* directory, direct_policy_t policy);
+
+// Send a message block to a participant (the channel takes ownership on success)
+// A receiver holds at most about DIRECT_MAX_QUEUED blocks: at that limit, or
+// with DIRECT_CAPACITY messages in this pair, the send fails or evicts the
+// receiver's oldest message depending on the policy
+bool direct_send(direct_directory_t* directory, mem_pool_t* direct_pool, int sender_id,
+                 int receiver_id, mem_pool_t* message_pool, void* block);
+
+// Deliver the receiver's pending messages, oldest first per sender
+// Returns the number of messages delivered
+int direct_receive(direct_directory_t* directory, mem_pool_t* direct_pool, int receiver_id,
+                   mem_pool_t* message_pool, direct_message_callback_t callback, void* context);
+
+// Check whether a participant has pending direct messages (lock free)
+bool direct_has_pending(const direct_directory_t* directory, int receiver_id);
+
+// Take the number of messages evicted for a receiver since the last call
+uint32_t direct_take_missed(direct_directory_t* directory, int receiver_id);
+
+// Drop all messages waiting for a participant that left, died or was
+// disconnected; safe while that participant is still receiving
+void direct_release_participant(direct_directory_t* directory, mem_pool_t* direct_pool,
+                                int receiver_id, mem_pool_t* message_pool);
+
+#endif // DIRECT_CHANNEL_H
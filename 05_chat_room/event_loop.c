@@ -0,0 +1,203 @@
+#include "event_loop.h"
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+
+// Register a source in a free entry and add it to the epoll set
+static bool add_source(event_loop_t* loop, int fd, uint32_t events, event_source_kind_t kind,
+                       event_handler_t handler, void* context, bool owned) {
+    // Entries never move (epoll refers to them by pointer), so removed ones are reused
+    int index = 0;
+    while (index < loop->source_count && loop->sources[index].fd != -1) {
+        index++;
+    }
+    if (index == EVENT_LOOP_MAX_SOURCES) {
+        return false;
+    }
+    
+    event_source_t* source = &loop->sources[index];
+    source->fd = fd;
+    source->kind = kind;
+    source->handler = handler;
+    source->context = context;
+    source->owned = owned;
+    
+    struct epoll_event event = { .events = events, .data.ptr = source };
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        source->fd = -1;
+        return false;
+    }
+    
+    if (index == loop->source_count) {
+        loop->source_count++;
+    }
+    return true;
+}
+
+// Initialize an empty event loop
+bool event_loop_init(event_loop_t* loop) {
+    if (loop == NULL) {
+        return false;
+    }
+    
+    memset(loop, 0, sizeof(event_loop_t));
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    return loop->epoll_fd != -1;
+}
+
+// Watch a descriptor
+bool event_loop_add_fd(event_loop_t* loop, int fd, uint32_t events,
+                       event_handler_t handler, void* context) {
+    if (loop == NULL || fd < 0 || handler == NULL) {
+        return false;
+    }
+    
+    return add_source(loop, fd, events, EVENT_SOURCE_FD, handler, context, false);
+}
+
+// Stop watching a descriptor
+bool event_loop_remove_fd(event_loop_t* loop, int fd) {
+    if (loop == NULL || fd < 0) {
+        return false;
+    }
+    
+    for (int i = 0; i < loop->source_count; i++) {
+        if (loop->sources[i].fd == fd) {
+            epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+            loop->sources[i].fd = -1;  // Events already fetched for it are skipped
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+// Call `handler` every `interval_ms` milliseconds
+int event_loop_add_timer(event_loop_t* loop, uint32_t interval_ms,
+                         event_handler_t handler, void* context) {
+    if (loop == NULL || interval_ms == 0 || handler == NULL) {
+        return -1;
+    }
+    
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = interval_ms / 1000;
+    spec.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+    spec.it_value = spec.it_interval;
+    
+    if (timerfd_settime(fd, 0, &spec, NULL) == -1 ||
+        !add_source(loop, fd, EPOLLIN, EVENT_SOURCE_TIMER, handler, context, true)) {
+        close(fd);
+        return -1;
+    }
+    
+    return fd;
+}
+
+// Deliver the given signals through the loop
+int event_loop_add_signals(event_loop_t* loop, const int* signals, int count,
+                           event_handler_t handler, void* context) {
+    if (loop == NULL || signals == NULL || count <= 0 || handler == NULL) {
+        return -1;
+    }
+    
+    sigset_t mask;
+    sigemptyset(&mask);
+    for (int i = 0; i < count; i++) {
+        sigaddset(&mask, signals[i]);
+    }
+    
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1) {
+        return -1;
+    }
+    
+    int fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    
+    if (!add_source(loop, fd, EPOLLIN, EVENT_SOURCE_SIGNAL, handler, context, true)) {
+        close(fd);
+        return -1;
+    }
+    
+    return fd;
+}
+
+// Read what the loop consumes itself and call the handler
+static void dispatch(event_source_t* source, uint32_t events) {
+    if (source->fd == -1) {
+        return;  // Removed by an earlier handler in this batch
+    }
+    
+    if (source->kind == EVENT_SOURCE_TIMER) {
+        uint64_t expirations;
+        if (read(source->fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+            source->handler(source->fd, (uint32_t)expirations, source->context);
+        }
+        return;
+    }
+    
+    if (source->kind == EVENT_SOURCE_SIGNAL) {
+        struct signalfd_siginfo info;
+        while (read(source->fd, &info, sizeof(info)) == sizeof(info)) {
+            source->handler(source->fd, info.ssi_signo, source->context);
+        }
+        return;
+    }
+    
+    source->handler(source->fd, events, source->context);
+}
+
+// Dispatch events until event_loop_stop is called
+void event_loop_run(event_loop_t* loop) {
+    if (loop == NULL) {
+        return;
+    }
+    
+    struct epoll_event events[EVENT_LOOP_MAX_SOURCES];
+    loop->running = 1;
+    
+    while (loop->running) {
+        int count = epoll_wait(loop->epoll_fd, events, EVENT_LOOP_MAX_SOURCES, -1);
+        if (count == -1 && errno != EINTR) {
+            break;
+        }
+        
+        for (int i = 0; i < count && loop->running; i++) {
+            dispatch(events[i].data.ptr, events[i].events);
+        }
+    }
+}
+
+// Make event_loop_run return after the current dispatch
+void event_loop_stop(event_loop_t* loop) {
+    if (loop != NULL) {
+        loop->running = 0;
+    }
+}
+
+// Close the loop and the descriptors it created
+void event_loop_destroy(event_loop_t* loop) {
+    if (loop == NULL || loop->epoll_fd == -1) {
+        return;
+    }
+    
+    for (int i = 0; i < loop->source_count; i++) {
+        if (loop->sources[i].fd != -1 && loop->sources[i].owned) {
+            close(loop->sources[i].fd);
+        }
+    }
+    
+    close(loop->epoll_fd);
+    loop->epoll_fd = -1;
+    loop->source_count = 0;
+}
@@ -0,0 +1,69 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Event loop limits
+#define EVENT_LOOP_MAX_SOURCES 16
+
+// Kinds of event sources
+typedef enum {
+    EVENT_SOURCE_FD = 0,                 // Plain descriptor, the handler does the I/O
+    EVENT_SOURCE_TIMER = 1,              // timerfd, expirations are read by the loop
+    EVENT_SOURCE_SIGNAL = 2              // signalfd, siginfo is read by the loop
+} event_source_kind_t;
+
+// Handler for an event source
+// `events` is the epoll event mask for descriptors, the number of expirations
+// for timers and the signal number for signals
+typedef void (*event_handler_t)(int fd, uint32_t events, void* context);
+
+// A registered event source
+typedef struct {
+    int fd;
+    event_source_kind_t kind;
+    event_handler_t handler;
+    void* context;
+    bool owned;                          // Closed by the loop (timers and signals)
+} event_source_t;
+
+// Single-threaded epoll event loop (process local)
+typedef struct {
+    int epoll_fd;
+    volatile int running;
+    event_source_t sources[EVENT_LOOP_MAX_SOURCES];
+    int source_count;
+} event_loop_t;
+
+// Initialize an empty event loop
+bool event_loop_init(event_loop_t* loop);
+
+// Watch a descriptor for `events` (EPOLLIN, EPOLLOUT, ...)
+bool event_loop_add_fd(event_loop_t* loop, int fd, uint32_t events,
+                       event_handler_t handler, void* context);
+
+// Stop watching a descriptor (it is not closed)
+bool event_loop_remove_fd(event_loop_t* loop, int fd);
+
+// Call `handler` every `interval_ms` milliseconds
+// Returns the timerfd, or -1 on failure
+int event_loop_add_timer(event_loop_t* loop, uint32_t interval_ms,
+                         event_handler_t handler, void* context);
+
+// Deliver the given signals through the loop instead of asynchronous handlers
+// The signals are blocked for the calling thread; create threads after this
+// call so they inherit the mask. Returns the signalfd, or -1 on failure
+int event_loop_add_signals(event_loop_t* loop, const int* signals, int count,
+                           event_handler_t handler, void* context);
+
+// Dispatch events until event_loop_stop is called
+void event_loop_run(event_loop_t* loop);
+
+// Make event_loop_run return after the current dispatch
+void event_loop_stop(event_loop_t* loop);
+
+// Close the loop and the descriptors it created
+void event_loop_destroy(event_loop_t* loop);
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shm_manager.h"
+#include "direct_channel.h"
+#include "event_loop.h"
+
+// Refresh period and number of segments that can be watched
+#define DEFAULT_INTERVAL_MS 1000
+#define MAX_SEGMENTS 16
+
+// Segments shown when none are named on the command line
+static const char* default_segments[] = {
+    SHM_CHAT_POOL, SHM_CHANNEL_POOL, SHM_CHANNEL_MESSAGE_POOL, SHM_DIRECT_POOL, SHM_CHAT_RING,
+    SHM_MESSAGE_TRACKER
+};
+
+// A read-only mapping of a segment, remapped on every refresh so a
+// restarted server is picked up
+typedef struct {
+    const void* memory;
+    size_t size;
+} segment_view_t;
+
+// Counters of the previous refresh, for rates
+typedef struct {
+    const char* name;
+    uint64_t allocs;
+    uint64_t frees;
+    bool valid;
+} segment_history_t;
+
+static event_loop_t loop;
+static segment_history_t history[MAX_SEGMENTS];
+static int segment_count = 0;
+static uint32_t interval_ms = DEFAULT_INTERVAL_MS;
+
+// Map a segment read-only; nothing in it is ever written, locks included
+static bool view_open(const char* name, segment_view_t* view) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) {
+        return false;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    
+    void* memory = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    
+    view->memory = memory;
+    view->size = st.st_size;
+    return true;
+}
+
+static void view_close(segment_view_t* view) {
+    munmap((void*)view->memory, view->size);
+}
+
+static const char* lock_state(const atomic_uint* lock) {
+    return atomic_load_explicit(lock, memory_order_relaxed) != 0 ? "held" : "free";
+}
+
+static const char* policy_name(uint32_t policy) {
+    switch (policy) {
+        case TRACKER_POLICY_REJECT: return "reject";
+        case TRACKER_POLICY_EVICT_OLDEST: return "evict";
+        case TRACKER_POLICY_DISCONNECT: return "disconnect";
+        default: return "?";
+    }
+}
+
+// Statistics block of a pool segment, NULL if it has none
+// It sits in the last cache-line-aligned bytes, like mempool_ring.c puts it
+static const mempool_stats_t* find_stats(const segment_view_t* view) {
+    if (view->size < sizeof(ring_buffer_t) + sizeof(mempool_stats_t)) {
+        return NULL;
+    }
+    
+    size_t offset = (view->size - sizeof(mempool_stats_t)) & ~(size_t)63;
+    const mempool_stats_t* stats = (const mempool_stats_t*)((const uint8_t*)view->memory + offset);
+    return stats->magic == MEMPOOL_STATS_MAGIC ? stats : NULL;
+}
+
+// Per-CPU free lists of a pool segment, NULL if it has none
+// They follow the free ring from the next cache line, like mempool_ring.c puts them
+static const cpu_shards_t* find_shards(const segment_view_t* view, const mempool_stats_t* stats) {
+    const ring_buffer_t* free_ring = view->memory;
+    size_t offset = (ring_buffer_size(free_ring->capacity) + 63) & ~(size_t)63;
+    if (view->size < offset + sizeof(cpu_shards_t) || (stats != NULL && stats->blocks_offset <= offset)) {
+        return NULL;
+    }
+    
+    const cpu_shards_t* shards = (const cpu_shards_t*)((const uint8_t*)view->memory + offset);
+    if (shards->magic != CPU_SHARDS_MAGIC ||
+        view->size < offset + cpu_shards_size(shards->num_shards, shards->capacity)) {
+        return NULL;
+    }
+    return shards;
+}
+
+// Print the free ring and lock state of a ring
+static void print_ring_locks(const ring_buffer_t* ring) {
+    printf("  locks    producer %s  consumer %s\n",
+           lock_state(&ring->producer_lock), lock_state(&ring->consumer_lock));
+}
+
+// A pool: the free ring first, then the per-CPU free lists if any, then
+// the blocks, then the statistics block
+// Blocks cached by the CPUs are free, but only their own CPU hands them out quickly
+static void print_pool(const char* name, const segment_view_t* view, const mempool_stats_t* stats,
+                       segment_history_t* previous) {
+    const ring_buffer_t* free_ring = view->memory;
+    const cpu_shards_t* shards = find_shards(view, stats);
+    uint32_t free_count = atomic_load_explicit(&free_ring->count, memory_order_relaxed);
+    uint32_t cached = shards != NULL ? cpu_shards_count(shards) : 0;
+    uint32_t num_blocks = stats != NULL ? stats->num_blocks : free_ring->capacity;
+    uint32_t used = free_count + cached < num_blocks ? num_blocks - free_count - cached : 0;
+    
+    if (stats == NULL) {
+        printf("POOL %s  %u blocks (no statistics block)\n", name, num_blocks);
+        printf("  used     %u / %u (%.1f%%)", used, num_blocks,
+               num_blocks != 0 ? 100.0 * used / num_blocks : 0.0);
+        if (shards != NULL) {
+            printf("  cached %u on %u CPUs", cached, shards->num_shards);
+        }
+        printf("\n");
+        print_ring_locks(free_ring);
+        return;
+    }
+    
+    mempool_stats_snapshot_t snapshot;
+    memory_pool_sum_stats(stats, &snapshot);
+    
+    // Rates since the previous refresh
+    double seconds = interval_ms / 1000.0;
+    uint64_t alloc_rate = 0;
+    uint64_t free_rate = 0;
+    if (previous->valid && snapshot.allocs >= previous->allocs && snapshot.frees >= previous->frees) {
+        alloc_rate = (uint64_t)((snapshot.allocs - previous->allocs) / seconds);
+        free_rate = (uint64_t)((snapshot.frees - previous->frees) / seconds);
+    }
+    previous->allocs = snapshot.allocs;
+    previous->frees = snapshot.frees;
+    previous->valid = true;
+    
+    printf("POOL %s  %u blocks x %u B\n", name, num_blocks, stats->block_size);
+    printf("  used     %u / %u (%.1f%%)  peak %u", used, num_blocks,
+           num_blocks != 0 ? 100.0 * used / num_blocks : 0.0, snapshot.peak_used);
+    if (shards != NULL) {
+        printf("  cached %u on %u CPUs", cached, shards->num_shards);  // Peak counts cached blocks as used
+    }
+    printf("\n");
+    printf("  allocs   %llu (%llu/s)  frees %llu (%llu/s)\n",
+           (unsigned long long)snapshot.allocs, (unsigned long long)alloc_rate,
+           (unsigned long long)snapshot.frees, (unsigned long long)free_rate);
+    printf("  failures alloc %llu  free %llu\n",
+           (unsigned long long)snapshot.alloc_failures, (unsigned long long)snapshot.free_failures);
+    printf("  locks    producer %s  consumer %s  spins %llu  backoffs %llu\n",
+           lock_state(&free_ring->producer_lock), lock_state(&free_ring->consumer_lock),
+           (unsigned long long)snapshot.lock_spins, (unsigned long long)snapshot.lock_backoffs);
+}
+
+// A plain ring of pointers
+static void print_ring(const char* name, const segment_view_t* view) {
+    const ring_buffer_t* ring = view->memory;
+    printf("RING %s  depth %u / %u  head %u  tail %u\n", name,
+           atomic_load_explicit(&ring->count, memory_order_relaxed), ring->capacity,
+           atomic_load_explicit(&ring->head, memory_order_relaxed),
+           atomic_load_explicit(&ring->tail, memory_order_relaxed));
+    print_ring_locks(ring);
+}
+
+// The message tracker, with per-participant unread counts
+// Names and private message counts come from the participants and direct
+// segments when they can be mapped too
+static void print_tracker(const char* name, const segment_view_t* view) {
+    const message_tracker_t* tracker = view->memory;
+    
+    printf("TRACKER %s  tracked %u / %d  policy %s  max lag %u  lock %s\n", name,
+           atomic_load_explicit(&tracker->count, memory_order_relaxed), MAX_TRACKED_MESSAGES,
+           policy_name(tracker->policy), tracker->max_lag, lock_state(&tracker->tracker_lock));
+    
+    segment_view_t participants_view = { NULL, 0 };
+    segment_view_t direct_view = { NULL, 0 };
+    const participants_directory_t* directory = NULL;
+    const direct_directory_t* direct = NULL;
+    if (view_open(SHM_PARTICIPANTS, &participants_view) &&
+        participants_view.size >= sizeof(participants_directory_t)) {
+        directory = participants_view.memory;
+    }
+    if (view_open(SHM_DIRECT, &direct_view) && direct_view.size >= sizeof(direct_directory_t)) {
+        direct = direct_view.memory;
+    }
+    
+    uint32_t active = directory != NULL ? atomic_load(&directory->active_mask) : 0;
+    uint32_t sleeping = directory != NULL ? atomic_load(&directory->sleeping_mask) : 0;
+    uint32_t evicted = atomic_load(&tracker->evicted_mask);
+    
+    printf("  %3s  %-*s %8s %7s %7s %4s  %s\n", "id", MAX_USERNAME_LENGTH / 2, "user", "pid",
+           "unread", "missed", "dm", "state");
+    for (int i = 0; i < TRACKER_MAX_PARTICIPANTS; i++) {
+        uint32_t bit = 1u << i;
+        uint32_t pending = atomic_load_explicit(&tracker->pending[i], memory_order_relaxed);
+        uint32_t missed = atomic_load_explicit(&tracker->missed[i], memory_order_relaxed);
+        if (!(active & bit) && pending == 0 && missed == 0) {
+            continue;
+        }
+        
+        char username[MAX_USERNAME_LENGTH] = "-";
+        int pid = 0;
+        if (directory != NULL && (active & bit)) {
+            memcpy(username, directory->participants[i].username, MAX_USERNAME_LENGTH);
+            username[MAX_USERNAME_LENGTH - 1] = '\0';
+            pid = directory->participants[i].pid;
+        }
+        int direct_pending = direct != NULL && i < DIRECT_MAX_PARTICIPANTS ?
+                             __builtin_popcount(atomic_load(&direct->pending[i])) : 0;
+        
+        const char* state = (evicted & bit) ? "evicted" :
+                            !(active & bit) ? "gone" :
+                            (sleeping & bit) ? "waiting" : "running";
+        printf("  %3d  %-*s %8d %7u %7u %4d  %s\n", i, MAX_USERNAME_LENGTH / 2, username, pid,
+               pending, missed, direct_pending, state);
+    }
+    
+    if (participants_view.memory != NULL) {
+        view_close(&participants_view);
+    }
+    if (direct_view.memory != NULL) {
+        view_close(&direct_view);
+    }
+}
+
+// Work out what a segment holds and print it
+static void print_segment(const char* name, segment_history_t* previous) {
+    segment_view_t view;
+    if (!view_open(name, &view)) {
+        printf("%s  not available\n", name);
+        previous->valid = false;
+        return;
+    }
+    
+    const ring_buffer_t* ring = view.memory;
+    const mempool_stats_t* stats = find_stats(&view);
+    
+    if (strcmp(name, SHM_MESSAGE_TRACKER) == 0 && view.size >= sizeof(message_tracker_t)) {
+        print_tracker(name, &view);
+    } else if (stats != NULL) {
+        print_pool(name, &view, stats, previous);
+    } else if (view.size >= sizeof(ring_buffer_t) && ring->capacity != 0 &&
+               ring_buffer_size(ring->capacity) == view.size) {
+        print_ring(name, &view);
+    } else if (view.size >= sizeof(ring_buffer_t) && ring->capacity != 0 &&
+               ring_buffer_size(ring->capacity) < view.size) {
+        print_pool(name, &view, NULL, previous);  // Pool built without MEMPOOL_STATS
+    } else {
+        printf("%s  unknown layout (%zu bytes)\n", name, view.size);
+    }
+    
+    view_close(&view);
+}
+
+// Print every watched segment
+static void refresh(void) {
+    if (isatty(STDOUT_FILENO)) {
+        printf("\033[H\033[2J");
+    }
+    printf("mempool_top  refresh %u ms  (Ctrl+C to quit)\n\n", interval_ms);
+    
+    for (int i = 0; i < segment_count; i++) {
+        print_segment(history[i].name, &history[i]);
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+static void handle_refresh(int fd, uint32_t expirations, void* context) {
+    (void)fd;
+    (void)expirations;
+    (void)context;
+    refresh();
+}
+
+static void handle_signal(int fd, uint32_t signo, void* context) {
+    (void)fd;
+    (void)signo;
+    (void)context;
+    event_loop_stop(&loop);
+}
+
+int main(int argc, char* argv[]) {
+    bool once = false;
+    
+    // Parse command line options; anything else names a segment
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            interval_ms = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--once") == 0) {
+            once = true;
+        } else if (argv[i][0] == '/' && segment_count < MAX_SEGMENTS) {
+            history[segment_count++].name = argv[i];
+        } else {
+            fprintf(stderr, "Usage: %s [--interval MS] [--once] [/segment ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    
+    if (segment_count == 0) {
+        for (size_t i = 0; i < sizeof(default_segments) / sizeof(default_segments[0]); i++) {
+            history[segment_count++].name = default_segments[i];
+        }
+    }
+    
+    if (once) {
+        refresh();
+        return 0;
+    }
+    
+    int signals[] = { SIGINT, SIGTERM };
+    if (!event_loop_init(&loop) || event_loop_add_signals(&loop, signals, 2, handle_signal, NULL) == -1 ||
+        event_loop_add_timer(&loop, interval_ms, handle_refresh, NULL) == -1) {
+        perror("Failed to set up event loop");
+        return 1;
+    }
+    
+    refresh();
+    event_loop_run(&loop);
+    event_loop_destroy(&loop);
+    return 0;
+}
@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "event_trace.h"
+
+// Where POSIX shared memory segments show up as files
+#define SHM_DIRECTORY "/dev/shm"
+#define MAX_TRACES 64
+#define PATH_LENGTH 512
+
+typedef enum {
+    ACTION_DECODE = 0,    // Print Chrome trace JSON
+    ACTION_ENABLE = 1,    // Switch recording on in a running process
+    ACTION_DISABLE = 2,   // Switch recording off
+    ACTION_REMOVE = 3     // Delete the segment
+} trace_action_t;
+
+static bool first_event = true;
+
+// Path of a trace given as a pid or as a file (a copied segment)
+static void trace_path(const char* arg, char* path, size_t size) {
+    bool numeric = arg[0] != '\0';
+    for (const char* c = arg; *c != '\0'; c++) {
+        numeric = numeric && isdigit((unsigned char)*c);
+    }
+    
+    if (numeric) {
+        snprintf(path, size, "%s%s%s", SHM_DIRECTORY, EVENT_TRACE_PREFIX, arg);
+    } else {
+        snprintf(path, size, "%s", arg);
+    }
+}
+
+// Map a trace; writable only to flip the recording switch
+static trace_header_t* trace_map(const char* path, bool writable, size_t* size) {
+    int fd = open(path, writable ? O_RDWR : O_RDONLY);
+    if (fd == -1) {
+        perror(path);
+        return NULL;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror(path);
+        close(fd);
+        return NULL;
+    }
+    
+    void* memory = mmap(NULL, st.st_size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED || !event_trace_valid(memory, st.st_size)) {
+        fprintf(stderr, "%s: not a trace segment of this version\n", path);
+        if (memory != MAP_FAILED) {
+            munmap(memory, st.st_size);
+        }
+        return NULL;
+    }
+    
+    *size = st.st_size;
+    return memory;
+}
+
+static void print_separator(void) {
+    printf(first_event ? "\n" : ",\n");
+    first_event = false;
+}
+
+// Name, category and phase of an event
+static void describe(const trace_event_t* event, const char** name, const char** category, char* phase) {
+    static const char* lock_names[] = { "wait ring producer lock", "wait ring consumer lock", "wait tracker lock" };
+    const char* lock_name = event->aux < 3 ? lock_names[event->aux] : "wait lock";
+    
+    *phase = 'i';
+    switch (event->type) {
+        case TRACE_POOL_ALLOC:
+            *name = event->arg != EVENT_TRACE_NO_INDEX ? "alloc" : "alloc failed";
+            *category = "pool";
+            break;
+        case TRACE_POOL_FREE:
+            *name = event->aux != 0 ? "free" : "free rejected";
+            *category = "pool";
+            break;
+        case TRACE_RING_PUT:
+            *name = event->aux != 0 ? "put" : "put full";
+            *category = "ring";
+            break;
+        case TRACE_RING_GET:
+            *name = event->aux != 0 ? "get" : "get empty";
+            *category = "ring";
+            break;
+        case TRACE_TRACKER_ADD:
+            *name = "track";
+            *category = "tracker";
+            break;
+        case TRACE_TRACKER_MARK:
+            *name = "mark read";
+            *category = "tracker";
+            break;
+        case TRACE_TRACKER_FREE:
+            *name = "release";
+            *category = "tracker";
+            break;
+        case TRACE_LOCK_WAIT_BEGIN:
+        case TRACE_LOCK_WAIT_END:
+            *name = lock_name;
+            *category = "lock";
+            *phase = event->type == TRACE_LOCK_WAIT_BEGIN ? 'B' : 'E';
+            break;
+        default:
+            *name = "unknown";
+            *category = "unknown";
+            break;
+    }
+}
+
+// Arguments of an event as a JSON object body
+static void print_args(const trace_event_t* event) {
+    switch (event->type) {
+        case TRACE_POOL_ALLOC:
+        case TRACE_POOL_FREE:
+            if (event->arg != EVENT_TRACE_NO_INDEX) {
+                printf("\"block\":%u", event->arg);
+            }
+            break;
+        case TRACE_RING_PUT:
+        case TRACE_RING_GET:
+            printf("\"count\":%u", event->arg);
+            break;
+        case TRACE_TRACKER_ADD:
+            printf("\"sequence\":%u,\"slot\":%u", event->arg, event->aux);
+            break;
+        case TRACE_TRACKER_MARK:
+            printf("\"slot\":%u,\"participant\":%u", event->arg, event->aux);
+            break;
+        case TRACE_TRACKER_FREE:
+            printf("\"slot\":%u", event->arg);
+            break;
+        case TRACE_LOCK_WAIT_END:
+            printf("\"attempts\":%u", event->arg);
+            break;
+        default:
+            break;
+    }
+}
+
+// Print a name with JSON string escaping
+static void print_string(const char* text, size_t max) {
+    putchar('"');
+    for (size_t i = 0; i < max && text[i] != '\0'; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\') {
+            printf("\\%c", c);
+        } else if (c < 0x20) {
+            printf("\\u%04x", c);
+        } else {
+            putchar(c);
+        }
+    }
+    putchar('"');
+}
+
+// Print the events of one thread ring, oldest first
+static void decode_thread(const trace_header_t* header, const trace_thread_t* ring, trace_event_t* copy) {
+    // Copy the ring, then drop what the writer may have overwritten meanwhile
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t start = head > EVENT_TRACE_EVENTS ? head - EVENT_TRACE_EVENTS : 0;
+    for (uint64_t i = start; i < head; i++) {
+        copy[i & (EVENT_TRACE_EVENTS - 1)] = ring->events[i & (EVENT_TRACE_EVENTS - 1)];
+    }
+    
+    // The fence keeps the copy above from being reordered past the second head load
+    // (the slot of event `head_after` may be half written, hence the + 1)
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t head_after = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head_after + 1 > start + EVENT_TRACE_EVENTS) {
+        start = head_after + 1 - EVENT_TRACE_EVENTS < head ? head_after + 1 - EVENT_TRACE_EVENTS : head;
+    }
+    
+    print_separator();
+    printf("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":",
+           header->pid, ring->tid);
+    print_string(ring->name, sizeof(ring->name));
+    printf("}}");
+    
+    for (uint64_t i = start; i < head; i++) {
+        const trace_event_t* event = &copy[i & (EVENT_TRACE_EVENTS - 1)];
+        const char* name;
+        const char* category;
+        char phase;
+        describe(event, &name, &category, &phase);
+        
+        uint64_t ns = event_trace_to_ns(header, event->tsc);
+        print_separator();
+        printf("{\"ph\":\"%c\",%s\"name\":\"%s\",\"cat\":\"%s\",\"pid\":%u,\"tid\":%u,\"ts\":%llu.%03llu,\"args\":{",
+               phase, phase == 'i' ? "\"s\":\"t\"," : "", name, category, header->pid, ring->tid,
+               (unsigned long long)(ns / 1000), (unsigned long long)(ns % 1000));
+        print_args(event);
+        printf("}}");
+    }
+}
+
+// Print all events of a trace segment
+static void decode_trace(const trace_header_t* header, trace_event_t* copy) {
+    print_separator();
+    printf("{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%u,\"tid\":0,\"args\":{\"name\":", header->pid);
+    print_string(header->process, sizeof(header->process));
+    printf("}}");
+    
+    uint32_t threads = atomic_load(&header->threads_used);
+    for (uint32_t i = 0; i < threads && i < EVENT_TRACE_MAX_THREADS; i++) {
+        decode_thread(header, &header->threads[i], copy);
+    }
+    
+    uint32_t dropped = atomic_load(&header->threads_dropped);
+    if (dropped != 0) {
+        fprintf(stderr, "%s (pid %u): %u threads had no ring and were not traced\n",
+                header->process, header->pid, dropped);
+    }
+}
+
+// Apply an action to one trace
+static bool handle_trace(const char* path, trace_action_t action, trace_event_t* copy) {
+    if (action == ACTION_REMOVE) {
+        if (unlink(path) == -1) {
+            perror(path);
+            return false;
+        }
+        return true;
+    }
+    
+    size_t size;
+    trace_header_t* header = trace_map(path, action != ACTION_DECODE, &size);
+    if (header == NULL) {
+        return false;
+    }
+    
+    if (action == ACTION_DECODE) {
+        decode_trace(header, copy);
+    } else {
+        atomic_store(&header->enabled, action == ACTION_ENABLE ? 1 : 0);
+        fprintf(stderr, "%s (pid %u): recording %s\n", header->process, header->pid,
+                action == ACTION_ENABLE ? "on" : "off");
+    }
+    
+    munmap(header, size);
+    return true;
+}
+
+// All trace segments currently in shared memory
+static int find_traces(char paths[][PATH_LENGTH], int max) {
+    DIR* directory = opendir(SHM_DIRECTORY);
+    if (directory == NULL) {
+        return 0;
+    }
+    
+    int count = 0;
+    const char* prefix = EVENT_TRACE_PREFIX + 1;  // Without the leading '/'
+    struct dirent* entry;
+    while ((entry = readdir(directory)) != NULL && count < max) {
+        if (strncmp(entry->d_name, prefix, strlen(prefix)) == 0) {
+            snprintf(paths[count++], PATH_LENGTH, "%s/%s", SHM_DIRECTORY, entry->d_name);
+        }
+    }
+    closedir(directory);
+    return count;
+}
+
+int main(int argc, char* argv[]) {
+    static char paths[MAX_TRACES][PATH_LENGTH];
+    int count = 0;
+    trace_action_t action = ACTION_DECODE;
+    
+    // Parse command line options; anything else is a pid or a copied segment
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--enable") == 0) {
+            action = ACTION_ENABLE;
+        } else if (strcmp(argv[i], "--disable") == 0) {
+            action = ACTION_DISABLE;
+        } else if (strcmp(argv[i], "--remove") == 0) {
+            action = ACTION_REMOVE;
+        } else if (argv[i][0] != '-' && count < MAX_TRACES) {
+            trace_path(argv[i], paths[count++], sizeof(paths[0]));
+        } else {
+            fprintf(stderr, "Usage: %s [--enable | --disable | --remove] [PID | FILE ...]\n"
+                            "Without an option, prints the traces as Chrome trace JSON\n", argv[0]);
+            return 1;
+        }
+    }
+    
+    if (count == 0) {
+        count = find_traces(paths, MAX_TRACES);
+        if (count == 0) {
+            fprintf(stderr, "No traces in %s (start programs with MEMPOOL_TRACE=1)\n", SHM_DIRECTORY);
+            return 1;
+        }
+    }
+    
+    trace_event_t* copy = malloc(sizeof(trace_event_t) * EVENT_TRACE_EVENTS);
+    if (copy == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    
+    if (action == ACTION_DECODE) {
+        printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    }
+    
+    bool success = true;
+    for (int i = 0; i < count; i++) {
+        success = handle_trace(paths[i], action, copy) && success;
+    }
+    
+    if (action == ACTION_DECODE) {
+        printf("\n]}\n");
+    }
+    
+    free(copy);
+    return success ? 0 : 1;
+}
@@ -1,25 +1,175 @@
 #include "message_tracker.h"
+#include "event_trace.h"
+#include "mempool_probes.h"
 #include <string.h>
 #include <time.h>
 
-// Helper function for spinlock with backoff
-static void spinlock_acquire(atomic_uint* lock) {
-    uint32_t backoff = 1;
-    const uint32_t max_backoff = 1000;
+// Helper function for spinlock, waiting as the tracker's wait strategy says
+static void spinlock_acquire(atomic_uint* lock, uint32_t strategy) {
+    if (wait_lock_try(lock)) {
+        return;
+    }
+    
+    EVENT_TRACE(TRACE_LOCK_WAIT_BEGIN, 0, TRACE_LOCK_TRACKER);
+    uint64_t wait_start = event_trace_clock_ns();
+    uint32_t sleeps;
+    uint32_t attempts = wait_lock_acquire_slow(lock, (wait_strategy_t)strategy, &sleeps);
     
-    while (atomic_exchange(lock, 1) != 0) {
-        // Use exponential backoff to reduce contention
-        struct timespec ts = {0, backoff * 100};  // Nanoseconds
-        nanosleep(&ts, NULL);
+    EVENT_TRACE(TRACE_LOCK_WAIT_END, attempts, TRACE_LOCK_TRACKER);
+    MEMPOOL_PROBE(mempool, lock_wait, lock, TRACE_LOCK_TRACKER, attempts, event_trace_clock_ns() - wait_start);
+}
+
+static void spinlock_release(atomic_uint* lock) {
+    wait_lock_release(lock);
+}
+
+// Blocks are tracked by offset so the tracker is valid in every process,
+// whatever address the pool segment is mapped at
+static inline uint32_t block_to_offset(const mem_pool_t* pool, const void* block) {
+    return (uint32_t)((const uint8_t*)block - (const uint8_t*)pool->pool_start);
+}
+
+static inline void* offset_to_block(const mem_pool_t* pool, uint32_t offset) {
+    return (uint8_t*)pool->pool_start + offset;
+}
+
+// Free a tracked message nobody references any more (tracker lock held)
+static bool free_message_locked(message_tracker_t* tracker, int index, mem_pool_t* pool) {
+    uint32_t offset = tracker->messages[index].block_offset;
+    if (offset == TRACKER_NO_BLOCK || atomic_load(&tracker->messages[index].ref_count) > 0) {
+        return false;
+    }
+    
+    if (!memory_pool_free(pool, offset_to_block(pool, offset))) {
+        return false;
+    }
+    MEMPOOL_PROBE(chat, tracker_free, tracker, index, tracker->messages[index].sequence,
+                  tracker->messages[index].timestamp_ns);
+    
+    // Clear the tracker entry
+    tracker->messages[index].block_offset = TRACKER_NO_BLOCK;
+    tracker->messages[index].sequence = 0;
+    tracker->messages[index].timestamp_ns = 0;
+    tracker->messages[index].priority = TRACKER_PRIORITY_NORMAL;
+    atomic_store(&tracker->messages[index].participants_mask, 0);
+    
+    // Decrement count
+    atomic_fetch_sub(&tracker->count, 1);
+    EVENT_TRACE(TRACE_TRACKER_FREE, index, 0);
+    return true;
+}
+
+// Drop one participant's reference to a message without it being read (tracker lock held)
+static void drop_reference_locked(message_tracker_t* tracker, int index, int participant_id,
+                                  mem_pool_t* pool, bool count_missed) {
+    uint32_t bit = 1u << participant_id;
+    uint32_t old_mask = atomic_fetch_and(&tracker->messages[index].participants_mask, ~bit);
+    if ((old_mask & bit) == 0) {
+        return;  // Read meanwhile
+    }
+    
+    atomic_fetch_sub(&tracker->messages[index].ref_count, 1);
+    atomic_fetch_sub(&tracker->pending[participant_id], 1);
+    if (count_missed) {
+        atomic_fetch_add(&tracker->missed[participant_id], 1);
+    }
+    
+    free_message_locked(tracker, index, pool);
+}
+
+// Find the oldest message still unread by any participant in `mask` (tracker lock held)
+static int oldest_message_locked(message_tracker_t* tracker, uint32_t mask) {
+    uint64_t oldest_sequence = UINT64_MAX;
+    int oldest_index = -1;
+    
+    for (int i = 0; i < MAX_TRACKED_MESSAGES; i++) {
+        if (tracker->messages[i].block_offset != TRACKER_NO_BLOCK &&
+            (atomic_load(&tracker->messages[i].participants_mask) & mask) != 0 &&
+            tracker->messages[i].sequence < oldest_sequence) {
+            oldest_sequence = tracker->messages[i].sequence;
+            oldest_index = i;
+        }
+    }
+    
+    return oldest_index;
+}
+
+// Disconnect participants: flag them and drop all their references (tracker lock held)
+static void disconnect_locked(message_tracker_t* tracker, uint32_t mask, mem_pool_t* pool) {
+    atomic_fetch_or(&tracker->evicted_mask, mask);
+    
+    for (int i = 0; i < MAX_TRACKED_MESSAGES; i++) {
+        if (tracker->messages[i].block_offset == TRACKER_NO_BLOCK) {
+            continue;
+        }
         
-        // Increase backoff time (capped at max_backoff)
-        if (backoff < max_backoff)
-            backoff *= 2;
+        uint32_t holders = atomic_load(&tracker->messages[i].participants_mask) & mask;
+        while (holders != 0) {
+            int participant_id = __builtin_ctz(holders);
+            holders &= holders - 1;
+            drop_reference_locked(tracker, i, participant_id, pool, false);
+        }
     }
 }
 
-static void spinlock_release(atomic_uint* lock) {
-    atomic_store(lock, 0);
+// Apply the slow-consumer policy before adding a message (tracker lock held)
+static void apply_policy_locked(message_tracker_t* tracker, uint32_t active_mask, mem_pool_t* pool) {
+    if (tracker->policy == TRACKER_POLICY_REJECT) {
+        return;
+    }
+    
+    // Participants at their lag limit; retained ones are never dropped
+    uint32_t droppable = ~tracker->retained_mask;
+    uint32_t laggards = 0;
+    if (tracker->max_lag > 0) {
+        uint32_t candidates = active_mask & droppable;
+        while (candidates != 0) {
+            int participant_id = __builtin_ctz(candidates);
+            candidates &= candidates - 1;
+            if (atomic_load(&tracker->pending[participant_id]) >= tracker->max_lag) {
+                laggards |= 1u << participant_id;
+            }
+        }
+    }
+    
+    if (tracker->policy == TRACKER_POLICY_DISCONNECT) {
+        // When full, whoever still holds the oldest message is the laggard
+        if (atomic_load(&tracker->count) >= MAX_TRACKED_MESSAGES) {
+            int oldest = oldest_message_locked(tracker, droppable);
+            if (oldest >= 0) {
+                laggards |= atomic_load(&tracker->messages[oldest].participants_mask) & droppable;
+            }
+        }
+        if (laggards != 0) {
+            disconnect_locked(tracker, laggards, pool);
+        }
+        return;
+    }
+    
+    // EVICT_OLDEST: each laggard loses its oldest unread message
+    while (laggards != 0) {
+        int participant_id = __builtin_ctz(laggards);
+        laggards &= laggards - 1;
+        
+        int oldest = oldest_message_locked(tracker, 1u << participant_id);
+        if (oldest >= 0) {
+            drop_reference_locked(tracker, oldest, participant_id, pool, true);
+        }
+    }
+    
+    // Still full: drop the oldest message for everyone holding it but the
+    // retained participants, whose references keep it alive until they read it
+    if (atomic_load(&tracker->count) >= MAX_TRACKED_MESSAGES) {
+        int oldest = oldest_message_locked(tracker, droppable);
+        if (oldest >= 0) {
+            uint32_t holders = atomic_load(&tracker->messages[oldest].participants_mask) & droppable;
+            while (holders != 0) {
+                int participant_id = __builtin_ctz(holders);
+                holders &= holders - 1;
+                drop_reference_locked(tracker, oldest, participant_id, pool, true);
+            }
+        }
+    }
 }
 
 // Initialize the message tracker
@@ -35,30 +185,114 @@ bool tracker_init(message_tracker_t* tracker) {
     atomic_store(&tracker->count, 0);
     atomic_store(&tracker->next_index, 0);
     atomic_store(&tracker->tracker_lock, 0);
+    atomic_store(&tracker->next_sequence, 0);
+    atomic_store(&tracker->evicted_mask, 0);
+    tracker->policy = TRACKER_POLICY_REJECT;
+    tracker->max_lag = 0;
+    tracker->wait_strategy = wait_strategy_default();
+    tracker->retained_mask = 0;
+    for (int i = 0; i < TRACKER_MAX_PARTICIPANTS; i++) {
+        atomic_store(&tracker->pending[i], 0);
+        atomic_store(&tracker->missed[i], 0);
+    }
     
     // Initialize reference counts for all messages
     for (int i = 0; i < MAX_TRACKED_MESSAGES; i++) {
         atomic_store(&tracker->messages[i].ref_count, 0);
         atomic_store(&tracker->messages[i].participants_mask, 0);
-        tracker->messages[i].block_ptr = NULL;
-        tracker->messages[i].timestamp = 0;
+        tracker->messages[i].block_offset = TRACKER_NO_BLOCK;
+        tracker->messages[i].sequence = 0;
+        tracker->messages[i].timestamp_ns = 0;
+        tracker->messages[i].priority = TRACKER_PRIORITY_NORMAL;
     }
     
     return true;
 }
 
+// Set the slow-consumer policy and per-participant lag limit
+void tracker_set_policy(message_tracker_t* tracker, tracker_policy_t policy, uint32_t max_lag) {
+    if (tracker == NULL) {
+        return;
+    }
+    
+    spinlock_acquire(&tracker->tracker_lock, tracker->wait_strategy);
+    tracker->policy = policy;
+    tracker->max_lag = max_lag;
+    spinlock_release(&tracker->tracker_lock);
+}
+
+// Exempt participants from the slow-consumer policy
+void tracker_set_retained(message_tracker_t* tracker, uint32_t retained_mask) {
+    if (tracker == NULL) {
+        return;
+    }
+    
+    spinlock_acquire(&tracker->tracker_lock, tracker->wait_strategy);
+    tracker->retained_mask = retained_mask;
+    spinlock_release(&tracker->tracker_lock);
+}
+
+// Choose how processes wait for the tracker lock
+void tracker_set_wait_strategy(message_tracker_t* tracker, wait_strategy_t strategy) {
+    if (tracker != NULL) {
+        tracker->wait_strategy = strategy;
+    }
+}
+
+// Take the number of messages dropped for a participant since the last call
+uint32_t tracker_take_missed(message_tracker_t* tracker, int participant_id) {
+    if (tracker == NULL || participant_id < 0 || participant_id >= TRACKER_MAX_PARTICIPANTS) {
+        return 0;
+    }
+    
+    return atomic_exchange(&tracker->missed[participant_id], 0);
+}
+
+// Take the participants flagged for disconnection since the last call
+uint32_t tracker_take_evicted(message_tracker_t* tracker) {
+    if (tracker == NULL) {
+        return 0;
+    }
+    
+    return atomic_exchange(&tracker->evicted_mask, 0);
+}
+
+// Take the next global message sequence number
+uint64_t tracker_next_sequence(message_tracker_t* tracker) {
+    if (tracker == NULL) {
+        return 0;
+    }
+    
+    return atomic_fetch_add(&tracker->next_sequence, 1);
+}
+
+// Continue the sequence from `next` (e.g. after a restart)
+void tracker_seed_sequence(message_tracker_t* tracker, uint64_t next) {
+    if (tracker != NULL) {
+        atomic_store(&tracker->next_sequence, next);
+    }
+}
+
 // Track a new message
-bool tracker_add_message(message_tracker_t* tracker, void* block, uint32_t active_mask) {
-    if (tracker == NULL || block == NULL) {
+bool tracker_add_message(message_tracker_t* tracker, mem_pool_t* pool, void* block, uint32_t active_mask,
+                         uint64_t* sequence, uint64_t timestamp_ns, tracker_priority_t priority) {
+    if (tracker == NULL || pool == NULL || block == NULL || sequence == NULL) {
         return false;
     }
     
     // Acquire the tracker lock
-    spinlock_acquire(&tracker->tracker_lock);
+    spinlock_acquire(&tracker->tracker_lock, tracker->wait_strategy);
+    
+    // Make room by dealing with slow consumers
+    apply_policy_locked(tracker, active_mask, pool);
+    
+    // Participants flagged for disconnection get no new messages
+    active_mask &= ~atomic_load(&tracker->evicted_mask);
     
     // Check if tracker is full
     if (atomic_load(&tracker->count) >= MAX_TRACKED_MESSAGES) {
         spinlock_release(&tracker->tracker_lock);
+        MEMPOOL_PROBE(chat, tracker_add, tracker, -1, 0, active_mask);
         return false;
     }
     
@@ -68,13 +302,22 @@ bool tracker_add_message(message_tracker_t* tracker, void* block, uint32_t activ
     
     do {
         // Check if slot is available
-        if (tracker->messages[index].block_ptr == NULL) {
+        if (tracker->messages[index].block_offset == TRACKER_NO_BLOCK) {
             // Found an empty slot, use it
-            tracker->messages[index].block_ptr = block;
-            tracker->messages[index].timestamp = (uint32_t)time(NULL);
+            uint64_t message_sequence = atomic_fetch_add(&tracker->next_sequence, 1);
+            *sequence = message_sequence;
+            tracker->messages[index].block_offset = block_to_offset(pool, block);
+            tracker->messages[index].sequence = message_sequence;
+            tracker->messages[index].timestamp_ns = timestamp_ns;
+            tracker->messages[index].priority = priority;
             atomic_store(&tracker->messages[index].ref_count, __builtin_popcount(active_mask));
             atomic_store(&tracker->messages[index].participants_mask, active_mask);
             
+            // Count the message against every recipient's lag
+            for (uint32_t recipients = active_mask; recipients != 0; recipients &= recipients - 1) {
+                atomic_fetch_add(&tracker->pending[__builtin_ctz(recipients)], 1);
+            }
+            
             // Increment count
             atomic_fetch_add(&tracker->count, 1);
             
@@ -82,6 +325,8 @@ bool tracker_add_message(message_tracker_t* tracker, void* block, uint32_t activ
             atomic_store(&tracker->next_index, (index + 1) % MAX_TRACKED_MESSAGES);
             
             spinlock_release(&tracker->tracker_lock);
+            EVENT_TRACE(TRACE_TRACKER_ADD, message_sequence, index);
+            MEMPOOL_PROBE(chat, tracker_add, tracker, (int)index, message_sequence, active_mask);
             return true;
         }
         
@@ -91,38 +336,47 @@ bool tracker_add_message(message_tracker_t* tracker, void* block, uint32_t activ
     
     // No available slots
     spinlock_release(&tracker->tracker_lock);
+    MEMPOOL_PROBE(chat, tracker_add, tracker, -1, 0, active_mask);
     return false;
 }
 
 // Mark a message as read by a participant
-bool tracker_mark_read(message_tracker_t* tracker, int message_index, int participant_id) {
+bool tracker_mark_read(message_tracker_t* tracker, int message_index, int participant_id,
+                       uint64_t sequence) {
     if (tracker == NULL || message_index < 0 || message_index >= MAX_TRACKED_MESSAGES ||
-        participant_id < 0 || participant_id >= 32) {
+        participant_id < 0 || participant_id >= TRACKER_MAX_PARTICIPANTS) {
         return false;
     }
     
-    // Check if message exists
-    void* block = tracker->messages[message_index].block_ptr;
-    if (block == NULL) {
+    tracked_message_t* message = &tracker->messages[message_index];
+    
+    // Check that the slot still holds the message the caller read
+    if (message->block_offset == TRACKER_NO_BLOCK || message->sequence != sequence) {
         return false;
     }
     
     // Calculate participant mask bit
     uint32_t participant_bit = 1 << participant_id;
     
-    // Check if already marked as read
-    uint32_t current_mask = atomic_load(&tracker->messages[message_index].participants_mask);
-    if ((current_mask & participant_bit) == 0) {
-        // Already marked as read
-        return true;
+    // Clear the participant bit atomically (other readers update the same mask)
+    uint32_t old_mask = atomic_fetch_and(&message->participants_mask, ~participant_bit);
+    if ((old_mask & participant_bit) == 0) {
+        // Already marked as read, or dropped by the slow-consumer policy
+        return false;
     }
     
-    // Update mask to remove participant bit
-    uint32_t new_mask = current_mask & ~participant_bit;
-    atomic_store(&tracker->messages[message_index].participants_mask, new_mask);
+    // Our bit pins the message from here on (its references include ours), but
+    // the slot may have been freed and reused just before we cleared the bit:
+    // then the bit belonged to a newer message we have not read, so put it back
+    if (message->sequence != sequence) {
+        atomic_fetch_or(&message->participants_mask, participant_bit);
+        return false;
+    }
     
     // Decrement reference count
-    uint32_t old_count = atomic_fetch_sub(&tracker->messages[message_index].ref_count, 1);
+    atomic_fetch_sub(&message->ref_count, 1);
+    atomic_fetch_sub(&tracker->pending[participant_id], 1);
+    EVENT_TRACE(TRACE_TRACKER_MARK, message_index, participant_id);
     
     return true;
 }
@@ -135,8 +389,7 @@ bool tracker_has_read(message_tracker_t* tracker, int message_index, int partici
     }
     
     // Check if message exists
-    void* block = tracker->messages[message_index].block_ptr;
-    if (block == NULL) {
+    if (tracker->messages[message_index].block_offset == TRACKER_NO_BLOCK) {
         return true; // Message doesn't exist, so consider it read
     }
     
@@ -149,7 +402,7 @@ bool tracker_has_read(message_tracker_t* tracker, int message_index, int partici
 }
 
 // Get next unread message for a participant
-int tracker_get_next_unread(message_tracker_t* tracker, int participant_id) {
+int tracker_get_next_unread(message_tracker_t* tracker, int participant_id, bool by_priority) {
     if (tracker == NULL || participant_id < 0 || participant_id >= 32) {
         return -1;
     }
@@ -157,18 +410,22 @@ int tracker_get_next_unread(message_tracker_t* tracker, int participant_id) {
     // Calculate participant mask bit
     uint32_t participant_bit = 1 << participant_id;
     
-    // Find oldest unread message
-    uint32_t oldest_timestamp = UINT32_MAX;
+    // Find oldest unread message (lowest sequence number), within the
+    // highest priority present when asked to
+    uint32_t best_priority = TRACKER_PRIORITY_NORMAL;
+    uint64_t oldest_sequence = UINT64_MAX;
     int oldest_index = -1;
     
     for (int i = 0; i < MAX_TRACKED_MESSAGES; i++) {
-        void* block = tracker->messages[i].block_ptr;
-        if (block != NULL) {
+        if (tracker->messages[i].block_offset != TRACKER_NO_BLOCK) {
             uint32_t mask = atomic_load(&tracker->messages[i].participants_mask);
             if ((mask & participant_bit) != 0) {
                 // This message is unread by this participant
-                if (tracker->messages[i].timestamp < oldest_timestamp) {
-                    oldest_timestamp = tracker->messages[i].timestamp;
+                uint32_t priority = by_priority ? tracker->messages[i].priority : TRACKER_PRIORITY_NORMAL;
+                if (priority < best_priority ||
+                    (priority == best_priority && tracker->messages[i].sequence < oldest_sequence)) {
+                    best_priority = priority;
+                    oldest_sequence = tracker->messages[i].sequence;
                     oldest_index = i;
                 }
             }
@@ -179,12 +436,17 @@ int tracker_get_next_unread(message_tracker_t* tracker, int participant_id) {
 }
 
 // Get the message block for a tracked message
-void* tracker_get_message(message_tracker_t* tracker, int message_index) {
-    if (tracker == NULL || message_index < 0 || message_index >= MAX_TRACKED_MESSAGES) {
+void* tracker_get_message(message_tracker_t* tracker, mem_pool_t* pool, int message_index) {
+    if (tracker == NULL || pool == NULL || message_index < 0 || message_index >= MAX_TRACKED_MESSAGES) {
+        return NULL;
+    }
+    
+    uint32_t offset = tracker->messages[message_index].block_offset;
+    if (offset == TRACKER_NO_BLOCK) {
         return NULL;
     }
     
-    return tracker->messages[message_index].block_ptr;
+    return offset_to_block(pool, offset);
 }
 
 // Free a message if all participants have read it
@@ -194,8 +456,8 @@ bool tracker_try_free_message(message_tracker_t* tracker, int message_index, mem
     }
     
     // Check if message exists
-    void* block = tracker->messages[message_index].block_ptr;
-    if (block == NULL) {
+    uint32_t offset = tracker->messages[message_index].block_offset;
+    if (offset == TRACKER_NO_BLOCK) {
         return false;
     }
     
@@ -205,27 +467,44 @@ bool tracker_try_free_message(message_tracker_t* tracker, int message_index, mem
     }
     
     // Acquire the tracker lock
-    spinlock_acquire(&tracker->tracker_lock);
-    
-    // Double-check that reference count is still zero
-    if (atomic_load(&tracker->messages[message_index].ref_count) == 0) {
-        // Free the memory block
-        if (memory_pool_free(pool, block)) {
-            // Clear the tracker entry
-            tracker->messages[message_index].block_ptr = NULL;
-            tracker->messages[message_index].timestamp = 0;
-            atomic_store(&tracker->messages[message_index].participants_mask, 0);
-            
-            // Decrement count
-            atomic_fetch_sub(&tracker->count, 1);
-            
-            spinlock_release(&tracker->tracker_lock);
-            return true;
+    spinlock_acquire(&tracker->tracker_lock, tracker->wait_strategy);
+    
+    // Double-check that the slot was not freed meanwhile and is still unreferenced
+    bool freed = tracker->messages[message_index].block_offset == offset &&
+                 free_message_locked(tracker, message_index, pool);
+    
+    spinlock_release(&tracker->tracker_lock);
+    return freed;
+}
+
+// Drop all unread references of a participant that left or died
+int tracker_release_participant(message_tracker_t* tracker, int participant_id, mem_pool_t* pool) {
+    if (tracker == NULL || pool == NULL || participant_id < 0 || participant_id >= TRACKER_MAX_PARTICIPANTS) {
+        return 0;
+    }
+    
+    int released = 0;
+    for (int i = 0; i < MAX_TRACKED_MESSAGES; i++) {
+        if (tracker->messages[i].block_offset == TRACKER_NO_BLOCK) {
+            continue;
+        }
+        
+        uint64_t sequence = tracker->messages[i].sequence;
+        if (tracker_has_read(tracker, i, participant_id)) {
+            continue;
+        }
+        
+        if (tracker_mark_read(tracker, i, participant_id, sequence)) {
+            tracker_try_free_message(tracker, i, pool);
+            released++;
         }
     }
     
-    spinlock_release(&tracker->tracker_lock);
-    return false;
+    // Nothing left to report to or disconnect
+    atomic_store(&tracker->missed[participant_id], 0);
+    atomic_fetch_and(&tracker->evicted_mask, ~(1u << participant_id));
+    
+    return released;
 }
 
 // Reset the tracker
@@ -235,12 +514,14 @@ void tracker_reset(message_tracker_t* tracker) {
     }
     
     // Acquire the tracker lock
-    spinlock_acquire(&tracker->tracker_lock);
+    spinlock_acquire(&tracker->tracker_lock, tracker->wait_strategy);
     
     // Reset all entries
     for (int i = 0; i < MAX_TRACKED_MESSAGES; i++) {
-        tracker->messages[i].block_ptr = NULL;
-        tracker->messages[i].timestamp = 0;
+        tracker->messages[i].block_offset = TRACKER_NO_BLOCK;
+        tracker->messages[i].sequence = 0;
+        tracker->messages[i].timestamp_ns = 0;
+        tracker->messages[i].priority = TRACKER_PRIORITY_NORMAL;
         atomic_store(&tracker->messages[i].ref_count, 0);
         atomic_store(&tracker->messages[i].participants_mask, 0);
     }
@@ -5,16 +5,38 @@
 #include <stdbool.h>
 #include <stdatomic.h>
 #include "mempool_ring.h"
+#include "wait_strategy.h"
 
 // Maximum number of tracked messages
 #define MAX_TRACKED_MESSAGES 100
 
+// Marks an unused tracker slot
+#define TRACKER_NO_BLOCK UINT32_MAX
+
+// Participants tracked (bits of participants_mask)
+#define TRACKER_MAX_PARTICIPANTS 32
+
+// What to do about participants that stop reading
+typedef enum {
+    TRACKER_POLICY_REJECT = 0,       // Refuse new messages once the tracker is full
+    TRACKER_POLICY_EVICT_OLDEST = 1, // Drop laggards' oldest messages and count them as missed
+    TRACKER_POLICY_DISCONNECT = 2    // Flag laggards for disconnection and drop all their messages
+} tracker_policy_t;
+
+// Delivery priority of a tracked message (lower is more urgent)
+typedef enum {
+    TRACKER_PRIORITY_SYSTEM = 0,     // Server notices, delivered ahead of the backlog
+    TRACKER_PRIORITY_NORMAL = 1      // Participant messages
+} tracker_priority_t;
+
 // Message tracking structure
 typedef struct {
-    void* block_ptr;             // Pointer to memory block
+    uint32_t block_offset;       // Offset of the block from the pool start (TRACKER_NO_BLOCK if free)
     atomic_uint ref_count;       // Reference count for this message
     atomic_uint participants_mask;  // Bitmask of participants who have seen the message
-    uint32_t timestamp;          // Message timestamp
+    uint64_t sequence;           // Global message sequence number (delivery order)
+    uint64_t timestamp_ns;       // CLOCK_MONOTONIC send time in nanoseconds
+    uint32_t priority;           // tracker_priority_t
 } tracked_message_t;
 
 // Message tracker
@@ -23,29 +45,76 @@ typedef struct {
     atomic_uint count;           // Number of active tracked messages
     atomic_uint next_index;      // Next index to use
     atomic_uint tracker_lock;    // Lock for the tracker
+    atomic_ullong next_sequence; // Global message sequence counter
+    uint32_t policy;             // tracker_policy_t for slow consumers
+    uint32_t max_lag;            // Unread messages allowed per participant (0 = no limit)
+    atomic_uint pending[TRACKER_MAX_PARTICIPANTS]; // Unread messages per participant
+    atomic_uint missed[TRACKER_MAX_PARTICIPANTS];  // Dropped messages not yet reported
+    atomic_uint evicted_mask;    // Participants flagged for disconnection
+    uint32_t wait_strategy;      // wait_strategy_t for tracker_lock
+    uint32_t retained_mask;      // Participants the slow-consumer policy never drops
 } message_tracker_t;
 
 // Initialize the message tracker
 bool tracker_init(message_tracker_t* tracker);
 
+// Set the slow-consumer policy and per-participant lag limit
+void tracker_set_policy(message_tracker_t* tracker, tracker_policy_t policy, uint32_t max_lag);
+
+// Exempt participants from the slow-consumer policy (e.g. a server that
+// journals every message); while one of them lags, adds fail as with REJECT
+void tracker_set_retained(message_tracker_t* tracker, uint32_t retained_mask);
+
+// Choose how processes wait for the tracker lock (tracker_init takes the
+// MEMPOOL_WAIT_STRATEGY default); only while nobody else uses the tracker
+void tracker_set_wait_strategy(message_tracker_t* tracker, wait_strategy_t strategy);
+
+// Take the number of messages dropped for a participant since the last call
+uint32_t tracker_take_missed(message_tracker_t* tracker, int participant_id);
+
+// Take the participants flagged for disconnection since the last call
+uint32_t tracker_take_evicted(message_tracker_t* tracker);
+
+// Take the next global message sequence number
+uint64_t tracker_next_sequence(message_tracker_t* tracker);
+
+// Continue the sequence from `next` (e.g. after a restart)
+void tracker_seed_sequence(message_tracker_t* tracker, uint64_t next);
+
 // Track a new message
-bool tracker_add_message(message_tracker_t* tracker, void* block, uint32_t active_mask);
+// Applies the slow-consumer policy first, so with EVICT_OLDEST or DISCONNECT
+// a stalled participant never makes this fail
+// The next global sequence number is taken under the tracker lock and
+// stored to `sequence` (normally the block's header) before the message is
+// visible, so sequence order is publish order even with concurrent senders
+bool tracker_add_message(message_tracker_t* tracker, mem_pool_t* pool, void* block, uint32_t active_mask,
+                         uint64_t* sequence, uint64_t timestamp_ns, tracker_priority_t priority);
 
 // Mark a message as read by a participant
-bool tracker_mark_read(message_tracker_t* tracker, int message_index, int participant_id);
+// `sequence` is the sequence of the message the caller read (from its copy
+// of the header); a slot that was freed and reused meanwhile is left alone
+// Returns false if the participant no longer held that message (read,
+// dropped or replaced), in which case the caller's copy must be discarded
+bool tracker_mark_read(message_tracker_t* tracker, int message_index, int participant_id,
+                       uint64_t sequence);
 
 // Check if a participant has read a message
 bool tracker_has_read(message_tracker_t* tracker, int message_index, int participant_id);
 
-// Get next unread message for a participant
-int tracker_get_next_unread(message_tracker_t* tracker, int participant_id);
+// Get next unread message for a participant: the oldest one, or with
+// `by_priority` the oldest of the most urgent priority waiting
+int tracker_get_next_unread(message_tracker_t* tracker, int participant_id, bool by_priority);
 
 // Get the message block for a tracked message
-void* tracker_get_message(message_tracker_t* tracker, int message_index);
+void* tracker_get_message(message_tracker_t* tracker, mem_pool_t* pool, int message_index);
 
 // Free a message if all participants have read it
 bool tracker_try_free_message(message_tracker_t* tracker, int message_index, mem_pool_t* pool);
 
+// Drop all unread references of a participant that left or died
+// Returns the number of messages released
+int tracker_release_participant(message_tracker_t* tracker, int participant_id, mem_pool_t* pool);
+
 // Reset the tracker
 void tracker_reset(message_tracker_t* tracker);
 
@@ -1,12 +1,25 @@
 #include "shm_manager.h"
+#include "chat_journal.h"
+#include "channel_directory.h"
+#include "direct_channel.h"
+#include "event_trace.h"
+#include "wait_strategy.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <linux/futex.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 
 // Global structures for the current process
 static mem_pool_t message_pool;
@@ -15,6 +28,26 @@ static participants_directory_t* participants = NULL;
 static message_tracker_t* message_tracker = NULL;
 static int my_participant_id = -1;
 static bool is_server = false;
+static journal_writer_t journal;          // Server only: persistent message journal
+static bool journal_open = false;
+static channel_directory_t* channel_directory = NULL;
+static mem_pool_t channel_pool;           // Channel structures
+static mem_pool_t channel_message_pool;   // Channel messages, so channels cannot drain the room's pool
+static channel_t* joined_channels[MAX_JOINED_CHANNELS];  // Channels this process reads
+static int joined_channel_count = 0;
+static direct_directory_t* direct_directory = NULL;
+static mem_pool_t direct_pool;            // Direct message pair channels
+static int watch_pidfds[MAX_PARTICIPANTS];   // Server only: pidfd per watched participant (-1 = kill() polling)
+static pid_t watch_pids[MAX_PARTICIPANTS];   // Server only: pid each watch refers to
+static uint32_t watched_mask = 0;            // Server only: participants being watched
+static int watch_epoll_fd = -1;              // Server only: epoll set of the pidfds
+static int notify_fd = -1;                   // eventfd signalled when our doorbell rings
+static pthread_t notify_thread;
+static atomic_int notify_stop;
+static uint32_t last_liveness_poll = 0;      // Server only: last kill() polling round
+static uint64_t delivered_count = 0;      // Messages delivered to this process
+static uint64_t delivery_latency_total_ns = 0;
+static uint64_t delivery_latency_max_ns = 0;
 
 // For atomic operations
 static inline uint32_t atomic_add_uint32(uint32_t* ptr, uint32_t val) {
@@ -26,30 +59,505 @@ static uint32_t get_timestamp(void) {
     return (uint32_t)time(NULL);
 }
 
+// Get CLOCK_MONOTONIC time in nanoseconds
+static uint64_t get_monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
 // Calculate active participants mask
 static uint32_t calculate_active_mask(void) {
-    uint32_t mask = 0;
-    
     if (participants == NULL) {
         return 0;
     }
     
-    for (int i = 0; i < MAX_PARTICIPANTS; i++) {
-        if (participants->participants[i].status == PARTICIPANT_ACTIVE) {
-            mask |= (1 << i);
+    return atomic_load(&participants->active_mask);
+}
+
+// futex on a shared (not process-private) word
+static long futex(atomic_uint* word, int op, uint32_t value) {
+    return syscall(SYS_futex, word, op, value, NULL, NULL, 0);
+}
+
+// Tell participants new messages are waiting for them
+// Each participant has a doorbell word; a futex wake is only issued for
+// participants whose notifier thread is asleep on it
+static void ring_doorbells(uint32_t mask) {
+    if (participants == NULL) {
+        return;
+    }
+    
+    for (uint32_t pending = mask; pending != 0; pending &= pending - 1) {
+        atomic_fetch_add(&participants->doorbell[__builtin_ctz(pending)], 1);
+    }
+    
+    uint32_t sleeping = atomic_load(&participants->sleeping_mask) & mask;
+    while (sleeping != 0) {
+        int slot = __builtin_ctz(sleeping);
+        sleeping &= sleeping - 1;
+        futex(&participants->doorbell[slot], FUTEX_WAKE, 1);
+    }
+}
+
+// FNV-1a hash of a username
+static uint32_t username_hash(const char* username) {
+    uint32_t hash = 2166136261u;
+    for (const char* p = username; *p != '\0'; p++) {
+        hash ^= (uint8_t)*p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Names nobody can join with: local notices are shown as coming from "System"
+static bool username_reserved(const char* username) {
+    return strcmp(username, "System") == 0;
+}
+
+// Username an index entry refers to, a participant's or a guest name
+static const char* username_entry_name(uint32_t entry) {
+    if (entry >= USERNAME_INDEX_GUEST) {
+        return participants->guests[entry - USERNAME_INDEX_GUEST].username;
+    }
+    return participants->participants[entry - 1].username;
+}
+
+// Check whether an index entry other than `own` holds `username`
+static bool username_entry_matches(uint32_t entry, uint32_t own, const char* username) {
+    if (entry == USERNAME_INDEX_EMPTY || entry == USERNAME_INDEX_TOMBSTONE || entry == own) {
+        return false;
+    }
+    
+    return strncmp(username_entry_name(entry), username, MAX_USERNAME_LENGTH) == 0;
+}
+
+// Take the lock serializing username index and guest name changes
+static void lock_usernames(void) {
+    if (wait_lock_try(&participants->username_lock)) {
+        return;
+    }
+    
+    uint32_t sleeps;
+    wait_lock_acquire_slow(&participants->username_lock, 
+                           (wait_strategy_t)participants->wait_strategy, &sleeps);
+}
+
+static void unlock_usernames(void) {
+    wait_lock_release(&participants->username_lock);
+}
+
+// Insert a username into the index as entry `own` (slot + 1 or a guest entry)
+// Fails if the name is reserved, already taken or the table is full
+// Callers hold username_lock; lookups do not take it
+static bool username_index_insert(const char* username, uint32_t own) {
+    if (username_reserved(username)) {
+        return false;
+    }
+    
+    uint32_t home = username_hash(username) & (USERNAME_INDEX_SIZE - 1);
+    int free_pos = -1;
+    
+    // Check the whole probe chain for the name, remembering the first free entry
+    for (uint32_t i = 0; i < USERNAME_INDEX_SIZE; i++) {
+        uint32_t pos = (home + i) & (USERNAME_INDEX_SIZE - 1);
+        uint32_t entry = atomic_load(&participants->username_index[pos]);
+        
+        if (entry == USERNAME_INDEX_EMPTY || entry == USERNAME_INDEX_TOMBSTONE) {
+            if (free_pos < 0) {
+                free_pos = pos;
+            }
+            if (entry == USERNAME_INDEX_EMPTY) {
+                break;  // End of the probe chain
+            }
+        } else if (username_entry_matches(entry, own, username)) {
+            return false;  // Name already taken
+        }
+    }
+    
+    if (free_pos < 0) {
+        return false;  // Table full
+    }
+    
+    atomic_store(&participants->username_index[free_pos], own);
+    return true;
+}
+
+// Remove index entry `own` holding `username` (callers hold username_lock)
+static void username_index_remove(const char* username, uint32_t own) {
+    uint32_t home = username_hash(username) & (USERNAME_INDEX_SIZE - 1);
+    
+    for (uint32_t i = 0; i < USERNAME_INDEX_SIZE; i++) {
+        uint32_t pos = (home + i) & (USERNAME_INDEX_SIZE - 1);
+        uint32_t entry = atomic_load(&participants->username_index[pos]);
+        
+        if (entry == USERNAME_INDEX_EMPTY) {
+            return;  // Not indexed
+        }
+        if (entry != own) {
+            continue;
+        }
+        
+        // Inside a cluster the entry must stay as a tombstone so later entries
+        // remain reachable. At the end of one no chain runs past it: empty it
+        // and the tombstones before it, so the chains do not grow without bound
+        uint32_t next = (pos + 1) & (USERNAME_INDEX_SIZE - 1);
+        if (atomic_load(&participants->username_index[next]) != USERNAME_INDEX_EMPTY) {
+            atomic_store(&participants->username_index[pos], USERNAME_INDEX_TOMBSTONE);
+            return;
+        }
+        
+        do {
+            atomic_store(&participants->username_index[pos], USERNAME_INDEX_EMPTY);
+            pos = (pos - 1) & (USERNAME_INDEX_SIZE - 1);
+        } while (atomic_load(&participants->username_index[pos]) == USERNAME_INDEX_TOMBSTONE);
+        return;
+    }
+}
+
+// Take a guest entry for a participant: a released one, else a never used one
+// Returns the entry or -1 if all are in use (callers hold username_lock)
+static int claim_guest_name(int slot) {
+    uint32_t handle;
+    if (participants->guest_free != 0) {
+        handle = participants->guest_free - 1;
+        participants->guest_free = participants->guests[handle].next;
+    } else if (participants->guest_used < MAX_GUEST_NAMES) {
+        handle = participants->guest_used++;
+    } else {
+        return -1;
+    }
+    
+    // Link it at the head of the participant's list
+    guest_name_t* guest = &participants->guests[handle];
+    guest->owner = (uint32_t)slot + 1;
+    guest->prev = 0;
+    guest->next = participants->guest_heads[slot];
+    if (guest->next != 0) {
+        participants->guests[guest->next - 1].prev = handle + 1;
+    }
+    participants->guest_heads[slot] = handle + 1;
+    return (int)handle;
+}
+
+// Unlink a guest entry from its owner's list and free it (callers hold username_lock)
+static void free_guest_name(uint32_t handle) {
+    guest_name_t* guest = &participants->guests[handle];
+    
+    if (guest->prev != 0) {
+        participants->guests[guest->prev - 1].next = guest->next;
+    } else {
+        participants->guest_heads[guest->owner - 1] = guest->next;
+    }
+    if (guest->next != 0) {
+        participants->guests[guest->next - 1].prev = guest->prev;
+    }
+    
+    guest->owner = 0;
+    guest->next = participants->guest_free;
+    participants->guest_free = handle + 1;
+}
+
+// Claim a free participant slot with a CAS on its status
+static int claim_participant_slot(void) {
+    // Concurrent joiners start at different slots, so they rarely collide
+    uint32_t start = atomic_fetch_add(&participants->join_hint, 1);
+    
+    for (uint32_t i = 0; i < MAX_PARTICIPANTS; i++) {
+        int slot = (start + i) % MAX_PARTICIPANTS;
+        uint32_t expected = PARTICIPANT_INACTIVE;
+        
+        if (atomic_compare_exchange_strong(&participants->participants[slot].status, 
+                                           &expected, PARTICIPANT_JOINING)) {
+            return slot;
+        }
+    }
+    
+    return -1;
+}
+
+// Open a pidfd for a process; -1 with errno set if unsupported or gone
+static int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+// Publish a claimed slot as an active participant
+static void activate_participant_slot(int slot) {
+    participants->participants[slot].last_active = get_timestamp();
+    atomic_store(&participants->participants[slot].status, PARTICIPANT_ACTIVE);
+    atomic_fetch_or(&participants->active_mask, 1u << slot);
+    atomic_add_uint32(&participants->count, 1);
+}
+
+// Release the guest names a participant reserved for its clients
+// Callers hold username_lock
+static void release_guest_names(int slot) {
+    while (participants->guest_heads[slot] != 0) {
+        uint32_t handle = participants->guest_heads[slot] - 1;
+        username_index_remove(participants->guests[handle].username, USERNAME_INDEX_GUEST + handle);
+        free_guest_name(handle);
+    }
+}
+
+// Release a participant slot (active or still joining)
+static void release_participant_slot(int slot) {
+    bool was_active = atomic_load(&participants->participants[slot].status) == PARTICIPANT_ACTIVE;
+    
+    atomic_fetch_and(&participants->active_mask, ~(1u << slot));
+    lock_usernames();
+    release_guest_names(slot);
+    username_index_remove(participants->participants[slot].username, (uint32_t)slot + 1);
+    unlock_usernames();
+    if (was_active) {
+        atomic_add_uint32(&participants->count, -1);
+    }
+    atomic_store(&participants->participants[slot].status, PARTICIPANT_INACTIVE);
+}
+
+// Create or attach the channel directory and channel pool
+static bool open_channel_segments(bool create) {
+    int flags = create ? (O_CREAT | O_RDWR) : O_RDWR;
+    int directory_fd = shm_open(SHM_CHANNELS, flags, 0666);
+    if (directory_fd == -1) {
+        return false;
+    }
+    
+    if (create && ftruncate(directory_fd, sizeof(channel_directory_t)) == -1) {
+        close(directory_fd);
+        return false;
+    }
+    
+    channel_directory = mmap(NULL, sizeof(channel_directory_t), 
+                             PROT_READ | PROT_WRITE, MAP_SHARED, 
+                             directory_fd, 0);
+    close(directory_fd);  // Mapping remains
+    if (channel_directory == MAP_FAILED) {
+        channel_directory = NULL;
+        return false;
+    }
+    
+    if (!memory_pool_init_shared(&channel_pool, SHM_CHANNEL_POOL, CHANNEL_POOL_SIZE, 
+                                 CHANNEL_BLOCK_SIZE, create, 0666)) {
+        munmap(channel_directory, sizeof(channel_directory_t));
+        channel_directory = NULL;
+        return false;
+    }
+    
+    if (!memory_pool_init_shared(&channel_message_pool, SHM_CHANNEL_MESSAGE_POOL, 
+                                 CHANNEL_MESSAGE_POOL_SIZE, MESSAGE_BLOCK_SIZE, create, 0666)) {
+        memory_pool_destroy(&channel_pool, create);
+        munmap(channel_directory, sizeof(channel_directory_t));
+        channel_directory = NULL;
+        return false;
+    }
+    
+    if (create) {
+        channel_directory_init(channel_directory);
+    }
+    
+    joined_channel_count = 0;
+    return true;
+}
+
+// Leave all joined channels and unmap the channel segments
+static void close_channel_segments(bool unlink) {
+    if (channel_directory == NULL) {
+        return;
+    }
+    
+    for (int i = 0; i < joined_channel_count; i++) {
+        channel_leave(joined_channels[i], my_participant_id, &channel_message_pool);
+    }
+    joined_channel_count = 0;
+    
+    memory_pool_destroy(&channel_message_pool, unlink);
+    memory_pool_destroy(&channel_pool, unlink);
+    munmap(channel_directory, sizeof(channel_directory_t));
+    channel_directory = NULL;
+}
+
+// Create or attach the direct message directory and pair pool
+static bool open_direct_segments(bool create) {
+    int flags = create ? (O_CREAT | O_RDWR) : O_RDWR;
+    int directory_fd = shm_open(SHM_DIRECT, flags, 0666);
+    if (directory_fd == -1) {
+        return false;
+    }
+    
+    if (create && ftruncate(directory_fd, sizeof(direct_directory_t)) == -1) {
+        close(directory_fd);
+        return false;
+    }
+    
+    direct_directory = mmap(NULL, sizeof(direct_directory_t), 
+                            PROT_READ | PROT_WRITE, MAP_SHARED, 
+                            directory_fd, 0);
+    close(directory_fd);  // Mapping remains
+    if (direct_directory == MAP_FAILED) {
+        direct_directory = NULL;
+        return false;
+    }
+    
+    if (!memory_pool_init_shared(&direct_pool, SHM_DIRECT_POOL, DIRECT_POOL_SIZE, 
+                                 DIRECT_BLOCK_SIZE, create, 0666)) {
+        munmap(direct_directory, sizeof(direct_directory_t));
+        direct_directory = NULL;
+        return false;
+    }
+    
+    if (create) {
+        direct_directory_init(direct_directory);
+    }
+    
+    return true;
+}
+
+// Drop our unread direct messages and unmap the direct segments
+static void close_direct_segments(bool unlink) {
+    if (direct_directory == NULL) {
+        return;
+    }
+    
+    // Only while the slot is still ours; otherwise the next occupant cleans up
+    if (is_server || is_connected()) {
+        direct_release_participant(direct_directory, &direct_pool, my_participant_id, &message_pool);
+    }
+    
+    memory_pool_destroy(&direct_pool, unlink);
+    munmap(direct_directory, sizeof(direct_directory_t));
+    direct_directory = NULL;
+}
+
+// Direct messages follow the room's slow-consumer policy: a receiver that
+// stops reading loses its oldest private messages rather than pinning blocks,
+// unless the room rejects new messages too (server only)
+static void apply_direct_policy(tracker_policy_t policy) {
+    if (direct_directory != NULL) {
+        direct_set_policy(direct_directory, policy == TRACKER_POLICY_REJECT ? 
+                          DIRECT_POLICY_REJECT : DIRECT_POLICY_EVICT_OLDEST);
+    }
+}
+
+// Find the active participant with a username, -1 if there is none
+static int find_participant(const char* username) {
+    uint32_t home = username_hash(username) & (USERNAME_INDEX_SIZE - 1);
+    
+    for (uint32_t i = 0; i < USERNAME_INDEX_SIZE; i++) {
+        uint32_t entry = atomic_load(&participants->username_index[(home + i) & (USERNAME_INDEX_SIZE - 1)]);
+        if (entry == USERNAME_INDEX_EMPTY) {
+            break;  // End of the probe chain
         }
+        
+        if (entry < USERNAME_INDEX_GUEST && username_entry_matches(entry, USERNAME_INDEX_EMPTY, username) &&
+            atomic_load(&participants->participants[entry - 1].status) == PARTICIPANT_ACTIVE) {
+            return entry - 1;
+        }
+    }
+    
+    return -1;
+}
+
+// Fill in the header of a message block whose text is already in place
+// The sequence is stamped when the message is published
+static void fill_message_header(void* block, const char* sender, uint32_t length) {
+    message_header_t* header = (message_header_t*)block;
+    header->sequence = 0;
+    header->timestamp_ns = get_monotonic_ns();
+    strncpy(header->sender, sender, MAX_USERNAME_LENGTH - 1);
+    header->sender[MAX_USERNAME_LENGTH - 1] = '\0';
+    header->message_length = length;
+    
+    char* message_data = (char*)block + sizeof(message_header_t);
+    message_data[length] = '\0';  // Ensure null-termination
+}
+
+// Copy our message text into a block and fill in its header
+static void write_message_block(void* block, const char* message, size_t message_len) {
+    // Copy message data after the header
+    char* message_data = (char*)block + sizeof(message_header_t);
+    memcpy(message_data, message, message_len);
+    fill_message_header(block, participants->participants[my_participant_id].username, message_len);
+}
+
+// Allocate a message block and fill in header and text
+static void* create_message_block(const char* message) {
+    size_t message_len = strlen(message);
+    if (message_len == 0 || message_len >= MAX_MESSAGE_LENGTH) {
+        return NULL;  // Empty or too long message
+    }
+    
+    // Allocate memory for the message
+    void* block = memory_pool_alloc(&message_pool);
+    if (block == NULL) {
+        fprintf(stderr, "Failed to allocate memory for message\n");
+        return NULL;
+    }
+    
+    write_message_block(block, message, message_len);
+    return block;
+}
+
+// Hand a filled message block to the tracker for all active participants
+// The block is freed if it cannot be tracked
+static bool track_message_block(void* block, tracker_priority_t priority) {
+    // Calculate active participants mask
+    uint32_t active_mask = calculate_active_mask();
+    
+    // Add message to the tracker, which stamps its sequence as it publishes it
+    message_header_t* header = (message_header_t*)block;
+    if (!tracker_add_message(message_tracker, &message_pool, block, active_mask,
+                             &header->sequence, header->timestamp_ns, priority)) {
+        fprintf(stderr, "Failed to track message\n");
+        memory_pool_free(&message_pool, block);
+        return false;
+    }
+    
+    ring_doorbells(active_mask);
+    return true;
+}
+
+// Retire a participant: stop addressing new messages to it, release its
+// unread references, then free the slot for reuse
+static void retire_participant(int slot, bool release_channels) {
+    atomic_fetch_and(&participants->active_mask, ~(1u << slot));
+    
+    if (message_tracker != NULL) {
+        tracker_release_participant(message_tracker, slot, &message_pool);
+    }
+    
+    if (release_channels && channel_directory != NULL) {
+        channel_directory_release_participant(channel_directory, &channel_pool, slot, 
+                                              &channel_message_pool);
+    }
+    
+    if (release_channels && direct_directory != NULL) {
+        direct_release_participant(direct_directory, &direct_pool, slot, &message_pool);
     }
     
-    return mask;
+    release_participant_slot(slot);
 }
 
 // Initialize shared memory for chat server
 bool init_chat_server(void) {
+    // Record pool, ring and tracker events when MEMPOOL_TRACE is set
+    event_trace_open_from_env();
+    
     // Clean up any existing shared memory with these names
     shm_unlink(SHM_CHAT_POOL);
     shm_unlink(SHM_CHAT_RING);
     shm_unlink(SHM_PARTICIPANTS);
     shm_unlink(SHM_MESSAGE_TRACKER);
+    shm_unlink(SHM_CHANNELS);
+    shm_unlink(SHM_CHANNEL_POOL);
+    shm_unlink(SHM_CHANNEL_MESSAGE_POOL);
+    shm_unlink(SHM_DIRECT);
+    shm_unlink(SHM_DIRECT_POOL);
 
     // Create shared memory for the participants directory
     int participants_fd = shm_open(SHM_PARTICIPANTS, O_CREAT | O_RDWR, 0666);
@@ -76,7 +584,10 @@ bool init_chat_server(void) {
     }
     
     // Initialize participants directory
-    memset(participants, 0, sizeof(participants_directory_t));
+    // The new segment reads as zeros already; the guest table is left alone
+    // so its pages are only allocated as gateways reserve names
+    memset(participants, 0, offsetof(participants_directory_t, guests));
+    participants->wait_strategy = wait_strategy_default();
     usleep(350000);
     participants->count = 0;
     participants->last_ping = get_timestamp();
@@ -168,19 +679,59 @@ bool init_chat_server(void) {
     
     // Initialize the message tracker
     tracker_init(message_tracker);
+    tracker_set_policy(message_tracker, DEFAULT_SLOW_CONSUMER_POLICY, DEFAULT_MAX_LAG);
     
     // Close file descriptor (mapping remains)
     close(tracker_fd);
     
+    // Open the persistent journal; the chat still works without it
+    journal_open = journal_open_writer(&journal);
+    if (!journal_open) {
+        perror("Failed to open message journal");
+    } else {
+        // Sequence numbers continue across server restarts
+        tracker_seed_sequence(message_tracker, journal.next_sequence);
+        
+        // The journal must get every message, so the slow-consumer policy
+        // leaves the server's (participant 0) references alone
+        tracker_set_retained(message_tracker, 1u << 0);
+    }
+    
     // Register the server as participant 0
+    atomic_store(&participants->participants[0].status, PARTICIPANT_JOINING);
     participants->participants[0].pid = getpid();
     strncpy(participants->participants[0].username, "Server", MAX_USERNAME_LENGTH);
-    participants->participants[0].status = PARTICIPANT_ACTIVE;
-    participants->participants[0].last_active = get_timestamp();
-    participants->count = 1;
+    lock_usernames();
+    username_index_insert("Server", 1);
+    unlock_usernames();
+    activate_participant_slot(0);
     
     is_server = true;
     my_participant_id = 0;
+    watched_mask = 0;
+    
+    // Exited participants' pidfds become readable in this set
+    watch_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (watch_epoll_fd == -1) {
+        perror("Failed to create participant watch set");
+        cleanup_chat_server();
+        return false;
+    }
+    
+    // Create the channel directory
+    if (!open_channel_segments(true)) {
+        perror("Failed to create channel directory");
+        cleanup_chat_server();
+        return false;
+    }
+    
+    // Create the direct message directory
+    if (!open_direct_segments(true)) {
+        perror("Failed to create direct message directory");
+        cleanup_chat_server();
+        return false;
+    }
+    apply_direct_policy(DEFAULT_SLOW_CONSUMER_POLICY);
     
     return true;
 }
@@ -192,6 +743,31 @@ void cleanup_chat_server(void) {
         return;
     }
     
+    // Stop watching participants
+    for (int i = 0; i < MAX_PARTICIPANTS; i++) {
+        if ((watched_mask & (1u << i)) && watch_pidfds[i] >= 0) {
+            close(watch_pidfds[i]);
+        }
+    }
+    watched_mask = 0;
+    if (watch_epoll_fd != -1) {
+        close(watch_epoll_fd);
+        watch_epoll_fd = -1;
+    }
+    
+    // Stop the notifier thread
+    close_message_notifier();
+    
+    // Unmap the channel and direct message segments
+    close_channel_segments(true);
+    close_direct_segments(true);
+    
+    // Close the journal (segment files outlive the server)
+    if (journal_open) {
+        journal_close_writer(&journal);
+        journal_open = false;
+    }
+    
     // Unmap the participants directory
     if (participants != NULL) {
         munmap(participants, sizeof(participants_directory_t));
@@ -219,6 +795,14 @@ void cleanup_chat_server(void) {
     shm_unlink(SHM_CHAT_RING);
     shm_unlink(SHM_PARTICIPANTS);
     shm_unlink(SHM_MESSAGE_TRACKER);
+    shm_unlink(SHM_CHANNELS);
+    shm_unlink(SHM_CHANNEL_POOL);
+    shm_unlink(SHM_CHANNEL_MESSAGE_POOL);
+    shm_unlink(SHM_DIRECT);
+    shm_unlink(SHM_DIRECT_POOL);
+    
+    my_participant_id = -1;
+    is_server = false;
 }
 
 // Join chat as a client
@@ -229,6 +813,9 @@ bool join_chat_client(const char* username) {
         return false;
     }
     
+    // Record pool, ring and tracker events when MEMPOOL_TRACE is set
+    event_trace_open_from_env();
+    
     // Open participants directory
     int participants_fd = shm_open(SHM_PARTICIPANTS, O_RDWR, 0666);
     if (participants_fd == -1) {
@@ -249,15 +836,8 @@ bool join_chat_client(const char* username) {
     // Close file descriptor (mapping remains)
     close(participants_fd);
     
-    // Find an empty slot
-    int slot = -1;
-    for (int i = 0; i < MAX_PARTICIPANTS; i++) {
-        if (participants->participants[i].status == PARTICIPANT_INACTIVE) {
-            slot = i;
-            break;
-        }
-    }
-    
+    // Claim a free slot
+    int slot = claim_participant_slot();
     if (slot == -1) {
         fprintf(stderr, "Chat is full\n");
         munmap(participants, sizeof(participants_directory_t));
@@ -265,21 +845,26 @@ bool join_chat_client(const char* username) {
         return false;
     }
     
-    // Check for duplicate username
-    for (int i = 0; i < MAX_PARTICIPANTS; i++) {
-        if (participants->participants[i].status == PARTICIPANT_ACTIVE &&
-            strcmp(participants->participants[i].username, username) == 0) {
-            fprintf(stderr, "Username already in use\n");
-            munmap(participants, sizeof(participants_directory_t));
-            participants = NULL;
-            return false;
-        }
+    participants->participants[slot].pid = getpid();
+    strncpy(participants->participants[slot].username, username, MAX_USERNAME_LENGTH);
+    
+    // Reserve the username (rejects duplicates, including concurrent joins)
+    lock_usernames();
+    bool reserved = username_index_insert(username, (uint32_t)slot + 1);
+    unlock_usernames();
+    if (!reserved) {
+        fprintf(stderr, "Username reserved or already in use\n");
+        release_participant_slot(slot);
+        munmap(participants, sizeof(participants_directory_t));
+        participants = NULL;
+        return false;
     }
     
     // Connect to message pool
     if (!memory_pool_init_shared(&message_pool, SHM_CHAT_POOL, MEMORY_POOL_SIZE, 
                                MESSAGE_BLOCK_SIZE, false, 0666)) {
         perror("Failed to connect to message pool");
+        release_participant_slot(slot);
         munmap(participants, sizeof(participants_directory_t));
         participants = NULL;
         return false;
@@ -291,6 +876,7 @@ bool join_chat_client(const char* username) {
     if (ring_fd == -1) {
         perror("Failed to open ring buffer shared memory");
         memory_pool_destroy(&message_pool, false);
+        release_participant_slot(slot);
         munmap(participants, sizeof(participants_directory_t));
         participants = NULL;
         return false;
@@ -303,6 +889,7 @@ bool join_chat_client(const char* username) {
         perror("Failed to map ring buffer");
         close(ring_fd);
         memory_pool_destroy(&message_pool, false);
+        release_participant_slot(slot);
         munmap(participants, sizeof(participants_directory_t));
         participants = NULL;
         return false;
@@ -320,6 +907,7 @@ bool join_chat_client(const char* username) {
         perror("Failed to open message tracker shared memory");
         munmap(message_ring, ring_size);
         memory_pool_destroy(&message_pool, false);
+        release_participant_slot(slot);
         munmap(participants, sizeof(participants_directory_t));
         participants = NULL;
         return false;
@@ -334,6 +922,7 @@ bool join_chat_client(const char* username) {
         close(tracker_fd);
         munmap(message_ring, ring_size);
         memory_pool_destroy(&message_pool, false);
+        release_participant_slot(slot);
         munmap(participants, sizeof(participants_directory_t));
         participants = NULL;
         return false;
@@ -342,16 +931,38 @@ bool join_chat_client(const char* username) {
     // Close file descriptor (mapping remains)
     close(tracker_fd);
     
+    // Attach to the direct message directory
+    if (!open_direct_segments(false)) {
+        perror("Failed to connect to direct message directory");
+        munmap(message_tracker, sizeof(message_tracker_t));
+        message_tracker = NULL;
+        munmap(message_ring, ring_size);
+        message_ring = NULL;
+        memory_pool_destroy(&message_pool, false);
+        release_participant_slot(slot);
+        munmap(participants, sizeof(participants_directory_t));
+        participants = NULL;
+        return false;
+    }
+    
+    // Drop references and direct messages a previous occupant of the slot
+    // may have left behind, before anyone can address new ones to us
+    tracker_release_participant(message_tracker, slot, &message_pool);
+    direct_release_participant(direct_directory, &direct_pool, slot, &message_pool);
+    
     // Register as a participant
-    participants->participants[slot].pid = getpid();
-    strncpy(participants->participants[slot].username, username, MAX_USERNAME_LENGTH);
-    participants->participants[slot].status = PARTICIPANT_ACTIVE;
-    participants->participants[slot].last_active = get_timestamp();
-    atomic_add_uint32(&participants->count, 1);
+    activate_participant_slot(slot);
     
     my_participant_id = slot;
     is_server = false;
     
+    // Attach to the channel directory
+    if (!open_channel_segments(false)) {
+        perror("Failed to connect to channel directory");
+        leave_chat();
+        return false;
+    }
+    
     return true;
 }
 
@@ -361,10 +972,17 @@ void leave_chat(void) {
         return;  // Not connected
     }
     
-    // Mark as inactive
-    if (participants != NULL) {
-        participants->participants[my_participant_id].status = PARTICIPANT_INACTIVE;
-        atomic_add_uint32(&participants->count, -1);
+    // Stop the notifier thread before the doorbells are unmapped
+    close_message_notifier();
+    
+    // Leave all channels and drop unread direct messages
+    close_channel_segments(false);
+    close_direct_segments(false);
+    
+    // Mark as inactive and release unread messages, unless the server
+    // already disconnected us and the slot may belong to someone else now
+    if (participants != NULL && is_connected()) {
+        retire_participant(my_participant_id, false);
     }
     
     // Unmap the participants directory
@@ -392,49 +1010,120 @@ void leave_chat(void) {
     my_participant_id = -1;
 }
 
+// Reserve a username for a client that shares this participant's slot
+int reserve_username(const char* username) {
+    if (my_participant_id < 0 || participants == NULL || username == NULL ||
+        username[0] == '\0' || strlen(username) >= MAX_USERNAME_LENGTH) {
+        return -1;
+    }
+    
+    // Take a guest entry, then index the name like a participant's
+    lock_usernames();
+    int handle = claim_guest_name(my_participant_id);
+    if (handle >= 0) {
+        guest_name_t* guest = &participants->guests[handle];
+        strncpy(guest->username, username, MAX_USERNAME_LENGTH - 1);
+        guest->username[MAX_USERNAME_LENGTH - 1] = '\0';
+        
+        if (!username_index_insert(guest->username, USERNAME_INDEX_GUEST + (uint32_t)handle)) {
+            free_guest_name((uint32_t)handle);
+            handle = -1;  // Reserved or in use
+        }
+    }
+    unlock_usernames();
+    
+    return handle;
+}
+
+// Release a username taken with reserve_username
+void release_username(int handle) {
+    if (participants == NULL || handle < 0 || handle >= MAX_GUEST_NAMES) {
+        return;
+    }
+    
+    lock_usernames();
+    guest_name_t* guest = &participants->guests[handle];
+    if (guest->owner == (uint32_t)my_participant_id + 1) {
+        username_index_remove(guest->username, USERNAME_INDEX_GUEST + (uint32_t)handle);
+        free_guest_name((uint32_t)handle);
+    }
+    unlock_usernames();
+}
+
 // Send a message to all participants
 bool send_message(const char* message) {
     if (my_participant_id < 0 || message == NULL || message_ring == NULL) {
         return false;  // Not connected
     }
     
-    size_t message_len = strlen(message);
-    if (message_len == 0 || message_len >= MAX_MESSAGE_LENGTH) {
-        return false;  // Empty or too long message
+    if (!is_server && !is_connected()) {
+        return false;  // Disconnected by the server
     }
     
-    // Update last active timestamp
-    participants->participants[my_participant_id].last_active = get_timestamp();
+    void* block = create_message_block(message);
+    if (block == NULL) {
+        return false;
+    }
     
-    // Allocate memory for the message
-    void* block = memory_pool_alloc(&message_pool);
+    return track_message_block(block, TRACKER_PRIORITY_NORMAL);
+}
+
+// Send a server notice that clients see ahead of the messages they have queued
+static bool send_system_notice(const char* message) {
+    void* block = create_message_block(message);
     if (block == NULL) {
-        fprintf(stderr, "Failed to allocate memory for message\n");
         return false;
     }
-    // Set up message header
-    message_header_t* header = (message_header_t*)&message_pool.free_blocks->buffer;
-    header->timestamp = get_timestamp();
-    strncpy(header->sender, participants->participants[my_participant_id].username, 
-            MAX_USERNAME_LENGTH);
-    header->message_length = message_len;
     
-    // Copy message data after the header
-    char* message_data = (char*)block + sizeof(message_header_t);
-    strncpy(message_data, message, message_len);
-    message_data[message_len] = '\0';  // Ensure null-termination
+    return track_message_block(block, TRACKER_PRIORITY_SYSTEM);
+}
+
+// Reserve a message block whose text the caller fills in place
+void* reserve_message_block(void) {
+    if (my_participant_id < 0 || message_tracker == NULL) {
+        return NULL;  // Not connected
+    }
     
-    // Calculate active participants mask
-    uint32_t active_mask = calculate_active_mask();
+    return memory_pool_alloc(&message_pool);
+}
+
+// Text area of a reserved block (MAX_MESSAGE_LENGTH bytes)
+char* message_block_text(void* block) {
+    return (char*)block + sizeof(message_header_t);
+}
+
+// Send a reserved block holding `length` bytes of text on behalf of `sender`
+bool commit_message_block(void* block, const char* sender, uint32_t length) {
+    if (block == NULL) {
+        return false;
+    }
     
-    // Add message to the tracker
-    if (!tracker_add_message(message_tracker, block, active_mask)) {
-        fprintf(stderr, "Failed to track message\n");
+    if (sender == NULL || length == 0 || length >= MAX_MESSAGE_LENGTH ||
+        (!is_server && !is_connected())) {
         memory_pool_free(&message_pool, block);
         return false;
     }
     
-    return true;
+    fill_message_header(block, sender, length);
+    return track_message_block(block, TRACKER_PRIORITY_NORMAL);
+}
+
+// Return a reserved block without sending it
+void release_message_block(void* block) {
+    if (block != NULL) {
+        memory_pool_free(&message_pool, block);
+    }
+}
+
+// Account the latency of a delivered message
+static void record_delivery(const message_header_t* header) {
+    uint64_t latency = get_monotonic_ns() - header->timestamp_ns;
+    
+    delivered_count++;
+    delivery_latency_total_ns += latency;
+    if (latency > delivery_latency_max_ns) {
+        delivery_latency_max_ns = latency;
+    }
 }
 
 // Check for and handle new messages
@@ -443,68 +1132,210 @@ int process_new_messages(void (*message_callback)(const char* sender, const char
         return 0;  // Not connected
     }
     
-    // Update last active timestamp
-    participants->participants[my_participant_id].last_active = get_timestamp();
-    
     int messages_processed = 0;
     
+    // Report messages the slow-consumer policy dropped while we were behind
+    uint32_t missed = tracker_take_missed(message_tracker, my_participant_id);
+    if (missed > 0) {
+        char notice[MAX_MESSAGE_LENGTH];
+        snprintf(notice, MAX_MESSAGE_LENGTH, "You missed %u messages", missed);
+        message_callback("System", notice);
+    }
+    
     // Process all available unread messages for this participant
+    // Clients take server notices first; the server reads in sequence order
+    // because it journals what it reads
     int message_index;
-    while ((message_index = tracker_get_next_unread(message_tracker, my_participant_id)) >= 0) {
+    while ((message_index = tracker_get_next_unread(message_tracker, my_participant_id, !is_server)) >= 0) {
         // Get the message from the tracker
-        void* block = tracker_get_message(message_tracker, message_index);
+        void* block = tracker_get_message(message_tracker, &message_pool, message_index);
         if (block == NULL) {
             continue;  // Message no longer exists
         }
         
-        // Process the message
-        message_header_t* header = (message_header_t*)block;
-        char* message_data = (char*)block + sizeof(message_header_t);
-        
-        // Call the callback function with sender and message
-        message_callback(header->sender, message_data);
+        // Copy the message out: a sender may drop it from under us if we lag
+        // behind, and only a successful mark_read of the copied sequence
+        // proves the copy is intact; otherwise look again
+        message_header_t header = *(message_header_t*)block;
+        char message_data[MAX_MESSAGE_LENGTH];
+        uint32_t length = header.message_length < MAX_MESSAGE_LENGTH ? 
+                          header.message_length : MAX_MESSAGE_LENGTH - 1;
+        memcpy(message_data, (char*)block + sizeof(message_header_t), length);
+        message_data[length] = '\0';
+        header.sender[MAX_USERNAME_LENGTH - 1] = '\0';
         
         // Mark the message as read by this participant
-        tracker_mark_read(message_tracker, message_index, my_participant_id);
+        if (!tracker_mark_read(message_tracker, message_index, my_participant_id, header.sequence)) {
+            continue;  // Dropped or replaced while we copied it
+        }
         
         // Try to free the message if all participants have read it
         tracker_try_free_message(message_tracker, message_index, &message_pool);
         
+        // The server sees every message, so it journals them here rather than
+        // the senders doing it on the send path
+        if (journal_open) {
+            journal_append(&journal, header.sequence, (uint64_t)time(NULL), header.sender,
+                           message_data, length);
+        }
+        
+        // Record send-to-delivery latency
+        record_delivery(&header);
+        
+        // Call the callback function with sender and message
+        message_callback(header.sender, message_data);
+        
         messages_processed++;
     }
     
+    // Publish the batch to journal readers in one go
+    if (journal_open && messages_processed > 0) {
+        journal_flush(&journal);
+    }
+    
     return messages_processed;
 }
 
+// Start watching a participant's process
+static void watch_participant(int slot) {
+    watch_pids[slot] = participants->participants[slot].pid;
+    watch_pidfds[slot] = open_pidfd(watch_pids[slot]);
+    watched_mask |= 1u << slot;
+    
+    if (watch_pidfds[slot] >= 0) {
+        struct epoll_event event = { .events = EPOLLIN, .data.u32 = (uint32_t)slot };
+        epoll_ctl(watch_epoll_fd, EPOLL_CTL_ADD, watch_pidfds[slot], &event);
+    }
+}
+
+// Stop watching a participant's process
+static void unwatch_participant(int slot) {
+    if (watch_pidfds[slot] >= 0) {
+        epoll_ctl(watch_epoll_fd, EPOLL_CTL_DEL, watch_pidfds[slot], NULL);
+        close(watch_pidfds[slot]);
+        watch_pidfds[slot] = -1;
+    }
+    watched_mask &= ~(1u << slot);
+}
+
+// Release a participant whose process died without leaving
+static void release_dead_participant(int slot) {
+    char username[MAX_USERNAME_LENGTH];
+    strncpy(username, participants->participants[slot].username, MAX_USERNAME_LENGTH);
+    
+    unwatch_participant(slot);
+    retire_participant(slot, true);
+    
+    char disconnect_msg[MAX_MESSAGE_LENGTH];
+    snprintf(disconnect_msg, MAX_MESSAGE_LENGTH, "%s has been disconnected", username);
+    send_system_notice(disconnect_msg);
+}
+
+// Disconnect participants the slow-consumer policy flagged
+static void disconnect_slow_participants(void) {
+    uint32_t evicted = tracker_take_evicted(message_tracker) & ~(1u << my_participant_id);
+    
+    while (evicted != 0) {
+        int slot = __builtin_ctz(evicted);
+        evicted &= evicted - 1;
+        
+        if (atomic_load(&participants->participants[slot].status) != PARTICIPANT_ACTIVE) {
+            continue;  // Left on its own meanwhile
+        }
+        
+        char username[MAX_USERNAME_LENGTH];
+        strncpy(username, participants->participants[slot].username, MAX_USERNAME_LENGTH);
+        
+        unwatch_participant(slot);
+        retire_participant(slot, true);
+        
+        char disconnect_msg[MAX_MESSAGE_LENGTH];
+        snprintf(disconnect_msg, MAX_MESSAGE_LENGTH, "%s has been disconnected (too slow)", username);
+        send_system_notice(disconnect_msg);
+    }
+}
+
 // Check if participants are still active
+// Each participant's process is watched through a pidfd, which becomes
+// readable the moment the process exits; kernels without pidfd support
+// fall back to a kill(pid, 0) probe once per second
 void check_participants(void) {
-    if (participants == NULL) {
+    if (participants == NULL || !is_server) {
         return;
     }
     
-    uint32_t now = get_timestamp();
-    uint32_t timeout = 60;  // 60 seconds timeout
+    disconnect_slow_participants();
+    
+    uint32_t active = atomic_load(&participants->active_mask) & ~(1u << my_participant_id);
+    
+    // Reconcile the watch set with the directory (slots may have been reused)
+    for (int i = 0; i < MAX_PARTICIPANTS; i++) {
+        uint32_t bit = 1u << i;
+        bool watched = (watched_mask & bit) != 0;
+        
+        if (watched && (!(active & bit) || participants->participants[i].pid != watch_pids[i])) {
+            unwatch_participant(i);
+            watched = false;
+        }
+        if (!watched && (active & bit)) {
+            watch_participant(i);
+            if (watch_pidfds[i] < 0 && errno == ESRCH) {
+                release_dead_participant(i);  // Already gone
+            }
+        }
+    }
+    
+    // Collect exited participants without blocking
+    struct epoll_event events[MAX_PARTICIPANTS];
+    int count = epoll_wait(watch_epoll_fd, events, MAX_PARTICIPANTS, 0);
+    for (int i = 0; i < count; i++) {
+        int slot = (int)events[i].data.u32;
+        if (watched_mask & (1u << slot)) {
+            release_dead_participant(slot);
+        }
+    }
     
+    bool need_probe = false;
     for (int i = 0; i < MAX_PARTICIPANTS; i++) {
-        if (participants->participants[i].status == PARTICIPANT_ACTIVE) {
-            if (now - participants->participants[i].last_active > timeout) {
-                // Participant is inactive
-                participants->participants[i].status = PARTICIPANT_INACTIVE;
-                atomic_add_uint32(&participants->count, -1);
-                
-                // If we're the server, send a system message
-                if (is_server) {
-                    char disconnect_msg[MAX_MESSAGE_LENGTH];
-                    snprintf(disconnect_msg, MAX_MESSAGE_LENGTH, 
-                            "%s has been disconnected (timeout)", 
-                            participants->participants[i].username);
-                    send_message(disconnect_msg);
-                }
+        if ((watched_mask & (1u << i)) && watch_pidfds[i] < 0) {
+            need_probe = true;
+        }
+    }
+    
+    // Fallback probe for participants without a pidfd
+    uint32_t now = get_timestamp();
+    if (need_probe && now != last_liveness_poll) {
+        last_liveness_poll = now;
+        for (int i = 0; i < MAX_PARTICIPANTS; i++) {
+            if ((watched_mask & (1u << i)) && watch_pidfds[i] < 0 &&
+                kill(watch_pids[i], 0) == -1 && errno == ESRCH) {
+                release_dead_participant(i);
             }
         }
     }
 }
 
+// Choose how the server treats participants that fall behind
+bool set_slow_consumer_policy(tracker_policy_t policy, uint32_t max_lag) {
+    if (!is_server || message_tracker == NULL || policy > TRACKER_POLICY_DISCONNECT) {
+        return false;
+    }
+    
+    tracker_set_policy(message_tracker, policy, max_lag);
+    apply_direct_policy(policy);
+    return true;
+}
+
+// Check whether this process still holds its participant slot
+bool is_connected(void) {
+    if (participants == NULL || my_participant_id < 0) {
+        return false;
+    }
+    
+    participant_info_t* me = &participants->participants[my_participant_id];
+    return atomic_load(&me->status) == PARTICIPANT_ACTIVE && me->pid == getpid();
+}
+
 // Get list of active participants
 int get_participants(char usernames[][MAX_USERNAME_LENGTH], int max_count) {
     if (participants == NULL || usernames == NULL || max_count <= 0) {
@@ -514,7 +1345,7 @@ int get_participants(char usernames[][MAX_USERNAME_LENGTH], int max_count) {
     int count = 0;
     
     for (int i = 0; i < MAX_PARTICIPANTS && count < max_count; i++) {
-        if (participants->participants[i].status == PARTICIPANT_ACTIVE) {
+        if (atomic_load(&participants->participants[i].status) == PARTICIPANT_ACTIVE) {
             strncpy(usernames[count], participants->participants[i].username, 
                    MAX_USERNAME_LENGTH);
             count++;
@@ -522,4 +1353,338 @@ int get_participants(char usernames[][MAX_USERNAME_LENGTH], int max_count) {
     }
     
     return count;
-}
\ No newline at end of file
+}
+
+// Get send-to-delivery latency of messages processed by this process
+void get_delivery_latency(uint64_t* average_ns, uint64_t* max_ns) {
+    if (average_ns != NULL) {
+        *average_ns = delivered_count > 0 ? delivery_latency_total_ns / delivered_count : 0;
+    }
+    if (max_ns != NULL) {
+        *max_ns = delivery_latency_max_ns;
+    }
+}
+
+// Context for replay_record; function pointers cannot travel through void*
+typedef struct {
+    void (*message_callback)(const char* sender, const char* message);
+} replay_context_t;
+
+// Adapts journal records to the chat message callback
+static void replay_record(const journal_record_t* record, void* context) {
+    const replay_context_t* replay = (const replay_context_t*)context;
+    replay->message_callback(record->sender, record->data);
+}
+
+// Replay the last `count` journaled messages
+int replay_chat_history(int count, void (*message_callback)(const char* sender, const char* message)) {
+    if (count <= 0 || message_callback == NULL) {
+        return 0;
+    }
+    
+    journal_reader_t reader;
+    if (!journal_open_reader(&reader)) {
+        return 0;  // No history yet
+    }
+    
+    replay_context_t replay = { .message_callback = message_callback };
+    int replayed = journal_replay_last(&reader, (uint32_t)count, replay_record, &replay);
+    journal_close_reader(&reader);
+    
+    return replayed;
+}
+
+// Replay journaled messages with from <= timestamp <= to
+int replay_chat_history_range(uint64_t from, uint64_t to, 
+                              void (*message_callback)(const char* sender, const char* message)) {
+    if (message_callback == NULL) {
+        return 0;
+    }
+    
+    journal_reader_t reader;
+    if (!journal_open_reader(&reader)) {
+        return 0;  // No history yet
+    }
+    
+    replay_context_t replay = { .message_callback = message_callback };
+    int replayed = journal_replay_range(&reader, from, to, replay_record, &replay);
+    journal_close_reader(&reader);
+    
+    return replayed;
+}
+
+// Find a channel in this process's joined list
+static int find_joined_channel(const channel_t* channel) {
+    for (int i = 0; i < joined_channel_count; i++) {
+        if (joined_channels[i] == channel) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Join a channel, creating it if it does not exist
+bool join_channel(const char* name) {
+    if (my_participant_id < 0 || channel_directory == NULL) {
+        return false;  // Not connected
+    }
+    
+    channel_t* channel = channel_open(channel_directory, &channel_pool, name);
+    if (channel == NULL) {
+        return false;
+    }
+    
+    if (find_joined_channel(channel) >= 0) {
+        return true;  // Already a member
+    }
+    
+    if (joined_channel_count >= MAX_JOINED_CHANNELS || 
+        !channel_join(channel, my_participant_id)) {
+        return false;
+    }
+    
+    joined_channels[joined_channel_count++] = channel;
+    return true;
+}
+
+// Leave a channel
+bool leave_channel(const char* name) {
+    if (my_participant_id < 0 || channel_directory == NULL) {
+        return false;  // Not connected
+    }
+    
+    int index = find_joined_channel(channel_lookup(channel_directory, &channel_pool, name));
+    if (index < 0) {
+        return false;  // Not a member
+    }
+    
+    channel_leave(joined_channels[index], my_participant_id, &channel_message_pool);
+    joined_channels[index] = joined_channels[--joined_channel_count];
+    return true;
+}
+
+// Send a message to the members of a channel
+bool send_channel_message(const char* name, const char* message) {
+    if (my_participant_id < 0 || message == NULL || channel_directory == NULL) {
+        return false;  // Not connected
+    }
+    
+    channel_t* channel = channel_lookup(channel_directory, &channel_pool, name);
+    if (channel == NULL) {
+        return false;  // No such channel
+    }
+    
+    size_t message_len = strlen(message);
+    if (message_len == 0 || message_len >= MAX_MESSAGE_LENGTH) {
+        return false;  // Empty or too long message
+    }
+    
+    // Channel messages come from their own pool, within the channel's quota
+    void* block = channel_alloc_message(channel, &channel_message_pool);
+    if (block == NULL) {
+        fprintf(stderr, "Failed to allocate memory for channel message\n");
+        return false;
+    }
+    
+    // The channel log, not the sequence, orders channel messages
+    write_message_block(block, message, message_len);
+    ((message_header_t*)block)->sequence = tracker_next_sequence(message_tracker);
+    if (!channel_post(channel, &channel_message_pool, block)) {
+        return false;
+    }
+    
+    ring_doorbells(atomic_load(&channel->members));
+    return true;
+}
+
+// Context for deliver_channel_message; function pointers cannot travel through void*
+typedef struct {
+    void (*channel_callback)(const char* channel, const char* sender, const char* message);
+} channel_context_t;
+
+// Adapts channel deliveries to the chat channel callback
+static void deliver_channel_message(const channel_t* channel, void* block, void* context) {
+    const channel_context_t* delivery = (const channel_context_t*)context;
+    message_header_t* header = (message_header_t*)block;
+    record_delivery(header);
+    delivery->channel_callback(channel->name, header->sender, (char*)block + sizeof(message_header_t));
+}
+
+// Check the joined channels for new messages
+int process_channel_messages(void (*channel_callback)(const char* channel, const char* sender, 
+                                                      const char* message)) {
+    if (my_participant_id < 0 || channel_callback == NULL) {
+        return 0;  // Not connected
+    }
+    
+    channel_context_t delivery = { .channel_callback = channel_callback };
+    int messages_processed = 0;
+    for (int i = 0; i < joined_channel_count; i++) {
+        messages_processed += channel_receive(joined_channels[i], &channel_message_pool, 
+                                              my_participant_id, deliver_channel_message, &delivery);
+    }
+    
+    return messages_processed;
+}
+
+// Send a private message to one participant
+bool send_direct_message(const char* username, const char* message) {
+    if (my_participant_id < 0 || username == NULL || message == NULL || direct_directory == NULL) {
+        return false;  // Not connected
+    }
+    
+    if (!is_server && !is_connected()) {
+        return false;  // Disconnected by the server
+    }
+    
+    int receiver_id = find_participant(username);
+    if (receiver_id < 0) {
+        return false;  // No such participant
+    }
+    
+    void* block = create_message_block(message);
+    if (block == NULL) {
+        return false;
+    }
+    
+    // The pair queue, not the sequence, orders direct messages
+    ((message_header_t*)block)->sequence = tracker_next_sequence(message_tracker);
+    if (!direct_send(direct_directory, &direct_pool, my_participant_id, receiver_id, 
+                     &message_pool, block)) {
+        memory_pool_free(&message_pool, block);
+        return false;
+    }
+    
+    ring_doorbells(1u << receiver_id);
+    return true;
+}
+
+// Context for deliver_direct_message; function pointers cannot travel through void*
+typedef struct {
+    void (*direct_callback)(const char* sender, const char* message);
+} direct_context_t;
+
+// Hand one direct message to the callback passed as context
+static void deliver_direct_message(int sender_id, void* block, void* context) {
+    (void)sender_id;  // The header carries the sender's name
+    const direct_context_t* delivery = (const direct_context_t*)context;
+    message_header_t* header = (message_header_t*)block;
+    record_delivery(header);
+    delivery->direct_callback(header->sender, (char*)block + sizeof(message_header_t));
+}
+
+// Check for private messages sent to this participant
+int process_direct_messages(void (*direct_callback)(const char* sender, const char* message)) {
+    if (my_participant_id < 0 || direct_callback == NULL || direct_directory == NULL) {
+        return 0;  // Not connected
+    }
+    
+    if (!is_server && !is_connected()) {
+        return 0;
+    }
+    
+    // Report private messages evicted while we were not reading
+    int messages_processed = 0;
+    uint32_t missed = direct_take_missed(direct_directory, my_participant_id);
+    if (missed > 0) {
+        char notice[MAX_MESSAGE_LENGTH];
+        snprintf(notice, MAX_MESSAGE_LENGTH, "You missed %u private messages", missed);
+        direct_callback("System", notice);
+        messages_processed++;
+    }
+    
+    if (!direct_has_pending(direct_directory, my_participant_id)) {
+        return messages_processed;
+    }
+    
+    direct_context_t delivery = { .direct_callback = direct_callback };
+    return messages_processed + direct_receive(direct_directory, &direct_pool, my_participant_id,
+                                               &message_pool, deliver_direct_message, &delivery);
+}
+
+// Notifier thread: sleeps on our doorbell and signals the eventfd when it rings
+static void* notifier_thread(void* arg) {
+    (void)arg;
+    atomic_uint* doorbell = &participants->doorbell[my_participant_id];
+    uint32_t bit = 1u << my_participant_id;
+    uint32_t seen = atomic_load(doorbell);
+    
+    while (!atomic_load(&notify_stop)) {
+        // Announce the sleep before checking the word, so a ringer either
+        // sees us asleep or we see its increment
+        atomic_fetch_or(&participants->sleeping_mask, bit);
+        futex(doorbell, FUTEX_WAIT, seen);
+        atomic_fetch_and(&participants->sleeping_mask, ~bit);
+        
+        uint32_t now = atomic_load(doorbell);
+        if (now != seen) {
+            seen = now;
+            uint64_t one = 1;
+            ssize_t written = write(notify_fd, &one, sizeof(one));
+            (void)written;  // Counter saturation still leaves the fd readable
+        }
+    }
+    
+    return NULL;
+}
+
+// Get a descriptor that becomes readable when messages may be waiting
+int open_message_notifier(void) {
+    if (my_participant_id < 0 || participants == NULL) {
+        return -1;  // Not connected
+    }
+    
+    if (notify_fd != -1) {
+        return notify_fd;
+    }
+    
+    notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (notify_fd == -1) {
+        return -1;
+    }
+    
+    // The thread inherits a fully blocked mask, so signals stay with the caller
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    
+    atomic_store(&notify_stop, 0);
+    int error = pthread_create(&notify_thread, NULL, notifier_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    
+    if (error != 0) {
+        close(notify_fd);
+        notify_fd = -1;
+        return -1;
+    }
+    
+    return notify_fd;
+}
+
+// Reset the notifier descriptor after it became readable
+void ack_message_notifier(void) {
+    uint64_t count;
+    if (notify_fd != -1) {
+        ssize_t n = read(notify_fd, &count, sizeof(count));
+        (void)n;  // EAGAIN just means it was already reset
+    }
+}
+
+// Stop the notifier thread and close its descriptor
+void close_message_notifier(void) {
+    if (notify_fd == -1) {
+        return;
+    }
+    
+    atomic_store(&notify_stop, 1);
+    ring_doorbells(1u << my_participant_id);
+    pthread_join(notify_thread, NULL);
+    
+    close(notify_fd);
+    notify_fd = -1;
+}
+
+// Get a descriptor that becomes readable when a watched participant exits
+int participant_watch_fd(void) {
+    return is_server ? watch_epoll_fd : -1;
+}
@@ -12,39 +12,77 @@
 #define SHM_CHAT_RING "/chat_message_ring"
 #define SHM_PARTICIPANTS "/chat_participants"
 #define SHM_MESSAGE_TRACKER "/chat_message_tracker"
+#define SHM_CHANNELS "/chat_channels"
+#define SHM_CHANNEL_POOL "/chat_channel_pool"
+#define SHM_CHANNEL_MESSAGE_POOL "/chat_channel_messages"
+#define SHM_DIRECT "/chat_direct"
+#define SHM_DIRECT_POOL "/chat_direct_pool"
 
 // Constants
 #define MAX_PARTICIPANTS 32
 #define MAX_USERNAME_LENGTH 32
 #define MAX_MESSAGE_LENGTH 256
 #define MEMORY_POOL_SIZE (1024 * 1024) // 1MB
+#define CHANNEL_MESSAGE_POOL_SIZE (512 * 1024) // Channel messages, apart from the room's pool
 #define MESSAGE_BLOCK_SIZE (MAX_MESSAGE_LENGTH + 128) // Message plus overhead
 #define RING_BUFFER_SIZE 128
+#define HISTORY_REPLAY_COUNT 20 // Messages replayed to a client when it joins
+#define USERNAME_INDEX_SIZE 16384 // Open-addressing username table (power of 2)
+#define MAX_GUEST_NAMES 8192    // Names of clients sharing a participant's slot (gateway users)
+#define MAX_JOINED_CHANNELS 64  // Channels one participant can be in
+#define DEFAULT_SLOW_CONSUMER_POLICY TRACKER_POLICY_EVICT_OLDEST
+#define DEFAULT_MAX_LAG 64      // Unread messages a participant may fall behind
+
+// Username index entry values (otherwise slot + 1, or USERNAME_INDEX_GUEST + guest name)
+#define USERNAME_INDEX_EMPTY 0
+#define USERNAME_INDEX_TOMBSTONE UINT32_MAX
+#define USERNAME_INDEX_GUEST (MAX_PARTICIPANTS + 1)
 
 // Participant status
 typedef enum {
     PARTICIPANT_INACTIVE = 0,
-    PARTICIPANT_ACTIVE = 1
+    PARTICIPANT_ACTIVE = 1,
+    PARTICIPANT_JOINING = 2              // Slot claimed, join in progress
 } participant_status_t;
 
 // Participant information
 typedef struct {
     pid_t pid;                           // Process ID
     char username[MAX_USERNAME_LENGTH];  // User name
-    participant_status_t status;         // Status (active/inactive)
-    uint32_t last_active;                // Last active timestamp
+    atomic_uint status;                  // participant_status_t, claimed by CAS
+    uint32_t last_active;                // Join timestamp (liveness is tracked by the server)
 } participant_info_t;
 
+// A name a participant registered for one of its own clients
+typedef struct {
+    uint32_t owner;                      // Owning participant slot + 1, 0 if free
+    uint32_t next;                       // Next entry + 1 in the owner's or the free list, 0 at the end
+    uint32_t prev;                       // Previous entry + 1 in the owner's list, 0 at the head
+    char username[MAX_USERNAME_LENGTH];  // User name
+} guest_name_t;
+
 // Participants directory
 typedef struct {
     participant_info_t participants[MAX_PARTICIPANTS];
     uint32_t count;                      // Number of active participants
     uint32_t last_ping;                  // Last ping timestamp
+    atomic_uint join_hint;               // Rotating start slot for claims
+    atomic_uint active_mask;             // Bitmask of active participants
+    atomic_uint username_lock;           // Serializes username index and guest name changes
+    uint32_t wait_strategy;              // wait_strategy_t for username_lock
+    atomic_uint username_index[USERNAME_INDEX_SIZE]; // Username hash -> slot + 1 (lock-free lookups)
+    atomic_uint doorbell[MAX_PARTICIPANTS]; // Bumped when messages are sent to a participant (futex word)
+    atomic_uint sleeping_mask;           // Participants waiting on their doorbell
+    uint32_t guest_heads[MAX_PARTICIPANTS]; // First guest entry + 1 of each participant, 0 if none
+    uint32_t guest_free;                 // First released guest entry + 1, 0 if none
+    uint32_t guest_used;                 // Entries handed out so far; the rest are untouched
+    guest_name_t guests[MAX_GUEST_NAMES]; // Names of clients sharing a participant's slot (last)
 } participants_directory_t;
 
 // Message header
 typedef struct {
-    uint32_t timestamp;                  // Message timestamp
+    uint64_t sequence;                   // Global sequence number (delivery order)
+    uint64_t timestamp_ns;               // CLOCK_MONOTONIC send time in nanoseconds
     char sender[MAX_USERNAME_LENGTH];    // Sender username
     uint32_t message_length;             // Length of message data
 } message_header_t;
@@ -61,17 +99,102 @@ bool join_chat_client(const char* username);
 // Leave chat
 void leave_chat(void);
 
+// Reserve a username for a client that shares this participant's slot
+// (e.g. a gateway's socket clients), so nobody else can join with it
+// Returns a handle for release_username, or -1 if the name is reserved,
+// in use or invalid
+int reserve_username(const char* username);
+
+// Release a username taken with reserve_username
+void release_username(int handle);
+
 // Send a message to all participants
 bool send_message(const char* message);
 
+// Reserve a message block whose text the caller fills in place
+// Returns NULL when not connected or the pool is exhausted
+void* reserve_message_block(void);
+
+// Text area of a reserved block (MAX_MESSAGE_LENGTH bytes)
+char* message_block_text(void* block);
+
+// Send a reserved block holding `length` bytes of text on behalf of `sender`
+// Takes ownership of the block whether or not it succeeds
+bool commit_message_block(void* block, const char* sender, uint32_t length);
+
+// Return a reserved block without sending it
+void release_message_block(void* block);
+
 // Check for and handle new messages
+// Messages dropped because this participant fell behind are reported
+// through the callback as a "System" notice
 // Returns the number of new messages processed
 int process_new_messages(void (*message_callback)(const char* sender, const char* message));
 
 // Check if participants are still active
+// Also disconnects participants the slow-consumer policy flagged
 void check_participants(void);
 
+// Choose how the server treats participants that fall more than `max_lag`
+// messages behind (server only)
+bool set_slow_consumer_policy(tracker_policy_t policy, uint32_t max_lag);
+
+// Check whether this process still holds its participant slot
+// (false once the server disconnected it)
+bool is_connected(void);
+
 // Get list of active participants
 int get_participants(char usernames[][MAX_USERNAME_LENGTH], int max_count);
 
+// Get send-to-delivery latency of messages processed by this process
+void get_delivery_latency(uint64_t* average_ns, uint64_t* max_ns);
+
+// Replay the last `count` messages from the persistent journal
+// Returns the number of messages replayed
+int replay_chat_history(int count, void (*message_callback)(const char* sender, const char* message));
+
+// Replay journaled messages with from <= timestamp <= to
+// Returns the number of messages replayed
+int replay_chat_history_range(uint64_t from, uint64_t to, 
+                              void (*message_callback)(const char* sender, const char* message));
+
+// Join a channel, creating it if it does not exist
+bool join_channel(const char* name);
+
+// Leave a channel
+bool leave_channel(const char* name);
+
+// Send a message to the members of a channel
+bool send_channel_message(const char* name, const char* message);
+
+// Check the joined channels for new messages
+// Returns the number of messages processed
+int process_channel_messages(void (*channel_callback)(const char* channel, const char* sender, 
+                                                      const char* message));
+
+// Send a private message to one participant
+// It bypasses the broadcast tracker: each sender/receiver pair has its own queue
+bool send_direct_message(const char* username, const char* message);
+
+// Check for private messages sent to this participant
+// Returns the number of messages processed
+int process_direct_messages(void (*direct_callback)(const char* sender, const char* message));
+
+// Get a descriptor that becomes readable when messages may be waiting for
+// this participant (broadcast, channel or private); add it to an epoll set
+// and call ack_message_notifier before processing messages
+// A helper thread (with all signals blocked) bridges the shared futex
+// doorbell to the descriptor
+int open_message_notifier(void);
+
+// Reset the notifier descriptor after it became readable
+void ack_message_notifier(void);
+
+// Stop the notifier thread and close its descriptor
+void close_message_notifier(void);
+
+// Get a descriptor that becomes readable when a watched participant exits
+// (server only); call check_participants when it does
+int participant_watch_fd(void);
+
 #endif // SHM_MANAGER_H
\ No newline at end of file
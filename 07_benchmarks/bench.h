@@ -0,0 +1,47 @@
+#ifndef BENCH_H
+#define BENCH_H
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Operations of a memory pool implementation under test
+ * The benchmark only sees this table, so every implementation pays the
+ * same indirect call per operation
+ */
+typedef struct {
+    const char* name;         // Implementation (directory) name
+    bool thread_safe;         // Safe to call from several threads without a lock
+    
+    /**
+     * Create a pool of about `capacity` blocks
+     *
+     * @param capacity Number of blocks wanted
+     * @param block_size Size of each block in bytes
+     * @return Pool instance, or NULL on failure
+     */
+    void* (*create)(uint32_t capacity, uint32_t block_size);
+    void (*destroy)(void* instance);
+    void* (*alloc)(void* instance);
+    bool (*free)(void* instance, void* block);
+} bench_pool_ops_t;
+
+/**
+ * Operations of a ring buffer implementation under test
+ */
+typedef struct {
+    const char* name;         // Implementation (directory) name
+    bool thread_safe;         // Safe to call from several threads without a lock
+    
+    /**
+     * Create an empty ring
+     *
+     * @param capacity Maximum number of elements
+     * @return Ring instance, or NULL on failure
+     */
+    void* (*create)(uint32_t capacity);
+    void (*destroy)(void* instance);
+    bool (*put)(void* instance, void* item);
+    void* (*get)(void* instance);
+} bench_ring_ops_t;
+
+#endif // BENCH_H
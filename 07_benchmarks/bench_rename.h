@@ -0,0 +1,59 @@
+#ifndef BENCH_RENAME_H
+#define BENCH_RENAME_H
+
+/**
+ * Symbol renaming for the benchmark build
+ *
+ * Every generation of the pool and ring exports the same function names,
+ * so they cannot be linked into one executable as they are. Each one is
+ * compiled from its own unmodified sources with this header forced in
+ * first (-include) and BENCH_PREFIX set, which gives its functions a
+ * prefix: memory_pool_alloc becomes impl04_memory_pool_alloc and so on.
+ * This header must not include anything, so sources that define feature
+ * macros (_GNU_SOURCE) before their first system header keep working.
+ */
+#ifdef BENCH_PREFIX
+
+#define BENCH_CONCAT_(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_(a, b)
+#define BENCH_SYMBOL(name) BENCH_CONCAT(BENCH_PREFIX, name)
+
+// Memory pools
+#define memory_pool_init BENCH_SYMBOL(memory_pool_init)
+#define memory_pool_init_shared BENCH_SYMBOL(memory_pool_init_shared)
+#define memory_pool_init_percpu BENCH_SYMBOL(memory_pool_init_percpu)
+#define memory_pool_init_shared_percpu BENCH_SYMBOL(memory_pool_init_shared_percpu)
+#define memory_pool_percpu_size BENCH_SYMBOL(memory_pool_percpu_size)
+#define memory_pool_alloc BENCH_SYMBOL(memory_pool_alloc)
+#define memory_pool_free BENCH_SYMBOL(memory_pool_free)
+#define memory_pool_free_count BENCH_SYMBOL(memory_pool_free_count)
+#define memory_pool_used_count BENCH_SYMBOL(memory_pool_used_count)
+#define memory_pool_reset BENCH_SYMBOL(memory_pool_reset)
+#define memory_pool_destroy BENCH_SYMBOL(memory_pool_destroy)
+#define memory_pool_get_stats BENCH_SYMBOL(memory_pool_get_stats)
+#define memory_pool_sum_stats BENCH_SYMBOL(memory_pool_sum_stats)
+#define memory_pool_set_wait_strategy BENCH_SYMBOL(memory_pool_set_wait_strategy)
+
+// Ring buffers
+#define ring_buffer_size BENCH_SYMBOL(ring_buffer_size)
+#define ring_buffer_init BENCH_SYMBOL(ring_buffer_init)
+#define ring_buffer_put BENCH_SYMBOL(ring_buffer_put)
+#define ring_buffer_get BENCH_SYMBOL(ring_buffer_get)
+#define ring_buffer_put_untimed BENCH_SYMBOL(ring_buffer_put_untimed)
+#define ring_buffer_get_untimed BENCH_SYMBOL(ring_buffer_get_untimed)
+#define ring_buffer_put_batch BENCH_SYMBOL(ring_buffer_put_batch)
+#define ring_buffer_drain BENCH_SYMBOL(ring_buffer_drain)
+#define ring_buffer_peek BENCH_SYMBOL(ring_buffer_peek)
+#define ring_buffer_iter_begin BENCH_SYMBOL(ring_buffer_iter_begin)
+#define ring_buffer_iter_next BENCH_SYMBOL(ring_buffer_iter_next)
+#define ring_buffer_iter_end BENCH_SYMBOL(ring_buffer_iter_end)
+#define ring_buffer_is_empty BENCH_SYMBOL(ring_buffer_is_empty)
+#define ring_buffer_is_full BENCH_SYMBOL(ring_buffer_is_full)
+#define ring_buffer_count BENCH_SYMBOL(ring_buffer_count)
+#define ring_buffer_reset BENCH_SYMBOL(ring_buffer_reset)
+#define ring_buffer_take_lock_stats BENCH_SYMBOL(ring_buffer_take_lock_stats)
+#define ring_buffer_set_wait_strategy BENCH_SYMBOL(ring_buffer_set_wait_strategy)
+
+#endif // BENCH_PREFIX
+
+#endif // BENCH_RENAME_H
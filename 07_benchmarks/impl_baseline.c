@@ -0,0 +1,91 @@
+// Baselines the pools have to beat: glibc malloc/free and a naive
+// single-threaded free list over one slab
+#include <stdlib.h>
+#include "bench.h"
+
+// glibc malloc: the "pool" only remembers the object size
+typedef struct {
+    uint32_t block_size;
+} malloc_instance_t;
+
+static void* malloc_create(uint32_t capacity, uint32_t block_size) {
+    (void)capacity;  // Never runs out
+    malloc_instance_t* instance = malloc(sizeof(malloc_instance_t));
+    if (instance != NULL) {
+        instance->block_size = block_size;
+    }
+    return instance;
+}
+
+static void malloc_destroy(void* instance) {
+    free(instance);
+}
+
+static void* malloc_alloc(void* instance) {
+    return malloc(((malloc_instance_t*)instance)->block_size);
+}
+
+static bool malloc_free(void* instance, void* block) {
+    (void)instance;
+    free(block);
+    return true;
+}
+
+const bench_pool_ops_t baseline_malloc_pool_ops = {
+    "glibc_malloc", true, malloc_create, malloc_destroy, malloc_alloc, malloc_free
+};
+
+// Free list: free blocks are linked through their first word, no checks
+typedef struct {
+    void* slab;
+    void* head;
+} free_list_instance_t;
+
+static void* free_list_create(uint32_t capacity, uint32_t block_size) {
+    free_list_instance_t* instance = malloc(sizeof(free_list_instance_t));
+    if (instance == NULL) {
+        return NULL;
+    }
+    
+    block_size = (block_size + sizeof(void*) - 1) & ~(uint32_t)(sizeof(void*) - 1);
+    instance->slab = aligned_alloc(64, ((size_t)capacity * block_size + 63) & ~(size_t)63);
+    if (instance->slab == NULL) {
+        free(instance);
+        return NULL;
+    }
+    
+    // Link the blocks in address order
+    instance->head = NULL;
+    for (uint32_t i = capacity; i > 0; i--) {
+        void** block = (void**)((char*)instance->slab + (size_t)(i - 1) * block_size);
+        *block = instance->head;
+        instance->head = block;
+    }
+    
+    return instance;
+}
+
+static void free_list_destroy(void* instance) {
+    free(((free_list_instance_t*)instance)->slab);
+    free(instance);
+}
+
+static void* free_list_alloc(void* instance) {
+    free_list_instance_t* list = instance;
+    void** block = list->head;
+    if (block != NULL) {
+        list->head = *block;
+    }
+    return block;
+}
+
+static bool free_list_free(void* instance, void* block) {
+    free_list_instance_t* list = instance;
+    *(void**)block = list->head;
+    list->head = block;
+    return true;
+}
+
+const bench_pool_ops_t baseline_free_list_pool_ops = {
+    "free_list", false, free_list_create, free_list_destroy, free_list_alloc, free_list_free
+};
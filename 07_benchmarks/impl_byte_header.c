@@ -0,0 +1,46 @@
+// Benchmark adapter for the byte-header pool (01_memory_pool_imp)
+#include <stdlib.h>
+#include "mem_pool.h"
+#include "bench.h"
+
+typedef struct {
+    mem_pool pool;
+    void* memory;
+} pool_instance_t;
+
+static void* pool_create(uint32_t capacity, uint32_t block_size) {
+    pool_instance_t* instance = malloc(sizeof(pool_instance_t));
+    if (instance == NULL) {
+        return NULL;
+    }
+    
+    // One status byte in front of every block
+    uint32_t memory_size = capacity * (block_size + 1);
+    instance->memory = malloc(memory_size);
+    if (instance->memory == NULL ||
+        !memory_pool_init(&instance->pool, instance->memory, memory_size, block_size)) {
+        free(instance->memory);
+        free(instance);
+        return NULL;
+    }
+    
+    return instance;
+}
+
+static void pool_destroy(void* instance) {
+    pool_instance_t* pool_instance = instance;
+    free(pool_instance->memory);
+    free(pool_instance);
+}
+
+static void* pool_alloc(void* instance) {
+    return memory_pool_alloc(&((pool_instance_t*)instance)->pool);
+}
+
+static bool pool_free(void* instance, void* block) {
+    return memory_pool_free(&((pool_instance_t*)instance)->pool, block) != 0;
+}
+
+const bench_pool_ops_t BENCH_SYMBOL(pool_ops) = {
+    BENCH_NAME, false, pool_create, pool_destroy, pool_alloc, pool_free
+};
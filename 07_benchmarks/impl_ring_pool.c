@@ -0,0 +1,102 @@
+// Benchmark adapter for the ring-based pools and their rings
+// (03_ring_buffers_mempool_imp*, 04_shared_mempool*)
+//
+// Compiled once per implementation with its directory on the include path:
+//   BENCH_NAME                  Implementation name in the results
+//   BENCH_THREAD_SAFE           1 if the ring and pool take their own locks
+//   BENCH_RING_EXTERNAL_BUFFER  ring_buffer_init takes a separate slot array
+//   BENCH_PERCPU_CAPACITY       Create the pool with per-CPU free lists of this size
+#include <stdlib.h>
+#include "ring_buffer.h"
+#include "mempool_ring.h"
+#include "bench.h"
+
+typedef struct {
+    mem_pool_t pool;
+    void* memory;
+} pool_instance_t;
+
+// memory_pool_init, or its per-CPU variant
+static bool pool_init(mem_pool_t* pool, void* memory, uint32_t memory_size, uint32_t block_size) {
+#ifdef BENCH_PERCPU_CAPACITY
+    return memory_pool_init_percpu(pool, memory, memory_size, block_size, BENCH_PERCPU_CAPACITY);
+#else
+    return memory_pool_init(pool, memory, memory_size, block_size);
+#endif
+}
+
+static void* pool_create(uint32_t capacity, uint32_t block_size) {
+    pool_instance_t* instance = malloc(sizeof(pool_instance_t));
+    if (instance == NULL) {
+        return NULL;
+    }
+    
+    // Blocks, one ring slot per block, the ring header and room for a
+    // statistics block (04 keeps it in pool memory)
+    uint32_t memory_size = capacity * (block_size + sizeof(void*)) + 4096;
+#ifdef BENCH_PERCPU_CAPACITY
+    memory_size += (memory_pool_percpu_size(BENCH_PERCPU_CAPACITY) + 63) & ~(size_t)63;
+#endif
+    instance->memory = aligned_alloc(64, memory_size);
+    if (instance->memory == NULL ||
+        !pool_init(&instance->pool, instance->memory, memory_size, block_size)) {
+        free(instance->memory);
+        free(instance);
+        return NULL;
+    }
+    
+    return instance;
+}
+
+static void pool_destroy(void* instance) {
+    pool_instance_t* pool_instance = instance;
+    free(pool_instance->memory);
+    free(pool_instance);
+}
+
+static void* pool_alloc(void* instance) {
+    return memory_pool_alloc(&((pool_instance_t*)instance)->pool);
+}
+
+static bool pool_free(void* instance, void* block) {
+    return memory_pool_free(&((pool_instance_t*)instance)->pool, block);
+}
+
+const bench_pool_ops_t BENCH_SYMBOL(pool_ops) = {
+    BENCH_NAME, BENCH_THREAD_SAFE, pool_create, pool_destroy, pool_alloc, pool_free
+};
+
+static void* ring_create(uint32_t capacity) {
+#ifdef BENCH_RING_EXTERNAL_BUFFER
+    // Header and slot array in one allocation
+    ring_buffer_t* ring = malloc(sizeof(ring_buffer_t) + capacity * sizeof(void*));
+    if (ring == NULL || !ring_buffer_init(ring, (void**)(ring + 1), capacity)) {
+        free(ring);
+        return NULL;
+    }
+#else
+    size_t size = (ring_buffer_size(capacity) + 63) & ~(size_t)63;
+    ring_buffer_t* ring = aligned_alloc(64, size);
+    if (ring == NULL || !ring_buffer_init(ring, capacity)) {
+        free(ring);
+        return NULL;
+    }
+#endif
+    return ring;
+}
+
+static void ring_destroy(void* instance) {
+    free(instance);
+}
+
+static bool ring_put(void* instance, void* item) {
+    return ring_buffer_put(instance, item);
+}
+
+static void* ring_get(void* instance) {
+    return ring_buffer_get(instance);
+}
+
+const bench_ring_ops_t BENCH_SYMBOL(ring_ops) = {
+    BENCH_NAME, BENCH_THREAD_SAFE, ring_create, ring_destroy, ring_put, ring_get
+};
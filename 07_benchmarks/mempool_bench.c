@@ -0,0 +1,729 @@
+// mempool_bench.c
+// Runs the same workloads against every pool and ring generation in the
+// repository and prints one CSV row per implementation, workload and
+// thread count
+#define _GNU_SOURCE  // For pthread_barrier and sched_yield
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "bench.h"
+#include "perf_counters.h"
+
+#define DEFAULT_OPS 200000        // Operations per thread
+#define DEFAULT_BLOCKS 4096       // Pool blocks / ring slots
+#define DEFAULT_BLOCK_SIZES "32,384,4096" // Small objects, chat messages, pages
+#define MAX_BLOCK_SIZES 8
+#define DEFAULT_SAMPLE 16         // Time one operation in this many
+#define HANDOFF_CAPACITY 256      // Producer/consumer queue per pair (power of 2)
+
+// Implementations (see impl_*.c and CMakeLists.txt)
+extern const bench_pool_ops_t baseline_malloc_pool_ops;
+extern const bench_pool_ops_t baseline_free_list_pool_ops;
+extern const bench_pool_ops_t impl01_pool_ops;
+extern const bench_pool_ops_t impl03_pool_ops;
+extern const bench_pool_ops_t impl03old_pool_ops;
+extern const bench_pool_ops_t impl04old_pool_ops;
+extern const bench_pool_ops_t impl04_pool_ops;
+extern const bench_pool_ops_t impl04nostats_pool_ops;
+extern const bench_pool_ops_t impl04percpu_pool_ops;
+extern const bench_ring_ops_t impl03_ring_ops;
+extern const bench_ring_ops_t impl03old_ring_ops;
+extern const bench_ring_ops_t impl04old_ring_ops;
+extern const bench_ring_ops_t impl04_ring_ops;
+
+static const bench_pool_ops_t* pools[] = {
+    &baseline_malloc_pool_ops, &baseline_free_list_pool_ops, &impl01_pool_ops, &impl03_pool_ops, &impl03old_pool_ops,
+    &impl04old_pool_ops, &impl04_pool_ops, &impl04nostats_pool_ops, &impl04percpu_pool_ops
+};
+
+static const bench_ring_ops_t* rings[] = {
+    &impl03_ring_ops, &impl03old_ring_ops,
+    &impl04old_ring_ops, &impl04_ring_ops
+};
+
+typedef enum {
+    WORKLOAD_PINGPONG = 0,    // alloc/free (put/get) back to back
+    WORKLOAD_CHURN = 1,       // Random lifetimes over a private working set (pools only)
+    WORKLOAD_PRODCONS = 2,    // Half the threads allocate/put, the other half free/get
+    WORKLOAD_FILL_DRAIN = 3,  // Take a share of the capacity, then give it all back
+    WORKLOAD_COUNT = 4
+} workload_t;
+
+static const char* workload_names[WORKLOAD_COUNT] = {
+    "pingpong", "churn", "prodcons", "fill_drain"
+};
+
+// Benchmark settings
+typedef struct {
+    int max_threads;
+    uint32_t ops;
+    uint32_t blocks;
+    uint32_t block_sizes[MAX_BLOCK_SIZES];
+    int block_size_count;
+    uint32_t sample;
+    const char* impl_filter;
+    const char* workload_filter;
+    bool perf;                          // Add perf_event_open counters per operation
+} bench_config_t;
+
+// Single-producer single-consumer queue handing pool blocks from a
+// producer thread to its consumer
+typedef struct {
+    _Alignas(64) atomic_uint tail;
+    _Alignas(64) atomic_uint head;
+    _Alignas(64) void* slots[HANDOFF_CAPACITY];
+} handoff_t;
+
+// State shared by the threads of one run
+typedef struct {
+    const bench_config_t* config;
+    workload_t workload;
+    const bench_pool_ops_t* pool_ops;   // Exactly one of pool_ops and ring_ops is set
+    const bench_ring_ops_t* ring_ops;
+    void* instance;
+    bool serialize;                     // Implementation is not thread safe: take `lock`
+    pthread_mutex_t lock;
+    pthread_barrier_t start;
+    int threads;
+    handoff_t* handoffs;                // One per producer/consumer pair
+} bench_run_t;
+
+// Per-thread results
+typedef struct {
+    bench_run_t* run;
+    int thread_id;
+    uint64_t ops;                       // Successful operations
+    uint64_t failures;                  // Allocations from an empty pool, rejected frees
+    uint64_t* samples;                  // Sampled operation latencies in ns
+    uint32_t sample_count;
+    uint32_t sample_capacity;
+    uint32_t countdown;                 // Operations until the next sample
+    uint64_t rng;
+    uint64_t start_ns;                  // When this thread started and finished its work
+    uint64_t end_ns;
+    perf_counters_t counters;           // Opened by the thread itself when config->perf is set
+    perf_counts_t counts;
+    pthread_t thread;
+} bench_thread_t;
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t next_random(bench_thread_t* thread) {
+    // xorshift64
+    thread->rng ^= thread->rng << 13;
+    thread->rng ^= thread->rng >> 7;
+    thread->rng ^= thread->rng << 17;
+    return thread->rng;
+}
+
+// Whether to time the next operation (1 in config->sample)
+static inline bool sample_next(bench_thread_t* thread) {
+    if (--thread->countdown != 0) {
+        return false;
+    }
+    thread->countdown = thread->run->config->sample;
+    return thread->sample_count < thread->sample_capacity;
+}
+
+// The operations, with the run's lock when the implementation needs one
+static inline void* do_alloc(bench_run_t* run) {
+    if (!run->serialize) {
+        return run->pool_ops->alloc(run->instance);
+    }
+    pthread_mutex_lock(&run->lock);
+    void* block = run->pool_ops->alloc(run->instance);
+    pthread_mutex_unlock(&run->lock);
+    return block;
+}
+
+static inline bool do_free(bench_run_t* run, void* block) {
+    if (!run->serialize) {
+        return run->pool_ops->free(run->instance, block);
+    }
+    pthread_mutex_lock(&run->lock);
+    bool result = run->pool_ops->free(run->instance, block);
+    pthread_mutex_unlock(&run->lock);
+    return result;
+}
+
+static inline bool do_put(bench_run_t* run, void* item) {
+    if (!run->serialize) {
+        return run->ring_ops->put(run->instance, item);
+    }
+    pthread_mutex_lock(&run->lock);
+    bool result = run->ring_ops->put(run->instance, item);
+    pthread_mutex_unlock(&run->lock);
+    return result;
+}
+
+static inline void* do_get(bench_run_t* run) {
+    if (!run->serialize) {
+        return run->ring_ops->get(run->instance);
+    }
+    pthread_mutex_lock(&run->lock);
+    void* item = run->ring_ops->get(run->instance);
+    pthread_mutex_unlock(&run->lock);
+    return item;
+}
+
+// Timed wrappers: one operation in config->sample is timed and recorded
+// Only successful operations count towards ops; the workloads count the
+// failed ones, so a workload retrying on an empty pool does not inflate ops/s
+static void* timed_alloc(bench_thread_t* thread) {
+    void* block;
+    if (!sample_next(thread)) {
+        block = do_alloc(thread->run);
+    } else {
+        uint64_t start = now_ns();
+        block = do_alloc(thread->run);
+        thread->samples[thread->sample_count++] = now_ns() - start;
+    }
+    thread->ops += block != NULL;
+    return block;
+}
+
+static bool timed_free(bench_thread_t* thread, void* block) {
+    bool result;
+    if (!sample_next(thread)) {
+        result = do_free(thread->run, block);
+    } else {
+        uint64_t start = now_ns();
+        result = do_free(thread->run, block);
+        thread->samples[thread->sample_count++] = now_ns() - start;
+    }
+    thread->ops += result;
+    return result;
+}
+
+static bool timed_put(bench_thread_t* thread, void* item) {
+    bool result;
+    if (!sample_next(thread)) {
+        result = do_put(thread->run, item);
+    } else {
+        uint64_t start = now_ns();
+        result = do_put(thread->run, item);
+        thread->samples[thread->sample_count++] = now_ns() - start;
+    }
+    thread->ops += result;
+    return result;
+}
+
+static void* timed_get(bench_thread_t* thread) {
+    void* item;
+    if (!sample_next(thread)) {
+        item = do_get(thread->run);
+    } else {
+        uint64_t start = now_ns();
+        item = do_get(thread->run);
+        thread->samples[thread->sample_count++] = now_ns() - start;
+    }
+    thread->ops += item != NULL;
+    return item;
+}
+
+// Free a block, counting rejections
+static inline void release_block(bench_thread_t* thread, void* block) {
+    if (!timed_free(thread, block)) {
+        thread->failures++;
+    }
+}
+
+// alloc, touch, free
+static void pool_pingpong(bench_thread_t* thread, uint32_t ops) {
+    for (uint32_t i = 0; i < ops; i += 2) {
+        char* block = timed_alloc(thread);
+        if (block == NULL) {
+            thread->failures++;
+            continue;
+        }
+        block[0] = (char)i;
+        release_block(thread, block);
+    }
+}
+
+// Each operation picks a random slot of a private working set and
+// allocates into it when empty or frees it when full
+static void pool_churn(bench_thread_t* thread, uint32_t ops) {
+    bench_run_t* run = thread->run;
+    uint32_t working_set = run->config->blocks / run->threads / 2;
+    if (working_set == 0) {
+        working_set = 1;
+    }
+    
+    void** slots = calloc(working_set, sizeof(void*));
+    if (slots == NULL) {
+        return;
+    }
+    
+    for (uint32_t i = 0; i < ops; i++) {
+        uint32_t index = (uint32_t)(next_random(thread) % working_set);
+        if (slots[index] == NULL) {
+            slots[index] = timed_alloc(thread);
+            if (slots[index] == NULL) {
+                thread->failures++;
+            }
+        } else {
+            release_block(thread, slots[index]);
+            slots[index] = NULL;
+        }
+    }
+    
+    for (uint32_t i = 0; i < working_set; i++) {
+        if (slots[i] != NULL) {
+            do_free(run, slots[i]);
+        }
+    }
+    free(slots);
+}
+
+// Allocate this thread's share of the pool, then free it in the same order
+static void pool_fill_drain(bench_thread_t* thread, uint32_t ops) {
+    bench_run_t* run = thread->run;
+    uint32_t share = run->config->blocks / run->threads;
+    void** held = malloc(((size_t)share + 1) * sizeof(void*));
+    if (held == NULL) {
+        return;
+    }
+    
+    uint32_t done = 0;
+    while (done < ops) {
+        uint32_t count = 0;
+        while (count < share && done < ops) {
+            void* block = timed_alloc(thread);
+            done++;
+            if (block == NULL) {
+                thread->failures++;
+                break;
+            }
+            held[count++] = block;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            release_block(thread, held[i]);
+            done++;
+        }
+    }
+    free(held);
+}
+
+// Even threads allocate and hand blocks to the next thread, which frees them
+static void pool_prodcons(bench_thread_t* thread, uint32_t ops) {
+    bench_run_t* run = thread->run;
+    handoff_t* handoff = &run->handoffs[thread->thread_id / 2];
+    uint32_t transfers = ops / 2;
+    
+    if (thread->thread_id % 2 == 0) {
+        for (uint32_t i = 0; i < transfers; i++) {
+            void* block;
+            while ((block = timed_alloc(thread)) == NULL) {
+                thread->failures++;
+                sched_yield();
+            }
+            uint32_t tail = atomic_load_explicit(&handoff->tail, memory_order_relaxed);
+            while (tail - atomic_load_explicit(&handoff->head, memory_order_acquire) == HANDOFF_CAPACITY) {
+                sched_yield();
+            }
+            handoff->slots[tail % HANDOFF_CAPACITY] = block;
+            atomic_store_explicit(&handoff->tail, tail + 1, memory_order_release);
+        }
+    } else {
+        for (uint32_t i = 0; i < transfers; i++) {
+            uint32_t head = atomic_load_explicit(&handoff->head, memory_order_relaxed);
+            while (atomic_load_explicit(&handoff->tail, memory_order_acquire) == head) {
+                sched_yield();
+            }
+            void* block = handoff->slots[head % HANDOFF_CAPACITY];
+            atomic_store_explicit(&handoff->head, head + 1, memory_order_release);
+            release_block(thread, block);
+        }
+    }
+}
+
+// put, get
+static void ring_pingpong(bench_thread_t* thread, uint32_t ops) {
+    for (uint32_t i = 0; i < ops; i += 2) {
+        if (!timed_put(thread, (void*)(uintptr_t)(i | 1))) {
+            thread->failures++;
+            continue;
+        }
+        while (timed_get(thread) == NULL) {
+            thread->failures++;    // Another thread took ours; one of theirs follows
+            sched_yield();
+        }
+    }
+}
+
+// Put this thread's share of the capacity, then take as many items back
+static void ring_fill_drain(bench_thread_t* thread, uint32_t ops) {
+    bench_run_t* run = thread->run;
+    uint32_t share = run->config->blocks / run->threads;
+    uint32_t done = 0;
+    
+    while (done < ops) {
+        uint32_t count = 0;
+        for (; count < share && done < ops; count++, done++) {
+            while (!timed_put(thread, (void*)(uintptr_t)(done | 1))) {
+                thread->failures++;
+                sched_yield();
+            }
+        }
+        for (uint32_t i = 0; i < count; i++, done++) {
+            while (timed_get(thread) == NULL) {
+                thread->failures++;
+                sched_yield();
+            }
+        }
+    }
+}
+
+// Even threads put, odd threads get, all through the ring itself
+static void ring_prodcons(bench_thread_t* thread, uint32_t ops) {
+    uint32_t transfers = ops / 2;
+    
+    if (thread->thread_id % 2 == 0) {
+        for (uint32_t i = 0; i < transfers; i++) {
+            while (!timed_put(thread, (void*)(uintptr_t)(i | 1))) {
+                thread->failures++;
+                sched_yield();
+            }
+        }
+    } else {
+        for (uint32_t i = 0; i < transfers; i++) {
+            while (timed_get(thread) == NULL) {
+                thread->failures++;
+                sched_yield();
+            }
+        }
+    }
+}
+
+static void* bench_thread(void* arg) {
+    bench_thread_t* thread = arg;
+    bench_run_t* run = thread->run;
+    uint32_t ops = run->config->ops;
+    
+    // Counters only count the thread that opens them
+    if (run->config->perf) {
+        perf_counters_open(&thread->counters);
+    }
+    
+    pthread_barrier_wait(&run->start);
+    if (run->config->perf) {
+        perf_counters_start(&thread->counters);
+    }
+    thread->start_ns = now_ns();
+    
+    if (run->pool_ops != NULL) {
+        switch (run->workload) {
+            case WORKLOAD_PINGPONG: pool_pingpong(thread, ops); break;
+            case WORKLOAD_CHURN: pool_churn(thread, ops); break;
+            case WORKLOAD_PRODCONS: pool_prodcons(thread, ops); break;
+            case WORKLOAD_FILL_DRAIN: pool_fill_drain(thread, ops); break;
+            default: break;
+        }
+    } else {
+        switch (run->workload) {
+            case WORKLOAD_PINGPONG: ring_pingpong(thread, ops); break;
+            case WORKLOAD_PRODCONS: ring_prodcons(thread, ops); break;
+            case WORKLOAD_FILL_DRAIN: ring_fill_drain(thread, ops); break;
+            default: break;
+        }
+    }
+    
+    thread->end_ns = now_ns();
+    if (run->config->perf) {
+        perf_counters_stop(&thread->counters, &thread->counts);
+        perf_counters_close(&thread->counters);
+    }
+    return NULL;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const uint64_t* sorted, uint32_t count, double fraction) {
+    if (count == 0) {
+        return 0;
+    }
+    uint32_t index = (uint32_t)(fraction * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+// Resident set size of the process in KB
+static uint64_t resident_kb(void) {
+    unsigned long size = 0, resident = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm != NULL) {
+        if (fscanf(statm, "%lu %lu", &size, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(statm);
+    }
+    return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE) / 1024;
+}
+
+// Run one workload on a fresh instance and print its row
+// `block_size` is 0 for rings
+static bool run_benchmark(const bench_config_t* config, const char* name, const char* kind,
+                          const bench_pool_ops_t* pool_ops, const bench_ring_ops_t* ring_ops,
+                          workload_t workload, int threads, uint32_t block_size) {
+    bench_run_t run;
+    memset(&run, 0, sizeof(run));
+    run.config = config;
+    run.workload = workload;
+    run.pool_ops = pool_ops;
+    run.ring_ops = ring_ops;
+    run.threads = threads;
+    run.serialize = threads > 1 && !(pool_ops != NULL ? pool_ops->thread_safe : ring_ops->thread_safe);
+    uint64_t rss_before = resident_kb();
+    run.instance = pool_ops != NULL ? pool_ops->create(config->blocks, block_size)
+                                    : ring_ops->create(config->blocks);
+    if (run.instance == NULL) {
+        fprintf(stderr, "%s: failed to create %s\n", name, kind);
+        return false;
+    }
+    
+    run.handoffs = aligned_alloc(64, sizeof(handoff_t) * (threads / 2 + 1));
+    bench_thread_t* workers = calloc(threads, sizeof(bench_thread_t));
+    uint32_t sample_capacity = config->ops / config->sample + 1;
+    if (run.handoffs == NULL || workers == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < threads / 2 + 1; i++) {
+        atomic_init(&run.handoffs[i].head, 0);
+        atomic_init(&run.handoffs[i].tail, 0);
+    }
+    
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_barrier_init(&run.start, NULL, threads + 1);
+    
+    for (int i = 0; i < threads; i++) {
+        workers[i].run = &run;
+        workers[i].thread_id = i;
+        workers[i].samples = malloc(sample_capacity * sizeof(uint64_t));
+        workers[i].sample_capacity = sample_capacity;
+        workers[i].countdown = config->sample;
+        workers[i].rng = 0x9E3779B97F4A7C15ULL * (i + 1);
+        if (workers[i].samples == NULL ||
+            pthread_create(&workers[i].thread, NULL, bench_thread, &workers[i]) != 0) {
+            fprintf(stderr, "Failed to start benchmark thread\n");
+            exit(1);
+        }
+    }
+    
+    pthread_barrier_wait(&run.start);
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    
+    // Memory the instance and the workload added (malloc keeps freed
+    // memory in its arenas, so this also shows what it holds on to)
+    uint64_t rss_after = resident_kb();
+    uint64_t rss_growth = rss_after > rss_before ? rss_after - rss_before : 0;
+    
+    // Merge the results; the run lasts from the first thread starting to
+    // the last one finishing (the main thread may not run in between)
+    uint64_t start = workers[0].start_ns;
+    uint64_t end = workers[0].end_ns;
+    uint64_t ops = 0;
+    uint64_t failures = 0;
+    uint32_t sample_count = 0;
+    perf_counts_t counts;
+    for (int i = 0; i < threads; i++) {
+        perf_counts_add(&counts, &workers[i].counts, i == 0);
+        start = workers[i].start_ns < start ? workers[i].start_ns : start;
+        end = workers[i].end_ns > end ? workers[i].end_ns : end;
+        ops += workers[i].ops;
+        failures += workers[i].failures;
+        sample_count += workers[i].sample_count;
+    }
+    
+    uint64_t* samples = malloc(((size_t)sample_count + 1) * sizeof(uint64_t));
+    if (samples == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    uint32_t merged = 0;
+    for (int i = 0; i < threads; i++) {
+        memcpy(samples + merged, workers[i].samples, workers[i].sample_count * sizeof(uint64_t));
+        merged += workers[i].sample_count;
+        free(workers[i].samples);
+    }
+    qsort(samples, sample_count, sizeof(uint64_t), compare_u64);
+    
+    double seconds = (end - start) / 1e9;
+    printf("%s,%s,%s,%d,%u,%s,%llu,%llu,%.6f,%.0f,%llu,%llu,%llu,%llu,%llu,%llu",
+           name, kind, workload_names[workload], threads, block_size,
+           run.serialize ? "mutex" : (threads > 1 ? "internal" : "none"),
+           (unsigned long long)ops, (unsigned long long)failures, seconds,
+           seconds > 0 ? ops / seconds : 0.0, (unsigned long long)rss_growth,
+           (unsigned long long)percentile(samples, sample_count, 0.50),
+           (unsigned long long)percentile(samples, sample_count, 0.90),
+           (unsigned long long)percentile(samples, sample_count, 0.99),
+           (unsigned long long)percentile(samples, sample_count, 0.999),
+           (unsigned long long)(sample_count > 0 ? samples[sample_count - 1] : 0));
+    if (config->perf) {
+        // Per operation, empty where the counter is not available
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+            if (counts.valid[i] && ops > 0) {
+                printf(",%.4f", (double)counts.values[i] / ops);
+            } else {
+                printf(",");
+            }
+        }
+    }
+    printf("\n");
+    fflush(stdout);
+    
+    free(samples);
+    free(workers);
+    free(run.handoffs);
+    pthread_barrier_destroy(&run.start);
+    pthread_mutex_destroy(&run.lock);
+    if (pool_ops != NULL) {
+        pool_ops->destroy(run.instance);
+    } else {
+        ring_ops->destroy(run.instance);
+    }
+    return true;
+}
+
+// Thread counts 1, 2, 4, ... and max_threads itself
+static int next_thread_count(int threads, int max_threads) {
+    if (threads >= max_threads) {
+        return 0;
+    }
+    return threads * 2 < max_threads ? threads * 2 : max_threads;
+}
+
+static bool selected(const char* filter, const char* name) {
+    return filter == NULL || strcmp(filter, name) == 0;
+}
+
+// Parse a comma-separated list of block sizes
+static bool parse_block_sizes(const char* list, bench_config_t* config) {
+    config->block_size_count = 0;
+    while (*list != '\0') {
+        char* end;
+        unsigned long size = strtoul(list, &end, 10);
+        if (end == list || size < 16 || config->block_size_count == MAX_BLOCK_SIZES) {
+            return false;
+        }
+        config->block_sizes[config->block_size_count++] = (uint32_t)size;
+        list = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return false;
+        }
+    }
+    return config->block_size_count > 0;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [--threads N] [--ops N] [--blocks N] [--block-size N[,N...]] [--sample N]\n"
+                    "          [--impl NAME] [--workload pingpong|churn|prodcons|fill_drain] [--perf]\n", program);
+}
+
+int main(int argc, char* argv[]) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    bench_config_t config = {
+        .max_threads = cpus > 2 ? (int)cpus : 2,
+        .ops = DEFAULT_OPS,
+        .blocks = DEFAULT_BLOCKS,
+        .block_size_count = 0,
+        .sample = DEFAULT_SAMPLE,
+        .impl_filter = NULL,
+        .workload_filter = NULL,
+        .perf = false
+    };
+    parse_block_sizes(DEFAULT_BLOCK_SIZES, &config);
+    
+    // Parse command line options
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--perf") == 0) {
+            config.perf = true;
+            continue;
+        }
+        
+        bool has_value = i + 1 < argc;
+        long value = has_value ? atol(argv[i + 1]) : 0;
+        if (strcmp(argv[i], "--threads") == 0 && value > 0) {
+            config.max_threads = (int)value;
+        } else if (strcmp(argv[i], "--ops") == 0 && value > 0) {
+            config.ops = (uint32_t)value;
+        } else if (strcmp(argv[i], "--blocks") == 0 && value > 0) {
+            config.blocks = (uint32_t)value;
+        } else if (strcmp(argv[i], "--block-size") == 0 && has_value &&
+                   parse_block_sizes(argv[i + 1], &config)) {
+        } else if (strcmp(argv[i], "--sample") == 0 && value > 0) {
+            config.sample = (uint32_t)value;
+        } else if (strcmp(argv[i], "--impl") == 0 && has_value) {
+            config.impl_filter = argv[i + 1];
+        } else if (strcmp(argv[i], "--workload") == 0 && has_value) {
+            config.workload_filter = argv[i + 1];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+    
+    // Say once which counters are missing rather than on every row
+    if (config.perf) {
+        perf_counters_probe(stderr);
+    }
+    
+    printf("impl,kind,workload,threads,block_size,locking,ops,failures,seconds,ops_per_sec,rss_kb,"
+           "p50_ns,p90_ns,p99_ns,p999_ns,max_ns");
+    if (config.perf) {
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+            printf(",%s_per_op", perf_counter_names[i]);
+        }
+    }
+    printf("\n");
+    
+    for (int w = 0; w < WORKLOAD_COUNT; w++) {
+        if (!selected(config.workload_filter, workload_names[w])) {
+            continue;
+        }
+        
+        for (int threads = 1; threads != 0; threads = next_thread_count(threads, config.max_threads)) {
+            // Producer/consumer needs whole pairs
+            if (w == WORKLOAD_PRODCONS && (threads < 2 || threads % 2 != 0)) {
+                continue;
+            }
+            
+            // Every pool sees the same operation sequence for each object size
+            for (int b = 0; b < config.block_size_count; b++) {
+                for (size_t i = 0; i < sizeof(pools) / sizeof(pools[0]); i++) {
+                    if (selected(config.impl_filter, pools[i]->name)) {
+                        run_benchmark(&config, pools[i]->name, "pool", pools[i], NULL, w, threads,
+                                      config.block_sizes[b]);
+                    }
+                }
+            }
+            
+            if (w == WORKLOAD_CHURN) {
+                continue;  // Ring items have no lifetime
+            }
+            for (size_t i = 0; i < sizeof(rings) / sizeof(rings[0]); i++) {
+                if (selected(config.impl_filter, rings[i]->name)) {
+                    run_benchmark(&config, rings[i]->name, "ring", NULL, rings[i], w, threads, 0);
+                }
+            }
+        }
+    }
+    
+    return 0;
+}
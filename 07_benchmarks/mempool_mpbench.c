@@ -0,0 +1,409 @@
+// mempool_mpbench.c
+// Forks N processes that all attach to one memory_pool_init_shared segment
+// and measures aggregate throughput, fairness between the processes and
+// lock contention as N grows
+#define _GNU_SOURCE  // For CPU_SET and sched_setaffinity
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "mempool_ring.h"
+
+#define DEFAULT_DURATION_MS 500   // Measured time per run
+#define DEFAULT_BLOCKS 4096       // Pool blocks
+#define DEFAULT_BLOCK_SIZE 384    // Chat message size
+#define HANDOFF_CAPACITY 256      // Producer/consumer ring per pair
+#define STOP_CHECK_INTERVAL 64    // Operations between looks at the stop flag
+#define DRAIN_BATCH 64            // Most blocks a consumer takes from its ring at once
+#define SHM_NAME "/mempool_mpbench"
+
+typedef enum {
+    WORKLOAD_PINGPONG = 0,    // alloc/free back to back in every process
+    WORKLOAD_PRODCONS = 1,    // Even processes allocate, odd ones free what their partner sent
+    WORKLOAD_COUNT = 2
+} workload_t;
+
+static const char* workload_names[WORKLOAD_COUNT] = { "pingpong", "prodcons" };
+
+// Benchmark settings
+typedef struct {
+    int max_procs;
+    uint32_t duration_ms;
+    uint32_t blocks;
+    uint32_t block_size;
+    bool pin;
+    wait_strategy_t wait;               // How processes wait for pool and ring locks
+    uint32_t percpu;                    // Per-CPU free list capacity (0: shared ring only)
+    const char* workload_filter;
+} mp_config_t;
+
+// Result of one process, written by the child
+typedef struct {
+    _Alignas(64) uint64_t ops;
+    uint64_t failures;                  // Allocations from an empty pool, full handoff rings
+    int cpu;                            // CPU the process was pinned to (-1 if not pinned)
+} proc_result_t;
+
+// Control block shared with the children (anonymous mapping inherited by fork)
+// followed by one result per process and one handoff ring per pair
+typedef struct {
+    _Alignas(64) atomic_int ready;      // Children attached and waiting
+    _Alignas(64) atomic_int go;         // Set by the parent to start
+    _Alignas(64) atomic_int stop;       // Set by the parent after the duration
+} mp_control_t;
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Shared memory size for a pool of `blocks` blocks
+static uint32_t pool_memory_size(const mp_config_t* config) {
+    return (uint32_t)(ring_buffer_size(config->blocks) + (size_t)config->blocks * config->block_size +
+                      memory_pool_percpu_size(config->percpu) + MEMPOOL_STATS_RESERVED + 64);
+}
+
+// Layout of the control mapping
+static size_t results_offset(void) {
+    return (sizeof(mp_control_t) + 63) & ~(size_t)63;
+}
+
+static size_t handoffs_offset(int procs) {
+    return results_offset() + (size_t)procs * sizeof(proc_result_t);
+}
+
+static size_t handoff_size(void) {
+    return (ring_buffer_size(HANDOFF_CAPACITY) + 63) & ~(size_t)63;
+}
+
+static size_t control_size(int procs) {
+    return handoffs_offset(procs) + (size_t)(procs / 2 + 1) * handoff_size();
+}
+
+static ring_buffer_t* handoff_ring(void* control, int procs, int pair) {
+    return (ring_buffer_t*)((uint8_t*)control + handoffs_offset(procs) + pair * handoff_size());
+}
+
+// CPU for process `index`: the index-th CPU we may run on, wrapping around
+static int pick_cpu(int index) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+        return -1;
+    }
+    
+    int wanted = index % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && wanted-- == 0) {
+            return cpu;
+        }
+    }
+    return -1;
+}
+
+// alloc, touch, free until stopped
+static void run_pingpong(mem_pool_t* pool, mp_control_t* control, proc_result_t* result) {
+    uint64_t ops = 0;
+    while (!atomic_load_explicit(&control->stop, memory_order_relaxed)) {
+        for (int i = 0; i < STOP_CHECK_INTERVAL; i++) {
+            char* block = memory_pool_alloc(pool);
+            if (block == NULL) {
+                result->failures++;
+                continue;
+            }
+            block[0] = (char)i;
+            memory_pool_free(pool, block);
+            ops += 2;
+        }
+    }
+    result->ops = ops;
+}
+
+// Blocks travel between processes as indexes, because every process maps
+// the pool at its own address
+static void run_producer(mem_pool_t* pool, mp_control_t* control, ring_buffer_t* handoff,
+                         proc_result_t* result) {
+    uint64_t ops = 0;
+    while (!atomic_load_explicit(&control->stop, memory_order_relaxed)) {
+        for (int i = 0; i < STOP_CHECK_INTERVAL; i++) {
+            uint8_t* block = memory_pool_alloc(pool);
+            if (block == NULL) {
+                result->failures++;
+                sched_yield();
+                continue;
+            }
+            ops++;
+            
+            uintptr_t index = (block - (uint8_t*)pool->pool_start) / pool->block_size;
+            while (!ring_buffer_put(handoff, (void*)(index + 1))) {
+                result->failures++;
+                if (atomic_load_explicit(&control->stop, memory_order_relaxed)) {
+                    memory_pool_free(pool, block);
+                    result->ops = ops;
+                    return;
+                }
+                sched_yield();
+            }
+        }
+    }
+    result->ops = ops;
+}
+
+static void run_consumer(mem_pool_t* pool, mp_control_t* control, ring_buffer_t* handoff,
+                         proc_result_t* result) {
+    uint64_t ops = 0;
+    void* items[DRAIN_BATCH];
+    while (!atomic_load_explicit(&control->stop, memory_order_relaxed)) {
+        for (int i = 0; i < STOP_CHECK_INTERVAL; i++) {
+            // Take everything queued with one lock acquisition
+            uint32_t taken = ring_buffer_drain(handoff, items, DRAIN_BATCH);
+            if (taken == 0) {
+                sched_yield();
+                continue;
+            }
+            for (uint32_t j = 0; j < taken; j++) {
+                uintptr_t index = (uintptr_t)items[j] - 1;
+                memory_pool_free(pool, (uint8_t*)pool->pool_start + index * pool->block_size);
+            }
+            ops += taken;
+        }
+    }
+    result->ops = ops;
+}
+
+// Body of a benchmark process
+static void child_main(const mp_config_t* config, workload_t workload, int procs, int index,
+                       void* control_memory) {
+    mp_control_t* control = control_memory;
+    proc_result_t* result = (proc_result_t*)((uint8_t*)control_memory + results_offset()) + index;
+    
+    result->cpu = -1;
+    if (config->pin) {
+        int cpu = pick_cpu(index);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (cpu >= 0) {
+            CPU_SET(cpu, &set);
+            if (sched_setaffinity(0, sizeof(set), &set) == 0) {
+                result->cpu = cpu;
+            }
+        }
+    }
+    
+    // Attach like an independent process would, at our own address
+    mem_pool_t pool;
+    if (!memory_pool_init_shared_percpu(&pool, SHM_NAME, pool_memory_size(config), config->block_size,
+                                        config->percpu, false, 0600)) {
+        fprintf(stderr, "Process %d: failed to attach to %s\n", index, SHM_NAME);
+        _exit(1);
+    }
+    
+    atomic_fetch_add(&control->ready, 1);
+    while (!atomic_load(&control->go)) {
+        sched_yield();
+    }
+    
+    if (workload == WORKLOAD_PINGPONG) {
+        run_pingpong(&pool, control, result);
+    } else if (index % 2 == 0) {
+        run_producer(&pool, control, handoff_ring(control_memory, procs, index / 2), result);
+    } else {
+        run_consumer(&pool, control, handoff_ring(control_memory, procs, index / 2), result);
+    }
+    
+    memory_pool_destroy(&pool, false);
+    _exit(0);
+}
+
+// Fork `procs` processes on a fresh pool, let them run and print the row
+static bool run_benchmark(const mp_config_t* config, workload_t workload, int procs) {
+    mem_pool_t pool;
+    shm_unlink(SHM_NAME);
+    if (!memory_pool_init_shared_percpu(&pool, SHM_NAME, pool_memory_size(config), config->block_size,
+                                        config->percpu, true, 0600)) {
+        fprintf(stderr, "Failed to create shared pool %s\n", SHM_NAME);
+        return false;
+    }
+    memory_pool_set_wait_strategy(&pool, config->wait);
+    
+    size_t size = control_size(procs);
+    void* control_memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (control_memory == MAP_FAILED) {
+        memory_pool_destroy(&pool, true);
+        return false;
+    }
+    mp_control_t* control = control_memory;
+    for (int pair = 0; pair < procs / 2 + 1; pair++) {
+        ring_buffer_init(handoff_ring(control_memory, procs, pair), HANDOFF_CAPACITY);
+        ring_buffer_set_wait_strategy(handoff_ring(control_memory, procs, pair), config->wait);
+    }
+    
+    pid_t* pids = calloc(procs, sizeof(pid_t));
+    int started = 0;
+    for (; pids != NULL && started < procs; started++) {
+        pids[started] = fork();
+        if (pids[started] == 0) {
+            child_main(config, workload, procs, started, control_memory);
+        }
+        if (pids[started] < 0) {
+            perror("fork");
+            break;
+        }
+    }
+    
+    // Start everybody at once, then stop them after the duration
+    bool success = started == procs;
+    while (success && atomic_load(&control->ready) < procs) {
+        int status;
+        if (waitpid(-1, &status, WNOHANG) > 0) {
+            success = false;  // A child failed to attach
+        }
+        sched_yield();
+    }
+    
+    uint64_t start = now_ns();
+    atomic_store(&control->go, 1);
+    struct timespec duration = { config->duration_ms / 1000, (config->duration_ms % 1000) * 1000000L };
+    if (success) {
+        nanosleep(&duration, NULL);
+    }
+    atomic_store(&control->stop, 1);
+    for (int i = 0; i < started; i++) {
+        int status;
+        if (waitpid(pids[i], &status, 0) != pids[i] || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            success = false;
+        }
+    }
+    double seconds = (now_ns() - start) / 1e9;
+    
+    if (success) {
+        // Jain's fairness index: 1 when every process did the same work, 1/N when one did it all
+        proc_result_t* results = (proc_result_t*)((uint8_t*)control_memory + results_offset());
+        uint64_t ops = 0, failures = 0;
+        uint64_t min_ops = UINT64_MAX, max_ops = 0;
+        double sum = 0, sum_squares = 0;
+        cpu_set_t cpus_used;
+        CPU_ZERO(&cpus_used);
+        for (int i = 0; i < procs; i++) {
+            if (results[i].cpu >= 0) {
+                CPU_SET(results[i].cpu, &cpus_used);
+            }
+            ops += results[i].ops;
+            failures += results[i].failures;
+            min_ops = results[i].ops < min_ops ? results[i].ops : min_ops;
+            max_ops = results[i].ops > max_ops ? results[i].ops : max_ops;
+            sum += (double)results[i].ops;
+            sum_squares += (double)results[i].ops * results[i].ops;
+        }
+        double fairness = sum_squares > 0 ? sum * sum / (procs * sum_squares) : 0.0;
+        
+        // Lock contention from the pool's statistics block
+        mempool_stats_snapshot_t stats;
+        bool have_stats = memory_pool_get_stats(&pool, &stats);
+        
+        printf("%s,%s,%u,%d,%d,%llu,%llu,%.6f,%.0f,%llu,%llu,%.4f,",
+               workload_names[workload], wait_strategy_name(config->wait), config->percpu, procs,
+               CPU_COUNT(&cpus_used),
+               (unsigned long long)ops, (unsigned long long)failures, seconds,
+               seconds > 0 ? ops / seconds : 0.0,
+               (unsigned long long)min_ops, (unsigned long long)max_ops, fairness);
+        if (have_stats && ops > 0) {
+            printf("%.4f,%.4f\n", (double)stats.lock_spins / ops, (double)stats.lock_backoffs / ops);
+        } else {
+            printf(",\n");
+        }
+        fflush(stdout);
+    } else {
+        fprintf(stderr, "%s with %d processes failed\n", workload_names[workload], procs);
+    }
+    
+    free(pids);
+    munmap(control_memory, size);
+    memory_pool_destroy(&pool, true);
+    return success;
+}
+
+// Process counts 1, 2, 4, ... and max_procs itself
+static int next_proc_count(int procs, int max_procs) {
+    if (procs >= max_procs) {
+        return 0;
+    }
+    return procs * 2 < max_procs ? procs * 2 : max_procs;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [--procs N] [--duration MS] [--blocks N] [--block-size N] [--no-pin]\n"
+                    "          [--workload pingpong|prodcons] [--wait backoff|spin|yield|futex]\n"
+                    "          [--percpu CAPACITY]\n", program);
+}
+
+int main(int argc, char* argv[]) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    mp_config_t config = {
+        .max_procs = cpus > 2 ? (int)cpus : 2,
+        .duration_ms = DEFAULT_DURATION_MS,
+        .blocks = DEFAULT_BLOCKS,
+        .block_size = DEFAULT_BLOCK_SIZE,
+        .pin = true,
+        .wait = wait_strategy_default(),
+        .percpu = 0,
+        .workload_filter = NULL
+    };
+    
+    // Parse command line options
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-pin") == 0) {
+            config.pin = false;
+            continue;
+        }
+        
+        bool has_value = i + 1 < argc;
+        long value = has_value ? atol(argv[i + 1]) : 0;
+        if (strcmp(argv[i], "--procs") == 0 && value > 0) {
+            config.max_procs = (int)value;
+        } else if (strcmp(argv[i], "--duration") == 0 && value > 0) {
+            config.duration_ms = (uint32_t)value;
+        } else if (strcmp(argv[i], "--blocks") == 0 && value > 0) {
+            config.blocks = (uint32_t)value;
+        } else if (strcmp(argv[i], "--block-size") == 0 && value >= 16) {
+            config.block_size = (uint32_t)value;
+        } else if (strcmp(argv[i], "--percpu") == 0 && has_value && value >= 0 && value <= CPU_SHARDS_MAX_CAPACITY) {
+            config.percpu = (uint32_t)value;
+        } else if (strcmp(argv[i], "--workload") == 0 && has_value) {
+            config.workload_filter = argv[i + 1];
+        } else if (strcmp(argv[i], "--wait") == 0 && has_value &&
+                   wait_strategy_parse(argv[i + 1], &config.wait)) {
+            // Parsed in the condition
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+    
+    // cpus is the number of CPUs the processes were pinned to (0 with --no-pin)
+    printf("workload,wait,percpu,procs,cpus,ops,failures,seconds,ops_per_sec,min_proc_ops,max_proc_ops,fairness,"
+           "lock_spins_per_op,lock_backoffs_per_op\n");
+    
+    bool success = true;
+    for (int w = 0; w < WORKLOAD_COUNT; w++) {
+        if (config.workload_filter != NULL && strcmp(config.workload_filter, workload_names[w]) != 0) {
+            continue;
+        }
+        
+        for (int procs = 1; procs != 0; procs = next_proc_count(procs, config.max_procs)) {
+            // Producer/consumer needs whole pairs
+            if (w == WORKLOAD_PRODCONS && (procs < 2 || procs % 2 != 0)) {
+                continue;
+            }
+            success = run_benchmark(&config, (workload_t)w, procs) && success;
+        }
+    }
+    
+    return success ? 0 : 1;
+}
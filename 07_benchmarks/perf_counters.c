@@ -0,0 +1,187 @@
+// perf_counters.c
+// Per-thread perf_event_open counters for the benchmark threads
+#define _GNU_SOURCE  // For RUSAGE_THREAD
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/perf_event.h>
+#include "perf_counters.h"
+
+#define RUSAGE_FALLBACK -2  // Context switches come from getrusage instead
+
+const char* const perf_counter_names[PERF_COUNTER_COUNT] = {
+    "cycles", "instructions", "llc_misses", "dtlb_misses", "context_switches"
+};
+
+// Event type and config of each counter
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} events[PERF_COUNTER_COUNT] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES }
+};
+
+// Open one counter for the calling thread, disabled; returns -1 with errno set
+static int open_counter(perf_counter_t counter) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[counter].type;
+    attr.config = events[counter].config;
+    attr.disabled = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    
+    int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    if (fd >= 0 || counter == PERF_COUNTER_CONTEXT_SWITCHES) {
+        // A context switch happens in the kernel, so excluding it would count nothing
+        return fd;
+    }
+    
+    // perf_event_paranoid 2 only allows user space
+    attr.exclude_kernel = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+static uint64_t thread_context_switches(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) != 0) {
+        return 0;
+    }
+    return (uint64_t)usage.ru_nvcsw + (uint64_t)usage.ru_nivcsw;
+}
+
+/**
+ * Open the counters for the calling thread
+ *
+ * @param counters Counters to initialize
+ * @return Number of counters available
+ */
+int perf_counters_open(perf_counters_t* counters) {
+    int available = 0;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        counters->fds[i] = open_counter((perf_counter_t)i);
+        if (counters->fds[i] < 0 && i == PERF_COUNTER_CONTEXT_SWITCHES) {
+            counters->fds[i] = RUSAGE_FALLBACK;
+        }
+        if (counters->fds[i] != -1) {
+            available++;
+        }
+    }
+    counters->rusage_switches = 0;
+    return available;
+}
+
+/**
+ * Reset and enable the counters
+ *
+ * @param counters Counters opened by this thread
+ */
+void perf_counters_start(perf_counters_t* counters) {
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (counters->fds[i] >= 0) {
+            ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        } else if (counters->fds[i] == RUSAGE_FALLBACK) {
+            counters->rusage_switches = thread_context_switches();
+        }
+    }
+}
+
+/**
+ * Disable the counters and read them
+ *
+ * @param counters Counters opened by this thread
+ * @param counts Receives the values (invalid ones are marked)
+ */
+void perf_counters_stop(perf_counters_t* counters, perf_counts_t* counts) {
+    // Stop everything first so reading does not count itself
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (counters->fds[i] >= 0) {
+            ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        counts->values[i] = 0;
+        counts->valid[i] = false;
+        
+        if (counters->fds[i] == RUSAGE_FALLBACK) {
+            counts->values[i] = thread_context_switches() - counters->rusage_switches;
+            counts->valid[i] = true;
+            continue;
+        }
+        
+        // value, time enabled, time running
+        uint64_t data[3];
+        if (counters->fds[i] < 0 || read(counters->fds[i], data, sizeof(data)) != sizeof(data) ||
+            data[2] == 0) {
+            continue;
+        }
+        
+        // The kernel multiplexes counters when there are not enough of them
+        counts->values[i] = data[2] < data[1] ? (uint64_t)((double)data[0] * data[1] / data[2])
+                                              : data[0];
+        counts->valid[i] = true;
+    }
+}
+
+/**
+ * Close the counters
+ *
+ * @param counters Counters to close
+ */
+void perf_counters_close(perf_counters_t* counters) {
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (counters->fds[i] >= 0) {
+            close(counters->fds[i]);
+        }
+        counters->fds[i] = -1;
+    }
+}
+
+/**
+ * Add one thread's counts to a total
+ *
+ * @param total Sum of the counts so far
+ * @param counts Counts to add
+ * @param first True for the first counts added to `total`
+ */
+void perf_counts_add(perf_counts_t* total, const perf_counts_t* counts, bool first) {
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        total->values[i] = (first ? 0 : total->values[i]) + counts->values[i];
+        total->valid[i] = (first || total->valid[i]) && counts->valid[i];
+    }
+}
+
+/**
+ * Tell which counters cannot be opened on this machine and why
+ *
+ * @param out Stream to print to
+ * @return Number of counters available
+ */
+int perf_counters_probe(FILE* out) {
+    int available = 0;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        int fd = open_counter((perf_counter_t)i);
+        if (fd >= 0) {
+            close(fd);
+            available++;
+        } else if (i == PERF_COUNTER_CONTEXT_SWITCHES) {
+            available++;
+            fprintf(out, "perf: %s: %s, using getrusage\n", perf_counter_names[i], strerror(errno));
+        } else {
+            fprintf(out, "perf: %s: %s, column left empty\n", perf_counter_names[i], strerror(errno));
+        }
+    }
+    return available;
+}
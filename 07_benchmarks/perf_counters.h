@@ -0,0 +1,90 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/**
+ * Hardware and software counters read with perf_event_open
+ * Each counter is opened on its own, so one the kernel or the machine
+ * does not allow (no PMU in a VM, perf_event_paranoid, seccomp) leaves
+ * only that column empty
+ */
+typedef enum {
+    PERF_COUNTER_CYCLES = 0,
+    PERF_COUNTER_INSTRUCTIONS = 1,
+    PERF_COUNTER_LLC_MISSES = 2,        // Last level cache read misses
+    PERF_COUNTER_DTLB_MISSES = 3,       // Data TLB read misses
+    PERF_COUNTER_CONTEXT_SWITCHES = 4,
+    PERF_COUNTER_COUNT = 5
+} perf_counter_t;
+
+extern const char* const perf_counter_names[PERF_COUNTER_COUNT];
+
+/**
+ * Counters of one thread
+ */
+typedef struct {
+    int fds[PERF_COUNTER_COUNT];        // -1 when the counter could not be opened
+    uint64_t rusage_switches;           // Context switches at start when read from getrusage
+} perf_counters_t;
+
+/**
+ * Values measured between perf_counters_start and perf_counters_stop
+ */
+typedef struct {
+    uint64_t values[PERF_COUNTER_COUNT];
+    bool valid[PERF_COUNTER_COUNT];
+} perf_counts_t;
+
+/**
+ * Open the counters for the calling thread (they only count this thread)
+ * Context switches fall back to getrusage when the perf event is refused
+ *
+ * @param counters Counters to initialize
+ * @return Number of counters available
+ */
+int perf_counters_open(perf_counters_t* counters);
+
+/**
+ * Reset and enable the counters
+ *
+ * @param counters Counters opened by this thread
+ */
+void perf_counters_start(perf_counters_t* counters);
+
+/**
+ * Disable the counters and read them, scaled up if the kernel had to
+ * multiplex them
+ *
+ * @param counters Counters opened by this thread
+ * @param counts Receives the values (invalid ones are marked)
+ */
+void perf_counters_stop(perf_counters_t* counters, perf_counts_t* counts);
+
+/**
+ * Close the counters
+ *
+ * @param counters Counters to close
+ */
+void perf_counters_close(perf_counters_t* counters);
+
+/**
+ * Add one thread's counts to a total (a counter stays valid only if it
+ * was valid in both)
+ *
+ * @param total Sum of the counts so far
+ * @param counts Counts to add
+ * @param first True for the first counts added to `total`
+ */
+void perf_counts_add(perf_counts_t* total, const perf_counts_t* counts, bool first);
+
+/**
+ * Tell which counters cannot be opened on this machine and why
+ *
+ * @param out Stream to print to
+ * @return Number of counters available
+ */
+int perf_counters_probe(FILE* out);
+
+#endif // PERF_COUNTERS_H